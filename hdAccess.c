@@ -0,0 +1,1327 @@
+/* Module: hdAccess.c
+ *
+ * Description: Helicity Decoder Register Access Layer
+ *              Backends for the bus accesses of the library (jvme,
+ *              in-memory board, record / replay), per routine
+ *              transaction counts, and trace files.
+ *
+ * Author:
+ *        Bryan Moffit
+ *        JLab Data Acquisition Group
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "hdAccess.h"
+
+/**
+ * @defgroup Access Register Access
+ */
+
+/* jvme backend */
+static uint32_t
+hdVmeRead32(void *ctx, volatile uint32_t *addr)
+{
+  return vmeRead32(addr);
+}
+
+static void
+hdVmeWrite32(void *ctx, volatile uint32_t *addr, uint32_t value)
+{
+  vmeWrite32(addr, value);
+}
+
+static int32_t
+hdVmeBusToLocalAdrs(void *ctx, int32_t am, char *vmeAddr, char **localAddr)
+{
+  return vmeBusToLocalAdrs(am, vmeAddr, localAddr);
+}
+
+static int32_t
+hdVmeMemProbe(void *ctx, char *addr, int32_t size, char *value)
+{
+  return vmeMemProbe(addr, size, value);
+}
+
+static int32_t
+hdVmeDmaConfig(void *ctx, uint32_t addrType, uint32_t dataType, uint32_t sstMode)
+{
+  return vmeDmaConfig(addrType, dataType, sstMode);
+}
+
+static int32_t
+hdVmeDmaSend(void *ctx, unsigned long localAddr, uint32_t vmeAddr, int32_t nbytes)
+{
+  return vmeDmaSend(localAddr, vmeAddr, nbytes);
+}
+
+static int32_t
+hdVmeDmaDone(void *ctx)
+{
+  return vmeDmaDone();
+}
+
+const HD_ACCESS_OPS hdAccessVME =
+  {
+    "vme", NULL,
+    hdVmeRead32, hdVmeWrite32, hdVmeBusToLocalAdrs, hdVmeMemProbe,
+    hdVmeDmaConfig, hdVmeDmaSend, hdVmeDmaDone, NULL
+  };
+
+static const HD_ACCESS_OPS *hdAccess = &hdAccessVME;
+
+/* Transaction counts.  Open addressing on the __func__ pointer, entries
+   are never removed, so lookups need no lock */
+static HD_ACCESS_COUNT hdAccessCounts[HD_ACCESS_MAX_FUNCS];
+static HD_ACCESS_COUNT hdAccessTotal;
+
+static HD_ACCESS_COUNT *
+hdAccessCount(const char *func)
+{
+  uint32_t hash = ((uintptr_t)func >> 3) % HD_ACCESS_MAX_FUNCS, iprobe;
+  HD_ACCESS_COUNT *c;
+
+  for(iprobe = 0; iprobe < HD_ACCESS_MAX_FUNCS; iprobe++)
+    {
+      c = &hdAccessCounts[(hash + iprobe) % HD_ACCESS_MAX_FUNCS];
+      if(c->func == func)
+	return c;
+      if((c->func == NULL) &&
+	 (__sync_bool_compare_and_swap(&c->func, NULL, func) || (c->func == func)))
+	return c;
+    }
+
+  return NULL;
+}
+
+#define HDCOUNT(_func, _field, _n) {					\
+    HD_ACCESS_COUNT *_c = hdAccessCount(_func);				\
+    if(_c) __sync_fetch_and_add(&_c->_field, _n);			\
+    __sync_fetch_and_add(&hdAccessTotal._field, _n);			\
+  }
+
+/**
+ * @ingroup Access
+ * @brief Select the backend for all bus accesses of the library
+ *
+ *   Select it before hdInit; addresses from one backend mean nothing to
+ *   another.
+ *
+ * @param ops Backend.  NULL for jvme (hdAccessVME).
+ *
+ * @return OK
+ */
+int32_t
+hdSetAccess(const HD_ACCESS_OPS *ops)
+{
+  hdAccess = (ops != NULL) ? ops : &hdAccessVME;
+
+  return OK;
+}
+
+/**
+ * @ingroup Access
+ * @brief Return the selected backend
+ *
+ * @return Backend
+ */
+const HD_ACCESS_OPS *
+hdGetAccess()
+{
+  return hdAccess;
+}
+
+uint32_t
+hdAccessRead32(const char *func, volatile uint32_t *addr)
+{
+  HDCOUNT(func, reads, 1);
+
+  if(hdAccess == &hdAccessVME)
+    return vmeRead32(addr);
+
+  return hdAccess->read32(hdAccess->ctx, addr);
+}
+
+void
+hdAccessWrite32(const char *func, volatile uint32_t *addr, uint32_t value)
+{
+  HDCOUNT(func, writes, 1);
+
+  if(hdAccess == &hdAccessVME)
+    vmeWrite32(addr, value);
+  else
+    hdAccess->write32(hdAccess->ctx, addr, value);
+}
+
+int32_t
+hdAccessBusToLocalAdrs(int32_t am, char *vmeAddr, char **localAddr)
+{
+  return hdAccess->busToLocalAdrs(hdAccess->ctx, am, vmeAddr, localAddr);
+}
+
+int32_t
+hdAccessMemProbe(const char *func, char *addr, int32_t size, char *value)
+{
+  HDCOUNT(func, reads, 1);
+
+  return hdAccess->memProbe(hdAccess->ctx, addr, size, value);
+}
+
+int32_t
+hdAccessDmaConfig(uint32_t addrType, uint32_t dataType, uint32_t sstMode)
+{
+  return hdAccess->dmaConfig(hdAccess->ctx, addrType, dataType, sstMode);
+}
+
+int32_t
+hdAccessDmaSend(const char *func, unsigned long localAddr, uint32_t vmeAddr,
+		int32_t nbytes)
+{
+  HDCOUNT(func, dmas, 1);
+  HDCOUNT(func, dmaBytes, nbytes);
+
+  return hdAccess->dmaSend(hdAccess->ctx, localAddr, vmeAddr, nbytes);
+}
+
+int32_t
+hdAccessDmaDone()
+{
+  return hdAccess->dmaDone(hdAccess->ctx);
+}
+
+/**
+ * @ingroup Access
+ * @brief Mark a point in the bus transactions, e.g. each trigger of a
+ *        readout list.  A recording keeps the mark, and its replay expects
+ *        it at the same point.  Other backends ignore it.
+ *
+ * @param value Mark value (event number, ...)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAccessMark(uint32_t value)
+{
+  if(hdAccess->mark == NULL)
+    return OK;
+
+  return hdAccess->mark(hdAccess->ctx, value);
+}
+
+/**
+ * @ingroup Access
+ * @brief Zero the transaction counts
+ *
+ * @return OK
+ */
+int32_t
+hdAccessCountReset()
+{
+  int32_t ifunc;
+
+  for(ifunc = 0; ifunc < HD_ACCESS_MAX_FUNCS; ifunc++)
+    memset(&hdAccessCounts[ifunc].reads, 0,
+	   sizeof(HD_ACCESS_COUNT) - offsetof(HD_ACCESS_COUNT, reads));
+  memset(&hdAccessTotal, 0, sizeof(hdAccessTotal));
+
+  return OK;
+}
+
+/**
+ * @ingroup Access
+ * @brief Transactions of all routines, since hdAccessCountReset
+ *
+ * @param total Where to put the counts
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAccessCountTotal(HD_ACCESS_COUNT *total)
+{
+  if(total == NULL)
+    return ERROR;
+
+  *total = hdAccessTotal;
+  total->func = "total";
+
+  return OK;
+}
+
+/**
+ * @ingroup Access
+ * @brief Transactions made directly by one routine, since
+ *        hdAccessCountReset.  Routines it calls are counted separately.
+ *
+ * @param func Routine name, e.g. "hdReadScalers"
+ * @param count Where to put the counts
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAccessCountFunc(const char *func, HD_ACCESS_COUNT *count)
+{
+  int32_t ifunc;
+
+  if((func == NULL) || (count == NULL))
+    return ERROR;
+
+  memset(count, 0, sizeof(HD_ACCESS_COUNT));
+  count->func = func;
+
+  for(ifunc = 0; ifunc < HD_ACCESS_MAX_FUNCS; ifunc++)
+    {
+      if((hdAccessCounts[ifunc].func != NULL) &&
+	 (strcmp(hdAccessCounts[ifunc].func, func) == 0))
+	{
+	  count->reads += hdAccessCounts[ifunc].reads;
+	  count->writes += hdAccessCounts[ifunc].writes;
+	  count->dmas += hdAccessCounts[ifunc].dmas;
+	  count->dmaBytes += hdAccessCounts[ifunc].dmaBytes;
+	}
+    }
+
+  return OK;
+}
+
+static int
+hdAccessCountCompare(const void *a, const void *b)
+{
+  const HD_ACCESS_COUNT *ca = a, *cb = b;
+  uint64_t na = ca->reads + ca->writes + ca->dmas;
+  uint64_t nb = cb->reads + cb->writes + cb->dmas;
+
+  return (na < nb) ? 1 : (na > nb) ? -1 : 0;
+}
+
+/**
+ * @ingroup Access
+ * @brief Transactions per routine, most first
+ *
+ * @param counts Where to put the counts
+ * @param max Size of counts
+ *
+ * @return Number of routines with transactions
+ */
+int32_t
+hdAccessCountGet(HD_ACCESS_COUNT *counts, int32_t max)
+{
+  int32_t ifunc, n = 0;
+
+  if(counts == NULL)
+    return ERROR;
+
+  for(ifunc = 0; (ifunc < HD_ACCESS_MAX_FUNCS) && (n < max); ifunc++)
+    {
+      HD_ACCESS_COUNT *c = &hdAccessCounts[ifunc];
+      if((c->func != NULL) && (c->reads + c->writes + c->dmas > 0))
+	counts[n++] = *c;
+    }
+
+  qsort(counts, n, sizeof(HD_ACCESS_COUNT), hdAccessCountCompare);
+
+  return n;
+}
+
+/**
+ * @ingroup Access
+ * @brief Print the transactions per routine
+ *
+ * @return OK
+ */
+int32_t
+hdAccessCountPrint()
+{
+  HD_ACCESS_COUNT counts[HD_ACCESS_MAX_FUNCS], total;
+  int32_t ifunc, n;
+
+  n = hdAccessCountGet(counts, HD_ACCESS_MAX_FUNCS);
+  hdAccessCountTotal(&total);
+
+  printf("\n  Bus transactions (backend %s)\n", hdAccess->name);
+  printf("  %-36s %10s %10s %8s %12s\n", "Routine", "Reads", "Writes",
+	 "DMAs", "DMA bytes");
+  printf("  ------------------------------------------------------------------------------\n");
+  for(ifunc = 0; ifunc < n; ifunc++)
+    printf("  %-36s %10llu %10llu %8llu %12llu\n", counts[ifunc].func,
+	   (unsigned long long)counts[ifunc].reads,
+	   (unsigned long long)counts[ifunc].writes,
+	   (unsigned long long)counts[ifunc].dmas,
+	   (unsigned long long)counts[ifunc].dmaBytes);
+  printf("  %-36s %10llu %10llu %8llu %12llu\n\n", total.func,
+	 (unsigned long long)total.reads, (unsigned long long)total.writes,
+	 (unsigned long long)total.dmas, (unsigned long long)total.dmaBytes);
+
+  return OK;
+}
+
+/* In-memory board */
+static uint32_t
+hdMemoryRead32(void *ctx, volatile uint32_t *addr)
+{
+  HD_ACCESS_MEMORY *mem = (HD_ACCESS_MEMORY *)ctx;
+
+  if(addr == &mem->fifoPort)
+    {
+      if(mem->fifoTail == mem->fifoHead)
+	return 0xffffffff;  /* As with a bus error */
+      return mem->fifo[mem->fifoTail++ % HD_ACCESS_MEMORY_FIFO];
+    }
+
+  return *addr;
+}
+
+static void
+hdMemoryWrite32(void *ctx, volatile uint32_t *addr, uint32_t value)
+{
+  HD_ACCESS_MEMORY *mem = (HD_ACCESS_MEMORY *)ctx;
+
+  /* csr bits written are commands (resets, pulses), not stored */
+  if((addr == &mem->reg.csr) || (addr == &mem->fifoPort))
+    return;
+
+  *addr = value;
+}
+
+static int32_t
+hdMemoryBusToLocalAdrs(void *ctx, int32_t am, char *vmeAddr, char **localAddr)
+{
+  HD_ACCESS_MEMORY *mem = (HD_ACCESS_MEMORY *)ctx;
+
+  if(am == 0x09)
+    {
+      *localAddr = (char *)&mem->fifoPort;
+      return 0;
+    }
+
+  if((uint32_t)(uintptr_t)vmeAddr != mem->vmeA24)
+    return -1;
+
+  *localAddr = (char *)&mem->reg;
+  return 0;
+}
+
+static int32_t
+hdMemoryMemProbe(void *ctx, char *addr, int32_t size, char *value)
+{
+  HD_ACCESS_MEMORY *mem = (HD_ACCESS_MEMORY *)ctx;
+
+  if((addr < (char *)&mem->reg) || (addr + size > (char *)(&mem->reg + 1)))
+    return -1;
+
+  memcpy(value, addr, size);
+  return 0;
+}
+
+static int32_t
+hdMemoryDmaConfig(void *ctx, uint32_t addrType, uint32_t dataType, uint32_t sstMode)
+{
+  return 0;
+}
+
+static int32_t
+hdMemoryDmaSend(void *ctx, unsigned long localAddr, uint32_t vmeAddr, int32_t nbytes)
+{
+  HD_ACCESS_MEMORY *mem = (HD_ACCESS_MEMORY *)ctx;
+
+  mem->dmaLocal = localAddr;
+  mem->dmaVme = vmeAddr;
+  mem->dmaBytes = nbytes;
+
+  return 0;
+}
+
+/* Block transfers are big endian on the bus */
+static int32_t
+hdMemoryDmaDone(void *ctx)
+{
+  HD_ACCESS_MEMORY *mem = (HD_ACCESS_MEMORY *)ctx;
+  volatile uint32_t *dst = (volatile uint32_t *)mem->dmaLocal;
+  uint32_t *reg = (uint32_t *)&mem->reg;
+  uint32_t iword, nwords = mem->dmaBytes >> 2, offset;
+
+  if((mem->dmaVme >= mem->vmeA24) &&
+     (mem->dmaVme + mem->dmaBytes <= mem->vmeA24 + sizeof(HD)))
+    {
+      offset = (mem->dmaVme - mem->vmeA24) >> 2;
+      for(iword = 0; iword < nwords; iword++)
+	dst[iword] = LSWAP(reg[offset + iword]);
+      return nwords << 2;
+    }
+
+  /* Data FIFO, up to the end of the data */
+  for(iword = 0; (iword < nwords) && (mem->fifoTail != mem->fifoHead); iword++)
+    dst[iword] = LSWAP(mem->fifo[mem->fifoTail++ % HD_ACCESS_MEMORY_FIFO]);
+
+  return iword << 2;
+}
+
+/**
+ * @ingroup Access
+ * @brief Set up an in-memory board.  Registers hold what is written
+ *        (except csr, whose bits are commands), and the data FIFO holds
+ *        what is pushed with hdAccessMemoryPush.
+ *
+ * @param mem Board
+ * @param vmeA24 A24 address hdInit will find it at
+ * @param ops Where to put the backend, for hdSetAccess
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAccessMemoryInit(HD_ACCESS_MEMORY *mem, uint32_t vmeA24, HD_ACCESS_OPS *ops)
+{
+  if((mem == NULL) || (ops == NULL))
+    return ERROR;
+
+  memset(mem, 0, sizeof(HD_ACCESS_MEMORY));
+  mem->vmeA24 = vmeA24;
+  mem->reg.version = (HD_VERSION_BOARD_TYPE << 16) | HD_SUPPORTED_FIRMWARE;
+  mem->reg.csr = HD_CSR_SYSTEM_CLK_PLL_LOCKED | HD_CSR_LOCAL_CLK_PLL_LOCKED |
+    HD_CSR_EMPTY;
+
+  ops->name = "memory";
+  ops->ctx = mem;
+  ops->read32 = hdMemoryRead32;
+  ops->write32 = hdMemoryWrite32;
+  ops->busToLocalAdrs = hdMemoryBusToLocalAdrs;
+  ops->memProbe = hdMemoryMemProbe;
+  ops->dmaConfig = hdMemoryDmaConfig;
+  ops->dmaSend = hdMemoryDmaSend;
+  ops->dmaDone = hdMemoryDmaDone;
+  ops->mark = NULL;
+
+  return OK;
+}
+
+/**
+ * @ingroup Access
+ * @brief Queue data words in the FIFO of an in-memory board
+ *
+ * @param mem Board
+ * @param data Words, as the module would produce them
+ * @param nwords Number of words
+ *
+ * @return Number of words queued
+ */
+int32_t
+hdAccessMemoryPush(HD_ACCESS_MEMORY *mem, const uint32_t *data, uint32_t nwords)
+{
+  uint32_t iword;
+
+  for(iword = 0; iword < nwords; iword++)
+    {
+      if(mem->fifoHead - mem->fifoTail >= HD_ACCESS_MEMORY_FIFO)
+	break;
+      mem->fifo[mem->fifoHead++ % HD_ACCESS_MEMORY_FIFO] = data[iword];
+    }
+
+  return iword;
+}
+
+/* Record / replay */
+
+/* VME address of a local address, from the windows mapped so far */
+static uint32_t
+hdRecordVmeAddr(HD_ACCESS_RECORDER *rec, volatile void *addr, int16_t *am)
+{
+  uintptr_t a = (uintptr_t)addr;
+  int32_t imap;
+
+  for(imap = 0; imap < rec->nmaps; imap++)
+    {
+      if((a >= rec->map[imap].local) && (a < rec->map[imap].local + sizeof(HD)))
+	{
+	  *am = rec->map[imap].am;
+	  return rec->map[imap].vme + (a - rec->map[imap].local);
+	}
+    }
+
+  *am = 0;
+  return (uint32_t)a;
+}
+
+static uint64_t
+hdRecordNow()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Trace writer thread.  Writes each buffer handed to it, without the
+   recorder mutex, then returns it as the spare */
+static void *
+hdTraceWriter(void *arg)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)arg;
+  HD_ACCESS_RECORD *buf;
+  uint32_t n;
+  size_t nwritten;
+
+  pthread_mutex_lock(&rec->mutex);
+  while(1)
+    {
+      while((rec->writing == NULL) && rec->writerRun)
+	pthread_cond_wait(&rec->traceCond, &rec->mutex);
+      if(rec->writing == NULL)
+	break;
+
+      buf = rec->writing;
+      n = rec->nwriting;
+      pthread_mutex_unlock(&rec->mutex);
+
+      nwritten = fwrite(buf, sizeof(HD_ACCESS_RECORD), n, rec->trace);
+
+      pthread_mutex_lock(&rec->mutex);
+      if((nwritten < n) && (rec->ndropped == 0))
+	printf("%s: ERROR: Trace write failed: %s\n", __func__, strerror(errno));
+
+      rec->ntraced += nwritten;
+      rec->ndropped += n - nwritten;
+      rec->writing = NULL;
+      rec->spare = buf;
+      pthread_cond_broadcast(&rec->traceCond);
+    }
+  pthread_mutex_unlock(&rec->mutex);
+
+  return NULL;
+}
+
+/* Hand the log to the writer thread, and record into the spare.  Waits
+   only while the writer is still busy with the previous one.  Called with
+   the recorder mutex held */
+static void
+hdTraceFlush(HD_ACCESS_RECORDER *rec)
+{
+  while(rec->writing != NULL)
+    pthread_cond_wait(&rec->traceCond, &rec->mutex);
+
+  if(rec->n == 0)
+    return;
+
+  rec->writing = rec->log;
+  rec->nwriting = rec->n;
+  rec->log = rec->spare;
+  rec->spare = NULL;
+  rec->n = 0;
+  pthread_cond_broadcast(&rec->traceCond);
+}
+
+/* Room for nrec records in the log, flushing it to the trace file if
+   needed.  NULL (and the records counted as dropped) if there is none */
+static HD_ACCESS_RECORD *
+hdRecordReserve(HD_ACCESS_RECORDER *rec, uint32_t nrec)
+{
+  HD_ACCESS_RECORD *r;
+
+  if((rec->n + nrec > rec->size) && (rec->trace != NULL))
+    hdTraceFlush(rec);
+
+  if(rec->n + nrec > rec->size)
+    {
+      rec->ndropped += nrec;
+      return NULL;
+    }
+
+  r = &rec->log[rec->n];
+  rec->n += nrec;
+
+  return r;
+}
+
+static HD_ACCESS_RECORD *
+hdRecordAdd(HD_ACCESS_RECORDER *rec, uint16_t type, int16_t am, uint32_t addr,
+	    uint32_t value, uint32_t npayload)
+{
+  uint64_t now = hdRecordNow(), dt = (rec->last != 0) ? now - rec->last : 0;
+  HD_ACCESS_RECORD *r = hdRecordReserve(rec, 1 + npayload);
+
+  if(r == NULL)
+    return NULL;
+
+  r->type = type;
+  r->am = am;
+  r->addr = addr;
+  r->value = value;
+  r->dt = (dt > 0xFFFFFFFF) ? 0xFFFFFFFF : dt;
+  rec->last = now;
+
+  return r;
+}
+
+/**
+ * @ingroup Access
+ * @brief Number of records taken by a record and its payload: the next
+ *        call's record is r + hdAccessRecordSpan(r)
+ *
+ * @param r Record
+ *
+ * @return Number of records
+ */
+uint32_t
+hdAccessRecordSpan(const HD_ACCESS_RECORD *r)
+{
+  if(r->type == HD_ACCESS_RECORD_DMA_DONE)
+    return 1 + HD_ACCESS_DMA_RECORDS(r->value);
+
+  return 1;
+}
+
+/* Attaching: the value last read or written at addr before the first
+   mark */
+static uint32_t
+hdReplayImage(HD_ACCESS_RECORDER *rec, uint32_t addr)
+{
+  HD_ACCESS_RECORD *r;
+  uint32_t irec, value = 0;
+
+  for(irec = 0; irec < rec->start; irec += hdAccessRecordSpan(r))
+    {
+      r = &rec->log[irec];
+      if((r->addr == addr) &&
+	 ((r->type == HD_ACCESS_RECORD_READ) || (r->type == HD_ACCESS_RECORD_WRITE) ||
+	  ((r->type == HD_ACCESS_RECORD_PROBE) && (r->am == 0))))
+	value = r->value;
+    }
+
+  return value;
+}
+
+/* Next replay record, if it is the expected call.  Register polls take a
+   different number of reads from run to run: a read repeated in the replay
+   gets the last value again, and reads repeated in the log are skipped */
+static HD_ACCESS_RECORD *
+hdReplayNext(HD_ACCESS_RECORDER *rec, uint16_t type, uint32_t addr)
+{
+  HD_ACCESS_RECORD *r, *last = rec->prev;
+  int32_t lastIsRead = (last != NULL) && (last->type == HD_ACCESS_RECORD_READ);
+
+  if(lastIsRead && (rec->pos < rec->n) &&
+     !((rec->log[rec->pos].type == type) && (rec->log[rec->pos].addr == addr)))
+    {
+      if((type == HD_ACCESS_RECORD_READ) && (addr == last->addr))
+	return last;
+
+      while((rec->pos < rec->n) &&
+	    (rec->log[rec->pos].type == HD_ACCESS_RECORD_READ) &&
+	    (rec->log[rec->pos].addr == last->addr))
+	rec->pos++;
+    }
+
+  if(rec->pos >= rec->n)
+    {
+      if(rec->nmismatch++ == 0)
+	printf("%s: ERROR: End of the log (type %d, addr 0x%08x)\n",
+	       __func__, type, addr);
+      return NULL;
+    }
+
+  r = &rec->log[rec->pos];
+  if((r->type != type) || (r->addr != addr))
+    {
+      if(rec->nmismatch++ == 0)
+	printf("%s: ERROR: Record %d is type %d at 0x%08x, not type %d at 0x%08x\n",
+	       __func__, rec->pos, r->type, r->addr, type, addr);
+      return NULL;
+    }
+
+  rec->pos += hdAccessRecordSpan(r);
+  if(rec->pos > rec->n)
+    {
+      if(rec->nmismatch++ == 0)
+	printf("%s: ERROR: Record %d is truncated\n", __func__, (int32_t)(r - rec->log));
+      rec->pos = rec->n;
+      return NULL;
+    }
+
+  rec->prev = r;
+  return r;
+}
+
+static uint32_t
+hdRecordRead32(void *ctx, volatile uint32_t *addr)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)ctx;
+  HD_ACCESS_RECORD *r;
+  uint32_t vme, value = 0xffffffff;
+  int16_t am;
+
+  pthread_mutex_lock(&rec->mutex);
+  vme = hdRecordVmeAddr(rec, addr, &am);
+  if(rec->inner)
+    {
+      value = rec->inner->read32(rec->inner->ctx, addr);
+      hdRecordAdd(rec, HD_ACCESS_RECORD_READ, am, vme, value, 0);
+    }
+  else if(rec->attach)
+    value = hdReplayImage(rec, vme);
+  else if((r = hdReplayNext(rec, HD_ACCESS_RECORD_READ, vme)) != NULL)
+    value = r->value;
+  pthread_mutex_unlock(&rec->mutex);
+
+  return value;
+}
+
+static void
+hdRecordWrite32(void *ctx, volatile uint32_t *addr, uint32_t value)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)ctx;
+  HD_ACCESS_RECORD *r;
+  uint32_t vme;
+  int16_t am;
+
+  pthread_mutex_lock(&rec->mutex);
+  vme = hdRecordVmeAddr(rec, addr, &am);
+  if(rec->inner)
+    {
+      rec->inner->write32(rec->inner->ctx, addr, value);
+      hdRecordAdd(rec, HD_ACCESS_RECORD_WRITE, am, vme, value, 0);
+    }
+  else if(!rec->attach &&
+	  ((r = hdReplayNext(rec, HD_ACCESS_RECORD_WRITE, vme)) != NULL) &&
+	  (r->value != value))
+    {
+      if(rec->nmismatch++ == 0)
+	printf("%s: ERROR: Record %d writes 0x%08x to 0x%08x, not 0x%08x\n",
+	       __func__, rec->pos - 1, r->value, vme, value);
+    }
+  pthread_mutex_unlock(&rec->mutex);
+}
+
+static int32_t
+hdRecordBusToLocalAdrs(void *ctx, int32_t am, char *vmeAddr, char **localAddr)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)ctx;
+  HD_ACCESS_RECORD *r;
+  uint32_t vme = (uint32_t)(uintptr_t)vmeAddr;
+  int32_t rval = -1, imap;
+
+  pthread_mutex_lock(&rec->mutex);
+  if(rec->inner)
+    {
+      rval = rec->inner->busToLocalAdrs(rec->inner->ctx, am, vmeAddr, localAddr);
+      hdRecordAdd(rec, HD_ACCESS_RECORD_MAP, rval, vme, am, 0);
+    }
+  else if(rec->attach || ((r = hdReplayNext(rec, HD_ACCESS_RECORD_MAP, vme)) != NULL))
+    {
+      rval = rec->attach ? 0 : r->am;
+      if(rval == 0)
+	{
+	  /* Reuse the window of an address already mapped */
+	  for(imap = 0; imap < rec->nmaps; imap++)
+	    if((rec->map[imap].am == am) && (rec->map[imap].vme == vme))
+	      break;
+	  if(imap < HD_ACCESS_MAX_MAPS)
+	    *localAddr = (char *)rec->scratch[imap];
+	  else
+	    rval = -1;
+	}
+    }
+
+  if(rval == 0)
+    {
+      for(imap = 0; imap < rec->nmaps; imap++)
+	if((rec->map[imap].am == am) && (rec->map[imap].vme == vme))
+	  break;
+      if((imap == rec->nmaps) && (imap < HD_ACCESS_MAX_MAPS))
+	{
+	  rec->map[imap].am = am;
+	  rec->map[imap].vme = vme;
+	  rec->map[imap].local = (uintptr_t)*localAddr;
+	  rec->nmaps++;
+	}
+    }
+  pthread_mutex_unlock(&rec->mutex);
+
+  return rval;
+}
+
+static int32_t
+hdRecordMemProbe(void *ctx, char *addr, int32_t size, char *value)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)ctx;
+  HD_ACCESS_RECORD *r;
+  uint32_t vme, word = 0;
+  int32_t rval = -1;
+  int16_t am;
+
+  pthread_mutex_lock(&rec->mutex);
+  vme = hdRecordVmeAddr(rec, addr, &am);
+  if(rec->inner)
+    {
+      rval = rec->inner->memProbe(rec->inner->ctx, addr, size, value);
+      if(rval == 0)
+	memcpy(&word, value, (size < 4) ? size : 4);
+      hdRecordAdd(rec, HD_ACCESS_RECORD_PROBE, rval, vme, word, 0);
+    }
+  else if(rec->attach)
+    {
+      rval = 0;
+      word = hdReplayImage(rec, vme);
+      memcpy(value, &word, (size < 4) ? size : 4);
+    }
+  else if((r = hdReplayNext(rec, HD_ACCESS_RECORD_PROBE, vme)) != NULL)
+    {
+      rval = r->am;
+      if(rval == 0)
+	memcpy(value, &r->value, (size < 4) ? size : 4);
+    }
+  pthread_mutex_unlock(&rec->mutex);
+
+  return rval;
+}
+
+static int32_t
+hdRecordDmaConfig(void *ctx, uint32_t addrType, uint32_t dataType, uint32_t sstMode)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)ctx;
+  uint32_t config = (addrType << 16) | (dataType << 8) | sstMode;
+  int32_t rval = 0;
+
+  pthread_mutex_lock(&rec->mutex);
+  if(rec->inner)
+    {
+      rval = rec->inner->dmaConfig(rec->inner->ctx, addrType, dataType, sstMode);
+      hdRecordAdd(rec, HD_ACCESS_RECORD_DMA_CONFIG, rval, config, 0, 0);
+    }
+  else if(!rec->attach &&
+	  (hdReplayNext(rec, HD_ACCESS_RECORD_DMA_CONFIG, config) == NULL))
+    rval = -1;
+  pthread_mutex_unlock(&rec->mutex);
+
+  return rval;
+}
+
+static int32_t
+hdRecordDmaSend(void *ctx, unsigned long localAddr, uint32_t vmeAddr, int32_t nbytes)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)ctx;
+  HD_ACCESS_RECORD *r;
+  int32_t rval = -1;
+
+  pthread_mutex_lock(&rec->mutex);
+  rec->dmaLocal = localAddr;
+  if(rec->inner)
+    {
+      rval = rec->inner->dmaSend(rec->inner->ctx, localAddr, vmeAddr, nbytes);
+      hdRecordAdd(rec, HD_ACCESS_RECORD_DMA_SEND, rval, vmeAddr, nbytes, 0);
+    }
+  else if(!rec->attach &&
+	  ((r = hdReplayNext(rec, HD_ACCESS_RECORD_DMA_SEND, vmeAddr)) != NULL))
+    rval = r->am;
+  pthread_mutex_unlock(&rec->mutex);
+
+  return rval;
+}
+
+static int32_t
+hdRecordDmaDone(void *ctx)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)ctx;
+  HD_ACCESS_RECORD *r;
+  void *data = (void *)rec->dmaLocal;
+  int32_t rval = -1;
+
+  pthread_mutex_lock(&rec->mutex);
+  if(rec->inner)
+    {
+      /* One record, then the payload as it is */
+      rval = rec->inner->dmaDone(rec->inner->ctx);
+      r = hdRecordAdd(rec, HD_ACCESS_RECORD_DMA_DONE, 0, 0, rval,
+		      HD_ACCESS_DMA_RECORDS(rval));
+      if((r != NULL) && (rval > 0))
+	memcpy(r + 1, data, rval);
+    }
+  else if(!rec->attach &&
+	  ((r = hdReplayNext(rec, HD_ACCESS_RECORD_DMA_DONE, 0)) != NULL))
+    {
+      rval = (int32_t)r->value;
+      if(rval > 0)
+	memcpy(data, r + 1, rval);
+    }
+  pthread_mutex_unlock(&rec->mutex);
+
+  return rval;
+}
+
+/* Attaching ends at the first mark */
+static int32_t
+hdRecordMark(void *ctx, uint32_t value)
+{
+  HD_ACCESS_RECORDER *rec = (HD_ACCESS_RECORDER *)ctx;
+  int32_t rval = OK;
+
+  pthread_mutex_lock(&rec->mutex);
+  if(rec->inner)
+    hdRecordAdd(rec, HD_ACCESS_RECORD_MARK, 0, value, 0, 0);
+  else
+    {
+      if(rec->attach)
+	{
+	  rec->attach = 0;
+	  rec->pos = rec->start;
+	  rec->prev = NULL;
+	}
+      if(hdReplayNext(rec, HD_ACCESS_RECORD_MARK, value) == NULL)
+	rval = ERROR;
+    }
+  pthread_mutex_unlock(&rec->mutex);
+
+  return rval;
+}
+
+static void
+hdRecordOps(HD_ACCESS_RECORDER *rec, HD_ACCESS_OPS *ops)
+{
+  ops->name = rec->inner ? "record" : "replay";
+  ops->ctx = rec;
+  ops->read32 = hdRecordRead32;
+  ops->write32 = hdRecordWrite32;
+  ops->busToLocalAdrs = hdRecordBusToLocalAdrs;
+  ops->memProbe = hdRecordMemProbe;
+  ops->dmaConfig = hdRecordDmaConfig;
+  ops->dmaSend = hdRecordDmaSend;
+  ops->dmaDone = hdRecordDmaDone;
+  ops->mark = hdRecordMark;
+}
+
+/**
+ * @ingroup Access
+ * @brief Record every call to a backend
+ *
+ * @param rec Recorder
+ * @param inner Backend to record.  NULL for jvme.
+ * @param log Where to put the records
+ * @param size Size of log.  Records past it are counted in rec->ndropped.
+ * @param ops Where to put the recording backend, for hdSetAccess
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAccessRecordInit(HD_ACCESS_RECORDER *rec, const HD_ACCESS_OPS *inner,
+		   HD_ACCESS_RECORD *log, uint32_t size, HD_ACCESS_OPS *ops)
+{
+  if((rec == NULL) || (log == NULL) || (ops == NULL))
+    return ERROR;
+
+  memset(rec, 0, sizeof(HD_ACCESS_RECORDER));
+  rec->inner = (inner != NULL) ? inner : &hdAccessVME;
+  rec->log = log;
+  rec->size = size;
+  pthread_mutex_init(&rec->mutex, NULL);
+  hdRecordOps(rec, ops);
+
+  return OK;
+}
+
+/**
+ * @ingroup Access
+ * @brief Replay a recording.  Reads, probes and block transfers return
+ *        the recorded values; calls that differ from the recording (type,
+ *        address, or value written) are counted in rec->nmismatch.
+ *
+ * @param rec Recorder
+ * @param log Records, from hdAccessRecordInit
+ * @param n Number of records
+ * @param ops Where to put the replay backend, for hdSetAccess
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAccessReplayInit(HD_ACCESS_RECORDER *rec, HD_ACCESS_RECORD *log, uint32_t n,
+		   HD_ACCESS_OPS *ops)
+{
+  if((rec == NULL) || (log == NULL) || (ops == NULL))
+    return ERROR;
+
+  memset(rec, 0, sizeof(HD_ACCESS_RECORDER));
+  rec->log = log;
+  rec->size = n;
+  rec->n = n;
+  pthread_mutex_init(&rec->mutex, NULL);
+  hdRecordOps(rec, ops);
+
+  return OK;
+}
+
+/**
+ * @ingroup Access
+ * @brief Replay a recording, attaching to it at its first mark.  Until
+ *        the first hdAccessMark, calls are not checked: reads and probes
+ *        return the value last read or written at the address before the
+ *        mark, writes are ignored, and windows map.  A program can then
+ *        attach (hdInit with HD_INIT_WARM) to a trace of a readout that
+ *        was configured differently, and replay it from the first mark.
+ *
+ * @param rec Recorder
+ * @param log Records, with at least one mark
+ * @param n Number of records
+ * @param ops Where to put the replay backend, for hdSetAccess
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAccessReplayAttachInit(HD_ACCESS_RECORDER *rec, HD_ACCESS_RECORD *log,
+			 uint32_t n, HD_ACCESS_OPS *ops)
+{
+  uint32_t irec;
+
+  if(hdAccessReplayInit(rec, log, n, ops) != OK)
+    return ERROR;
+
+  for(irec = 0; irec < n; irec += hdAccessRecordSpan(&log[irec]))
+    if(log[irec].type == HD_ACCESS_RECORD_MARK)
+      break;
+
+  if(irec >= n)
+    {
+      printf("%s: ERROR: No marks in the log\n", __func__);
+      return ERROR;
+    }
+
+  rec->start = irec;
+  rec->attach = 1;
+
+  return OK;
+}
+
+/**
+ * @ingroup Access
+ * @brief Write a recording to a trace file.  The records already in the
+ *        log, and all that follow, go to the file: each time the log fills
+ *        it is handed to a writer thread, and recording goes on in a
+ *        second buffer of the same size, so it no longer limits the
+ *        recording.  The log must still hold the largest block transfer.
+ *
+ * @param rec Recorder, from hdAccessRecordInit
+ * @param filename Trace file
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAccessTraceOpen(HD_ACCESS_RECORDER *rec, const char *filename)
+{
+  HD_ACCESS_TRACE_HEADER header;
+  HD_ACCESS_RECORD *spare;
+  FILE *fp;
+  int32_t rval = OK;
+
+  if((rec == NULL) || (rec->inner == NULL) || (filename == NULL))
+    {
+      printf("%s: ERROR: Invalid recorder or filename\n", __func__);
+      return ERROR;
+    }
+
+  memset(&header, 0, sizeof(header));
+  header.magic = HD_ACCESS_TRACE_MAGIC;
+  header.version = HD_ACCESS_TRACE_VERSION;
+  header.recordSize = sizeof(HD_ACCESS_RECORD);
+  header.started = (int64_t)time(NULL);
+  gethostname(header.host, sizeof(header.host) - 1);
+
+  spare = (HD_ACCESS_RECORD *)malloc(rec->size * sizeof(HD_ACCESS_RECORD));
+  if(spare == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate %u records\n", __func__, rec->size);
+      return ERROR;
+    }
+
+  pthread_mutex_lock(&rec->mutex);
+  if(rec->trace != NULL)
+    {
+      printf("%s: ERROR: Trace file already open\n", __func__);
+      rval = ERROR;
+    }
+  else if((fp = fopen(filename, "w")) == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s: %s\n", __func__, filename,
+	     strerror(errno));
+      rval = ERROR;
+    }
+  else if(fwrite(&header, sizeof(header), 1, fp) != 1)
+    {
+      printf("%s: ERROR: Unable to write %s: %s\n", __func__, filename,
+	     strerror(errno));
+      fclose(fp);
+      rval = ERROR;
+    }
+  else
+    {
+      rec->trace = fp;
+      rec->ntraced = 0;
+      rec->userLog = rec->log;
+      rec->spare = spare;
+      rec->writing = NULL;
+      rec->writerRun = 1;
+      pthread_cond_init(&rec->traceCond, NULL);
+      if(pthread_create(&rec->writer, NULL, hdTraceWriter, rec) != 0)
+	{
+	  perror("pthread_create");
+	  fclose(fp);
+	  rec->trace = NULL;
+	  rec->spare = NULL;
+	  rval = ERROR;
+	}
+    }
+  pthread_mutex_unlock(&rec->mutex);
+
+  if(rval != OK)
+    free(spare);
+
+  return rval;
+}
+
+/**
+ * @ingroup Access
+ * @brief Write the rest of the recording to the trace file, and close it
+ *
+ * @param rec Recorder, from hdAccessTraceOpen
+ *
+ * @return Number of records in the file if successful, otherwise ERROR
+ */
+int32_t
+hdAccessTraceClose(HD_ACCESS_RECORDER *rec)
+{
+  uint32_t counts[2];
+  int32_t rval = OK;
+
+  if((rec == NULL) || (rec->trace == NULL))
+    {
+      printf("%s: ERROR: No trace file open\n", __func__);
+      return ERROR;
+    }
+
+  /* Write the rest, and wait for the writer to finish */
+  pthread_mutex_lock(&rec->mutex);
+  hdTraceFlush(rec);
+  rec->writerRun = 0;
+  pthread_cond_broadcast(&rec->traceCond);
+  pthread_mutex_unlock(&rec->mutex);
+  pthread_join(rec->writer, NULL);
+
+  pthread_mutex_lock(&rec->mutex);
+  if(rec->log != rec->userLog)
+    {
+      rec->spare = rec->log;
+      rec->log = rec->userLog;
+    }
+  free(rec->spare);
+  rec->spare = NULL;
+  pthread_cond_destroy(&rec->traceCond);
+
+  counts[0] = rec->ntraced;
+  counts[1] = rec->ndropped;
+  if((fseek(rec->trace, offsetof(HD_ACCESS_TRACE_HEADER, nrecords), SEEK_SET) != 0) ||
+     (fwrite(counts, sizeof(uint32_t), 2, rec->trace) != 2))
+    rval = ERROR;
+  if(fclose(rec->trace) != 0)
+    rval = ERROR;
+  rec->trace = NULL;
+  pthread_mutex_unlock(&rec->mutex);
+
+  if(rval != OK)
+    {
+      printf("%s: ERROR: Unable to complete the trace file\n", __func__);
+      return ERROR;
+    }
+
+  return counts[0];
+}
+
+/**
+ * @ingroup Access
+ * @brief Read a trace file.  A trace that was never closed (the program
+ *        stopped while recording) is read to the end of the file, less a
+ *        block transfer cut short.
+ *
+ * @param filename Trace file
+ * @param header Where to put the header.  May be NULL.
+ * @param log Where to put the records, allocated with malloc.  The caller
+ *            frees them.
+ *
+ * @return Number of records if successful, otherwise ERROR
+ */
+int32_t
+hdAccessTraceLoad(const char *filename, HD_ACCESS_TRACE_HEADER *header,
+		  HD_ACCESS_RECORD **log)
+{
+  HD_ACCESS_TRACE_HEADER h;
+  FILE *fp;
+  long size;
+  uint32_t n, irec, span;
+
+  if((filename == NULL) || (log == NULL))
+    return ERROR;
+
+  if((fp = fopen(filename, "r")) == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s: %s\n", __func__, filename,
+	     strerror(errno));
+      return ERROR;
+    }
+
+  if((fread(&h, sizeof(h), 1, fp) != 1) || (h.magic != HD_ACCESS_TRACE_MAGIC) ||
+     (h.version != HD_ACCESS_TRACE_VERSION) ||
+     (h.recordSize != sizeof(HD_ACCESS_RECORD)))
+    {
+      printf("%s: ERROR: %s is not a trace file (version %d)\n", __func__,
+	     filename, HD_ACCESS_TRACE_VERSION);
+      fclose(fp);
+      return ERROR;
+    }
+
+  n = h.nrecords;
+  if(n == 0)
+    {
+      fseek(fp, 0, SEEK_END);
+      size = ftell(fp) - (long)sizeof(h);
+      n = (size > 0) ? size / sizeof(HD_ACCESS_RECORD) : 0;
+      fseek(fp, sizeof(h), SEEK_SET);
+      h.nrecords = n;
+    }
+
+  *log = (HD_ACCESS_RECORD *)malloc((n ? n : 1) * sizeof(HD_ACCESS_RECORD));
+  if(*log == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate %u records\n", __func__, n);
+      fclose(fp);
+      return ERROR;
+    }
+
+  if(fread(*log, sizeof(HD_ACCESS_RECORD), n, fp) != n)
+    {
+      printf("%s: ERROR: %s is truncated\n", __func__, filename);
+      free(*log);
+      *log = NULL;
+      fclose(fp);
+      return ERROR;
+    }
+  fclose(fp);
+
+  /* A trace that was never closed can end inside a block transfer */
+  for(irec = 0; irec < n; irec += span)
+    {
+      span = hdAccessRecordSpan(&(*log)[irec]);
+      if(irec + span > n)
+	{
+	  printf("%s: WARNING: %s ends inside record %u\n", __func__,
+		 filename, irec);
+	  n = h.nrecords = irec;
+	  break;
+	}
+    }
+
+  if(header != NULL)
+    *header = h;
+
+  return n;
+}
@@ -0,0 +1,190 @@
+#pragma once
+/******************************************************************************
+ *
+ *  hdAccess.h -  Register access layer for the JLab helicity decoder library.
+ *                Every bus access of the library goes through here, to the
+ *                selected backend (jvme by default), and is counted per
+ *                library routine.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "hdLib.h"
+
+/* Backend.  The routines follow the jvme routines of the same name. */
+typedef struct hd_access_ops_struct
+{
+  const char *name;
+  void       *ctx;
+  uint32_t (*read32)(void *ctx, volatile uint32_t *addr);
+  void     (*write32)(void *ctx, volatile uint32_t *addr, uint32_t value);
+  int32_t  (*busToLocalAdrs)(void *ctx, int32_t am, char *vmeAddr, char **localAddr);
+  int32_t  (*memProbe)(void *ctx, char *addr, int32_t size, char *value);
+  int32_t  (*dmaConfig)(void *ctx, uint32_t addrType, uint32_t dataType, uint32_t sstMode);
+  int32_t  (*dmaSend)(void *ctx, unsigned long localAddr, uint32_t vmeAddr, int32_t nbytes);
+  int32_t  (*dmaDone)(void *ctx);
+  int32_t  (*mark)(void *ctx, uint32_t value);  /* Optional.  See hdAccessMark */
+} HD_ACCESS_OPS;
+
+extern const HD_ACCESS_OPS hdAccessVME;
+
+int32_t hdSetAccess(const HD_ACCESS_OPS *ops);
+const HD_ACCESS_OPS *hdGetAccess();
+
+/* Used by the library in place of the jvme routines */
+uint32_t hdAccessRead32(const char *func, volatile uint32_t *addr);
+void     hdAccessWrite32(const char *func, volatile uint32_t *addr, uint32_t value);
+int32_t  hdAccessBusToLocalAdrs(int32_t am, char *vmeAddr, char **localAddr);
+int32_t  hdAccessMemProbe(const char *func, char *addr, int32_t size, char *value);
+int32_t  hdAccessDmaConfig(uint32_t addrType, uint32_t dataType, uint32_t sstMode);
+int32_t  hdAccessDmaSend(const char *func, unsigned long localAddr, uint32_t vmeAddr,
+			 int32_t nbytes);
+int32_t  hdAccessDmaDone();
+int32_t  hdAccessMark(uint32_t value);
+
+#define hdRead32(_addr)              hdAccessRead32(__func__, _addr)
+#define hdWrite32(_addr, _value)     hdAccessWrite32(__func__, _addr, _value)
+#define hdMemProbe(_addr, _sz, _val) hdAccessMemProbe(__func__, _addr, _sz, _val)
+#define hdDmaSend(_laddr, _vaddr, _nbytes)			\
+  hdAccessDmaSend(__func__, _laddr, _vaddr, _nbytes)
+
+/* Transaction counts, per library routine */
+#define HD_ACCESS_MAX_FUNCS 256
+
+typedef struct hd_access_count_struct
+{
+  const char *func;
+  uint64_t    reads;      /* Single cycle reads, and probes */
+  uint64_t    writes;     /* Single cycle writes */
+  uint64_t    dmas;       /* Block transfers */
+  uint64_t    dmaBytes;   /* Requested */
+} HD_ACCESS_COUNT;
+
+int32_t hdAccessCountReset();
+int32_t hdAccessCountTotal(HD_ACCESS_COUNT *total);
+int32_t hdAccessCountFunc(const char *func, HD_ACCESS_COUNT *count);
+int32_t hdAccessCountGet(HD_ACCESS_COUNT *counts, int32_t max);
+int32_t hdAccessCountPrint();
+
+/* In-memory board: plain registers, and a data FIFO read at the A32 base */
+#define HD_ACCESS_MEMORY_FIFO 4096
+
+typedef struct hd_access_memory_struct
+{
+  HD       reg;
+  uint32_t vmeA24;
+  uint32_t fifo[HD_ACCESS_MEMORY_FIFO];
+  uint32_t fifoHead;
+  uint32_t fifoTail;
+  uint32_t fifoPort;        /* Local address of the A32 window */
+
+  /* Pending block transfer */
+  unsigned long dmaLocal;
+  uint32_t dmaVme;
+  int32_t  dmaBytes;
+} HD_ACCESS_MEMORY;
+
+int32_t hdAccessMemoryInit(HD_ACCESS_MEMORY *mem, uint32_t vmeA24, HD_ACCESS_OPS *ops);
+int32_t hdAccessMemoryPush(HD_ACCESS_MEMORY *mem, const uint32_t *data, uint32_t nwords);
+
+/* Record / replay.  Each record is one backend call, addresses as VME
+   addresses.  A block transfer (DMA_DONE) is followed by the bytes
+   transferred, packed into HD_ACCESS_DMA_RECORDS(value) records (see
+   hdAccessRecordSpan).  A MARK (from hdAccessMark) has its value in addr */
+#define HD_ACCESS_RECORD_READ        1
+#define HD_ACCESS_RECORD_WRITE       2
+#define HD_ACCESS_RECORD_MAP         3   /* busToLocalAdrs */
+#define HD_ACCESS_RECORD_PROBE       4
+#define HD_ACCESS_RECORD_DMA_CONFIG  5
+#define HD_ACCESS_RECORD_DMA_SEND    6
+#define HD_ACCESS_RECORD_DMA_DONE    7
+#define HD_ACCESS_RECORD_MARK        9
+
+typedef struct hd_access_record_struct
+{
+  uint16_t type;
+  int16_t  am;       /* Address modifier, or the result (MAP, PROBE, DMA_SEND) */
+  uint32_t addr;
+  uint32_t value;
+  uint32_t dt;       /* ns since the previous record */
+} HD_ACCESS_RECORD;
+
+/* Records holding the payload of a block transfer of _nbytes */
+#define HD_ACCESS_DMA_RECORDS(_nbytes)					\
+  (((int32_t)(_nbytes) > 0) ?						\
+   ((uint32_t)(_nbytes) + sizeof(HD_ACCESS_RECORD) - 1) / sizeof(HD_ACCESS_RECORD) : 0)
+
+#define HD_ACCESS_MAX_MAPS 8
+
+typedef struct hd_access_recorder_struct
+{
+  const HD_ACCESS_OPS *inner;  /* Recorded backend.  NULL when replaying */
+  HD_ACCESS_RECORD *log;
+  uint32_t size;
+  uint32_t n;                  /* Records in the log */
+  uint32_t pos;                /* Replay position */
+  uint32_t ndropped;           /* Recording: log full */
+  uint32_t nmismatch;          /* Replay: calls that differ from the log */
+  pthread_mutex_t mutex;
+  uint64_t last;               /* Recording: time of the last record, ns */
+
+  /* Recording: trace file, from hdAccessTraceOpen.  A full log is handed
+     to the writer thread, and recording goes on in the spare */
+  FILE    *trace;
+  uint32_t ntraced;            /* Records written to it */
+  HD_ACCESS_RECORD *userLog;   /* log, from hdAccessRecordInit */
+  HD_ACCESS_RECORD *spare;     /* Free buffer, NULL while it is written */
+  HD_ACCESS_RECORD *writing;   /* Buffer handed to the writer */
+  uint32_t nwriting;
+  int32_t  writerRun;
+  pthread_t writer;
+  pthread_cond_t traceCond;
+
+  /* Replay: attach until the first mark (hdAccessReplayAttachInit) */
+  uint32_t attach;
+  uint32_t start;              /* First mark */
+  HD_ACCESS_RECORD *prev;      /* Last record replayed */
+
+  /* Address windows, from busToLocalAdrs */
+  int32_t  nmaps;
+  struct
+  {
+    int32_t   am;
+    uint32_t  vme;
+    uintptr_t local;
+  } map[HD_ACCESS_MAX_MAPS];
+  uint32_t scratch[HD_ACCESS_MAX_MAPS][sizeof(HD) >> 2];  /* Replay windows */
+
+  /* Pending block transfer */
+  unsigned long dmaLocal;
+} HD_ACCESS_RECORDER;
+
+int32_t hdAccessRecordInit(HD_ACCESS_RECORDER *rec, const HD_ACCESS_OPS *inner,
+			   HD_ACCESS_RECORD *log, uint32_t size, HD_ACCESS_OPS *ops);
+int32_t hdAccessReplayInit(HD_ACCESS_RECORDER *rec, HD_ACCESS_RECORD *log,
+			   uint32_t n, HD_ACCESS_OPS *ops);
+int32_t hdAccessReplayAttachInit(HD_ACCESS_RECORDER *rec, HD_ACCESS_RECORD *log,
+				 uint32_t n, HD_ACCESS_OPS *ops);
+uint32_t hdAccessRecordSpan(const HD_ACCESS_RECORD *r);
+
+/* Trace file: header, then the records (native byte order) */
+#define HD_ACCESS_TRACE_MAGIC    0x48445452  /* "HDTR" */
+#define HD_ACCESS_TRACE_VERSION  2
+
+typedef struct hd_access_trace_header_struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t nrecords;
+  uint32_t ndropped;
+  int64_t  started;            /* Unix time */
+  char     host[32];
+} HD_ACCESS_TRACE_HEADER;
+
+int32_t hdAccessTraceOpen(HD_ACCESS_RECORDER *rec, const char *filename);
+int32_t hdAccessTraceClose(HD_ACCESS_RECORDER *rec);
+int32_t hdAccessTraceLoad(const char *filename, HD_ACCESS_TRACE_HEADER *header,
+			  HD_ACCESS_RECORD **log);
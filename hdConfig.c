@@ -0,0 +1,311 @@
+/* Module: hdConfig.c
+ *
+ * Description: Helicity Decoder Configuration File
+ *              Load a configuration file, and apply it by writing only the
+ *              registers that differ from the module.
+ *
+ * Author:
+ *        Bryan Moffit
+ *        JLab Data Acquisition Group
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "jvme.h"
+#include "hdConfig.h"
+
+#define HD_CONFIG_MAX_VALUES 5
+
+#define U8  0xFF
+#define U16 0xFFFF
+#define U32 0xFFFFFFFF
+
+/* Largest value that fits each HD_CONFIG field.  The hdLib routines check
+   the values further when the configuration is applied. */
+static const struct
+{
+  const char *key;
+  uint32_t    bit;
+  int32_t     nvalues;
+  uint32_t    max[HD_CONFIG_MAX_VALUES];
+} hdConfigKeys[] =
+  {
+    {"HD_SIGNAL_SOURCES",     HD_CONFIG_SIGNAL_SOURCES,     3, {U8, U8, U8}},
+    {"HD_HELICITY_SOURCE",    HD_CONFIG_HELICITY_SOURCE,    3, {U8, U8, U8}},
+    {"HD_HELICITY_INVERSION", HD_CONFIG_HELICITY_INVERSION, 3, {U8, U8, U8}},
+    {"HD_BLOCKLEVEL",         HD_CONFIG_BLOCKLEVEL,         1, {U8}},
+    {"HD_PROC_DELAY",         HD_CONFIG_PROC_DELAY,         2, {U16, U16}},
+    {"HD_TSETTLE_FILTER",     HD_CONFIG_TSETTLE_FILTER,     1, {7}},
+    {"HD_GENERATOR",          HD_CONFIG_GENERATOR,          5, {U8, U8, U16, U32, U32}},
+    {"HD_GENERATOR_ENABLE",   HD_CONFIG_GENERATOR_ENABLE,   1, {1}},
+    {"HD_TEST_TRIGGER",       HD_CONFIG_TEST_TRIGGER,       2, {1, U32}},
+    {"HD_DELAY_TEST",         HD_CONFIG_DELAY_TEST,         2, {U8, 1}},
+    {"HD_PROCESSED_OUTPUT",   HD_CONFIG_PROCESSED_OUTPUT,   1, {1}},
+    {"HD_BERR",               HD_CONFIG_BERR,               1, {1}},
+  };
+#undef U8
+#undef U16
+#undef U32
+#define HD_CONFIG_NKEYS (sizeof(hdConfigKeys) / sizeof(hdConfigKeys[0]))
+
+static void
+hdConfigSetField(HD_CONFIG *c, uint32_t bit, const uint32_t *v)
+{
+  switch(bit)
+    {
+    case HD_CONFIG_SIGNAL_SOURCES:
+      c->clkSrc = v[0]; c->trigSrc = v[1]; c->srSrc = v[2];
+      break;
+    case HD_CONFIG_HELICITY_SOURCE:
+      c->helSrc = v[0]; c->helInput = v[1]; c->helOutput = v[2];
+      break;
+    case HD_CONFIG_HELICITY_INVERSION:
+      c->invFiberInput = v[0]; c->invCuInput = v[1]; c->invCuOutput = v[2];
+      break;
+    case HD_CONFIG_BLOCKLEVEL:
+      c->blocklevel = v[0];
+      break;
+    case HD_CONFIG_PROC_DELAY:
+      c->dataInputDelay = v[0]; c->triggerLatencyDelay = v[1];
+      break;
+    case HD_CONFIG_TSETTLE_FILTER:
+      c->tsettleFilter = v[0];
+      break;
+    case HD_CONFIG_GENERATOR:
+      c->genPattern = v[0]; c->genWindowDelay = v[1];
+      c->genSettleTime = v[2]; c->genStableTime = v[3]; c->genSeed = v[4];
+      break;
+    case HD_CONFIG_GENERATOR_ENABLE:
+      c->genEnable = v[0] ? 1 : 0;
+      break;
+    case HD_CONFIG_TEST_TRIGGER:
+      c->testTriggerEnable = v[0] ? 1 : 0; c->testTriggerDelay = v[1];
+      break;
+    case HD_CONFIG_DELAY_TEST:
+      c->delayTestSelection = v[0]; c->delayTestEnable = v[1] ? 1 : 0;
+      break;
+    case HD_CONFIG_PROCESSED_OUTPUT:
+      c->processedOutput = v[0] ? 1 : 0;
+      break;
+    case HD_CONFIG_BERR:
+      c->berr = v[0] ? 1 : 0;
+      break;
+    }
+}
+
+/**
+ * @ingroup Config
+ * @brief Load a configuration file
+ *
+ *   See hdConfig.h for the format.  A setting given more than once takes
+ *   the last value.  A value too large for its field is an error, rather
+ *   than being truncated.  Nothing is written to the module.
+ *
+ * @param filename Configuration file
+ * @param config Where to put the configuration
+ *
+ * @return Number of settings loaded if successful, otherwise ERROR
+ */
+int32_t
+hdConfigLoad(const char *filename, HD_CONFIG *config)
+{
+  FILE *f;
+  char line[256], *key, *tok, *end, *save;
+  uint32_t v[HD_CONFIG_MAX_VALUES];
+  unsigned long value;
+  int32_t lineno = 0, ikey, ival, nset = 0, rval = OK, range;
+
+  if(config == NULL)
+    {
+      printf("%s: ERROR: Invalid config pointer\n", __func__);
+      return ERROR;
+    }
+
+  f = fopen(filename, "r");
+  if(f == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      return ERROR;
+    }
+
+  memset(config, 0, sizeof(HD_CONFIG));
+
+  while(fgets(line, sizeof(line), f) != NULL)
+    {
+      lineno++;
+
+      if((tok = strchr(line, '#')) != NULL)
+	*tok = '\0';
+
+      key = strtok_r(line, " \t\r\n", &save);
+      if(key == NULL)
+	continue;
+
+      for(ikey = 0; ikey < HD_CONFIG_NKEYS; ikey++)
+	if(strcasecmp(key, hdConfigKeys[ikey].key) == 0)
+	  break;
+
+      if(ikey == HD_CONFIG_NKEYS)
+	{
+	  printf("%s: ERROR: %s:%d: Unknown setting %s\n",
+		 __func__, filename, lineno, key);
+	  rval = ERROR;
+	  continue;
+	}
+
+      range = 1;
+      for(ival = 0; ival < hdConfigKeys[ikey].nvalues; ival++)
+	{
+	  tok = strtok_r(NULL, " \t\r\n", &save);
+	  if(tok == NULL)
+	    break;
+	  value = strtoul(tok, &end, 0);
+	  if(*end != '\0')
+	    break;
+	  if(value > hdConfigKeys[ikey].max[ival])
+	    range = 0;
+	  v[ival] = value;
+	}
+
+      if((ival != hdConfigKeys[ikey].nvalues) ||
+	 (strtok_r(NULL, " \t\r\n", &save) != NULL))
+	{
+	  printf("%s: ERROR: %s:%d: %s takes %d numeric value(s)\n",
+		 __func__, filename, lineno, key, hdConfigKeys[ikey].nvalues);
+	  rval = ERROR;
+	  continue;
+	}
+
+      if(!range)
+	{
+	  printf("%s: ERROR: %s:%d: %s value out of range (max",
+		 __func__, filename, lineno, key);
+	  for(ival = 0; ival < hdConfigKeys[ikey].nvalues; ival++)
+	    printf(" %u", hdConfigKeys[ikey].max[ival]);
+	  printf(")\n");
+	  rval = ERROR;
+	  continue;
+	}
+
+      hdConfigSetField(config, hdConfigKeys[ikey].bit, v);
+      config->present |= hdConfigKeys[ikey].bit;
+      nset++;
+    }
+
+  fclose(f);
+
+  return (rval == OK) ? nset : ERROR;
+}
+
+/**
+ * @ingroup Config
+ * @brief Apply a configuration to the module
+ *
+ *   The settings are staged with the hdLib routines (hdConfigBegin), and
+ *   committed with hdConfigCommit, which reads the staged registers under
+ *   the same lock as the writes, so only the registers that differ are
+ *   written.  An unchanged configuration costs one read per register and
+ *   no writes.  The routines check the values as usual; if one fails,
+ *   nothing is written.
+ *
+ * @param config Configuration, from hdConfigLoad
+ *
+ * @return Number of register writes if successful, otherwise ERROR
+ */
+int32_t
+hdConfigApply(const HD_CONFIG *config)
+{
+  uint32_t p;
+  int32_t rval = OK;
+
+  if(config == NULL)
+    {
+      printf("%s: ERROR: Invalid config pointer\n", __func__);
+      return ERROR;
+    }
+  p = config->present;
+
+  if(hdConfigBegin() != OK)
+    return ERROR;
+
+  if(p & HD_CONFIG_SIGNAL_SOURCES)
+    rval |= hdSetSignalSources(config->clkSrc, config->trigSrc, config->srSrc);
+
+  if(p & HD_CONFIG_HELICITY_SOURCE)
+    rval |= hdSetHelicitySource(config->helSrc, config->helInput,
+				config->helOutput);
+
+  if(p & HD_CONFIG_HELICITY_INVERSION)
+    rval |= hdSetHelicityInversion(config->invFiberInput, config->invCuInput,
+				   config->invCuOutput);
+
+  if(p & HD_CONFIG_BLOCKLEVEL)
+    rval |= hdSetBlocklevel(config->blocklevel);
+
+  if(p & HD_CONFIG_PROC_DELAY)
+    rval |= hdSetProcDelay(config->dataInputDelay,
+			   config->triggerLatencyDelay);
+
+  if(p & HD_CONFIG_TSETTLE_FILTER)
+    rval |= hdSetTSettleFilter(config->tsettleFilter);
+
+  if(p & HD_CONFIG_GENERATOR)
+    rval |= hdHelicityGeneratorConfig(config->genPattern,
+				      config->genWindowDelay,
+				      config->genSettleTime,
+				      config->genStableTime, config->genSeed);
+
+  if(p & HD_CONFIG_GENERATOR_ENABLE)
+    rval |= config->genEnable ? hdEnableHelicityGenerator() :
+      hdDisableHelicityGenerator();
+
+  if(p & HD_CONFIG_TEST_TRIGGER)
+    {
+      rval |= hdSetInternalTestTriggerDelay(config->testTriggerDelay);
+      rval |= config->testTriggerEnable ? hdEnableInternalTestTrigger(0) :
+	hdDisableInternalTestTrigger(0);
+    }
+
+  if(p & HD_CONFIG_DELAY_TEST)
+    rval |= hdDelayTestSetup(config->delayTestSelection,
+			     config->delayTestEnable);
+
+  if(p & HD_CONFIG_PROCESSED_OUTPUT)
+    rval |= hdSetProcessedOutput(config->processedOutput);
+
+  if(p & HD_CONFIG_BERR)
+    rval |= hdSetBERR(config->berr);
+
+  if(rval != OK)
+    {
+      printf("%s: ERROR: Invalid configuration.  Nothing written.\n",
+	     __func__);
+      hdConfigAbort();
+      return ERROR;
+    }
+
+  return hdConfigCommit();
+}
+
+/**
+ * @ingroup Config
+ * @brief Load a configuration file and apply it to the module
+ *
+ * @param filename Configuration file
+ *
+ * @return Number of register writes if successful, otherwise ERROR
+ */
+int32_t
+hdConfigApplyFile(const char *filename)
+{
+  HD_CONFIG config;
+
+  if(hdConfigLoad(filename, &config) == ERROR)
+    return ERROR;
+
+  return hdConfigApply(&config);
+}
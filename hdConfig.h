@@ -0,0 +1,84 @@
+#pragma once
+/******************************************************************************
+ *
+ *  hdConfig.h -  Configuration file for the JLab helicity decoder.
+ *
+ *  One setting per line, values as in the hdLib routines (decimal, or hex
+ *  with 0x).  '#' starts a comment.  Settings not in the file are left as
+ *  they are in the module.
+ *
+ *    HD_SIGNAL_SOURCES      <clock> <trigger> <syncreset>
+ *    HD_HELICITY_SOURCE     <source> <input> <output>
+ *    HD_HELICITY_INVERSION  <fiber input> <copper input> <copper output>
+ *    HD_BLOCKLEVEL          <block level>
+ *    HD_PROC_DELAY          <data input delay> <trigger latency delay>
+ *    HD_TSETTLE_FILTER      <code 0-7, as hdSetTSettleFilter>
+ *    HD_GENERATOR           <pattern> <window delay> <settle> <stable> <seed>
+ *    HD_GENERATOR_ENABLE    <0|1>
+ *    HD_TEST_TRIGGER        <0|1> <delay>
+ *    HD_DELAY_TEST          <pair delay selection> <0|1>
+ *    HD_PROCESSED_OUTPUT    <0|1>
+ *    HD_BERR                <0|1>
+ *
+ */
+
+#include <stdint.h>
+#include "hdLib.h"
+
+/* HD_CONFIG.present bits */
+#define HD_CONFIG_SIGNAL_SOURCES      (1 << 0)
+#define HD_CONFIG_HELICITY_SOURCE     (1 << 1)
+#define HD_CONFIG_HELICITY_INVERSION  (1 << 2)
+#define HD_CONFIG_BLOCKLEVEL          (1 << 3)
+#define HD_CONFIG_PROC_DELAY          (1 << 4)
+#define HD_CONFIG_TSETTLE_FILTER      (1 << 5)
+#define HD_CONFIG_GENERATOR           (1 << 6)
+#define HD_CONFIG_GENERATOR_ENABLE    (1 << 7)
+#define HD_CONFIG_TEST_TRIGGER        (1 << 8)
+#define HD_CONFIG_DELAY_TEST          (1 << 9)
+#define HD_CONFIG_PROCESSED_OUTPUT    (1 << 10)
+#define HD_CONFIG_BERR                (1 << 11)
+
+typedef struct hd_config_struct
+{
+  uint32_t present;          /* HD_CONFIG_* settings given */
+
+  uint8_t  clkSrc;
+  uint8_t  trigSrc;
+  uint8_t  srSrc;
+
+  uint8_t  helSrc;
+  uint8_t  helInput;
+  uint8_t  helOutput;
+
+  uint8_t  invFiberInput;
+  uint8_t  invCuInput;
+  uint8_t  invCuOutput;
+
+  uint8_t  blocklevel;
+
+  uint16_t dataInputDelay;
+  uint16_t triggerLatencyDelay;
+
+  uint8_t  tsettleFilter;
+
+  uint8_t  genPattern;
+  uint8_t  genWindowDelay;
+  uint16_t genSettleTime;
+  uint32_t genStableTime;
+  uint32_t genSeed;
+  uint8_t  genEnable;
+
+  uint8_t  testTriggerEnable;
+  uint32_t testTriggerDelay;
+
+  uint8_t  delayTestSelection;
+  int8_t   delayTestEnable;
+
+  int8_t   processedOutput;
+  uint8_t  berr;
+} HD_CONFIG;
+
+int32_t hdConfigLoad(const char *filename, HD_CONFIG *config);
+int32_t hdConfigApply(const HD_CONFIG *config);
+int32_t hdConfigApplyFile(const char *filename);
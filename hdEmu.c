@@ -0,0 +1,724 @@
+/* Module: hdEmu.c
+ *
+ * Description: Helicity Decoder Emulator
+ *              Software model of the module, as a register access backend.
+ *              See hdEmu.h for what is modeled.
+ *
+ * Author:
+ *        Bryan Moffit
+ *        JLab Data Acquisition Group
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "hdEmu.h"
+
+/**
+ * @defgroup Emulator Emulator
+ */
+
+#define HD_EMU_EVENT_WORDS  (4 + HD_DECODER_NWORDS)
+#define HD_EMU_MAX_WINDOWS  (1 << 20)  /* Per time step */
+
+#define EMUREG(_off) (((volatile uint32_t *)&emu->reg)[(_off) >> 2])
+
+static const uint8_t hdEmuPatternSeq[4][8] =
+  {
+    {0, 1},                    /* Pair */
+    {0, 1, 1, 0},              /* Quartet */
+    {0, 1, 1, 0, 1, 0, 0, 1},  /* Octet */
+    {0, 1}                     /* Toggle */
+  };
+static const uint32_t hdEmuPatternLength[4] = {2, 4, 8, 2};
+
+/* 30 bit pseudorandom helicity sequence */
+static uint32_t
+hdEmuRanbit(uint32_t *s)
+{
+  uint32_t bit7 = (*s >> 6) & 1, bit28 = (*s >> 27) & 1;
+  uint32_t bit29 = (*s >> 28) & 1, bit30 = (*s >> 29) & 1;
+  uint32_t newbit = bit30 ^ bit29 ^ bit28 ^ bit7;
+
+  *s = ((*s << 1) | newbit) & HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK;
+
+  return newbit;
+}
+
+static uint64_t
+hdEmuWindowNs(HD_EMU *emu)
+{
+  uint64_t windowNs = HD_GENERATOR_TICK_NS *
+    ((uint64_t)((emu->reg.gen_config1 & HD_HELICITY_CONFIG1_HELICITY_SETTLE_MASK) >> 16) +
+     (emu->reg.gen_config2 & HD_HELICITY_CONFIG2_STABLE_TIME_MASK));
+
+  return (windowNs != 0) ? windowNs : HD_GENERATOR_TICK_NS;
+}
+
+/* Start the next helicity window.  Returns its PATTERN_SYNC, and PAIR_SYNC
+   in bit 1 */
+static uint32_t
+hdEmuGenWindow(HD_EMU *emu, HD_EMU_GEN *g, uint64_t windowNs)
+{
+  uint32_t pattern = emu->reg.gen_config1 & HD_HELICITY_CONFIG1_PATTERN_MASK;
+  uint32_t pos = g->windowCount % hdEmuPatternLength[pattern];
+  uint32_t patternSync = (pos == 0), pairSync = ((pos & 1) == 0);
+
+  if(patternSync)
+    {
+      if(pattern == HD_HELICITY_CONFIG1_PATTERN_TOGGLE)
+	g->patternHelicity ^= 1;
+      else
+	g->patternHelicity = hdEmuRanbit(&g->shiftReg);
+      g->patternCount++;
+      g->patternHelicityHistory =
+	(g->patternHelicityHistory << 1) | g->patternHelicity;
+    }
+  if(pairSync)
+    g->pairCount++;
+
+  g->windowStart += windowNs;
+  g->helicity = g->patternHelicity ^ hdEmuPatternSeq[pattern][pos];
+  g->patternSyncHistory = (g->patternSyncHistory << 1) | patternSync;
+  g->pairSyncHistory = (g->pairSyncHistory << 1) | pairSync;
+  g->helicityHistory = (g->helicityHistory << 1) | g->helicity;
+  g->windowCount++;
+
+  return patternSync | (pairSync << 1);
+}
+
+/* Next window of the internal generator: scalers, and the test trigger */
+static void
+hdEmuWindow(HD_EMU *emu, uint64_t windowNs)
+{
+  uint32_t sync = hdEmuGenWindow(emu, &emu->gen, windowNs);
+  uint32_t patternSync = sync & 1, pairSync = sync >> 1;
+
+  emu->past[emu->npast++ % HD_EMU_PAST_WINDOWS] = emu->gen;
+
+  emu->reg.helicity_scaler[HD_HELICITY_SCALER_TSTABLE_FALLING]++;
+  emu->reg.helicity_scaler[HD_HELICITY_SCALER_TSTABLE_RISING]++;
+  emu->reg.helicity_scaler[HD_HELICITY_SCALER_PATTERN_SYNC] += patternSync;
+  emu->reg.helicity_scaler[HD_HELICITY_SCALER_PAIR_SYNC] += pairSync;
+
+  if(patternSync && (emu->reg.ctrl1 & HD_CTRL1_INT_TESTTRIG_ENABLE))
+    {
+      emu->testTrigPending = 1;
+      emu->testTrigTime = emu->gen.windowStart + HD_CLOCK_NS *
+	(uint64_t)(emu->reg.int_testtrig_delay & HD_INT_TESTTRIG_DELAY_MASK);
+    }
+}
+
+/* Helicity generator state at time t: from the past windows, or run ahead
+   of the current one */
+static void
+hdEmuGenAt(HD_EMU *emu, int64_t t, HD_EMU_GEN *g)
+{
+  uint64_t windowNs = hdEmuWindowNs(emu);
+  uint32_t ipast, npast = (emu->npast < HD_EMU_PAST_WINDOWS) ?
+    emu->npast : HD_EMU_PAST_WINDOWS;
+
+  if(!(emu->reg.ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE) ||
+     (t >= (int64_t)emu->gen.windowStart) || (npast == 0))
+    {
+      *g = emu->gen;
+      if(emu->reg.ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE)
+	while(t >= (int64_t)(g->windowStart + windowNs))
+	  hdEmuGenWindow(emu, g, windowNs);
+      return;
+    }
+
+  for(ipast = 1; ipast <= npast; ipast++)
+    {
+      *g = emu->past[(emu->npast - ipast) % HD_EMU_PAST_WINDOWS];
+      if((int64_t)g->windowStart <= t)
+	return;
+    }
+}
+
+static void hdEmuEvent(HD_EMU *emu);
+
+/* Advance the time: helicity windows, and the test triggers on the way */
+static void
+hdEmuSetTime(HD_EMU *emu, uint64_t ns)
+{
+  uint64_t end = emu->now + ns, windowNs, next;
+
+  if(!(emu->reg.ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE))
+    {
+      emu->gen.windowStart = end;
+      emu->testTrigPending = 0;
+      emu->now = end;
+      return;
+    }
+
+  windowNs = hdEmuWindowNs(emu);
+
+  /* After a long idle time, only the last windows matter */
+  if((end - emu->gen.windowStart) / windowNs > HD_EMU_MAX_WINDOWS)
+    {
+      emu->gen.windowStart = end - HD_EMU_MAX_WINDOWS * windowNs;
+      emu->testTrigPending = 0;
+    }
+
+  for(;;)
+    {
+      next = emu->gen.windowStart + windowNs;
+      if(emu->testTrigPending && (emu->testTrigTime < next))
+	{
+	  if(emu->testTrigTime > end)
+	    break;
+	  if(emu->testTrigTime > emu->now)
+	    emu->now = emu->testTrigTime;
+	  emu->testTrigPending = 0;
+	  hdEmuEvent(emu);
+	  continue;
+	}
+
+      if(next > end)
+	break;
+      emu->now = next;
+      hdEmuWindow(emu, windowNs);
+    }
+
+  emu->now = end;
+}
+
+static uint32_t
+hdEmuFifoFree(HD_EMU *emu)
+{
+  return HD_EMU_FIFO_WORDS - (emu->fifoHead - emu->fifoTail);
+}
+
+static void
+hdEmuFifoPut(HD_EMU *emu, uint32_t word)
+{
+  emu->fifo[emu->fifoHead++ % HD_EMU_FIFO_WORDS] = word;
+}
+
+/* Pop one data word, keeping the events / blocks on board.  Decoder data
+   words can look like any data type, so the block boundaries are kept
+   aside, not decoded from the data */
+static uint32_t
+hdEmuFifoGet(HD_EMU *emu)
+{
+  uint32_t word, iblock;
+
+  if(emu->fifoHead == emu->fifoTail)
+    return HD_DUMMY_WORD;
+
+  word = emu->fifo[emu->fifoTail++ % HD_EMU_FIFO_WORDS];
+
+  iblock = emu->fifoBlockTail % HD_EMU_FIFO_BLOCKS;
+  if(++emu->readWords == emu->fifoBlock[iblock].nwords)
+    {
+      emu->blocksOnBoard--;
+      emu->eventsOnBoard -= emu->fifoBlock[iblock].nevents;
+      emu->fifoBlockTail++;
+      emu->readWords = 0;
+    }
+
+  return word;
+}
+
+static uint32_t
+hdEmuSlot(HD_EMU *emu)
+{
+  return (emu->vmeA24 >> 19) & 0x1F;
+}
+
+/* Close the block being built, and move it to the FIFO.  Events are an
+   even number of words, so blocks never need a filler word */
+static void
+hdEmuCloseBlock(HD_EMU *emu)
+{
+  uint32_t iword, nwords = emu->blockWords + 2;
+  uint32_t iblock = emu->fifoBlockHead++ % HD_EMU_FIFO_BLOCKS;
+
+  hdEmuFifoPut(emu, HD_DATA_TYPE_DEFINE | HD_DATA_BLOCK_HEADER |
+	       (hdEmuSlot(emu) << 22) | ((emu->blockNumber & 0x3FF) << 8) |
+	       (emu->blockEvents & 0xFF));
+  for(iword = 0; iword < emu->blockWords; iword++)
+    hdEmuFifoPut(emu, emu->block[iword]);
+  hdEmuFifoPut(emu, HD_DATA_TYPE_DEFINE | HD_DATA_BLOCK_TRAILER |
+	       (hdEmuSlot(emu) << 22) | nwords);
+
+  emu->fifoBlock[iblock].nwords = nwords;
+  emu->fifoBlock[iblock].nevents = emu->blockEvents;
+  emu->blocksOnBoard++;
+  emu->blockNumber++;
+  emu->blockWords = 0;
+  emu->blockEvents = 0;
+}
+
+/* Block level, limited to what fits in the block buffer */
+static uint32_t
+hdEmuBlocklevel(HD_EMU *emu)
+{
+  uint32_t blocklevel = emu->reg.blk_size & HD_BLOCKLEVEL_MASK;
+  uint32_t max = (sizeof(emu->block) / sizeof(emu->block[0])) / HD_EMU_EVENT_WORDS;
+
+  if(blocklevel == 0)
+    blocklevel = 1;
+  if(blocklevel > max)
+    blocklevel = max;
+
+  return blocklevel;
+}
+
+/* A trigger at the current time.  The event holds the helicity input at
+   trigger time + trigger latency delay - data input delay */
+static void
+hdEmuEvent(HD_EMU *emu)
+{
+  uint32_t *ev, blocklevel = hdEmuBlocklevel(emu);
+  uint32_t latency = emu->reg.delay & HD_DELAY_TRIGGER_MASK;
+  uint32_t dataDelay = (emu->reg.delay & HD_DELAY_DATA_MASK) >> 16;
+  uint64_t time;
+  HD_EMU_GEN g;
+
+  emu->reg.trig1_scaler++;
+
+  if((emu->reg.ctrl2 & (HD_CTRL2_GO | HD_CTRL2_EVENT_BUILD_ENABLE)) !=
+     (HD_CTRL2_GO | HD_CTRL2_EVENT_BUILD_ENABLE))
+    return;
+
+  /* No room for another block: the trigger is lost while busy */
+  if((emu->reg.ctrl2 & HD_CTRL2_FORCE_BUSY) ||
+     (hdEmuFifoFree(emu) < blocklevel * HD_EMU_EVENT_WORDS + 3))
+    {
+      emu->busyLatched = 1;
+      return;
+    }
+
+  hdEmuGenAt(emu, (int64_t)emu->now +
+	     HD_CLOCK_NS * ((int64_t)latency - (int64_t)dataDelay), &g);
+
+  emu->eventNumber++;
+  time = emu->now / HD_CLOCK_NS;
+
+  ev = &emu->block[emu->blockWords];
+  ev[0] = HD_DATA_TYPE_DEFINE | HD_DATA_EVENT_HEADER | (hdEmuSlot(emu) << 22) |
+    ((time & 0x3FF) << 12) | (emu->eventNumber & HD_DATA_EVENT_NUMBER_MASK);
+  ev[1] = HD_DATA_TYPE_DEFINE | HD_DATA_TRIGGER_TIME | (time & HD_DATA_TRIGGER_TIME_MASK);
+  ev[2] = (time >> 24) & HD_DATA_TRIGGER_TIME_MASK;
+  ev[3] = HD_DATA_TYPE_DEFINE | HD_DATA_DECODER_HEADER | HD_DECODER_NWORDS;
+  ev[4 + HD_DECODER_WORD_SHIFT_REG] = g.shiftReg;
+  ev[4 + HD_DECODER_WORD_WINDOW_COUNT] = g.windowCount;
+  ev[4 + HD_DECODER_WORD_PATTERN_COUNT] = g.patternCount;
+  ev[4 + HD_DECODER_WORD_PAIR_COUNT] = g.pairCount;
+  ev[4 + HD_DECODER_WORD_PATTERN_SYNC_HISTORY] = g.patternSyncHistory;
+  ev[4 + HD_DECODER_WORD_PAIR_SYNC_HISTORY] = g.pairSyncHistory;
+  ev[4 + HD_DECODER_WORD_HELICITY_HISTORY] = g.helicityHistory;
+  ev[4 + HD_DECODER_WORD_PATTERN_HELICITY_HISTORY] = g.patternHelicityHistory;
+
+  emu->blockWords += HD_EMU_EVENT_WORDS;
+  emu->blockEvents++;
+  emu->eventsOnBoard++;
+
+  if(emu->blockEvents >= blocklevel)
+    hdEmuCloseBlock(emu);
+}
+
+/* External trigger */
+static void
+hdEmuTrig(HD_EMU *emu)
+{
+  hdEmuSetTime(emu, emu->triggerPeriodNs);
+  hdEmuEvent(emu);
+}
+
+static void
+hdEmuReset(HD_EMU *emu)
+{
+  uint32_t version = emu->reg.version;
+
+  memset(&emu->reg, 0, sizeof(HD));
+  emu->reg.version = version;
+
+  emu->fifoHead = emu->fifoTail = 0;
+  emu->fifoBlockHead = emu->fifoBlockTail = emu->readWords = 0;
+  emu->blockWords = emu->blockEvents = emu->blockNumber = 0;
+  emu->eventNumber = emu->eventsOnBoard = emu->blocksOnBoard = 0;
+  emu->berrAsserted = emu->busyLatched = emu->forceTrailerStatus = 0;
+  memset(&emu->gen, 0, sizeof(HD_EMU_GEN));
+  emu->gen.windowStart = emu->now;
+  emu->npast = 0;
+  emu->testTrigPending = 0;
+}
+
+static uint32_t
+hdEmuCsr(HD_EMU *emu)
+{
+  uint32_t csr = HD_CSR_SYSTEM_CLK_PLL_LOCKED | HD_CSR_LOCAL_CLK_PLL_LOCKED;
+  uint32_t busy = (emu->reg.ctrl2 & HD_CTRL2_FORCE_BUSY) ||
+    (hdEmuFifoFree(emu) < hdEmuBlocklevel(emu) * HD_EMU_EVENT_WORDS + 3);
+
+  if(emu->blocksOnBoard)
+    csr |= HD_CSR_BLOCK_READY;
+  if(emu->fifoHead == emu->fifoTail)
+    csr |= HD_CSR_EMPTY;
+  if(emu->berrAsserted)
+    csr |= HD_CSR_BERR_ASSERTED;
+  if(busy)
+    csr |= HD_CSR_BUSY;
+  if(busy || emu->busyLatched)
+    csr |= HD_CSR_BUSY_LATCHED;
+
+  return csr | emu->forceTrailerStatus;
+}
+
+/* Delay buffer addresses: write - read = delay, 4096 deep */
+static uint32_t
+hdEmuConfirm(HD_EMU *emu, uint32_t delay)
+{
+  uint32_t wraddr = (emu->now / HD_CLOCK_NS) & 0xFFF;
+
+  if(delay == 0)
+    return 0;
+
+  return (wraddr << 16) | ((wraddr - delay) & HD_CONFIRM_READ_ADDR_MASK);
+}
+
+static uint32_t
+hdEmuReadReg(HD_EMU *emu, uint32_t offset)
+{
+  switch(offset)
+    {
+    case offsetof(HD, csr):
+      return hdEmuCsr(emu);
+
+    case offsetof(HD, evt_count):
+      return emu->eventsOnBoard & HD_EVENTS_ON_BOARD_MASK;
+
+    case offsetof(HD, blk_count):
+      return emu->blocksOnBoard & HD_BLOCKS_ON_BOARD_MASK;
+
+    case offsetof(HD, recovered_shift_reg):
+      return (emu->reg.ctrl1 & HD_CTRL1_USE_INT_HELICITY) ? emu->gen.shiftReg : 0;
+
+    case offsetof(HD, generator_shift_reg):
+      return emu->gen.shiftReg;
+
+    case offsetof(HD, latency_confirm):
+      return hdEmuConfirm(emu, emu->reg.delay & HD_DELAY_TRIGGER_MASK);
+
+    case offsetof(HD, delay_confirm):
+      return hdEmuConfirm(emu, (emu->reg.delay & HD_DELAY_DATA_MASK) >> 16);
+
+    case offsetof(HD, helicity_history1):
+      return emu->gen.patternSyncHistory;
+
+    case offsetof(HD, helicity_history2):
+      return emu->gen.pairSyncHistory;
+
+    case offsetof(HD, helicity_history3):
+      return emu->gen.helicityHistory;
+
+    case offsetof(HD, helicity_history4):
+      return emu->gen.patternHelicityHistory;
+
+    default:
+      return EMUREG(offset);
+    }
+}
+
+static void
+hdEmuWriteReg(HD_EMU *emu, uint32_t offset, uint32_t value)
+{
+  switch(offset)
+    {
+    case offsetof(HD, csr):
+      if(value & (HD_CSR_HARD_RESET | HD_CSR_SOFT_RESET))
+	hdEmuReset(emu);
+      if(value & HD_CSR_BUSY_LATCHED)
+	emu->busyLatched = 0;
+      if(value & HD_CSR_SYNC_RESET_PULSE)
+	{
+	  emu->reg.sync_scaler++;
+	  emu->eventNumber = 0;
+	  emu->blockNumber = 0;
+	}
+      if(value & HD_CSR_TRIGGER_PULSE)
+	hdEmuTrig(emu);
+      if(value & HD_CSR_FORCE_BLOCK_TRAILER)
+	{
+	  if(emu->blockEvents)
+	    {
+	      hdEmuCloseBlock(emu);
+	      emu->forceTrailerStatus = HD_CSR_FORCE_BLOCK_TRAILER_SUCCESS;
+	    }
+	  else
+	    emu->forceTrailerStatus = HD_CSR_FORCE_BLOCK_TRAILER_FAILED;
+	}
+      break;
+
+    case offsetof(HD, ctrl2):
+      if((value & HD_CTRL2_INT_HELICITY_ENABLE) &&
+	 !(emu->reg.ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE))
+	{
+	  /* Generator starts from its seed */
+	  memset(&emu->gen, 0, sizeof(HD_EMU_GEN));
+	  emu->gen.shiftReg = emu->reg.gen_config3 & HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK;
+	  emu->gen.windowStart = emu->now;
+	  emu->past[0] = emu->gen;
+	  emu->npast = 1;
+	}
+      emu->reg.ctrl2 = value;
+      break;
+
+    case offsetof(HD, delay):
+      emu->reg.delay = value & (HD_DELAY_TRIGGER_MASK | HD_DELAY_DATA_MASK);
+      if(value & HD_DELAY_TRIGGER_MASK)
+	emu->reg.delay |= HD_DELAY_TRIGGER_CONFIGURED;
+      if(value & HD_DELAY_DATA_MASK)
+	emu->reg.delay |= HD_DELAY_DATA_CONFIGURED;
+      break;
+
+    case offsetof(HD, delay_error_count):
+      if(value & HD_DELAY_ERROR_RESET)
+	emu->reg.delay_error_count = 0;
+      break;
+
+    case offsetof(HD, ctrl1):
+    case offsetof(HD, adr32):
+    case offsetof(HD, intr):
+    case offsetof(HD, blk_size):
+    case offsetof(HD, gen_config1):
+    case offsetof(HD, gen_config2):
+    case offsetof(HD, gen_config3):
+    case offsetof(HD, int_testtrig_delay):
+    case offsetof(HD, delay_setup):
+      EMUREG(offset) = value;
+      break;
+
+    default:  /* Read only */
+      break;
+    }
+}
+
+static int32_t
+hdEmuRegOffset(HD_EMU *emu, volatile void *addr, uint32_t *offset)
+{
+  uintptr_t a = (uintptr_t)addr, base = (uintptr_t)&emu->reg;
+
+  if((a < base) || (a >= base + sizeof(HD)) || (a & 3))
+    return ERROR;
+
+  *offset = a - base;
+  return OK;
+}
+
+static uint32_t
+hdEmuRead32(void *ctx, volatile uint32_t *addr)
+{
+  HD_EMU *emu = (HD_EMU *)ctx;
+  uint32_t offset, value = 0xFFFFFFFF;
+
+  pthread_mutex_lock(&emu->mutex);
+  hdEmuSetTime(emu, emu->accessNs);
+  if(addr == &emu->fifoPort)
+    value = hdEmuFifoGet(emu);
+  else if(hdEmuRegOffset(emu, addr, &offset) == OK)
+    value = hdEmuReadReg(emu, offset);
+  pthread_mutex_unlock(&emu->mutex);
+
+  return value;
+}
+
+static void
+hdEmuWrite32(void *ctx, volatile uint32_t *addr, uint32_t value)
+{
+  HD_EMU *emu = (HD_EMU *)ctx;
+  uint32_t offset;
+
+  pthread_mutex_lock(&emu->mutex);
+  hdEmuSetTime(emu, emu->accessNs);
+  if(hdEmuRegOffset(emu, addr, &offset) == OK)
+    hdEmuWriteReg(emu, offset, value);
+  pthread_mutex_unlock(&emu->mutex);
+}
+
+static int32_t
+hdEmuBusToLocalAdrs(void *ctx, int32_t am, char *vmeAddr, char **localAddr)
+{
+  HD_EMU *emu = (HD_EMU *)ctx;
+
+  if(am == 0x09)
+    {
+      *localAddr = (char *)&emu->fifoPort;
+      return 0;
+    }
+
+  if((uint32_t)(uintptr_t)vmeAddr != emu->vmeA24)
+    return -1;
+
+  *localAddr = (char *)&emu->reg;
+  return 0;
+}
+
+static int32_t
+hdEmuMemProbe(void *ctx, char *addr, int32_t size, char *value)
+{
+  HD_EMU *emu = (HD_EMU *)ctx;
+  uint32_t offset, word;
+
+  if((size != 4) || (hdEmuRegOffset(emu, addr, &offset) != OK))
+    return -1;
+
+  pthread_mutex_lock(&emu->mutex);
+  hdEmuSetTime(emu, emu->accessNs);
+  word = hdEmuReadReg(emu, offset);
+  pthread_mutex_unlock(&emu->mutex);
+
+  memcpy(value, &word, 4);
+  return 0;
+}
+
+static int32_t
+hdEmuDmaConfig(void *ctx, uint32_t addrType, uint32_t dataType, uint32_t sstMode)
+{
+  return 0;
+}
+
+static int32_t
+hdEmuDmaSend(void *ctx, unsigned long localAddr, uint32_t vmeAddr, int32_t nbytes)
+{
+  HD_EMU *emu = (HD_EMU *)ctx;
+
+  pthread_mutex_lock(&emu->mutex);
+  emu->dmaLocal = localAddr;
+  emu->dmaVme = vmeAddr;
+  emu->dmaBytes = nbytes;
+  emu->berrAsserted = 0;
+  pthread_mutex_unlock(&emu->mutex);
+
+  return 0;
+}
+
+/* Block transfers are big endian on the bus.  From the data FIFO, the
+   transfer ends with BERR at the end of the data, if enabled; otherwise
+   the rest is filler words */
+static int32_t
+hdEmuDmaDone(void *ctx)
+{
+  HD_EMU *emu = (HD_EMU *)ctx;
+  volatile uint32_t *dst = (volatile uint32_t *)emu->dmaLocal;
+  uint32_t iword, nwords = emu->dmaBytes >> 2;
+
+  pthread_mutex_lock(&emu->mutex);
+  hdEmuSetTime(emu, emu->accessNs);
+  if((emu->dmaVme >= emu->vmeA24) &&
+     (emu->dmaVme + emu->dmaBytes <= emu->vmeA24 + sizeof(HD)))
+    {
+      uint32_t offset = emu->dmaVme - emu->vmeA24;
+      for(iword = 0; iword < nwords; iword++)
+	dst[iword] = LSWAP(hdEmuReadReg(emu, offset + (iword << 2)));
+    }
+  else
+    {
+      for(iword = 0; (iword < nwords) && (emu->fifoHead != emu->fifoTail); iword++)
+	dst[iword] = LSWAP(hdEmuFifoGet(emu));
+
+      if(iword < nwords)
+	{
+	  if(emu->reg.ctrl1 & HD_CTRL1_BERR_ENABLE)
+	    emu->berrAsserted = 1;
+	  else
+	    for(; iword < nwords; iword++)
+	      dst[iword] = LSWAP(HD_DUMMY_WORD);
+	}
+    }
+  pthread_mutex_unlock(&emu->mutex);
+
+  return iword << 2;
+}
+
+/**
+ * @ingroup Emulator
+ * @brief Set up an emulated module, powered up and with the PLLs locked
+ *
+ * @param emu Module
+ * @param vmeA24 A24 address hdInit will find it at
+ * @param ops Where to put the backend, for hdSetAccess
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdEmuInit(HD_EMU *emu, uint32_t vmeA24, HD_ACCESS_OPS *ops)
+{
+  if((emu == NULL) || (ops == NULL))
+    return ERROR;
+
+  memset(emu, 0, sizeof(HD_EMU));
+  pthread_mutex_init(&emu->mutex, NULL);
+  emu->vmeA24 = vmeA24;
+  emu->triggerPeriodNs = HD_EMU_TRIGGER_PERIOD_NS;
+  emu->accessNs = HD_EMU_ACCESS_NS;
+  emu->reg.version = (HD_VERSION_BOARD_TYPE << 16) | HD_SUPPORTED_FIRMWARE;
+  hdEmuReset(emu);
+
+  ops->name = "emulator";
+  ops->ctx = emu;
+  ops->read32 = hdEmuRead32;
+  ops->write32 = hdEmuWrite32;
+  ops->busToLocalAdrs = hdEmuBusToLocalAdrs;
+  ops->memProbe = hdEmuMemProbe;
+  ops->dmaConfig = hdEmuDmaConfig;
+  ops->dmaSend = hdEmuDmaSend;
+  ops->dmaDone = hdEmuDmaDone;
+  ops->mark = NULL;
+
+  return OK;
+}
+
+/**
+ * @ingroup Emulator
+ * @brief Send external triggers (as from the trigger interface)
+ *
+ * @param emu Module
+ * @param ntrig Number of triggers
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdEmuTrigger(HD_EMU *emu, uint32_t ntrig)
+{
+  uint32_t itrig;
+
+  if(emu == NULL)
+    return ERROR;
+
+  pthread_mutex_lock(&emu->mutex);
+  for(itrig = 0; itrig < ntrig; itrig++)
+    hdEmuTrig(emu);
+  pthread_mutex_unlock(&emu->mutex);
+
+  return OK;
+}
+
+/**
+ * @ingroup Emulator
+ * @brief Advance the emulated time
+ *
+ * @param emu Module
+ * @param ns Time, in ns
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdEmuAdvance(HD_EMU *emu, uint64_t ns)
+{
+  if(emu == NULL)
+    return ERROR;
+
+  pthread_mutex_lock(&emu->mutex);
+  hdEmuSetTime(emu, ns);
+  pthread_mutex_unlock(&emu->mutex);
+
+  return OK;
+}
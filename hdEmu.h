@@ -0,0 +1,113 @@
+#pragma once
+/******************************************************************************
+ *
+ *  hdEmu.h -  Software model of the JLab helicity decoder, as a register
+ *             access backend (hdAccess.h).  Runs the library, and the
+ *             readout loops on top of it, without a crate.
+ *
+ *  Modeled:
+ *    - csr commands: resets, TRIGGER_PULSE, SYNC_RESET_PULSE,
+ *      FORCE_BLOCK_TRAILER, BUSY_LATCHED clear.  csr status bits.
+ *    - Event building (with ctrl2 GO and EVENT_BUILD_ENABLE) into blocks of
+ *      the configured block level, in the A32 data FIFO
+ *    - Block transfers from the FIFO, terminated with BERR (if enabled) at
+ *      the end of the data
+ *    - Trigger, sync, events / blocks on board, and helicity scalers
+ *    - Internal helicity generator (pattern, settle / stable time, seed),
+ *      its shift register, and the helicity histories
+ *    - Processing delays: an event holds the helicity input at its trigger
+ *      time + trigger latency delay - data input delay.  The confirmation
+ *      registers.
+ *    - Internal test trigger, test trigger delay after PATTERN_SYNC
+ *
+ *  Not modeled: external helicity inputs, window delay, the helicity
+ *  delay test, interrupts, and the firmware (config_csr) registers.
+ *
+ *  Time is emulated: it advances by triggerPeriodNs with each external
+ *  trigger, by accessNs with each bus access, and with hdEmuAdvance.
+ *
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include "hdLib.h"
+#include "hdAccess.h"
+
+#define HD_EMU_FIFO_WORDS        65536
+#define HD_EMU_FIFO_BLOCKS       8192
+#define HD_EMU_PAST_WINDOWS      1024   /* Kept for the data input delay */
+#define HD_EMU_TRIGGER_PERIOD_NS 1000
+#define HD_EMU_ACCESS_NS         500
+
+/* Helicity generator state, from the start of a window */
+typedef struct hd_emu_gen_struct
+{
+  uint64_t windowStart;      /* ns */
+  uint32_t shiftReg;         /* Pseudorandom sequence */
+  uint32_t patternHelicity;  /* Helicity of the first window of the pattern */
+  uint32_t helicity;
+  uint32_t windowCount;
+  uint32_t patternCount;
+  uint32_t pairCount;
+  uint32_t patternSyncHistory;
+  uint32_t pairSyncHistory;
+  uint32_t helicityHistory;
+  uint32_t patternHelicityHistory;
+} HD_EMU_GEN;
+
+typedef struct hd_emu_struct
+{
+  HD       reg;              /* Configuration registers, and scalers */
+  uint32_t vmeA24;
+  uint32_t fifoPort;         /* Local address of the A32 window */
+  pthread_mutex_t mutex;
+
+  uint64_t now;              /* Emulated time, ns */
+  uint64_t triggerPeriodNs;  /* Time between triggers */
+  uint64_t accessNs;         /* Time of a bus access */
+
+  /* Data FIFO: complete blocks only */
+  uint32_t fifo[HD_EMU_FIFO_WORDS];
+  uint32_t fifoHead;
+  uint32_t fifoTail;
+  struct
+  {
+    uint32_t nwords;
+    uint32_t nevents;
+  } fifoBlock[HD_EMU_FIFO_BLOCKS];  /* Block boundaries in the FIFO */
+  uint32_t fifoBlockHead;
+  uint32_t fifoBlockTail;
+  uint32_t readWords;        /* Words read of the block at the tail */
+
+  /* Block being built */
+  uint32_t block[HD_EMU_FIFO_WORDS / 4];
+  uint32_t blockWords;
+  uint32_t blockEvents;
+  uint32_t blockNumber;
+  uint32_t eventNumber;
+  uint32_t eventsOnBoard;
+  uint32_t blocksOnBoard;
+
+  /* csr status */
+  uint32_t berrAsserted;
+  uint32_t busyLatched;
+  uint32_t forceTrailerStatus;
+
+  /* Helicity generator: current window, and the last ones */
+  HD_EMU_GEN gen;
+  HD_EMU_GEN past[HD_EMU_PAST_WINDOWS];
+  uint32_t npast;
+
+  /* Internal test trigger */
+  uint32_t testTrigPending;
+  uint64_t testTrigTime;     /* ns */
+
+  /* Pending block transfer */
+  unsigned long dmaLocal;
+  uint32_t dmaVme;
+  int32_t  dmaBytes;
+} HD_EMU;
+
+int32_t hdEmuInit(HD_EMU *emu, uint32_t vmeA24, HD_ACCESS_OPS *ops);
+int32_t hdEmuTrigger(HD_EMU *emu, uint32_t ntrig);
+int32_t hdEmuAdvance(HD_EMU *emu, uint64_t ns);
@@ -10,26 +10,38 @@
  */
 
 #include "hdLib.h"
+#include "hdAccess.h"
 #include "hdFirmwareTools.h"
 
 #include <stdlib.h>
 #include <pthread.h>
 
-extern pthread_mutex_t hdMutex;
-#define HLOCK   if(pthread_mutex_lock(&hdMutex)<0) perror("pthread_mutex_lock");
-#define HUNLOCK if(pthread_mutex_unlock(&hdMutex)<0) perror("pthread_mutex_unlock");
-
-#define CHECKINIT {							\
-    if(hdp == NULL)							\
-      {                                                                 \
-        logMsg("%s: ERROR: Helcity Decoder is not initialized \n",	\
-               __func__,2,3,4,5,6);					\
-        return ERROR;                                                   \
-      }                                                                 \
+#ifdef HD_LOCK_PROFILE
+/* Wait and hold times per call site, see hdLockProfilePrint */
+#define HLOCK   {							\
+    static HD_LOCK_STATS _hdLockSite = {__func__, __LINE__};		\
+    hdLockProfileLock(&_hdLockSite);					\
   }
+#define HUNLOCK hdLockProfileUnlock();
+#else
+#define HLOCK   if(pthread_mutex_lock(hdLock)<0) perror("pthread_mutex_lock");
+#define HUNLOCK if(pthread_mutex_unlock(hdLock)<0) perror("pthread_mutex_unlock");
+#endif
 
+/* Resolve the selected board's registers and mutex once per routine */
+#define CHECKINIT							\
+  volatile HD *const hdRegs = hdGetRegs();				\
+  pthread_mutex_t *const hdLock = hdGetMutex();			\
+  (void) hdLock;							\
+  if(hdRegs == NULL)							\
+    {									\
+      logMsg("%s: ERROR: Helcity Decoder is not initialized \n",	\
+	     __func__,2,3,4,5,6);					\
+      return ERROR;							\
+    }
 
-extern volatile HD *hdp;
+/* Registers of the selected board */
+#define hdp hdRegs
 
 /* #define DEBUGFW */
 #define MAX_FW_DATA 0x800000
@@ -89,14 +101,14 @@ hdFirmwareEraseEPROM()
   printf("%s: BULK ERASE\n",__FUNCTION__);
 #endif
 
-  vmeWrite32(&hdp->config_csr, 0xC0000000);	// set up for bulk erase
-  csr = vmeRead32(&hdp->config_csr);
+  hdWrite32(&hdp->config_csr, 0xC0000000);	// set up for bulk erase
+  csr = hdRead32(&hdp->config_csr);
 #ifdef DEBUGFW
   printf("\n--- CSR = %X\n", csr);
 #endif
 
-  vmeWrite32(&hdp->config_data, 0);		// write triggers erase
-  csr = vmeRead32(&hdp->config_csr);
+  hdWrite32(&hdp->config_data, 0);		// write triggers erase
+  csr = hdRead32(&hdp->config_csr);
 #ifdef DEBUGFW
   printf("\n--- CSR = %X\n", csr);
 #endif
@@ -111,18 +123,18 @@ hdFirmwareEraseEPROM()
 	fflush(stdout);
       }
     taskDelay(1);
-    csr = vmeRead32(&hdp->config_csr);      // test for busy
+    csr = hdRead32(&hdp->config_csr);      // test for busy
     busy = (csr & 0x100) >> 8;
     iprint++;
   } while(busy);
 
   printf(" Done!\n");
 
-  csr = vmeRead32(&hdp->config_csr);
+  csr = hdRead32(&hdp->config_csr);
 #ifdef DEBUGFW
   printf("\n--- CSR = %X\n", csr);
 #endif
-  vmeWrite32(&hdp->config_csr, 0);		// set up for read
+  hdWrite32(&hdp->config_csr, 0);		// set up for read
 
   HUNLOCK;
   return OK;
@@ -148,7 +160,7 @@ hdFirmwareDownloadConfigData(int print_header)
 #endif
 
   HLOCK;
-  vmeWrite32(&hdp->config_csr, 0x80000000);	// set up for byte writes
+  hdWrite32(&hdp->config_csr, 0x80000000);	// set up for byte writes
 
   if(print_header)
     printf("     Writing to EPROM\n");
@@ -157,10 +169,10 @@ hdFirmwareDownloadConfigData(int print_header)
   for(iaddr=0; iaddr<fw_size; iaddr++)
     {
       data_word = (iaddr << 8) | fw_data[iaddr];
-      vmeWrite32(&hdp->config_data, data_word);
+      hdWrite32(&hdp->config_data, data_word);
 
       do {
-	value = vmeRead32(&hdp->config_csr);	// test for busy
+	value = hdRead32(&hdp->config_csr);	// test for busy
 	busy = (value & 0x100) >> 8;
       } while(busy);
 
@@ -172,7 +184,7 @@ hdFirmwareDownloadConfigData(int print_header)
     }
   printf(" Done!\n");
 
-  vmeWrite32(&hdp->config_csr, 0);			// default state is read
+  hdWrite32(&hdp->config_csr, 0);			// default state is read
   HUNLOCK;
 
   return OK;
@@ -194,7 +206,7 @@ hdFirmwareVerifyDownload(int print_header)
     }
 
   HLOCK;
-  vmeWrite32(&hdp->config_csr, 0); // Set up for read
+  hdWrite32(&hdp->config_csr, 0); // Set up for read
 
   if(print_header)
     printf("     Verifying Data\n");
@@ -203,13 +215,13 @@ hdFirmwareVerifyDownload(int print_header)
   for(idata =0; idata<fw_size; idata++)
     {
       data_word = (idata<<8);
-      vmeWrite32(&hdp->config_data, data_word);
+      hdWrite32(&hdp->config_data, data_word);
 
       do {
-	busy = (vmeRead32(&hdp->config_csr) & 0x100)>>8;
+	busy = (hdRead32(&hdp->config_csr) & 0x100)>>8;
       } while (busy);
 
-      data_word = vmeRead32(&hdp->config_csr) & 0xFF;
+      data_word = hdRead32(&hdp->config_csr) & 0xFF;
 
       if(data_word != fw_data[idata])
 	{
@@ -0,0 +1,1854 @@
+/* Module: hdHelicityTools.c
+ *
+ * Description: Helicity Decoder Helicity Analysis Tools Library
+ *              Software analysis of data read out from the module.
+ *              Registers are only accessed through the hdLib API.
+ *
+ * Author:
+ *        Bryan Moffit
+ *        JLab Data Acquisition Group
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "hdHelicityTools.h"
+
+/**
+ * @defgroup Analysis Helicity Analysis
+ */
+
+/**
+ * @ingroup Analysis
+ * @brief Allocate the arrays of an event table
+ *
+ * @param ev Event table
+ * @param maxevents Maximum number of events the table can hold
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdEventsAlloc(HD_EVENTS *ev, uint32_t maxevents)
+{
+  if((ev == NULL) || (maxevents == 0))
+    {
+      printf("%s: ERROR: Invalid arguments\n", __func__);
+      return ERROR;
+    }
+
+  memset(ev, 0, sizeof(HD_EVENTS));
+  ev->maxevents = maxevents;
+
+  ev->eventNumber            = calloc(maxevents, sizeof(uint32_t));
+  ev->trigTime               = calloc(maxevents, sizeof(uint64_t));
+  ev->shiftReg               = calloc(maxevents, sizeof(uint32_t));
+  ev->windowCount            = calloc(maxevents, sizeof(uint32_t));
+  ev->patternCount           = calloc(maxevents, sizeof(uint32_t));
+  ev->pairCount              = calloc(maxevents, sizeof(uint32_t));
+  ev->patternSyncHistory     = calloc(maxevents, sizeof(uint32_t));
+  ev->pairSyncHistory        = calloc(maxevents, sizeof(uint32_t));
+  ev->helicityHistory        = calloc(maxevents, sizeof(uint32_t));
+  ev->patternHelicityHistory = calloc(maxevents, sizeof(uint32_t));
+  ev->patternNumber          = calloc(maxevents, sizeof(uint32_t));
+  ev->windowIndex            = calloc(maxevents, sizeof(uint32_t));
+  ev->phase                  = calloc(maxevents, sizeof(uint8_t));
+  ev->flags                  = calloc(maxevents, sizeof(uint8_t));
+  ev->windowOffset           = calloc(maxevents, sizeof(uint32_t));
+
+  if(!ev->eventNumber || !ev->trigTime || !ev->shiftReg || !ev->windowCount ||
+     !ev->patternCount || !ev->pairCount || !ev->patternSyncHistory ||
+     !ev->pairSyncHistory || !ev->helicityHistory || !ev->patternHelicityHistory ||
+     !ev->patternNumber || !ev->windowIndex || !ev->phase || !ev->flags ||
+     !ev->windowOffset)
+    {
+      printf("%s: ERROR: Unable to allocate event table for %d events\n",
+	     __func__, maxevents);
+      hdEventsFree(ev);
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Free the arrays of an event table
+ *
+ * @param ev Event table
+ */
+void
+hdEventsFree(HD_EVENTS *ev)
+{
+  if(ev == NULL)
+    return;
+
+  free(ev->eventNumber);
+  free(ev->trigTime);
+  free(ev->shiftReg);
+  free(ev->windowCount);
+  free(ev->patternCount);
+  free(ev->pairCount);
+  free(ev->patternSyncHistory);
+  free(ev->pairSyncHistory);
+  free(ev->helicityHistory);
+  free(ev->patternHelicityHistory);
+  free(ev->patternNumber);
+  free(ev->windowIndex);
+  free(ev->phase);
+  free(ev->flags);
+  free(ev->windowOffset);
+
+  memset(ev, 0, sizeof(HD_EVENTS));
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Empty the event table, keeping its allocation
+ *
+ * @param ev Event table
+ */
+void
+hdEventsClear(HD_EVENTS *ev)
+{
+  if(ev != NULL)
+    ev->nevents = 0;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Decode a buffer of module data into the event table
+ *
+ * @param ev Event table
+ * @param data Module data, in host byte order (LSWAP the readout buffer)
+ * @param nwords Number of words in data
+ *
+ * @return Number of events added to the table if successful, otherwise ERROR
+ */
+int32_t
+hdEventsFill(HD_EVENTS *ev, const uint32_t *data, int32_t nwords)
+{
+  int32_t iword = 0, nadded = 0, ndecoder = 0, idecoder = 0;
+  int32_t cur = -1, timeWord = 0;
+  uint32_t word = 0, type = 0;
+
+  if((ev == NULL) || (data == NULL) || (ev->maxevents == 0))
+    {
+      printf("%s: ERROR: Invalid arguments\n", __func__);
+      return ERROR;
+    }
+
+  for(iword = 0; iword < nwords; iword++)
+    {
+      word = data[iword];
+
+      /* Decoder data words follow the decoder header, regardless of bit 31 */
+      if(idecoder < ndecoder)
+	{
+	  if((cur >= 0) && (idecoder < HD_DECODER_NWORDS))
+	    {
+	      switch(idecoder)
+		{
+		case HD_DECODER_WORD_SHIFT_REG:
+		  ev->shiftReg[cur] = word & HD_RECOVERED_SHIFT_REG_MASK;
+		  break;
+		case HD_DECODER_WORD_WINDOW_COUNT:
+		  ev->windowCount[cur] = word;
+		  break;
+		case HD_DECODER_WORD_PATTERN_COUNT:
+		  ev->patternCount[cur] = word;
+		  break;
+		case HD_DECODER_WORD_PAIR_COUNT:
+		  ev->pairCount[cur] = word;
+		  break;
+		case HD_DECODER_WORD_PATTERN_SYNC_HISTORY:
+		  ev->patternSyncHistory[cur] = word;
+		  break;
+		case HD_DECODER_WORD_PAIR_SYNC_HISTORY:
+		  ev->pairSyncHistory[cur] = word;
+		  break;
+		case HD_DECODER_WORD_HELICITY_HISTORY:
+		  ev->helicityHistory[cur] = word;
+		  break;
+		case HD_DECODER_WORD_PATTERN_HELICITY_HISTORY:
+		  ev->patternHelicityHistory[cur] = word;
+		  break;
+		}
+	    }
+	  idecoder++;
+	  if((cur >= 0) && (idecoder == ndecoder) && (ndecoder >= HD_DECODER_NWORDS))
+	    ev->flags[cur] &= ~HD_EVENT_FLAG_NO_DECODER_DATA;
+	  continue;
+	}
+
+      if(word & HD_DATA_TYPE_DEFINE)
+	{
+	  type = word & HD_DATA_TYPE_MASK;
+	  timeWord = 0;
+
+	  switch(type)
+	    {
+	    case HD_DATA_EVENT_HEADER:
+	      if(ev->nevents >= ev->maxevents)
+		{
+		  printf("%s: WARN: Event table full (%d events)\n",
+			 __func__, ev->maxevents);
+		  return nadded;
+		}
+	      cur = ev->nevents++;
+	      nadded++;
+
+	      ev->eventNumber[cur] = word & HD_DATA_EVENT_NUMBER_MASK;
+	      ev->trigTime[cur] = 0;
+	      ev->shiftReg[cur] = 0;
+	      ev->windowCount[cur] = 0;
+	      ev->patternCount[cur] = 0;
+	      ev->pairCount[cur] = 0;
+	      ev->patternSyncHistory[cur] = 0;
+	      ev->pairSyncHistory[cur] = 0;
+	      ev->helicityHistory[cur] = 0;
+	      ev->patternHelicityHistory[cur] = 0;
+	      ev->patternNumber[cur] = 0;
+	      ev->windowIndex[cur] = 0;
+	      ev->phase[cur] = 0;
+	      ev->flags[cur] = HD_EVENT_FLAG_NO_DECODER_DATA;
+	      ev->windowOffset[cur] = 0;
+	      break;
+
+	    case HD_DATA_TRIGGER_TIME:
+	      if(cur >= 0)
+		ev->trigTime[cur] = word & HD_DATA_TRIGGER_TIME_MASK;
+	      timeWord = 1;
+	      break;
+
+	    case HD_DATA_DECODER_HEADER:
+	      ndecoder = word & HD_DATA_DECODER_NWORDS_MASK;
+	      idecoder = 0;
+	      break;
+
+	    case HD_DATA_BLOCK_TRAILER:
+	      cur = -1;
+	      break;
+
+	    default:
+	      break;
+	    }
+	}
+      else if(type == HD_DATA_TRIGGER_TIME)
+	{
+	  /* Continuation word: upper 24 bits of the trigger time */
+	  if((cur >= 0) && (timeWord == 1))
+	    ev->trigTime[cur] |=
+	      ((uint64_t)(word & HD_DATA_TRIGGER_TIME_MASK)) << 24;
+	  timeWord++;
+	}
+    }
+
+  return nadded;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Initialize the pattern phase tracker
+ *
+ * @param t Tracker
+ * @param pattern Helicity Pattern (HD_HELICITY_CONFIG1_PATTERN_*)
+ *              0 Pair
+ *              1 Quartet
+ *              2 Octet
+ *              3 Toggle
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdPatternTrackerInit(HD_PATTERN_TRACKER *t, uint8_t pattern)
+{
+  if(t == NULL)
+    return ERROR;
+
+  memset(t, 0, sizeof(HD_PATTERN_TRACKER));
+
+  switch(pattern)
+    {
+    case HD_HELICITY_CONFIG1_PATTERN_PAIR:
+      t->patternSize = 2;
+      break;
+    case HD_HELICITY_CONFIG1_PATTERN_QUARTET:
+      t->patternSize = 4;
+      break;
+    case HD_HELICITY_CONFIG1_PATTERN_OCTET:
+      t->patternSize = 8;
+      break;
+    case HD_HELICITY_CONFIG1_PATTERN_TOGGLE:
+      t->patternSize = 1;
+      break;
+    default:
+      printf("%s: ERROR: Invalid pattern (%d)\n",
+	     __func__, pattern);
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/* Phase (windows since the most recent PATTERN_SYNC, 32 if none) and
+   flags of n events.  Only bit operations and selects, and no ctz
+   instruction, so the loop vectorizes */
+static void HD_VECTORIZE
+hdPatternPhase(const uint32_t * restrict history, uint8_t * restrict phase,
+	       uint8_t * restrict flags, uint32_t size, uint32_t n)
+{
+  uint32_t i;
+
+  for(i = 0; i < n; i++)
+    {
+      uint32_t low = history[i] & -history[i];
+      uint32_t since = ((low & 0xFFFF0000) ? 16 : 0) |
+	((low & 0xFF00FF00) ? 8 : 0) | ((low & 0xF0F0F0F0) ? 4 : 0) |
+	((low & 0xCCCCCCCC) ? 2 : 0) | ((low & 0xAAAAAAAA) ? 1 : 0);
+      uint8_t f = flags[i] &
+	~(HD_EVENT_FLAG_NO_PATTERN_SYNC | HD_EVENT_FLAG_PHASE_ERROR);
+
+      f |= (history[i] == 0) ? HD_EVENT_FLAG_NO_PATTERN_SYNC : 0;
+      f |= ((history[i] != 0) & (since >= size)) ? HD_EVENT_FLAG_PHASE_ERROR : 0;
+
+      phase[i] = (history[i] == 0) ? 32 : since;
+      flags[i] = f;
+    }
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Annotate events with their pattern number, phase within the
+ *        pattern, and window index since SyncReset.
+ *
+ *   The phase is the position of the most recent PATTERN_SYNC in the event's
+ *   32 window history.  Events without one in their history are extrapolated
+ *   from the last PATTERN_SYNC seen by the tracker, and flagged
+ *   HD_EVENT_FLAG_NO_PATTERN_SYNC.  Events must be in time order across calls.
+ *
+ * @param t Tracker
+ * @param ev Event table
+ * @param first Index of first event to annotate
+ * @param n Number of events to annotate
+ *
+ * @return Number of events with a phase error if successful, otherwise ERROR
+ */
+int32_t
+hdPatternTrackerAnnotate(HD_PATTERN_TRACKER *t, HD_EVENTS *ev,
+			 uint32_t first, uint32_t n)
+{
+  uint32_t i, last, size, nerr = 0;
+  const uint32_t * restrict window;
+  const uint32_t * restrict pcount;
+  const uint32_t * restrict history;
+  uint32_t * restrict pnumber;
+  uint32_t * restrict windex;
+  uint8_t * restrict phase;
+  uint8_t * restrict flags;
+
+  if((t == NULL) || (ev == NULL) || (t->patternSize == 0))
+    return ERROR;
+
+  if(first + n > ev->nevents)
+    {
+      printf("%s: ERROR: Invalid event range (%d + %d > %d)\n",
+	     __func__, first, n, ev->nevents);
+      return ERROR;
+    }
+
+  last = first + n;
+  size = t->patternSize;
+  window = ev->windowCount;
+  pcount = ev->patternCount;
+  history = ev->patternSyncHistory;
+  pnumber = ev->patternNumber;
+  windex = ev->windowIndex;
+  phase = ev->phase;
+  flags = ev->flags;
+
+  memcpy(&windex[first], &window[first], n * sizeof(uint32_t));
+  memcpy(&pnumber[first], &pcount[first], n * sizeof(uint32_t));
+  hdPatternPhase(&history[first], &phase[first], &flags[first], size, n);
+
+  /* Carry the last PATTERN_SYNC across events that have none in history */
+  for(i = first; i < last; i++)
+    {
+      if(flags[i] & HD_EVENT_FLAG_NO_DECODER_DATA)
+	{
+	  phase[i] = 0;
+	  continue;
+	}
+
+      if(flags[i] & HD_EVENT_FLAG_NO_PATTERN_SYNC)
+	{
+	  if(t->syncValid)
+	    phase[i] = (windex[i] - t->syncWindow) % size;
+	  else
+	    {
+	      phase[i] = 0;
+	      flags[i] |= HD_EVENT_FLAG_PHASE_ERROR;
+	    }
+	}
+      else
+	{
+	  t->syncWindow = windex[i] - phase[i];
+	  t->syncValid = 1;
+	}
+
+      if(flags[i] & HD_EVENT_FLAG_PHASE_ERROR)
+	nerr++;
+    }
+
+  t->nevents += n;
+  t->nerrors += nerr;
+
+  return nerr;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Initialize the helicity history stitcher
+ *
+ * @param s Stitcher
+ * @param size Number of helicity windows kept in the ring (power of 2)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdHistoryStitcherInit(HD_HISTORY_STITCHER *s, uint32_t size)
+{
+  if((s == NULL) || (size < 32) || (size & (size - 1)))
+    {
+      printf("%s: ERROR: Invalid size (%d).  Must be a power of 2, >= 32\n",
+	     __func__, size);
+      return ERROR;
+    }
+
+  memset(s, 0, sizeof(HD_HISTORY_STITCHER));
+
+  s->ring = calloc(size, sizeof(uint8_t));
+  if(s->ring == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate ring of %d windows\n",
+	     __func__, size);
+      return ERROR;
+    }
+  s->size = size;
+  pthread_mutex_init(&s->lock, NULL);
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Free the helicity history stitcher, stopping its sampler if running
+ *
+ * @param s Stitcher
+ */
+void
+hdHistoryStitcherFree(HD_HISTORY_STITCHER *s)
+{
+  if((s == NULL) || (s->ring == NULL))
+    return;
+
+  if(s->run)
+    hdHistorySamplerStop(s);
+
+  free(s->ring);
+  pthread_mutex_destroy(&s->lock);
+  memset(s, 0, sizeof(HD_HISTORY_STITCHER));
+}
+
+/* Do the oldest (32 - shift) bits of cur match the newest of prev */
+static int
+hdHistoryMatch(const uint32_t *prev, const uint32_t *cur, uint32_t shift)
+{
+  uint32_t mask = 0xFFFFFFFF >> shift;
+  int ireg;
+
+  for(ireg = 0; ireg < 4; ireg++)
+    if((cur[ireg] >> shift) != (prev[ireg] & mask))
+      return 0;
+
+  return 1;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Find the number of new helicity windows between two history
+ *        register snapshots, by aligning the bits they have in common.
+ *
+ * @param prev Previous snapshot of the four history registers
+ * @param cur Current snapshot of the four history registers
+ *
+ * @return Smallest shift [0,31] where all four registers overlap, otherwise -1
+ */
+int32_t
+hdHistoryAlign(const uint32_t *prev, const uint32_t *cur)
+{
+  uint32_t shift;
+
+  for(shift = 0; shift < 32; shift++)
+    if(hdHistoryMatch(prev, cur, shift))
+      return shift;
+
+  return -1;
+}
+
+/* Append the newest nbits windows of the snapshot to the ring, oldest first */
+static void
+hdHistoryAppend(HD_HISTORY_STITCHER *s, const uint32_t *h, uint32_t nbits,
+		int gap)
+{
+  int32_t ibit;
+  uint8_t w;
+
+  for(ibit = nbits - 1; ibit >= 0; ibit--)
+    {
+      w  = ((h[0] >> ibit) & 1) ? HD_HISTORY_PATTERN_SYNC : 0;
+      w |= ((h[1] >> ibit) & 1) ? HD_HISTORY_PAIR_SYNC : 0;
+      w |= ((h[2] >> ibit) & 1) ? HD_HISTORY_HELICITY : 0;
+      w |= ((h[3] >> ibit) & 1) ? HD_HISTORY_PATTERN_HELICITY : 0;
+      if(gap)
+	{
+	  w |= HD_HISTORY_GAP;
+	  gap = 0;
+	}
+
+      s->ring[s->nwindows & (s->size - 1)] = w;
+      s->nwindows++;
+    }
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Stitch a history register snapshot onto the continuous history.
+ *
+ *   The window count difference from the previous snapshot gives the number
+ *   of new windows, confirmed against the overlapping bits.  If they disagree,
+ *   the snapshot is placed by overlap alignment alone.  If there is no
+ *   overlap (32 or more new windows), the stream continues with the first new
+ *   window flagged HD_HISTORY_GAP.
+ *
+ * @param s Stitcher
+ * @param history Four history registers, as from hdReadHelicityHistoryCount
+ * @param windowCount T_STABLE rising edge count at the time of the snapshot
+ *
+ * @return Number of windows appended if successful, otherwise ERROR
+ */
+int32_t
+hdHistoryStitch(HD_HISTORY_STITCHER *s, const uint32_t *history,
+		uint32_t windowCount)
+{
+  uint32_t delta = 0, nnew = 0;
+  int32_t shift = 0, gap = 0;
+
+  if((s == NULL) || (s->ring == NULL) || (history == NULL))
+    return ERROR;
+
+  pthread_mutex_lock(&s->lock);
+
+  s->nsamples++;
+  delta = windowCount - s->lastCount;
+
+  if(!s->valid)
+    {
+      nnew = 32;
+      gap = 1;
+    }
+  else if(delta < 32)
+    {
+      if(hdHistoryMatch(s->last, history, delta))
+	nnew = delta;
+      else if((shift = hdHistoryAlign(s->last, history)) >= 0)
+	{
+	  nnew = shift;
+	  s->nrealigned++;
+	}
+      else
+	{
+	  nnew = 32;
+	  gap = 1;
+	  s->ngaps++;
+	}
+    }
+  else
+    {
+      nnew = 32;
+      gap = 1;
+      s->ngaps++;
+      s->nlost += delta - 32;
+    }
+
+  hdHistoryAppend(s, history, nnew, gap);
+
+  memcpy(s->last, history, sizeof(s->last));
+  s->lastCount = windowCount;
+  s->valid = 1;
+
+  pthread_mutex_unlock(&s->lock);
+
+  return nnew;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Read the history registers from the module and stitch them onto
+ *        the continuous history.
+ *
+ *   The four registers are one block transfer when called from a thread
+ *   set up for it with hdSetSnapshotDMA (e.g. the readout thread).  The
+ *   sampler thread (hdHistorySamplerStart) uses programmed I/O.
+ *
+ * @param s Stitcher
+ *
+ * @return Number of windows appended if successful, otherwise ERROR
+ */
+int32_t
+hdHistorySample(HD_HISTORY_STITCHER *s)
+{
+  uint32_t history[4], windowCount = 0;
+
+  if(hdReadHelicityHistoryCount(history, &windowCount) != 4)
+    return ERROR;
+
+  return hdHistoryStitch(s, history, windowCount);
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Copy windows from the continuous history
+ *
+ * @param s Stitcher
+ * @param cursor Window index of the next window to read.  Start with 0.
+ *               Updated with the index after the last window copied.
+ *               If the ring has overwritten the cursor position, reading
+ *               resumes with the oldest window, flagged HD_HISTORY_GAP.
+ * @param out Where to copy the windows
+ * @param max Maximum number of windows to copy
+ *
+ * @return Number of windows copied if successful, otherwise ERROR
+ */
+int32_t
+hdHistoryRead(HD_HISTORY_STITCHER *s, uint64_t *cursor, uint8_t *out,
+	      uint32_t max)
+{
+  uint64_t oldest = 0;
+  uint32_t n = 0, i;
+  int32_t overrun = 0;
+
+  if((s == NULL) || (s->ring == NULL) || (cursor == NULL) || (out == NULL))
+    return ERROR;
+
+  pthread_mutex_lock(&s->lock);
+  oldest = (s->nwindows > s->size) ? s->nwindows - s->size : 0;
+  if(*cursor < oldest)
+    {
+      *cursor = oldest;
+      overrun = 1;
+    }
+
+  if(s->nwindows - *cursor < max)
+    n = s->nwindows - *cursor;
+  else
+    n = max;
+
+  for(i = 0; i < n; i++)
+    out[i] = s->ring[(*cursor + i) & (s->size - 1)];
+
+  if(overrun && n)
+    out[0] |= HD_HISTORY_GAP;
+
+  *cursor += n;
+  pthread_mutex_unlock(&s->lock);
+
+  return n;
+}
+
+static void *
+hdHistorySamplerThread(void *arg)
+{
+  HD_HISTORY_STITCHER *s = (HD_HISTORY_STITCHER *)arg;
+
+  while(s->run)
+    {
+      hdHistorySample(s);
+      usleep(s->periodUs);
+    }
+
+  return NULL;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Start a thread that polls the history registers into the stitcher.
+ *
+ * @param s Stitcher
+ * @param periodUs Polling period in microseconds.  Must be well under the
+ *                 duration of 32 helicity windows to avoid gaps.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdHistorySamplerStart(HD_HISTORY_STITCHER *s, uint32_t periodUs)
+{
+  if((s == NULL) || (s->ring == NULL) || (periodUs == 0))
+    return ERROR;
+
+  if(s->run)
+    {
+      printf("%s: ERROR: Sampler already running\n", __func__);
+      return ERROR;
+    }
+
+  s->periodUs = periodUs;
+  s->run = 1;
+  if(pthread_create(&s->thread, NULL, hdHistorySamplerThread, s) != 0)
+    {
+      perror("pthread_create");
+      s->run = 0;
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Stop the history register polling thread
+ *
+ * @param s Stitcher
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdHistorySamplerStop(HD_HISTORY_STITCHER *s)
+{
+  if((s == NULL) || !s->run)
+    return ERROR;
+
+  s->run = 0;
+  pthread_join(s->thread, NULL);
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Initialize the helicity-pattern asymmetry accumulator
+ *
+ *   Channel 0 (HD_ASYM_CHANNEL_RATE) is filled with trigger counts by
+ *   hdAsymmetryAddEvents.  Other channels (e.g. charge) are filled with
+ *   hdAsymmetryAdd.  The helicity reporting delay is 0 windows, see
+ *   hdAsymmetrySetDelay.
+ *
+ * @param a Accumulator
+ * @param nchannels Number of yield channels [1, HD_ASYM_MAX_CHANNELS]
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAsymmetryInit(HD_ASYMMETRY *a, uint32_t nchannels)
+{
+  if((a == NULL) || (nchannels == 0) || (nchannels > HD_ASYM_MAX_CHANNELS))
+    {
+      printf("%s: ERROR: Invalid nchannels (%d).  MAX = %d\n",
+	     __func__, nchannels, HD_ASYM_MAX_CHANNELS);
+      return ERROR;
+    }
+
+  memset(a, 0, sizeof(HD_ASYMMETRY));
+  a->nchannels = nchannels;
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Set the helicity reporting delay used by hdAsymmetryAddEvents.
+ *
+ *   The helicity of a window is reported delayWindows windows later (e.g.
+ *   the windowDelay of hdHelicityGeneratorConfig).  Trigger counts are
+ *   held per window until a later event reports the window's helicity.
+ *
+ * @param a Accumulator
+ * @param delayWindows Reporting delay, in helicity windows
+ *                     [0, HD_ASYM_MAX_PENDING - 32]
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAsymmetrySetDelay(HD_ASYMMETRY *a, uint32_t delayWindows)
+{
+  if((a == NULL) || (delayWindows > HD_ASYM_MAX_PENDING - 32))
+    {
+      printf("%s: ERROR: Invalid delayWindows (%d).  MAX = %d\n",
+	     __func__, delayWindows, HD_ASYM_MAX_PENDING - 32);
+      return ERROR;
+    }
+
+  a->delayWindows = delayWindows;
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Add yields to the helicity pattern being accumulated
+ *
+ * @param a Accumulator
+ * @param helicity Helicity of the window the yields were measured in,
+ *                 corrected for the reporting delay (0 = minus, !0 = plus)
+ * @param yield Array of nchannels yields
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdAsymmetryAdd(HD_ASYMMETRY *a, uint8_t helicity, const double *yield)
+{
+  uint32_t ichan;
+
+  if((a == NULL) || (yield == NULL))
+    return ERROR;
+
+  a->patternOpen = 1;
+
+  if(helicity)
+    {
+      for(ichan = 0; ichan < a->nchannels; ichan++)
+	a->plus[ichan] += yield[ichan];
+      a->nplus++;
+    }
+  else
+    {
+      for(ichan = 0; ichan < a->nchannels; ichan++)
+	a->minus[ichan] += yield[ichan];
+      a->nminus++;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Close the helicity pattern being accumulated.  Compute its
+ *        asymmetry (plus - minus) / (plus + minus) for each complete
+ *        channel, and fold it into that channel's running mean and
+ *        variance.
+ *
+ *   The rate channel, when filled by hdAsymmetryAddEvents, is complete if
+ *   every trigger in the pattern had a reported helicity, whatever the
+ *   number of triggers in each state.  The channels filled by
+ *   hdAsymmetryAdd are complete with samples of both helicities.
+ *
+ * @param a Accumulator
+ *
+ * @return OK if the pattern was accepted by any channel, otherwise ERROR
+ */
+int32_t
+hdAsymmetryPatternEnd(HD_ASYMMETRY *a)
+{
+  uint32_t ichan, complete, nfolded = 0;
+  double sum, asym, delta;
+  int32_t rval = OK;
+
+  if(a == NULL)
+    return ERROR;
+
+  if(!a->patternOpen)
+    return ERROR;
+
+  for(ichan = 0; ichan < a->nchannels; ichan++)
+    {
+      if((ichan == HD_ASYM_CHANNEL_RATE) && (a->rateCounts || a->rateLost))
+	complete = (a->rateLost == 0);
+      else
+	complete = (a->nplus != 0) && (a->nminus != 0);
+
+      if(!complete)
+	continue;
+
+      sum = a->plus[ichan] + a->minus[ichan];
+      asym = (sum != 0) ? (a->plus[ichan] - a->minus[ichan]) / sum : 0;
+
+      a->last[ichan] = asym;
+      a->n[ichan]++;
+      delta = asym - a->mean[ichan];
+      a->mean[ichan] += delta / a->n[ichan];
+      a->m2[ichan] += delta * (asym - a->mean[ichan]);
+      nfolded++;
+    }
+
+  if(nfolded)
+    {
+      a->npatterns++;
+      a->lastPatternNumber = a->patternNumber;
+    }
+  else
+    {
+      a->nrejected++;
+      rval = ERROR;
+    }
+
+  a->patternOpen = 0;
+  a->nplus = 0;
+  a->nminus = 0;
+  a->rateCounts = 0;
+  a->rateLost = 0;
+  memset(a->plus, 0, sizeof(a->plus));
+  memset(a->minus, 0, sizeof(a->minus));
+
+  return rval;
+}
+
+/* Trigger counts of one window into the rate channel, in window order.
+   helicity < 0: not reported.  Returns the number of patterns completed */
+static uint32_t
+hdAsymmetryAddWindow(HD_ASYMMETRY *a, uint32_t patternNumber, int32_t helicity,
+		     uint32_t count)
+{
+  uint32_t ncomplete = 0;
+
+  if(a->patternOpen && (patternNumber != a->patternNumber))
+    {
+      if(hdAsymmetryPatternEnd(a) == OK)
+	ncomplete++;
+    }
+
+  a->patternNumber = patternNumber;
+  a->patternOpen = 1;
+
+  if(helicity < 0)
+    a->rateLost += count;
+  else
+    {
+      if(helicity)
+	a->plus[HD_ASYM_CHANNEL_RATE] += count;
+      else
+	a->minus[HD_ASYM_CHANNEL_RATE] += count;
+      a->rateCounts += count;
+    }
+
+  return ncomplete;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Accumulate trigger counts from annotated events into the rate
+ *        channel.
+ *
+ *   Triggers are counted per helicity window.  A window's count is added
+ *   with the helicity reported hdAsymmetrySetDelay windows later, from the
+ *   helicity history of a later event (within its 32 windows).  Counts of
+ *   windows never reported make their pattern incomplete.  A change of
+ *   pattern number closes the open pattern.
+ *
+ * @param a Accumulator
+ * @param ev Event table, annotated by hdPatternTrackerAnnotate
+ * @param first Index of first event
+ * @param n Number of events
+ *
+ * @return Number of patterns completed if successful, otherwise ERROR
+ */
+int32_t
+hdAsymmetryAddEvents(HD_ASYMMETRY *a, const HD_EVENTS *ev,
+		     uint32_t first, uint32_t n)
+{
+  uint32_t i, w, ncomplete = 0, ipend;
+  int32_t age;
+
+  if((a == NULL) || (ev == NULL) || (first + n > ev->nevents))
+    return ERROR;
+
+  for(i = first; i < first + n; i++)
+    {
+      if(ev->flags[i] & HD_EVENT_FLAG_NO_DECODER_DATA)
+	continue;
+
+      /* Count the trigger in its window */
+      w = ev->windowIndex[i];
+      ipend = (a->pendingTail - 1) % HD_ASYM_MAX_PENDING;
+      if((a->pendingHead != a->pendingTail) && (a->pending[ipend].window == w))
+	a->pending[ipend].count++;
+      else
+	{
+	  if(a->pendingTail - a->pendingHead >= HD_ASYM_MAX_PENDING)
+	    {
+	      /* Full: the oldest window is not reported in time */
+	      ipend = a->pendingHead++ % HD_ASYM_MAX_PENDING;
+	      ncomplete += hdAsymmetryAddWindow(a, a->pending[ipend].patternNumber,
+						-1, a->pending[ipend].count);
+	    }
+
+	  ipend = a->pendingTail++ % HD_ASYM_MAX_PENDING;
+	  a->pending[ipend].window = w;
+	  a->pending[ipend].patternNumber = ev->patternNumber[i];
+	  a->pending[ipend].count = 1;
+	}
+
+      /* This event reports the helicity of windows w - delay - 31 through
+	 w - delay */
+      while(a->pendingHead != a->pendingTail)
+	{
+	  ipend = a->pendingHead % HD_ASYM_MAX_PENDING;
+	  age = (int32_t)(w - a->delayWindows - a->pending[ipend].window);
+	  if(age < 0)
+	    break;
+
+	  ncomplete += hdAsymmetryAddWindow(a, a->pending[ipend].patternNumber,
+					    (age < 32) ?
+					    (int32_t)((ev->helicityHistory[i] >> age) & 1) : -1,
+					    a->pending[ipend].count);
+	  a->pendingHead++;
+	}
+    }
+
+  return ncomplete;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Get the asymmetries for a channel
+ *
+ * @param a Accumulator
+ * @param channel Channel number
+ * @param last Address to store asymmetry of last completed pattern (or NULL)
+ * @param mean Address to store running mean asymmetry (or NULL)
+ * @param variance Address to store running variance of the pattern
+ *                 asymmetry (or NULL)
+ * @param error Address to store statistical error of the mean (or NULL)
+ *
+ * @return Number of patterns in the channel's running mean, otherwise ERROR
+ */
+int32_t
+hdAsymmetryGet(HD_ASYMMETRY *a, uint32_t channel, double *last,
+	       double *mean, double *variance, double *error)
+{
+  double var = 0;
+
+  if((a == NULL) || (channel >= a->nchannels))
+    return ERROR;
+
+  if(a->n[channel] > 1)
+    var = a->m2[channel] / (a->n[channel] - 1);
+
+  if(last)
+    *last = a->last[channel];
+  if(mean)
+    *mean = a->mean[channel];
+  if(variance)
+    *variance = var;
+  if(error)
+    *error = (a->n[channel] > 1) ? sqrt(var / a->n[channel]) : 0;
+
+  return a->n[channel];
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Advance the 30 bit pseudo-random helicity shift register
+ *
+ * @param seed Address of the shift register value.  Updated.
+ *
+ * @return The new bit
+ */
+uint32_t
+hdSeqNextBit(uint32_t *seed)
+{
+  uint32_t s = *seed;
+  uint32_t bit7  = (s >> 6) & 1;
+  uint32_t bit28 = (s >> 27) & 1;
+  uint32_t bit29 = (s >> 28) & 1;
+  uint32_t bit30 = (s >> 29) & 1;
+  uint32_t newbit = bit30 ^ bit29 ^ bit28 ^ bit7;
+
+  *seed = ((s << 1) | newbit) & HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK;
+
+  return newbit;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Initialize the helicity sequence checker
+ *
+ * @param c Checker
+ * @param pattern Helicity Pattern (HD_HELICITY_CONFIG1_PATTERN_*)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdSeqCheckerInit(HD_SEQ_CHECKER *c, uint8_t pattern)
+{
+  if(c == NULL)
+    return ERROR;
+
+  memset(c, 0, sizeof(HD_SEQ_CHECKER));
+
+  /* Bit i is the helicity of window i, relative to the first window */
+  switch(pattern)
+    {
+    case HD_HELICITY_CONFIG1_PATTERN_PAIR:
+      c->patternSize = 2;
+      c->templ = 0x2;   /* + - */
+      break;
+    case HD_HELICITY_CONFIG1_PATTERN_QUARTET:
+      c->patternSize = 4;
+      c->templ = 0x6;   /* + - - + */
+      break;
+    case HD_HELICITY_CONFIG1_PATTERN_OCTET:
+      c->patternSize = 8;
+      c->templ = 0x96;  /* + - - + - + + - */
+      break;
+    case HD_HELICITY_CONFIG1_PATTERN_TOGGLE:
+      c->patternSize = 1;
+      c->templ = 0;
+      break;
+    default:
+      printf("%s: ERROR: Invalid pattern (%d)\n",
+	     __func__, pattern);
+      return ERROR;
+    }
+
+  c->pos = c->patternSize;
+
+  return OK;
+}
+
+static void
+hdSeqError(HD_SEQ_CHECKER *c, uint32_t type)
+{
+  HD_SEQ_ERROR *e = &c->log[c->nlog % HD_SEQ_LOG_SIZE];
+
+  e->window = c->nwindows;
+  e->pattern = c->npatterns;
+  e->type = type;
+
+  c->nlog++;
+  c->nerrors[type]++;
+}
+
+/* Check the reported helicity of a pattern against the pseudo-random sequence */
+static void
+hdSeqCheckPattern(HD_SEQ_CHECKER *c, uint32_t bit)
+{
+  uint32_t s, ibit, inverted = 1, dropped = 1;
+
+  if(c->nseed < 30)
+    {
+      c->seed = ((c->seed << 1) | bit) & HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK;
+      c->nseed++;
+      return;
+    }
+
+  if(c->pending == 0)
+    {
+      s = c->seed;
+      if(hdSeqNextBit(&s) == bit)
+	{
+	  c->seed = s;
+	  return;
+	}
+    }
+
+  /* Mismatch.  Collect HD_SEQ_LOOKAHEAD bits before deciding */
+  c->pendingBits |= bit << c->pending;
+  c->pending++;
+  if(c->pending < HD_SEQ_LOOKAHEAD)
+    return;
+
+  /* Inverted: the first bit is wrong, the rest follow the prediction.
+     Dropped: all bits follow the prediction, one pattern later */
+  s = c->seed;
+  hdSeqNextBit(&s);
+  for(ibit = 0; ibit < HD_SEQ_LOOKAHEAD; ibit++)
+    {
+      uint32_t p = hdSeqNextBit(&s);
+      if(ibit < HD_SEQ_LOOKAHEAD - 1)
+	inverted &= (((c->pendingBits >> (ibit + 1)) & 1) == p);
+      dropped &= (((c->pendingBits >> ibit) & 1) == p);
+    }
+
+  if(inverted)
+    {
+      hdSeqError(c, HD_SEQ_ERROR_INVERTED_BIT);
+      for(ibit = 0; ibit < HD_SEQ_LOOKAHEAD; ibit++)
+	hdSeqNextBit(&c->seed);
+    }
+  else if(dropped)
+    {
+      hdSeqError(c, HD_SEQ_ERROR_DROPPED_PATTERN);
+      for(ibit = 0; ibit <= HD_SEQ_LOOKAHEAD; ibit++)
+	hdSeqNextBit(&c->seed);
+    }
+  else
+    {
+      hdSeqError(c, HD_SEQ_ERROR_LOST_LOCK);
+      c->seed = 0;
+      for(ibit = 0; ibit < HD_SEQ_LOOKAHEAD; ibit++)
+	c->seed = (c->seed << 1) | ((c->pendingBits >> ibit) & 1);
+      c->nseed = HD_SEQ_LOOKAHEAD;
+    }
+
+  c->pending = 0;
+  c->pendingBits = 0;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Check a stream of helicity windows, as from hdHistoryRead.
+ *
+ *   Each pattern's reported helicity at PATTERN_SYNC is compared to the
+ *   prediction of the pseudo-random generator, after 30 patterns to acquire
+ *   the seed.  The windows within the pattern are compared to the pattern
+ *   structure.  This assumes the helicity reporting delay is a whole number
+ *   of patterns.  A window flagged HD_HISTORY_GAP restarts seed acquisition.
+ *
+ * @param c Checker
+ * @param windows Helicity windows (HD_HISTORY_* bits), oldest first
+ * @param n Number of windows
+ *
+ * @return Number of errors found in these windows, otherwise ERROR
+ */
+int32_t
+hdSeqCheckWindows(HD_SEQ_CHECKER *c, const uint8_t *windows, uint32_t n)
+{
+  uint32_t i, nlog0, expected, helicity;
+  uint8_t w;
+
+  if((c == NULL) || (windows == NULL) || (c->patternSize == 0))
+    return ERROR;
+
+  nlog0 = c->nlog;
+
+  for(i = 0; i < n; i++, c->nwindows++)
+    {
+      w = windows[i];
+      helicity = (w & HD_HISTORY_HELICITY) ? 1 : 0;
+
+      if(w & HD_HISTORY_GAP)
+	{
+	  c->pos = c->patternSize;
+	  c->nseed = 0;
+	  c->pending = 0;
+	  c->pendingBits = 0;
+	}
+
+      if(w & HD_HISTORY_PATTERN_SYNC)
+	{
+	  if(c->pos < c->patternSize - 1)
+	    hdSeqError(c, HD_SEQ_ERROR_DROPPED_WINDOW);
+
+	  c->pos = 0;
+	  c->first = helicity;
+	  c->npatterns++;
+
+	  if(c->patternSize > 1)
+	    hdSeqCheckPattern(c, (w & HD_HISTORY_PATTERN_HELICITY) ? 1 : 0);
+	  continue;
+	}
+
+      if(c->pos >= c->patternSize)
+	continue;  /* Not synchronized */
+
+      c->pos++;
+      if(c->pos == c->patternSize)
+	{
+	  hdSeqError(c, HD_SEQ_ERROR_SYNC_SLIP);
+	  continue;
+	}
+
+      if(c->patternSize == 1)
+	continue;
+
+      expected = c->first ^ ((c->templ >> c->pos) & 1);
+      if(helicity != expected)
+	hdSeqError(c, HD_SEQ_ERROR_INVERTED_BIT);
+    }
+
+  return c->nlog - nlog0;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Print the helicity sequence checker counters and error log
+ *        to standard out
+ *
+ * @param c Checker
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdSeqCheckerPrint(HD_SEQ_CHECKER *c)
+{
+  uint32_t i, first;
+  const char *names[HD_SEQ_NERROR_TYPES] =
+    {
+      "Dropped window", "Sync slip", "Inverted bit",
+      "Dropped pattern", "Lost lock"
+    };
+
+  if(c == NULL)
+    return ERROR;
+
+  printf("  Helicity Sequence Check\n");
+  printf("    Windows          = %llu\n", (unsigned long long)c->nwindows);
+  printf("    Patterns         = %d\n", c->npatterns);
+  printf("    Seed             = %s\n", (c->nseed >= 30) ? "Locked" : "Acquiring");
+  for(i = 0; i < HD_SEQ_NERROR_TYPES; i++)
+    printf("    %-16s = %d\n", names[i], c->nerrors[i]);
+
+  if(c->nlog)
+    {
+      printf("\n");
+      printf("    Window               Pattern     Error\n");
+      printf("  ------------------------------------------------------------------------------\n");
+      first = (c->nlog > HD_SEQ_LOG_SIZE) ? c->nlog - HD_SEQ_LOG_SIZE : 0;
+      for(i = first; i < c->nlog; i++)
+	{
+	  HD_SEQ_ERROR *e = &c->log[i % HD_SEQ_LOG_SIZE];
+	  printf("    %-20llu %-10d  %s\n",
+		 (unsigned long long)e->window, e->pattern, names[e->type]);
+	}
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Initialize the trigger to helicity window timing engine
+ *
+ * @param e Timing engine
+ * @param settleTicks Helicity settle time (1 count = 8 ns)
+ * @param stableTicks Helicity stable time (1 count = 8 ns)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdTimingInit(HD_TIMING *e, uint32_t settleTicks, uint32_t stableTicks)
+{
+  if((e == NULL) || (stableTicks == 0))
+    {
+      printf("%s: ERROR: Invalid stableTicks (%d)\n",
+	     __func__, stableTicks);
+      return ERROR;
+    }
+
+  memset(e, 0, sizeof(HD_TIMING));
+  e->settleTicks = settleTicks;
+  e->stableTicks = stableTicks;
+  e->period = settleTicks + stableTicks;
+
+  return OK;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Initialize the timing engine with the settle and stable times
+ *        of the module's internal helicity generator
+ *
+ *   Only for the internal helicity source.  With an external source, the
+ *   generator configuration says nothing about the windows: use
+ *   hdTimingInit with the source's timing.
+ *
+ * @param e Timing engine
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdTimingInitFromModule(HD_TIMING *e)
+{
+  uint8_t pattern, windowDelay, helSrc, input, output;
+  uint16_t settleTime;
+  uint32_t stableTime, seed;
+
+  if(hdGetHelicitySource(&helSrc, &input, &output) != OK)
+    return ERROR;
+
+  if(!helSrc)
+    {
+      printf("%s: ERROR: External helicity source.  Use hdTimingInit\n",
+	     __func__);
+      return ERROR;
+    }
+
+  if(hdGetHelicityGeneratorConfig(&pattern, &windowDelay,
+				  &settleTime, &stableTime, &seed) != OK)
+    return ERROR;
+
+  /* Generator counts to trigger time ticks */
+  return hdTimingInit(e, HD_GENERATOR_TICKS * settleTime,
+		      HD_GENERATOR_TICKS * stableTime);
+}
+
+/* Place one trigger in its window, given bounds on T_STABLE rising edge 0 */
+static inline void
+hdTimingPlace(const HD_TIMING *e, int64_t lo, int64_t hi, uint64_t t,
+	      uint32_t count, uint32_t *offset, uint8_t *flags)
+{
+  int64_t base = (int64_t)t - (int64_t)count * e->period;
+  int64_t off = base - lo - ((hi - lo) >> 1);
+  int64_t offEarly = base - hi, offLate = base - lo;
+  uint8_t f = *flags & ~(HD_EVENT_FLAG_TSETTLE | HD_EVENT_FLAG_TIMING_AMBIGUOUS);
+
+  off = (off < 0) ? 0 : (off >= e->period) ? e->period - 1 : off;
+
+  f |= (off >= e->stableTicks) ? HD_EVENT_FLAG_TSETTLE : 0;
+  f |= ((offEarly >= e->stableTicks) != (offLate >= e->stableTicks)) ?
+    HD_EVENT_FLAG_TIMING_AMBIGUOUS : 0;
+
+  *offset = (off >= e->stableTicks) ?
+    off - e->stableTicks : off + e->settleTicks;
+  *flags = f;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Place triggers inside their helicity windows.
+ *
+ *   A trigger with window count c (T_STABLE rising edges) at time t lies in
+ *   [R_c, R_c + period), where R_c is the time of rising edge c.  Every
+ *   trigger narrows the bounds on R_0, and the offset within the window
+ *   follows from them.  Triggers after T_STABLE falls are in the T_SETTLE
+ *   of the next window, and are flagged HD_EVENT_FLAG_TSETTLE.  Triggers
+ *   where the bounds don't decide the region are flagged
+ *   HD_EVENT_FLAG_TIMING_AMBIGUOUS.
+ *
+ *   The trigger time and the settle/stable times are both counted with the
+ *   8 ns module clock.
+ *
+ * @param e Timing engine
+ * @param ev Event table
+ * @param first Index of first event
+ * @param n Number of events
+ *
+ * @return Number of events in T_SETTLE if successful, otherwise ERROR
+ */
+int32_t
+hdTimingMap(HD_TIMING *e, HD_EVENTS *ev, uint32_t first, uint32_t n)
+{
+  uint32_t i, last, nsettle = 0;
+  int64_t lo, hi, cl, ch, period;
+  const uint64_t * restrict t;
+  const uint32_t * restrict count;
+  uint32_t * restrict offset;
+  uint8_t * restrict flags;
+
+  if((e == NULL) || (ev == NULL) || (e->period == 0) ||
+     (first + n > ev->nevents))
+    return ERROR;
+
+  last = first + n;
+  period = e->period;
+  t = ev->trigTime;
+  count = ev->windowCount;
+  offset = ev->windowOffset;
+  flags = ev->flags;
+
+  lo = e->valid ? e->lo : INT64_MIN;
+  hi = e->valid ? e->hi : INT64_MAX;
+
+  /* Narrow the bounds with the whole batch: min/max reduction */
+  for(i = first; i < last; i++)
+    {
+      int nodata = flags[i] & HD_EVENT_FLAG_NO_DECODER_DATA;
+      cl = (int64_t)t[i] - ((int64_t)count[i] + 1) * period + 1;
+      ch = (int64_t)t[i] - (int64_t)count[i] * period;
+      cl = nodata ? INT64_MIN : cl;
+      ch = nodata ? INT64_MAX : ch;
+      lo = (cl > lo) ? cl : lo;
+      hi = (ch < hi) ? ch : hi;
+    }
+
+  if(lo <= hi)
+    {
+      /* Consistent: place every trigger with the final bounds */
+      if(lo != INT64_MIN)
+	{
+	  e->lo = lo;
+	  e->hi = hi;
+	  e->valid = 1;
+	}
+
+      for(i = first; i < last; i++)
+	if(!(flags[i] & HD_EVENT_FLAG_NO_DECODER_DATA) && e->valid)
+	  hdTimingPlace(e, e->lo, e->hi, t[i], count[i], &offset[i], &flags[i]);
+    }
+  else
+    {
+      /* Inconsistent (drift, SyncReset): one trigger at a time, restarting
+	 the bounds where a trigger doesn't fit */
+      for(i = first; i < last; i++)
+	{
+	  if(flags[i] & HD_EVENT_FLAG_NO_DECODER_DATA)
+	    continue;
+
+	  cl = (int64_t)t[i] - ((int64_t)count[i] + 1) * period + 1;
+	  ch = (int64_t)t[i] - (int64_t)count[i] * period;
+
+	  if(!e->valid || (cl > e->hi) || (ch < e->lo))
+	    {
+	      if(e->valid)
+		e->nresync++;
+	      e->lo = cl;
+	      e->hi = ch;
+	      e->valid = 1;
+	    }
+	  else
+	    {
+	      e->lo = (cl > e->lo) ? cl : e->lo;
+	      e->hi = (ch < e->hi) ? ch : e->hi;
+	    }
+
+	  hdTimingPlace(e, e->lo, e->hi, t[i], count[i], &offset[i], &flags[i]);
+	}
+    }
+
+  for(i = first; i < last; i++)
+    {
+      nsettle += (flags[i] & HD_EVENT_FLAG_TSETTLE) ? 1 : 0;
+      e->nambiguous += (flags[i] & HD_EVENT_FLAG_TIMING_AMBIGUOUS) ? 1 : 0;
+    }
+
+  e->nevents += n;
+  e->nsettle += nsettle;
+
+  return nsettle;
+}
+
+#define HD_CAL_DATA_WORDS  64
+
+/* Read out the blocks on the module, into ev if not NULL.  Blocklevel 1 */
+static int32_t
+hdCalibrateRead(HD_EVENTS *ev)
+{
+  volatile unsigned int data[HD_CAL_DATA_WORDS];
+  uint32_t host[HD_CAL_DATA_WORDS];
+  int32_t nwords, iword, nread = 0;
+
+  while(hdBReady() > 0)
+    {
+      nwords = hdReadBlock(data, HD_CAL_DATA_WORDS, 0);
+      if(nwords <= 0)
+	return ERROR;
+
+      if(ev != NULL)
+	{
+	  for(iword = 0; iword < nwords; iword++)
+	    host[iword] = LSWAP(data[iword]);
+	  if(hdEventsFill(ev, host, nwords) == ERROR)
+	    return ERROR;
+	}
+      nread++;
+    }
+
+  return nread;
+}
+
+/* Collect nevents test triggers, after one discarded, with the programmed
+   delays */
+static int32_t
+hdCalibrateCollect(HD_DELAY_CALIBRATION *cal, HD_EVENTS *ev, uint32_t nevents)
+{
+  uint64_t start;
+  int32_t rval = OK, nread;
+
+  hdEventsClear(ev);
+  if(hdCalibrateRead(NULL) == ERROR)
+    return ERROR;
+
+  hdEnableInternalTestTrigger(0);
+  start = hdTimestamp();
+
+  while(ev->nevents < nevents + 1)
+    {
+      nread = hdCalibrateRead(ev);
+      if(nread == ERROR)
+	{
+	  rval = ERROR;
+	  break;
+	}
+
+      if((hdTimestamp() - start) > (uint64_t)cal->timeoutMs * 1000000ULL)
+	{
+	  printf("%s: ERROR: %d of %d test triggers in %d ms\n",
+		 __func__, ev->nevents, nevents + 1, cal->timeoutMs);
+	  rval = ERROR;
+	  break;
+	}
+
+      /* Nothing ready yet: leave the bus alone a while */
+      if(nread == 0)
+	usleep(HD_POLL_INTERVAL_US);
+    }
+
+  hdDisableInternalTestTrigger(0);
+
+  cal->nevents += ev->nevents;
+
+  return rval;
+}
+
+/* Whether the events at dataInputDelay see the window of their test
+   trigger (PATTERN_SYNC).  Returns 1 if all of them do, 0 if not,
+   otherwise ERROR */
+static int32_t
+hdCalibrateProbe(HD_DELAY_CALIBRATION *cal, HD_EVENTS *ev, uint16_t dataInputDelay)
+{
+  uint32_t iev;
+
+  if(hdSetProcDelay(dataInputDelay, cal->triggerLatencyDelay) != OK)
+    return ERROR;
+
+  if(hdConfirmProcDelay(0) != OK)
+    return ERROR;
+
+  if(hdCalibrateCollect(cal, ev, cal->neventsPerStep) != OK)
+    return ERROR;
+
+  cal->nsteps++;
+
+  for(iev = 1; iev < ev->nevents; iev++)
+    if((ev->flags[iev] & HD_EVENT_FLAG_NO_DECODER_DATA) ||
+       !(ev->patternSyncHistory[iev] & 1))
+      return 0;
+
+  return 1;
+}
+
+/* Last aligned delay from aligned, going in direction dir (+1, -1):
+   exponential steps to the first misaligned one, then bisection */
+static int32_t
+hdCalibrateEdge(HD_DELAY_CALIBRATION *cal, HD_EVENTS *ev, int32_t aligned,
+		int32_t dir)
+{
+  int32_t good = aligned, bad = -1, step = 1, next, rval;
+
+  while(bad < 0)
+    {
+      next = good + dir * step;
+      next = (next < 1) ? 1 : (next > 0xFFF) ? 0xFFF : next;
+      if(next == good)
+	return good;  /* Aligned to the end of the range */
+
+      rval = hdCalibrateProbe(cal, ev, next);
+      if(rval == ERROR)
+	return ERROR;
+
+      if(rval)
+	{
+	  good = next;
+	  step <<= 1;
+	}
+      else
+	bad = next;
+    }
+
+  while(abs(bad - good) > 1)
+    {
+      next = (good + bad) / 2;
+
+      rval = hdCalibrateProbe(cal, ev, next);
+      if(rval == ERROR)
+	return ERROR;
+
+      if(rval)
+	good = next;
+      else
+	bad = next;
+    }
+
+  return good;
+}
+
+/**
+ * @ingroup Analysis
+ * @brief Calibrate the data input delay with the internal test trigger.
+ *
+ *   The test trigger fires testTriggerDelay after each PATTERN_SYNC.  With
+ *   the trigger latency delay held, the data input delay is searched for
+ *   the band where its events see PATTERN_SYNC (the window they were
+ *   triggered in), starting from the middle of the band expected from the
+ *   generator's window length.  Each delay is checked with the
+ *   confirmation registers (hdConfirmProcDelay).  The middle of the band is
+ *   programmed, and validated: every event must see PATTERN_SYNC, PAIR_SYNC
+ *   and the pattern helicity in its own window.
+ *
+ *   The module must be enabled (hdEnable), with the helicity signal
+ *   running and no other triggers.  The blocklevel and test trigger
+ *   settings are restored.  The original processing delays are restored
+ *   if the calibration fails.
+ *
+ * @param cal Settings, and results
+ * @param pflag Print Flag
+ *           !0 = Print the results to standard out
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdCalibrateProcDelay(HD_DELAY_CALIBRATION *cal, int32_t pflag)
+{
+  int32_t rval = OK, centre, aligned = -1, step, ioff, side, d, lo, hi, probe;
+  uint16_t savedData = 0, savedLatency = 0, settleTime;
+  uint32_t savedTestDelay = 0, stableTime, seed, window, iev;
+  uint8_t pattern, windowDelay;
+  int32_t savedBlocklevel, testEnabled;
+  HD_SNAPSHOT snap;
+  HD_EVENTS ev;
+
+  if((cal == NULL) || (cal->triggerLatencyDelay == 0) ||
+     (cal->triggerLatencyDelay > HD_DELAY_TRIGGER_MASK))
+    {
+      printf("%s: ERROR: Invalid arguments\n", __func__);
+      return ERROR;
+    }
+
+  if(cal->neventsPerStep == 0)
+    cal->neventsPerStep = 8;
+  if(cal->timeoutMs == 0)
+    cal->timeoutMs = 5000;
+
+  cal->lo = cal->hi = cal->dataInputDelay = 0;
+  cal->nsteps = cal->nevents = cal->nvalidated = cal->nmisaligned = 0;
+
+  /* Window length, in trigger time ticks */
+  if(hdGetHelicityGeneratorConfig(&pattern, &windowDelay,
+				  &settleTime, &stableTime, &seed) != OK)
+    return ERROR;
+  window = HD_GENERATOR_TICKS * (settleTime + stableTime);
+
+  if(cal->testTriggerDelay == 0)
+    cal->testTriggerDelay = HD_GENERATOR_TICKS * settleTime +
+      (HD_GENERATOR_TICKS * stableTime) / 2;
+
+  if((cal->testTriggerDelay == 0) ||
+     (cal->testTriggerDelay > HD_INT_TESTTRIG_DELAY_MASK))
+    {
+      printf("%s: ERROR: Invalid test trigger delay (%d)\n",
+	     __func__, cal->testTriggerDelay);
+      return ERROR;
+    }
+
+  if(hdEventsAlloc(&ev, 4 * cal->neventsPerStep + 1) != OK)
+    return ERROR;
+
+  /* Settings to restore */
+  hdGetProcDelay(&savedData, &savedLatency);
+  hdGetInternalTestTriggerDelay(&savedTestDelay);
+  savedBlocklevel = hdGetBlocklevel();
+  if(hdSnapshot(&snap) != OK)
+    {
+      hdEventsFree(&ev);
+      return ERROR;
+    }
+  testEnabled = (snap.reg.ctrl1 & HD_CTRL1_INT_TESTTRIG_ENABLE) ? 1 : 0;
+
+  hdDisableInternalTestTrigger(0);
+  hdSetInternalTestTriggerDelay(cal->testTriggerDelay);
+  hdSetBlocklevel(1);
+
+  /* The sample at trigger + latency - data delay is in the trigger's
+     window for data delays in (T + L - window, T + L] */
+  centre = (int32_t)cal->testTriggerDelay + cal->triggerLatencyDelay -
+    (int32_t)window / 2;
+  centre = (centre < 1) ? 1 : (centre > 0xFFF) ? 0xFFF : centre;
+  step = (window >= 4) ? window / 4 : 64;
+
+  for(ioff = 0; (aligned < 0) && (ioff * step < 0x1000); ioff++)
+    {
+      for(side = 1; (side >= -1) && (aligned < 0); side -= 2)
+	{
+	  d = centre + side * ioff * step;
+	  if((d < 1) || (d > 0xFFF) || ((ioff == 0) && (side < 0)))
+	    continue;
+
+	  probe = hdCalibrateProbe(cal, &ev, d);
+	  if(probe == ERROR)
+	    {
+	      rval = ERROR;
+	      goto DONE;
+	    }
+	  if(probe)
+	    aligned = d;
+	}
+    }
+
+  if(aligned < 0)
+    {
+      printf("%s: ERROR: No data input delay with the helicity aligned\n",
+	     __func__);
+      rval = ERROR;
+      goto DONE;
+    }
+
+  lo = hdCalibrateEdge(cal, &ev, aligned, -1);
+  hi = hdCalibrateEdge(cal, &ev, aligned, 1);
+  if((lo == ERROR) || (hi == ERROR))
+    {
+      rval = ERROR;
+      goto DONE;
+    }
+
+  cal->lo = lo;
+  cal->hi = hi;
+  cal->dataInputDelay = (lo + hi) / 2;
+
+  /* Validate at the chosen delay */
+  if((hdSetProcDelay(cal->dataInputDelay, cal->triggerLatencyDelay) != OK) ||
+     (hdConfirmProcDelay(0) != OK) ||
+     (hdCalibrateCollect(cal, &ev, 4 * cal->neventsPerStep) != OK))
+    {
+      rval = ERROR;
+      goto DONE;
+    }
+
+  for(iev = 1; iev < ev.nevents; iev++)
+    {
+      cal->nvalidated++;
+      if((ev.flags[iev] & HD_EVENT_FLAG_NO_DECODER_DATA) ||
+	 !(ev.patternSyncHistory[iev] & 1) || !(ev.pairSyncHistory[iev] & 1) ||
+	 ((ev.helicityHistory[iev] ^ ev.patternHelicityHistory[iev]) & 1))
+	cal->nmisaligned++;
+    }
+
+  if(cal->nmisaligned)
+    {
+      printf("%s: ERROR: %d of %d events misaligned at dataInputDelay 0x%03x\n",
+	     __func__, cal->nmisaligned, cal->nvalidated, cal->dataInputDelay);
+      rval = ERROR;
+    }
+
+ DONE:
+  if((rval != OK) && savedData && savedLatency)
+    hdSetProcDelay(savedData, savedLatency);
+
+  hdCalibrateRead(NULL);
+  hdSetInternalTestTriggerDelay(savedTestDelay);
+  if(testEnabled)
+    hdEnableInternalTestTrigger(0);
+  if(savedBlocklevel > 0)
+    hdSetBlocklevel(savedBlocklevel);
+
+  hdEventsFree(&ev);
+
+  if(rval == OK)
+    rval = hdConfirmProcDelay(pflag);
+
+  if(pflag)
+    {
+      printf("%s: triggerLatencyDelay 0x%03x  testTriggerDelay %d\n",
+	     __func__, cal->triggerLatencyDelay, cal->testTriggerDelay);
+      printf("%s: Aligned for dataInputDelay 0x%03x - 0x%03x.  %s 0x%03x\n",
+	     __func__, cal->lo, cal->hi, (rval == OK) ? "Set" : "FAILED at",
+	     cal->dataInputDelay);
+      printf("%s: %d steps, %d events, %d of %d validated events misaligned\n",
+	     __func__, cal->nsteps, cal->nevents, cal->nmisaligned, cal->nvalidated);
+    }
+
+  return rval;
+}
@@ -0,0 +1,245 @@
+#pragma once
+/******************************************************************************
+ *
+ *  hdHelicityTools.h -  Header for software helicity analysis tools for
+ *                       data from the JLab helicity decoder
+ *
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include "hdLib.h"
+
+/* Event table, structure of arrays.  One entry per triggered event. */
+typedef struct hd_events_struct
+{
+  uint32_t nevents;
+  uint32_t maxevents;
+
+  /* Filled by hdEventsFill */
+  uint32_t *eventNumber;
+  uint64_t *trigTime;                 /* 48-bit trigger time (8 ns) */
+  uint32_t *shiftReg;
+  uint32_t *windowCount;
+  uint32_t *patternCount;
+  uint32_t *pairCount;
+  uint32_t *patternSyncHistory;
+  uint32_t *pairSyncHistory;
+  uint32_t *helicityHistory;
+  uint32_t *patternHelicityHistory;
+
+  /* Filled by hdPatternTrackerAnnotate */
+  uint32_t *patternNumber;
+  uint32_t *windowIndex;
+  uint8_t  *phase;
+  uint8_t  *flags;
+
+  /* Filled by hdTimingMap */
+  uint32_t *windowOffset;             /* Ticks since start of window (8 ns) */
+} HD_EVENTS;
+
+/* HD_EVENTS flags bits */
+#define HD_EVENT_FLAG_NO_DECODER_DATA  (1 << 0)
+#define HD_EVENT_FLAG_NO_PATTERN_SYNC  (1 << 1)
+#define HD_EVENT_FLAG_PHASE_ERROR      (1 << 2)
+#define HD_EVENT_FLAG_TSETTLE          (1 << 3)  /* In T_SETTLE of window+1 */
+#define HD_EVENT_FLAG_TIMING_AMBIGUOUS (1 << 4)
+
+/* Pattern phase and window index tracker */
+typedef struct hd_pattern_tracker_struct
+{
+  uint32_t patternSize;     /* Windows per pattern */
+  uint32_t syncWindow;      /* Window count at the last known PATTERN_SYNC */
+  uint32_t syncValid;
+  uint32_t nevents;
+  uint32_t nerrors;
+} HD_PATTERN_TRACKER;
+
+/* Continuous helicity history, one byte per helicity window */
+#define HD_HISTORY_PATTERN_SYNC           (1 << 0)
+#define HD_HISTORY_PAIR_SYNC              (1 << 1)
+#define HD_HISTORY_HELICITY               (1 << 2)
+#define HD_HISTORY_PATTERN_HELICITY       (1 << 3)
+#define HD_HISTORY_GAP                    (1 << 7)
+
+typedef struct hd_history_stitcher_struct
+{
+  pthread_mutex_t lock;
+  uint32_t size;            /* Ring size in windows, power of 2 */
+  uint8_t *ring;
+  uint64_t nwindows;        /* Windows written to the ring */
+
+  uint32_t valid;
+  uint32_t lastCount;       /* Window count of the last snapshot */
+  uint32_t last[4];         /* Last history register snapshot */
+
+  uint32_t nsamples;
+  uint32_t ngaps;           /* Discontinuities in the stream */
+  uint64_t nlost;           /* Windows lost in those discontinuities */
+  uint32_t nrealigned;      /* Snapshots aligned by overlap, not count */
+
+  /* Polling thread */
+  pthread_t thread;
+  uint32_t periodUs;
+  volatile int32_t run;
+} HD_HISTORY_STITCHER;
+
+/* Helicity-pattern asymmetry accumulator */
+#define HD_ASYM_MAX_CHANNELS  8
+#define HD_ASYM_CHANNEL_RATE  0    /* Channel filled with trigger counts */
+#define HD_ASYM_MAX_PENDING   512  /* Windows with triggers, waiting for their
+				      reported helicity */
+
+typedef struct hd_asymmetry_struct
+{
+  uint32_t nchannels;
+  uint32_t delayWindows;    /* Helicity reporting delay */
+
+  /* Pattern being accumulated */
+  uint32_t patternOpen;
+  uint32_t patternNumber;
+  uint32_t nplus, nminus;   /* hdAsymmetryAdd samples */
+  uint32_t rateCounts;      /* Trigger counts from hdAsymmetryAddEvents */
+  uint32_t rateLost;        /* Trigger counts with no reported helicity */
+  double plus[HD_ASYM_MAX_CHANNELS];
+  double minus[HD_ASYM_MAX_CHANNELS];
+
+  /* Trigger counts per window, until the window's helicity is reported */
+  struct
+  {
+    uint32_t window;
+    uint32_t patternNumber;
+    uint32_t count;
+  } pending[HD_ASYM_MAX_PENDING];
+  uint32_t pendingHead;
+  uint32_t pendingTail;
+
+  /* Last completed pattern */
+  double last[HD_ASYM_MAX_CHANNELS];
+  uint32_t lastPatternNumber;
+
+  /* Running mean and variance (Welford) over completed patterns */
+  uint64_t npatterns;
+  uint64_t nrejected;       /* Patterns with no channel complete */
+  uint64_t n[HD_ASYM_MAX_CHANNELS];  /* Patterns in each channel's mean */
+  double mean[HD_ASYM_MAX_CHANNELS];
+  double m2[HD_ASYM_MAX_CHANNELS];
+} HD_ASYMMETRY;
+
+/* Helicity sequence checker */
+#define HD_SEQ_ERROR_DROPPED_WINDOW   0  /* PATTERN_SYNC before end of pattern */
+#define HD_SEQ_ERROR_SYNC_SLIP        1  /* No PATTERN_SYNC at end of pattern */
+#define HD_SEQ_ERROR_INVERTED_BIT     2  /* Single helicity bit wrong */
+#define HD_SEQ_ERROR_DROPPED_PATTERN  3  /* Pseudo-random sequence skipped */
+#define HD_SEQ_ERROR_LOST_LOCK        4  /* Sequence lost, reacquiring seed */
+#define HD_SEQ_NERROR_TYPES           5
+
+#define HD_SEQ_LOG_SIZE   64
+#define HD_SEQ_LOOKAHEAD  6  /* Patterns used to classify a mismatch */
+
+typedef struct hd_seq_error_struct
+{
+  uint64_t window;          /* Window index in the checked stream */
+  uint32_t pattern;         /* Pattern index in the checked stream */
+  uint32_t type;
+} HD_SEQ_ERROR;
+
+typedef struct hd_seq_checker_struct
+{
+  uint32_t patternSize;
+  uint32_t templ;           /* Helicity of each window relative to the first */
+
+  /* Position in the window stream */
+  uint64_t nwindows;
+  uint32_t npatterns;
+  uint32_t pos;             /* Window within pattern, patternSize = unknown */
+  uint32_t first;           /* Reported helicity of the first window */
+
+  /* Pseudo-random sequence */
+  uint32_t seed;
+  uint32_t nseed;           /* Bits collected, locked at 30 */
+  uint32_t pending;         /* Bits collected since a mismatch */
+  uint32_t pendingBits;
+
+  uint32_t nerrors[HD_SEQ_NERROR_TYPES];
+  uint32_t nlog;
+  HD_SEQ_ERROR log[HD_SEQ_LOG_SIZE];
+} HD_SEQ_CHECKER;
+
+/* Trigger to helicity window timing */
+typedef struct hd_timing_struct
+{
+  uint32_t settleTicks;
+  uint32_t stableTicks;
+  uint32_t period;
+
+  /* Bounds on the time of T_STABLE rising edge 0, from all triggers so far */
+  uint32_t valid;
+  int64_t lo;
+  int64_t hi;
+
+  uint32_t nevents;
+  uint32_t nsettle;
+  uint32_t nambiguous;
+  uint32_t nresync;         /* Bounds restarted after inconsistent triggers */
+} HD_TIMING;
+
+/* Processing delay calibration, with the internal test trigger */
+typedef struct hd_delay_calibration_struct
+{
+  /* Settings */
+  uint16_t triggerLatencyDelay;  /* Held fixed (8 ns) */
+  uint32_t testTriggerDelay;     /* After PATTERN_SYNC (8 ns), 0 = middle of
+				    the generator's stable time */
+  uint32_t neventsPerStep;       /* 0 = 8 */
+  uint32_t timeoutMs;            /* Per step, 0 = 5000 */
+
+  /* Results: data input delays with the helicity aligned, and the choice */
+  uint16_t lo;
+  uint16_t hi;
+  uint16_t dataInputDelay;
+  uint32_t nsteps;
+  uint32_t nevents;
+  uint32_t nvalidated;
+  uint32_t nmisaligned;
+} HD_DELAY_CALIBRATION;
+
+int32_t hdEventsAlloc(HD_EVENTS *ev, uint32_t maxevents);
+void    hdEventsFree(HD_EVENTS *ev);
+void    hdEventsClear(HD_EVENTS *ev);
+int32_t hdEventsFill(HD_EVENTS *ev, const uint32_t *data, int32_t nwords);
+
+int32_t hdPatternTrackerInit(HD_PATTERN_TRACKER *t, uint8_t pattern);
+int32_t hdPatternTrackerAnnotate(HD_PATTERN_TRACKER *t, HD_EVENTS *ev,
+				 uint32_t first, uint32_t n);
+
+int32_t hdHistoryStitcherInit(HD_HISTORY_STITCHER *s, uint32_t size);
+void    hdHistoryStitcherFree(HD_HISTORY_STITCHER *s);
+int32_t hdHistoryAlign(const uint32_t *prev, const uint32_t *cur);
+int32_t hdHistoryStitch(HD_HISTORY_STITCHER *s, const uint32_t *history,
+			uint32_t windowCount);
+int32_t hdHistorySample(HD_HISTORY_STITCHER *s);
+int32_t hdHistoryRead(HD_HISTORY_STITCHER *s, uint64_t *cursor,
+		      uint8_t *out, uint32_t max);
+int32_t hdHistorySamplerStart(HD_HISTORY_STITCHER *s, uint32_t periodUs);
+int32_t hdHistorySamplerStop(HD_HISTORY_STITCHER *s);
+
+int32_t hdAsymmetryInit(HD_ASYMMETRY *a, uint32_t nchannels);
+int32_t hdAsymmetrySetDelay(HD_ASYMMETRY *a, uint32_t delayWindows);
+int32_t hdAsymmetryAdd(HD_ASYMMETRY *a, uint8_t helicity, const double *yield);
+int32_t hdAsymmetryPatternEnd(HD_ASYMMETRY *a);
+int32_t hdAsymmetryAddEvents(HD_ASYMMETRY *a, const HD_EVENTS *ev,
+			     uint32_t first, uint32_t n);
+int32_t hdAsymmetryGet(HD_ASYMMETRY *a, uint32_t channel, double *last,
+		       double *mean, double *variance, double *error);
+
+uint32_t hdSeqNextBit(uint32_t *seed);
+int32_t hdSeqCheckerInit(HD_SEQ_CHECKER *c, uint8_t pattern);
+int32_t hdSeqCheckWindows(HD_SEQ_CHECKER *c, const uint8_t *windows, uint32_t n);
+int32_t hdSeqCheckerPrint(HD_SEQ_CHECKER *c);
+
+int32_t hdTimingInit(HD_TIMING *e, uint32_t settleTicks, uint32_t stableTicks);
+int32_t hdTimingInitFromModule(HD_TIMING *e);
+int32_t hdTimingMap(HD_TIMING *e, HD_EVENTS *ev, uint32_t first, uint32_t n);
+
+int32_t hdCalibrateProcDelay(HD_DELAY_CALIBRATION *cal, int32_t pflag);
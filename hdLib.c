@@ -22,38 +22,156 @@
 #else
 #include <unistd.h>
 #include <stddef.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #endif
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "jvme.h"
 
 #include "hdLib.h"
+#include "hdAccess.h"
 
 #ifndef __JVME_DEVADDR_T
 #define __JVME_DEVADDR_T
 typedef unsigned long devaddr_t;
 #endif
 
-volatile HD *hdp=NULL;	  /* pointer to HD memory map */
-static volatile uint32_t *hdDatap=NULL; /* pointer to HD data memory map */
-static devaddr_t hdA24Offset = 0; /* Offset between VME A24 and Local address space */
-static devaddr_t hdA32Offset = 0x09000000; /* Offset between VME A32 and Local address space */
-static devaddr_t hdA32Base = 0x09000000; /* VME A32 to use for data */
+#define HD_NREGS (sizeof(HD) >> 2)
 
-
-/* Mutex for thread safe read/writes */
-pthread_mutex_t hdMutex = PTHREAD_MUTEX_INITIALIZER;
+/* Per board library state */
+typedef struct hd_board_struct
+{
+  volatile HD *regs;	  /* pointer to HD memory map */
+  volatile uint32_t *datap; /* pointer to HD data memory map */
+  devaddr_t a24Offset;	  /* Offset between VME A24 and Local address space */
+  devaddr_t a32Offset;	  /* Offset between VME A32 and Local address space */
+  devaddr_t a32Base;	  /* VME A32 to use for data */
+
+  pthread_mutex_t mutex;  /* hdMutex, for thread safe read/writes */
+  HD_LOCK_STATS *lockHolder; /* hdMutex profiling: current holder */
+  uint64_t lockAcquired;
+
+  /* Staged configuration, from hdConfigBegin to hdConfigCommit.
+     Per register: bits to clear, then bits to set */
+  pthread_mutex_t stageMutex;
+  int32_t staging;
+  pthread_t stageOwner;
+  uint32_t stageClear[HD_NREGS];
+  uint32_t stageSet[HD_NREGS];
+
+  HD_READOUT_STATS readoutStats; /* From hdReadBlock */
+  int32_t settleSignalSourcesUs; /* Last measured settle times, in us */
+  int32_t settleGeneratorUs;
+  char checkpointFile[256];	 /* Checked by hdInit with HD_INIT_WARM */
+} HD_BOARD;
+
+#define HD_A32_BASE_DEFAULT 0x09000000
+#define HD_A32_BASE_STEP    0x00800000  /* Per board, from hdInitAll */
+
+static HD_BOARD hdBoard[HD_MAX_BOARDS] =
+  {
+    [0 ... HD_MAX_BOARDS - 1] =
+    {
+      .a32Offset = HD_A32_BASE_DEFAULT,
+      .a32Base = HD_A32_BASE_DEFAULT,
+      .mutex = PTHREAD_MUTEX_INITIALIZER,
+      .stageMutex = PTHREAD_MUTEX_INITIALIZER
+    }
+  };
+static int32_t hdNboards = 0;
+static __thread int32_t hdSelected = 0; /* Board used by the hd* routines,
+					   in this thread */
+
+/* The hd* routines act on the board selected in the calling thread
+   (hdSelect).  HDBOARD resolves it once, at the top of the routine
+   (CHECKINIT does it), and the per board names below go through it. */
+#define HDBOARD     HD_BOARD *const hdb = &hdBoard[hdSelected]
+#define hdp         (hdb->regs)
+#define hdDatap     (hdb->datap)
+#define hdA24Offset (hdb->a24Offset)
+#define hdA32Offset (hdb->a32Offset)
+#define hdA32Base   (hdb->a32Base)
+#define hdMutex     (hdb->mutex)
+#define hdCheckpointFile        (hdb->checkpointFile)
+#define hdReadoutStats          (hdb->readoutStats)
+#define hdSettleSignalSourcesUs (hdb->settleSignalSourcesUs)
+#define hdSettleGeneratorUs     (hdb->settleGeneratorUs)
+#define hdStageMutex            (hdb->stageMutex)
+#define hdStaging               (hdb->staging)
+#define hdStageOwner            (hdb->stageOwner)
+#define hdStageClear            (hdb->stageClear)
+#define hdStageSet              (hdb->stageSet)
+
+static char hdDiscoveryCache[256] = ""; /* hdFindAll results, per crate */
+static pthread_mutex_t hdDiscoveryMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* DMA-capable buffer for register block transfers, per thread */
+static __thread volatile uint32_t *hdSnapshotDmaBuf = NULL;
+
+
+/* hdMutex of the board, for thread safe read/writes */
+#ifdef HD_LOCK_PROFILE
+/* Wait and hold times per call site, see hdLockProfilePrint */
+#define HLOCK   {							\
+    static HD_LOCK_STATS _hdLockSite = {__func__, __LINE__};		\
+    hdLockProfileLock(&_hdLockSite);					\
+  }
+#define HUNLOCK hdLockProfileUnlock();
+#else
 #define HLOCK   if(pthread_mutex_lock(&hdMutex)<0) perror("pthread_mutex_lock");
 #define HUNLOCK if(pthread_mutex_unlock(&hdMutex)<0) perror("pthread_mutex_unlock");
+#endif
 
-#define CHECKINIT {							\
-    if(hdp == NULL)							\
-      {                                                                 \
-        logMsg("%s: ERROR: Helcity Decoder is not initialized \n",	\
-               __func__,2,3,4,5,6);					\
-        return ERROR;                                                   \
-      }                                                                 \
-  }
+/* Single register read, without hdMutex.  One bus cycle is atomic on the
+   bus, so status getters need not wait behind hdReadBlock.  Sequences of
+   registers, and read-modify-write, must still use HLOCK / HUNLOCK. */
+#define HREAD(_reg) hdRead32(&hdp->_reg)
+
+/* hdMutex profiling.  The sites are shared by the boards, and protected
+   by hdLockProfileMutex.  The current holder is per board, protected by
+   its hdMutex */
+static pthread_mutex_t hdLockProfileMutex = PTHREAD_MUTEX_INITIALIZER;
+static HD_LOCK_STATS *hdLockSites[HD_LOCK_PROFILE_MAX_SITES];
+static int32_t hdLockNsites = 0;
+
+/* Configuration waits: poll the hardware, without hdMutex, instead of a
+   fixed delay.  Last measured settle times, in us */
+#define HD_PLL_LOCK_STABLE_US      1000
+#define HD_PLL_LOCK_TIMEOUT_US     1000000
+#define HD_PLL_UNLOCK_TIMEOUT_US   10000    /* For the old lock to drop */
+#define HD_GENERATOR_MIN_DWELL_US  1000     /* After each generator step */
+#define HD_REGISTER_TIMEOUT_US     100000
+
+/* Staged configuration (HD_BOARD) */
+static int32_t hdConfigStaged(HD_BOARD *hdb);
+static void hdConfigStage(HD_BOARD *hdb, uint32_t offset, uint32_t clear,
+			  uint32_t set);
+
+/* In the thread that called hdConfigBegin, stage the field instead of
+   writing the module */
+#define HSTAGE(_reg, _clear, _set)					\
+  if(hdConfigStaged(hdb))						\
+    {									\
+      hdConfigStage(hdb, offsetof(HD, _reg), _clear, _set);		\
+      return rval;							\
+    }
+
+/* Readout statistics from hdReadBlock (HD_BOARD).  Counters are atomic,
+   the timing is only taken when enabled with hdSetReadoutTiming */
+static volatile int32_t hdReadoutTiming = 0;
+
+#define CHECKINIT							\
+  HDBOARD;								\
+  if(hdp == NULL)							\
+    {									\
+      logMsg("%s: ERROR: Helcity Decoder is not initialized \n",	\
+	     __func__,2,3,4,5,6);					\
+      return ERROR;							\
+    }
 
 
 /**
@@ -125,6 +243,9 @@ hdCheckAddresses()
  *  @param iFlag Initialization bit mask
  *     - 0   Ignore firmware check
  *     - 1   Do not initialize the board, just setup the pointers to the registers
+ *     - 2   Attach to a running board: no reset or configuration.  Library
+ *           state (A32 base) is taken from the registers and checked against
+ *           the checkpoint file, if set with hdSetCheckpointFile.
  *
  *  @return OK if successful, otherwise ERROR.
  *
@@ -136,8 +257,9 @@ hdInit(uint32_t vAddr, uint8_t source, uint8_t helSignalSrc, uint32_t iFlag)
   uintptr_t laddr;
   uint32_t rval, boardID = 0, fwVersion = 0;
   int32_t stat;
-  int32_t noBoardInit=0, noFirmwareCheck=0;
+  int32_t noBoardInit=0, noFirmwareCheck=0, warmAttach=0, nboards;
   int32_t supportedVersion = HD_SUPPORTED_FIRMWARE;
+  HDBOARD;
 
 
   /* Check VME address */
@@ -169,8 +291,9 @@ hdInit(uint32_t vAddr, uint8_t source, uint8_t helSignalSrc, uint32_t iFlag)
 
   noBoardInit = (iFlag & HD_INIT_NO_INIT) ? 1 : 0;
   noFirmwareCheck = (iFlag & HD_INIT_IGNORE_FIRMWARE) ? 1 : 0;
+  warmAttach = (iFlag & HD_INIT_WARM) ? 1 : 0;
 
-  stat = vmeBusToLocalAdrs(0x39, (char *)(uintptr_t)vAddr, (char **) &laddr);
+  stat = hdAccessBusToLocalAdrs(0x39, (char *)(uintptr_t)vAddr, (char **) &laddr);
   if (stat != 0)
     {
       printf("%s: ERROR: Error in vmeBusToLocalAdrs res=%d \n",
@@ -189,7 +312,7 @@ hdInit(uint32_t vAddr, uint8_t source, uint8_t helSignalSrc, uint32_t iFlag)
   hdp = (HD *)laddr;
 
   /* Check if this address is readable */
-  stat = vmeMemProbe((char *) (&hdp->version), 4, (char *)&rval);
+  stat = hdMemProbe((char *) (&hdp->version), 4, (char *)&rval);
 
   if (stat != 0)
     {
@@ -238,6 +361,55 @@ hdInit(uint32_t vAddr, uint8_t source, uint8_t helSignalSrc, uint32_t iFlag)
 	    }
 	}
 
+  nboards = hdNboards;
+  while((hdSelected >= nboards) &&
+	!__sync_bool_compare_and_swap(&hdNboards, nboards, hdSelected + 1))
+    nboards = hdNboards;
+
+  /* Attach to a running module: take the library state from its registers,
+     without a reset, and check them against the checkpoint */
+  if(warmAttach)
+    {
+      HD_CHECKPOINT cp;
+      uint32_t adr32 = hdRead32(&hdp->adr32);
+
+      if(adr32 & HD_ADR32_ENABLE)
+	{
+	  uint32_t a32base = (adr32 & HD_ADR32_BASE_MASK) << 16;
+	  devaddr_t a32laddr = 0;
+
+	  if(hdAccessBusToLocalAdrs(0x09, (char *)(devaddr_t)a32base,
+			       (char **)&a32laddr) != 0)
+	    {
+	      printf("%s: ERROR in vmeBusToLocalAdrs(0x09,0x%x,&laddr) \n",
+		     __func__, a32base);
+	      hdp=NULL;
+	      return ERROR;
+	    }
+
+	  HLOCK;
+	  hdA32Base = a32base;
+	  hdA32Offset = a32laddr - hdA32Base;
+	  hdDatap = (uint32_t *)(a32laddr);
+	  HUNLOCK;
+	}
+
+      if(hdCheckpointFile[0] != '\0')
+	{
+	  if((hdCheckpointLoad(hdCheckpointFile, &cp) != OK) ||
+	     (hdCheckpointVerify(&cp, 1) != 0))
+	    {
+	      printf("%s: ERROR: Module does not match checkpoint %s\n",
+		     __func__, hdCheckpointFile);
+	      hdp=NULL;
+	      return ERROR;
+	    }
+	}
+
+      printf("  Attached warm.  A32 base 0x%08x\n", (uint32_t)hdA32Base);
+      return OK;
+    }
+
   /* Check if we should exit here, or initialize some board defaults */
   if(noBoardInit)
     {
@@ -281,441 +453,2205 @@ hdInit(uint32_t vAddr, uint8_t source, uint8_t helSignalSrc, uint32_t iFlag)
   return OK;
 }
 
+/* hdInitAll work queue */
+typedef struct
+{
+  const uint32_t *vAddr;
+  int32_t nboards;
+  uint8_t source;
+  uint8_t helSignalSrc;
+  uint32_t iFlag;
+  int32_t *status;
+  volatile int32_t next;
+} HD_INIT_QUEUE;
+
+static void *
+hdInitWorker(void *arg)
+{
+  HD_INIT_QUEUE *q = (HD_INIT_QUEUE *)arg;
+  int32_t id;
+
+  while((id = __sync_fetch_and_add(&q->next, 1)) < q->nboards)
+    {
+      hdSelect(id);
+      q->status[id] = hdInit(q->vAddr[id], q->source, q->helSignalSrc,
+			     q->iFlag);
+    }
+
+  return NULL;
+}
+
 /**
  *  @ingroup Config
- *  @brief Find the Helicity Decoder within the prescribed "GEO Slot to A24 VME Address"
- *           range from slot 3 to 21.
+ *  @brief Initialize several Helicity Decoders at once
  *
- *  @return A24 VME address if found.  Otherwise, 0
+ *   Board i is initialized as with hdInit, on a pool of
+ *   HD_INIT_NTHREADS threads, so the waits of each board (PLL lock, ...)
+ *   overlap.  Each board gets its own A32 base,
+ *   0x09000000 + i * 0x00800000.  The selection of the calling thread is
+ *   left as it is; use hdSelect to act on each board.  With HD_INIT_WARM,
+ *   each board is checked against its own checkpoint file
+ *   (hdSetCheckpointFile with that board selected).
+ *
+ *  @param vAddr  A24 VME address (or slot) of each board.
+ *                NULL to use the boards found by hdFindAll.
+ *  @param nboards  Number of boards in vAddr.  Ignored if vAddr is NULL.
+ *  @param source  Clock, Trigger, and SyncReset Source, as in hdInit
+ *  @param helSignalSrc  Helicity signal source, as in hdInit
+ *  @param iFlag  Initialization bit mask, as in hdInit
+ *  @param status  If not NULL, the hdInit result of each board
+ *
+ *  @return Number of boards initialized if all succeeded, otherwise ERROR
  */
-
-uint32_t
-hdFind()
+int32_t
+hdInitAll(const uint32_t *vAddr, int32_t nboards, uint8_t source,
+	  uint8_t helSignalSrc, uint32_t iFlag, int32_t *status)
 {
-  int islot, stat, hdFound=0;
-  unsigned int tAddr, rval;
-  unsigned long laddr;
-
-  for(islot = 3; islot<21; islot++)
+  HD_INIT_QUEUE q;
+  HD_FOUND found[HD_MAX_BOARDS];
+  uint32_t addr[HD_MAX_BOARDS];
+  int32_t result[HD_MAX_BOARDS];
+  pthread_t thread[HD_INIT_NTHREADS];
+  int32_t id, ithread, nthreads = 0, nfail = 0;
+
+  if(vAddr == NULL)
     {
-      tAddr = (islot<<19);
+      nboards = hdFindAll(found, HD_MAX_BOARDS, 0);
+      if(nboards <= 0)
+	{
+	  printf("%s: ERROR: Unable to find Helcity Decoders\n", __func__);
+	  return ERROR;
+	}
+      for(id = 0; id < nboards; id++)
+	addr[id] = found[id].vmeA24;
+      vAddr = addr;
+    }
 
-      stat = vmeBusToLocalAdrs(0x39, (char *)(unsigned long)tAddr, (char **)&laddr);
+  if((nboards <= 0) || (nboards > HD_MAX_BOARDS))
+    {
+      printf("%s: ERROR: Invalid number of boards (%d)\n", __func__, nboards);
+      return ERROR;
+    }
 
-      if(stat != 0)
-	continue;
+  for(id = 0; id < nboards; id++)
+    {
+      pthread_mutex_lock(&hdBoard[id].mutex);
+      hdBoard[id].a32Base = HD_A32_BASE_DEFAULT + id * HD_A32_BASE_STEP;
+      pthread_mutex_unlock(&hdBoard[id].mutex);
+      result[id] = ERROR;
+    }
 
-      /* Check if this address is readable */
-      stat = vmeMemProbe((char *)(laddr), 4, (char *)&rval);
+  q.vAddr = vAddr;
+  q.nboards = nboards;
+  q.source = source;
+  q.helSignalSrc = helSignalSrc;
+  q.iFlag = iFlag;
+  q.status = result;
+  q.next = 0;
 
-      if (stat != 0)
+  for(ithread = 0; (ithread < HD_INIT_NTHREADS) && (ithread < nboards);
+      ithread++)
+    {
+      if(pthread_create(&thread[ithread], NULL, hdInitWorker, &q) != 0)
 	{
-	  continue;
+	  perror("pthread_create");
+	  break;
 	}
-      else
+      nthreads++;
+    }
+
+  /* No threads: initialize them here */
+  if(nthreads == 0)
+    hdInitWorker(&q);
+
+  for(ithread = 0; ithread < nthreads; ithread++)
+    pthread_join(thread[ithread], NULL);
+
+  for(id = 0; id < nboards; id++)
+    {
+      if(result[id] != OK)
 	{
-	  /* Check that it is the helicity decoder */
-	  if(((rval & HD_VERSION_BOARD_TYPE_MASK) >> 16) != HD_VERSION_BOARD_TYPE)
-	    {
-	      continue;
-	    }
-	  else
-	    {
-	      printf("%s: Found Helicity Decoder at 0x%08x\n",
-		     __func__,tAddr);
-	      hdFound=1;
-	      break;
-	    }
+	  printf("%s: ERROR: Board %d (0x%06x) failed to initialize\n",
+		 __func__, id, vAddr[id]);
+	  nfail++;
 	}
+      if(status != NULL)
+	status[id] = result[id];
     }
 
-  if(hdFound)
-    return tAddr;
-  else
-    return 0;
-
+  return (nfail == 0) ? nboards : ERROR;
 }
 
 /**
- * @ingroup Status
- * @brief Print some status information module to standard out
+ *  @ingroup Config
+ *  @brief Select the board the hd* routines act on, in the calling thread
  *
- * @param pflag if pflag>0, print out raw registers
+ *   The selection is per thread: each thread starts on board 0, and
+ *   selecting a board does not change what other threads act on.
  *
+ *  @param id  Board index, as in hdInitAll.  0 for hdInit.
+ *
+ *  @return OK if successful, otherwise ERROR
  */
+int32_t
+hdSelect(int32_t id)
+{
+  if((id < 0) || (id >= HD_MAX_BOARDS))
+    {
+      printf("%s: ERROR: Invalid board (%d)\n", __func__, id);
+      return ERROR;
+    }
+
+  hdSelected = id;
+
+  return OK;
+}
 
+/**
+ *  @ingroup Status
+ *  @brief Return the board the hd* routines act on, in this thread
+ *
+ *  @return Board index
+ */
 int32_t
-hdStatus(int pflag)
+hdGetSelected()
 {
-  HD rv;
-  CHECKINIT;
+  return hdSelected;
+}
 
-  uint32_t vmeAddr = (uint32_t)(devaddr_t)hdp - hdA24Offset;
+/**
+ *  @ingroup Status
+ *  @brief Return the number of boards initialized
+ *
+ *  @return Number of boards
+ */
+int32_t
+hdGetNboards()
+{
+  return hdNboards;
+}
 
-#ifndef READHD
-#define READHD(_reg)				\
-  rv._reg = vmeRead32(&hdp->_reg);
-#endif
+/**
+ *  @ingroup Status
+ *  @brief Return the register map of the selected board
+ *
+ *  @return Pointer to the registers, or NULL if not initialized
+ */
+volatile HD *
+hdGetRegs()
+{
+  HDBOARD;
 
-  HLOCK;
-  READHD(version);
-  READHD(csr);
-  READHD(ctrl1);
-  READHD(ctrl2);
-  READHD(adr32);
-  READHD(blk_size);
-  READHD(delay);
-  READHD(intr);
-  READHD(int_testtrig_delay);
-  HUNLOCK;
+  return hdp;
+}
 
-#ifndef PREG
-#define PREG(_off, _reg)						\
-      printf("  %10.18s (0x%04lx) = 0x%08x%s",				\
-	     #_reg, (unsigned long)&rv._reg - (unsigned long)&rv, rv._reg, \
-	     #_off);
-#endif
+/**
+ *  @ingroup Status
+ *  @brief Return hdMutex of the selected board
+ *
+ *  @return Pointer to the mutex
+ */
+pthread_mutex_t *
+hdGetMutex()
+{
+  HDBOARD;
 
-  printf("\n");
-  printf("--------------------------------------------------------------------------------\n");
-  printf("STATUS for JLab Helicity Decoder\n");
-  if(pflag)
-    {
-      printf("\n");
-      PREG(\t,version);
-      PREG(\n,csr);
-      PREG(\t,ctrl1);
-      PREG(\n,ctrl2);
-      PREG(\t,adr32);
-      PREG(\n,intr);
-      PREG(\t,blk_size);
-      PREG(\n,delay);
-      PREG(\n,int_testtrig_delay);
-    }
+  return &hdMutex;
+}
 
-  printf("\n");
-  printf("  Slot    Type     Rev      FW         A24           A32\n");
-  printf("  ------------------------------------------------------------------------------\n");
-  /*
-   *     "   0    0xdec0    0x01    0x01    0xed0000    0x09000000"
-   */
+/**
+ *  @ingroup Config
+ *  @brief Find the Helicity Decoder within the prescribed "GEO Slot to A24 VME Address"
+ *           range from slot 3 to 21.  Uses the hdFindAll discovery cache,
+ *           so a board just installed in an empty slot is not found until
+ *           the cache is rescanned (see hdFindAll).
+ *
+ *  @return A24 VME address if found.  Otherwise, 0
+ */
 
-  printf("  %2d    ", (rv.intr & HD_INT_GEO_MASK) >> 16);
+uint32_t
+hdFind()
+{
+  HD_FOUND found;
 
-  printf("0x%04x    ", (rv.version & HD_VERSION_BOARD_TYPE_MASK) >> 16);
-  printf("0x%02x    ", (rv.version & HD_VERSION_BOARD_REV_MASK) >> 8);
-  printf("0x%02x    ", rv.version & HD_VERSION_FIRMWARE_MASK);
-  printf("0x%06x    ", vmeAddr);
-  if(rv.adr32 & HD_ADR32_ENABLE)
-    printf("0x%08x", (rv.adr32 & HD_ADR32_BASE_MASK) << 16);
-  else
-    printf("  disabled");
-  printf("\n");
+  if(hdFindAll(&found, 1, 0) <= 0)
+    return 0;
 
+  printf("%s: Found Helicity Decoder at 0x%08x\n",
+	 __func__, found.vmeA24);
 
-  printf("\n");
-  printf("                         Configuration\n\n");
+  return found.vmeA24;
+}
 
-  printf("  .Signal Sources..    .Helicity Src.  Block    .Processing Delay. \n");
-  printf("  Clk   Trig   Sync    Input   Output  Level        Trigger   Data \n");
-  printf("  ------------------------------------------------------------------------------\n");
-  /*
-   *     "  INT    INT    INT    FIBER     INT       1             64    256"
-   *     "                       Inverted  Normal  "
-   */
+/* Probe the version register at an A24 address.  OK if it is a helicity
+   decoder */
+static int32_t
+hdProbe(uint32_t tAddr, uint32_t *version)
+{
+  unsigned long laddr;
+  unsigned int rval;
 
-  printf("  %s    ",
-	 (rv.ctrl1 & HD_CTRL1_CLK_SRC_MASK) == HD_CTRL1_CLK_SRC_P0 ? "VXS" :
-	 (rv.ctrl1 & HD_CTRL1_CLK_SRC_MASK) == HD_CTRL1_CLK_SRC_FP ? " FP" :
-	 (rv.ctrl1 & HD_CTRL1_CLK_SRC_MASK) == HD_CTRL1_CLK_SRC_FP2 ? "FP2" :
-	 (rv.ctrl1 & HD_CTRL1_CLK_SRC_MASK) == HD_CTRL1_CLK_SRC_INT ? "INT" : "???");
+  if(hdAccessBusToLocalAdrs(0x39, (char *)(unsigned long)tAddr, (char **)&laddr) != 0)
+    return ERROR;
 
-  printf("%s    ",
-	 (rv.ctrl1 & HD_CTRL1_TRIG_SRC_MASK) == HD_CTRL1_TRIG_SRC_P0 ? "VXS" :
-	 (rv.ctrl1 & HD_CTRL1_TRIG_SRC_MASK) == HD_CTRL1_TRIG_SRC_FP ? " FP" :
-	 (rv.ctrl1 & HD_CTRL1_TRIG_SRC_MASK) == HD_CTRL1_TRIG_SRC_FP2 ? "FP2" :
-	 (rv.ctrl1 & HD_CTRL1_TRIG_SRC_MASK) == HD_CTRL1_TRIG_SRC_SOFT ? "INT" : "???");
+  if(hdMemProbe((char *)(laddr), 4, (char *)&rval) != 0)
+    return ERROR;
 
-  printf("%s    ",
-	 (rv.ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK) == HD_CTRL1_SYNC_RESET_SRC_P0 ? "VXS" :
-	 (rv.ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK) == HD_CTRL1_SYNC_RESET_SRC_FP ? " FP" :
-	 (rv.ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK) == HD_CTRL1_SYNC_RESET_SRC_FP2 ? "FP2" :
-	 (rv.ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK) == HD_CTRL1_SYNC_RESET_SRC_SOFT ?
-	 "INT" : "???");
+  if(((rval & HD_VERSION_BOARD_TYPE_MASK) >> 16) != HD_VERSION_BOARD_TYPE)
+    return ERROR;
 
-  printf("%s    ",
-	 (rv.ctrl1 & HD_CTRL1_USE_INT_HELICITY) ? "INT   " :
-	 (rv.ctrl1 & HD_CTRL1_HEL_SRC_MASK) == HD_CTRL1_USE_EXT_CU_IN ? "COPPER" :
-	 "FIBER ");
+  *version = rval;
+  return OK;
+}
 
-  printf("%s     ",
-	 (rv.ctrl1 & HD_CTRL1_INT_HELICITY_TO_FP) ? "INT" : "EXT");
+static void
+hdFoundFill(HD_FOUND *found, uint32_t tAddr, uint32_t version)
+{
+  found->vmeA24 = tAddr;
+  found->slot = tAddr >> 19;
+  found->version = version;
+  found->boardRev = (version & HD_VERSION_BOARD_REV_MASK) >> 8;
+  found->firmware = version & HD_VERSION_FIRMWARE_MASK;
+}
 
-  printf("%3d           ",
-	 rv.blk_size & HD_BLOCKLEVEL_MASK);
+/* Discovery cache file, for this crate and user: in $XDG_RUNTIME_DIR, or
+   else /tmp */
+static const char *
+hdDiscoveryCacheName()
+{
+  char host[64] = "";
+  const char *dir = getenv("XDG_RUNTIME_DIR");
 
-  printf("%4d   ",
-	 rv.delay & HD_DELAY_TRIGGER_MASK);
+  if(hdDiscoveryCache[0] == '\0')
+    {
+      gethostname(host, sizeof(host) - 1);
+      if((dir != NULL) && (dir[0] == '/'))
+	snprintf(hdDiscoveryCache, sizeof(hdDiscoveryCache),
+		 "%s/hdFindAll-%s.cache", dir, host);
+      else
+	snprintf(hdDiscoveryCache, sizeof(hdDiscoveryCache),
+		 "/tmp/hdFindAll-%u-%s.cache", (unsigned)geteuid(), host);
+    }
 
-  printf("%4d",
-	   (rv.delay & HD_DELAY_DATA_MASK) >> 16);
-  printf("\n");
-  printf("                       %s",
-	 ((rv.ctrl1 & (HD_CTRL1_HEL_SRC_MASK | HD_CTRL1_INVERT_FIBER_INPUT)) ==
-	  HD_CTRL1_INVERT_FIBER_INPUT) ? "Inverted" :
-	 ((rv.ctrl1 & (HD_CTRL1_HEL_SRC_MASK | HD_CTRL1_INVERT_CU_INPUT)) ==
-	  (HD_CTRL1_USE_EXT_CU_IN | HD_CTRL1_INVERT_CU_INPUT)) ? "Inverted" :
-	 "Normal  ");
+  return hdDiscoveryCache;
+}
 
-  printf("  %s",
-	 (rv.ctrl1 & HD_CTRL1_INVERT_CU_OUTPUT) ?
-	 "Inverted" : "Normal  ");
-  printf("\n");
-  printf("\n");
+/* Read the cache, and check each board with one probe.  Number of boards,
+   or ERROR if the cache is missing or stale: another crate, a board
+   changed, or older than HD_FIND_RESCAN_SEC */
+static int32_t
+hdDiscoveryCacheRead(HD_FOUND *found, int32_t max)
+{
+  FILE *f;
+  char line[128], host[64] = "", cachedHost[64] = "";
+  uint32_t tAddr, cachedVersion, version, slot;
+  unsigned long long scanned = 0;
+  int32_t nfound = 0, rval = OK, fd;
+  struct stat st;
+
+  /* Only a regular file of this user, that no one else can write */
+  fd = open(hdDiscoveryCacheName(), O_RDONLY | O_NOFOLLOW);
+  if(fd < 0)
+    return ERROR;
+
+  if((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+     (st.st_uid != geteuid()) || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+     ((f = fdopen(fd, "r")) == NULL))
+    {
+      close(fd);
+      return ERROR;
+    }
 
+  gethostname(host, sizeof(host) - 1);
 
-  printf("                                                              Internal\n");
-  printf("                          Event       Helicity    Force       Test Trigger\n");
-  printf("  Decoder     Triggers    Build       Generator   Busy        Status     Delay\n");
-  printf("  ------------------------------------------------------------------------------\n");
-  /*
-   *     "  Disabled    Disabled    Disabled    Disabled    Disabled    Disabled   0x3FFFF"
-  */
+  while((rval == OK) && (fgets(line, sizeof(line), f) != NULL))
+    {
+      if(sscanf(line, "# crate %63s", cachedHost) == 1)
+	{
+	  if(strcmp(host, cachedHost) != 0)
+	    rval = ERROR;
+	  continue;
+	}
 
-  printf("  %s    ",
-	 rv.ctrl2 & HD_CTRL2_DECODER_ENABLE ? "ENABLED " : "Disabled");
+      if(sscanf(line, "# scanned %llu", &scanned) == 1)
+	{
+	  if((uint64_t)time(NULL) - scanned > HD_FIND_RESCAN_SEC)
+	    rval = ERROR;
+	  continue;
+	}
 
-  printf("%s    ",
-	 rv.ctrl2 & HD_CTRL2_GO ? "ENABLED " : "Disabled");
+      if(sscanf(line, "%x %x", &tAddr, &cachedVersion) != 2)
+	continue;
+
+      /* Only the slots hdFindAll scans */
+      slot = tAddr >> 19;
+      if((tAddr & 0x7FFFF) || (slot < 3) || (slot > 20))
+	{
+	  rval = ERROR;
+	  continue;
+	}
+
+      if(nfound >= max)
+	break;
+
+      if((hdProbe(tAddr, &version) != OK) || (version != cachedVersion))
+	rval = ERROR;
+      else
+	hdFoundFill(&found[nfound++], tAddr, version);
+    }
+  fclose(f);
+
+  if((rval != OK) || (cachedHost[0] == '\0') || (scanned == 0))
+    return ERROR;
+
+  return nfound;
+}
+
+/* Write the cache to a new file (mode 0600), then rename it into place,
+   so an existing file or link at the name is never written through */
+static void
+hdDiscoveryCacheWrite(const HD_FOUND *found, int32_t nfound)
+{
+  FILE *f;
+  char host[64] = "", tmp[sizeof(hdDiscoveryCache) + 8];
+  int32_t ifound, fd, rval = OK;
+
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", hdDiscoveryCacheName());
+  fd = mkstemp(tmp);
+  if(fd < 0)
+    return;
+
+  f = fdopen(fd, "w");
+  if(f == NULL)
+    {
+      close(fd);
+      unlink(tmp);
+      return;
+    }
+
+  gethostname(host, sizeof(host) - 1);
+  fprintf(f, "# crate %s\n", host);
+  fprintf(f, "# scanned %llu\n", (unsigned long long)time(NULL));
+  for(ifound = 0; ifound < nfound; ifound++)
+    fprintf(f, "0x%06x 0x%08x\n", found[ifound].vmeA24, found[ifound].version);
+  if(ferror(f))
+    rval = ERROR;
+  if(fclose(f) != 0)
+    rval = ERROR;
+
+  if((rval != OK) || (rename(tmp, hdDiscoveryCacheName()) != 0))
+    unlink(tmp);
+}
+
+/**
+ *  @ingroup Config
+ *  @brief Find all Helicity Decoders from slot 3 to 20.
+ *
+ *   Each slot is probed once; the version register read by the probe gives
+ *   the board revision and firmware.  The result is cached for this crate
+ *   and user (see hdSetDiscoveryCache).  A cache file that is not a
+ *   regular file owned by the user, is writable by others, or lists a
+ *   slot outside 3 to 20, is ignored.  While the cache is valid, a repeat call
+ *   only probes the cached boards, instead of scanning every slot.  The
+ *   scan stops early when found is full; that result is not cached.
+ *
+ *   The cached probe does not look at empty slots.  A board installed in
+ *   one is only found by the next full scan: when the cache is older than
+ *   HD_FIND_RESCAN_SEC, with HD_FIND_NO_CACHE, or after
+ *   hdDiscoveryCacheClear.  A cached board that is removed or replaced
+ *   makes the cache stale at once.
+ *
+ *  @param found  Where to put the boards found, in slot order
+ *  @param max    Size of found
+ *  @param fflag  Options
+ *     - HD_FIND_NO_CACHE  Scan the crate, ignoring the cache
+ *
+ *  @return Number of boards found, or ERROR
+ */
+int32_t
+hdFindAll(HD_FOUND *found, int32_t max, uint32_t fflag)
+{
+  int32_t islot, nfound = 0;
+  uint32_t version;
+
+  if((found == NULL) || (max <= 0))
+    {
+      printf("%s: ERROR: Invalid found array\n", __func__);
+      return ERROR;
+    }
+
+  pthread_mutex_lock(&hdDiscoveryMutex);
+  if(!(fflag & HD_FIND_NO_CACHE))
+    {
+      nfound = hdDiscoveryCacheRead(found, max);
+      if(nfound > 0)
+	{
+	  pthread_mutex_unlock(&hdDiscoveryMutex);
+	  return nfound;
+	}
+    }
+
+  nfound = 0;
+  for(islot = 3; (islot < 21) && (nfound < max); islot++)
+    {
+      if(hdProbe(islot << 19, &version) == OK)
+	hdFoundFill(&found[nfound++], islot << 19, version);
+    }
+
+  /* Only a full scan is cached */
+  if((nfound > 0) && (islot == 21))
+    hdDiscoveryCacheWrite(found, nfound);
+  pthread_mutex_unlock(&hdDiscoveryMutex);
+
+  return nfound;
+}
+
+/**
+ *  @ingroup Config
+ *  @brief Set the discovery cache file used by hdFindAll
+ *
+ *  @param filename  Cache file.  NULL for the default,
+ *                   $XDG_RUNTIME_DIR/hdFindAll-<hostname>.cache, or
+ *                   /tmp/hdFindAll-<uid>-<hostname>.cache without it
+ *
+ *  @return OK
+ */
+int32_t
+hdSetDiscoveryCache(const char *filename)
+{
+  pthread_mutex_lock(&hdDiscoveryMutex);
+  if(filename == NULL)
+    hdDiscoveryCache[0] = '\0';
+  else
+    strncpy(hdDiscoveryCache, filename, sizeof(hdDiscoveryCache) - 1);
+  pthread_mutex_unlock(&hdDiscoveryMutex);
+
+  return OK;
+}
+
+/**
+ *  @ingroup Config
+ *  @brief Remove the discovery cache, so the next hdFindAll scans the crate
+ *
+ *  @return OK
+ */
+int32_t
+hdDiscoveryCacheClear()
+{
+  pthread_mutex_lock(&hdDiscoveryMutex);
+  remove(hdDiscoveryCacheName());
+  pthread_mutex_unlock(&hdDiscoveryMutex);
+
+  return OK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Timestamp used for snapshots and monitoring
+ *
+ * @return Monotonic clock, in ns
+ */
+uint64_t
+hdTimestamp()
+{
+  struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int32_t
+hdLockProfileBin(uint64_t ns)
+{
+  int32_t bin = 63 - __builtin_clzll(ns | 1);
+
+  return (bin < HD_LOCK_PROFILE_NBINS) ? bin : HD_LOCK_PROFILE_NBINS - 1;
+}
+
+/**
+ * @ingroup Status
+ * @brief Take hdMutex of the selected board, recording the wait for this
+ *        call site.  Used by HLOCK when built with -DHD_LOCK_PROFILE.
+ *
+ * @param site Statistics of the call site
+ */
+void
+hdLockProfileLock(HD_LOCK_STATS *site)
+{
+  uint64_t start, wait;
+  HDBOARD;
+
+  start = hdTimestamp();
+  if(pthread_mutex_lock(&hdMutex) < 0)
+    perror("pthread_mutex_lock");
+  hdb->lockAcquired = hdTimestamp();
+  wait = hdb->lockAcquired - start;
+
+  pthread_mutex_lock(&hdLockProfileMutex);
+  if(!site->registered && (hdLockNsites < HD_LOCK_PROFILE_MAX_SITES))
+    {
+      hdLockSites[hdLockNsites++] = site;
+      site->registered = 1;
+    }
+
+  site->nlocks++;
+  site->waitNs += wait;
+  if(wait > site->waitMaxNs)
+    site->waitMaxNs = wait;
+  site->waitHist[hdLockProfileBin(wait)]++;
+  pthread_mutex_unlock(&hdLockProfileMutex);
+
+  hdb->lockHolder = site;
+}
+
+/**
+ * @ingroup Status
+ * @brief Release hdMutex, recording the hold time for the call site that
+ *        took it.  Used by HUNLOCK when built with -DHD_LOCK_PROFILE.
+ */
+void
+hdLockProfileUnlock()
+{
+  HDBOARD;
+  HD_LOCK_STATS *site = hdb->lockHolder;
+  uint64_t hold;
+
+  if(site != NULL)
+    {
+      hold = hdTimestamp() - hdb->lockAcquired;
+      hdb->lockHolder = NULL;
+
+      pthread_mutex_lock(&hdLockProfileMutex);
+      site->holdNs += hold;
+      if(hold > site->holdMaxNs)
+	site->holdMaxNs = hold;
+      site->holdHist[hdLockProfileBin(hold)]++;
+      pthread_mutex_unlock(&hdLockProfileMutex);
+    }
+
+  if(pthread_mutex_unlock(&hdMutex) < 0)
+    perror("pthread_mutex_unlock");
+}
+
+/**
+ * @ingroup Status
+ * @brief Copy the hdMutex statistics of each call site that has been used
+ *
+ * @param stats Address to store the statistics
+ * @param max Maximum number of call sites to store
+ *
+ * @return Number of call sites stored, otherwise ERROR
+ */
+int32_t
+hdLockProfileGet(HD_LOCK_STATS *stats, int32_t max)
+{
+  int32_t isite, n;
+
+  if((stats == NULL) || (max < 0))
+    return ERROR;
+
+  pthread_mutex_lock(&hdLockProfileMutex);
+  n = (hdLockNsites < max) ? hdLockNsites : max;
+  for(isite = 0; isite < n; isite++)
+    stats[isite] = *hdLockSites[isite];
+  pthread_mutex_unlock(&hdLockProfileMutex);
+
+  return n;
+}
+
+/**
+ * @ingroup Status
+ * @brief Reset the hdMutex statistics
+ *
+ * @return OK
+ */
+int32_t
+hdLockProfileReset()
+{
+  int32_t isite;
+  HD_LOCK_STATS *site;
+
+  pthread_mutex_lock(&hdLockProfileMutex);
+  for(isite = 0; isite < hdLockNsites; isite++)
+    {
+      site = hdLockSites[isite];
+      site->nlocks = 0;
+      site->waitNs = site->waitMaxNs = 0;
+      site->holdNs = site->holdMaxNs = 0;
+      memset(site->waitHist, 0, sizeof(site->waitHist));
+      memset(site->holdHist, 0, sizeof(site->holdHist));
+    }
+  pthread_mutex_unlock(&hdLockProfileMutex);
+
+  return OK;
+}
+
+static int
+hdLockProfileCompare(const void *a, const void *b)
+{
+  const HD_LOCK_STATS *sa = a, *sb = b;
+
+  return (sb->holdNs > sa->holdNs) - (sb->holdNs < sa->holdNs);
+}
+
+/**
+ * @ingroup Status
+ * @brief Print the hdMutex statistics to standard out, by total hold time
+ *
+ * @param pflag if pflag>0, also print the wait and hold histograms
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdLockProfilePrint(int32_t pflag)
+{
+  static HD_LOCK_STATS stats[HD_LOCK_PROFILE_MAX_SITES];
+  int32_t n, isite, ibin;
+  HD_LOCK_STATS *s;
+
+#ifndef HD_LOCK_PROFILE
+  printf("%s: hdMutex profiling not enabled.  Build with LOCKPROFILE=1\n",
+	 __func__);
+#endif
+
+  n = hdLockProfileGet(stats, HD_LOCK_PROFILE_MAX_SITES);
+  if(n < 0)
+    return ERROR;
+
+  qsort(stats, n, sizeof(HD_LOCK_STATS), hdLockProfileCompare);
+
+  printf("\n");
+  printf("  hdMutex Profile (%d call sites)\n", n);
+  printf("\n");
+  printf("                                           ......Wait (us)......  ......Hold (us)......\n");
+  printf("  Function                   Line   Locks      Mean       Max      Mean       Max\n");
+  printf("  ------------------------------------------------------------------------------------\n");
+  for(isite = 0; isite < n; isite++)
+    {
+      s = &stats[isite];
+      if(s->nlocks == 0)
+	continue;
+
+      printf("  %-24.24s  %5d  %6llu  %8.1f  %8.1f  %8.1f  %8.1f\n",
+	     s->func, s->line, (unsigned long long)s->nlocks,
+	     s->waitNs * 1e-3 / s->nlocks, s->waitMaxNs * 1e-3,
+	     s->holdNs * 1e-3 / s->nlocks, s->holdMaxNs * 1e-3);
+
+      if(pflag)
+	{
+	  printf("      log2(ns)  wait  hold\n");
+	  for(ibin = 0; ibin < HD_LOCK_PROFILE_NBINS; ibin++)
+	    if(s->waitHist[ibin] || s->holdHist[ibin])
+	      printf("      %8d  %4d  %4d\n", ibin,
+		     s->waitHist[ibin], s->holdHist[ibin]);
+	}
+    }
+  printf("\n");
+
+  return OK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Write the hdMutex statistics, with histograms, to a CSV file
+ *
+ *   One line per call site:
+ *     func,line,nlocks,waitNs,waitMaxNs,holdNs,holdMaxNs,
+ *     wait[0..NBINS-1],hold[0..NBINS-1]
+ *
+ * @param filename File to write
+ *
+ * @return Number of call sites written, otherwise ERROR
+ */
+int32_t
+hdLockProfileDump(const char *filename)
+{
+  static HD_LOCK_STATS stats[HD_LOCK_PROFILE_MAX_SITES];
+  int32_t n, isite, ibin;
+  HD_LOCK_STATS *s;
+  FILE *f;
+
+  n = hdLockProfileGet(stats, HD_LOCK_PROFILE_MAX_SITES);
+  if(n < 0)
+    return ERROR;
+
+  f = fopen(filename, "w");
+  if(f == NULL)
+    {
+      perror("fopen");
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      return ERROR;
+    }
+
+  for(isite = 0; isite < n; isite++)
+    {
+      s = &stats[isite];
+      fprintf(f, "%s,%d,%llu,%llu,%llu,%llu,%llu",
+	      s->func, s->line, (unsigned long long)s->nlocks,
+	      (unsigned long long)s->waitNs, (unsigned long long)s->waitMaxNs,
+	      (unsigned long long)s->holdNs, (unsigned long long)s->holdMaxNs);
+      for(ibin = 0; ibin < HD_LOCK_PROFILE_NBINS; ibin++)
+	fprintf(f, ",%u", s->waitHist[ibin]);
+      for(ibin = 0; ibin < HD_LOCK_PROFILE_NBINS; ibin++)
+	fprintf(f, ",%u", s->holdHist[ibin]);
+      fprintf(f, "\n");
+    }
+
+  fclose(f);
+
+  return n;
+}
+
+/**
+ * @ingroup Status
+ * @brief Provide a DMA-capable buffer so that hdSnapshot, hdReadScalers and
+ *        hdReadHelicityHistoryCount, called from this thread, read their
+ *        registers with a single A24 block transfer.
+ *
+ *   The library does not change the DMA configuration, which is shared
+ *   with the other modules in the crate.  Before these calls, the caller
+ *   configures A24 BLT32 (vmeDmaConfig(1, 2, 0)), with the VME bus lock
+ *   held, and restores its readout configuration after, as hdStatusDMA in
+ *   rol/hd_list.c and test/hdStatus do.  Other threads (e.g. the monitor
+ *   samplers) keep using programmed I/O.
+ *
+ * @param buffer DMA-capable memory of at least sizeof(HD) bytes
+ *               (e.g. from a dmaPList pool).  NULL to use programmed I/O.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdSetSnapshotDMA(volatile uint32_t *buffer)
+{
+  if(((devaddr_t)buffer) & 0x7)
+    {
+      printf("%s: ERROR: buffer (%p) not on 8 byte boundary\n",
+	     __func__, buffer);
+      return ERROR;
+    }
+
+  hdSnapshotDmaBuf = buffer;
+
+  return OK;
+}
+
+/* Block transfer of nwords registers from offset, into out (host order),
+   through this thread's snapshot buffer and the DMA engine as the caller
+   configured it.  Call with hdMutex held.  Returns OK if every word was
+   read */
+static int32_t
+hdRegisterBlockRead(HD_BOARD *hdb, const char *func, uint32_t offset,
+		    uint32_t *out, int32_t nwords)
+{
+  int32_t iword, retVal = 0;
+  uint32_t vmeAddr;
+
+  if(hdSnapshotDmaBuf == NULL)
+    return ERROR;
+
+  vmeAddr = (uint32_t)((devaddr_t)hdp - hdA24Offset) + offset;
+  retVal = hdAccessDmaSend(func, (devaddr_t)hdSnapshotDmaBuf, vmeAddr,
+			   nwords << 2);
+  if(retVal == 0)
+    retVal = hdAccessDmaDone();
+  else
+    retVal = -1;
+
+  if(retVal != (nwords << 2))
+    return ERROR;
+
+  for(iword = 0; iword < nwords; iword++)
+    out[iword] = LSWAP(hdSnapshotDmaBuf[iword]);
+
+  return OK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Copy the module register map (0x00 - 0x97) into local memory.
+ *
+ *   With a buffer from hdSetSnapshotDMA, this is one A24 block transfer.
+ *   Otherwise, or if the transfer fails, the registers used by the status
+ *   and configuration routines are read with programmed I/O: the
+ *   configuration, csr, and the scalers and counters.  The shift register,
+ *   confirmation, history, delay error and firmware registers are then 0.
+ *   Both are done under a single lock.
+ *
+ * @param out Address to store the snapshot
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdSnapshot(HD_SNAPSHOT *out)
+{
+  CHECKINIT;
+
+  if(out == NULL)
+    return ERROR;
+
+  memset(out, 0, sizeof(HD_SNAPSHOT));
+
+  HLOCK;
+  out->timestamp = hdTimestamp();
+  out->vmeA24 = (uint32_t)((devaddr_t)hdp - hdA24Offset);
+  out->a32Base = hdA32Base;
+
+  if(hdRegisterBlockRead(hdb, __func__, 0, (uint32_t *)&out->reg,
+			 sizeof(HD) >> 2) == OK)
+    out->dma = 1;
+  else
+    {
+#ifndef SNAPHD
+#define SNAPHD(_reg)				\
+      out->reg._reg = hdRead32(&hdp->_reg);
+#endif
+      SNAPHD(version);
+      SNAPHD(csr);
+      SNAPHD(ctrl1);
+      SNAPHD(ctrl2);
+      SNAPHD(adr32);
+      SNAPHD(intr);
+      SNAPHD(blk_size);
+      SNAPHD(delay);
+      SNAPHD(gen_config1);
+      SNAPHD(gen_config2);
+      SNAPHD(gen_config3);
+      SNAPHD(int_testtrig_delay);
+      SNAPHD(delay_setup);
+      SNAPHD(trig1_scaler);
+      SNAPHD(trig2_scaler);
+      SNAPHD(sync_scaler);
+      SNAPHD(evt_count);
+      SNAPHD(blk_count);
+      SNAPHD(helicity_scaler[0]);
+      SNAPHD(helicity_scaler[1]);
+      SNAPHD(helicity_scaler[2]);
+      SNAPHD(helicity_scaler[3]);
+    }
+  HUNLOCK;
+
+  return OK;
+}
+
+/* Format the scalers, as ordered by hdReadScalers(data, 1) */
+static void
+hdFormatScalers(const uint32_t *scalers)
+{
+  printf("  Helicity Scalers:\n");
+  printf("    T_SETTLE falling = 0x%08x (%d)\n", scalers[0], scalers[0]);
+  printf("    T_SETTLE rising  = 0x%08x (%d)\n", scalers[1], scalers[1]);
+  printf("    PATTERN_SYNC     = 0x%08x (%d)\n", scalers[2], scalers[2]);
+  printf("    PAIR_SYNC        = 0x%08x (%d)\n", scalers[3], scalers[3]);
+  printf("\n");
+  printf("  Signal scalers:\n");
+  printf("    Trig1            = 0x%08x (%d)\n", scalers[4], scalers[4]);
+  printf("    Trig2            = 0x%08x (%d)\n", scalers[5], scalers[5]);
+  printf("    SyncReset        = 0x%08x (%d)\n", scalers[6], scalers[6]);
+  printf("\n");
+  printf("  Run Scalers:\n");
+  printf("    Events           = 0x%08x (%d)\n", scalers[7], scalers[7]);
+  printf("    Blocks           = 0x%08x (%d)\n", scalers[8], scalers[8]);
+}
+
+/* Format the helicity generator configuration registers */
+static void
+hdFormatHelicityGeneratorConfig(uint32_t config1, uint32_t config2,
+				uint32_t config3)
+{
+  uint8_t pattern = config1 & HD_HELICITY_CONFIG1_PATTERN_MASK;
+  uint8_t windowDelay = (config1 & HD_HELICITY_CONFIG1_HELICITY_DELAY_MASK) >> 8;
+  uint16_t settleTime = (config1 & HD_HELICITY_CONFIG1_HELICITY_SETTLE_MASK) >> 16;
+  uint32_t stableTime = config2 & HD_HELICITY_CONFIG2_STABLE_TIME_MASK;
+  uint32_t seed = config3 & HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK;
+
+  printf("\n");
+  printf("  Helicity Generator Configuration\n");
+  printf("\n");
+  printf("               Window Settle                Stable\n");
+  printf("    Pattern    Delay  Time                  Time                     Seed\n");
+  printf("  ------------------------------------------------------------------------------\n");
+  /*
+   *     "    PAIR       0      0x0000 (      0 ns)   0x0000000 (        0 ns) 0x00000000"
+   */
+
+  printf("    %s  ",
+	 (pattern == 0) ? "PAIR   " :
+	 (pattern == 1) ? "QUARTET" :
+	 (pattern == 2) ? "OCTET  " :
+	 (pattern == 3) ? "TOGGLE " : "???????" );
+
+  printf("%3d      ", windowDelay);
+
+  printf("0x%04x (%7d ns)   ", settleTime, settleTime * HD_GENERATOR_TICK_NS);
+  printf("0x%07x (%9d ns) ", stableTime, stableTime * HD_GENERATOR_TICK_NS);
+
+  printf("0x%08x", seed);
+  printf("\n");
+}
+
+/**
+ * @ingroup Status
+ * @brief Print some status information module to standard out
+ *
+ * @param pflag if pflag>0, print out raw registers
+ *
+ */
+
+int32_t
+hdStatus(int pflag)
+{
+  HD rv;
+  HD_SNAPSHOT snap;
+  uint32_t scalers[9];
+  CHECKINIT;
+
+  if(hdSnapshot(&snap) != OK)
+    return ERROR;
+
+  rv = snap.reg;
+  uint32_t vmeAddr = snap.vmeA24;
+
+#ifndef PREG
+#define PREG(_off, _reg)						\
+      printf("  %10.18s (0x%04lx) = 0x%08x%s",				\
+	     #_reg, (unsigned long)&rv._reg - (unsigned long)&rv, rv._reg, \
+	     #_off);
+#endif
+
+  printf("\n");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("STATUS for JLab Helicity Decoder\n");
+  if(pflag)
+    {
+      printf("\n");
+      PREG(\t,version);
+      PREG(\n,csr);
+      PREG(\t,ctrl1);
+      PREG(\n,ctrl2);
+      PREG(\t,adr32);
+      PREG(\n,intr);
+      PREG(\t,blk_size);
+      PREG(\n,delay);
+      PREG(\n,int_testtrig_delay);
+    }
+
+  printf("\n");
+  printf("  Slot    Type     Rev      FW         A24           A32\n");
+  printf("  ------------------------------------------------------------------------------\n");
+  /*
+   *     "   0    0xdec0    0x01    0x01    0xed0000    0x09000000"
+   */
+
+  printf("  %2d    ", (rv.intr & HD_INT_GEO_MASK) >> 16);
+
+  printf("0x%04x    ", (rv.version & HD_VERSION_BOARD_TYPE_MASK) >> 16);
+  printf("0x%02x    ", (rv.version & HD_VERSION_BOARD_REV_MASK) >> 8);
+  printf("0x%02x    ", rv.version & HD_VERSION_FIRMWARE_MASK);
+  printf("0x%06x    ", vmeAddr);
+  if(rv.adr32 & HD_ADR32_ENABLE)
+    printf("0x%08x", (rv.adr32 & HD_ADR32_BASE_MASK) << 16);
+  else
+    printf("  disabled");
+  printf("\n");
+
+
+  printf("\n");
+  printf("                         Configuration\n\n");
+
+  printf("  .Signal Sources..    .Helicity Src.  Block    .Processing Delay. \n");
+  printf("  Clk   Trig   Sync    Input   Output  Level        Trigger   Data \n");
+  printf("  ------------------------------------------------------------------------------\n");
+  /*
+   *     "  INT    INT    INT    FIBER     INT       1             64    256"
+   *     "                       Inverted  Normal  "
+   */
+
+  printf("  %s    ",
+	 (rv.ctrl1 & HD_CTRL1_CLK_SRC_MASK) == HD_CTRL1_CLK_SRC_P0 ? "VXS" :
+	 (rv.ctrl1 & HD_CTRL1_CLK_SRC_MASK) == HD_CTRL1_CLK_SRC_FP ? " FP" :
+	 (rv.ctrl1 & HD_CTRL1_CLK_SRC_MASK) == HD_CTRL1_CLK_SRC_FP2 ? "FP2" :
+	 (rv.ctrl1 & HD_CTRL1_CLK_SRC_MASK) == HD_CTRL1_CLK_SRC_INT ? "INT" : "???");
+
+  printf("%s    ",
+	 (rv.ctrl1 & HD_CTRL1_TRIG_SRC_MASK) == HD_CTRL1_TRIG_SRC_P0 ? "VXS" :
+	 (rv.ctrl1 & HD_CTRL1_TRIG_SRC_MASK) == HD_CTRL1_TRIG_SRC_FP ? " FP" :
+	 (rv.ctrl1 & HD_CTRL1_TRIG_SRC_MASK) == HD_CTRL1_TRIG_SRC_FP2 ? "FP2" :
+	 (rv.ctrl1 & HD_CTRL1_TRIG_SRC_MASK) == HD_CTRL1_TRIG_SRC_SOFT ? "INT" : "???");
+
+  printf("%s    ",
+	 (rv.ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK) == HD_CTRL1_SYNC_RESET_SRC_P0 ? "VXS" :
+	 (rv.ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK) == HD_CTRL1_SYNC_RESET_SRC_FP ? " FP" :
+	 (rv.ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK) == HD_CTRL1_SYNC_RESET_SRC_FP2 ? "FP2" :
+	 (rv.ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK) == HD_CTRL1_SYNC_RESET_SRC_SOFT ?
+	 "INT" : "???");
+
+  printf("%s    ",
+	 (rv.ctrl1 & HD_CTRL1_USE_INT_HELICITY) ? "INT   " :
+	 (rv.ctrl1 & HD_CTRL1_HEL_SRC_MASK) == HD_CTRL1_USE_EXT_CU_IN ? "COPPER" :
+	 "FIBER ");
+
+  printf("%s     ",
+	 (rv.ctrl1 & HD_CTRL1_INT_HELICITY_TO_FP) ? "INT" : "EXT");
+
+  printf("%3d           ",
+	 rv.blk_size & HD_BLOCKLEVEL_MASK);
+
+  printf("%4d   ",
+	 rv.delay & HD_DELAY_TRIGGER_MASK);
+
+  printf("%4d",
+	   (rv.delay & HD_DELAY_DATA_MASK) >> 16);
+  printf("\n");
+  printf("                       %s",
+	 ((rv.ctrl1 & (HD_CTRL1_HEL_SRC_MASK | HD_CTRL1_INVERT_FIBER_INPUT)) ==
+	  HD_CTRL1_INVERT_FIBER_INPUT) ? "Inverted" :
+	 ((rv.ctrl1 & (HD_CTRL1_HEL_SRC_MASK | HD_CTRL1_INVERT_CU_INPUT)) ==
+	  (HD_CTRL1_USE_EXT_CU_IN | HD_CTRL1_INVERT_CU_INPUT)) ? "Inverted" :
+	 "Normal  ");
+
+  printf("  %s",
+	 (rv.ctrl1 & HD_CTRL1_INVERT_CU_OUTPUT) ?
+	 "Inverted" : "Normal  ");
+  printf("\n");
+  printf("\n");
+
+
+  printf("                                                              Internal\n");
+  printf("                          Event       Helicity    Force       Test Trigger\n");
+  printf("  Decoder     Triggers    Build       Generator   Busy        Status     Delay\n");
+  printf("  ------------------------------------------------------------------------------\n");
+  /*
+   *     "  Disabled    Disabled    Disabled    Disabled    Disabled    Disabled   0x3FFFF"
+  */
+
+  printf("  %s    ",
+	 rv.ctrl2 & HD_CTRL2_DECODER_ENABLE ? "ENABLED " : "Disabled");
+
+  printf("%s    ",
+	 rv.ctrl2 & HD_CTRL2_GO ? "ENABLED " : "Disabled");
 
   printf("%s    ",
 	 rv.ctrl2 & HD_CTRL2_EVENT_BUILD_ENABLE ? "ENABLED " : "Disabled");
 
-  printf("%s    ",
-	 rv.ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE ? "ENABLED " : "Disabled");
+  printf("%s    ",
+	 rv.ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE ? "ENABLED " : "Disabled");
+
+  printf("%s    ",
+	 rv.ctrl2 & HD_CTRL2_FORCE_BUSY ? "ENABLED " : "Disabled");
+
+  printf("%s   ",
+	 rv.ctrl1 & HD_CTRL1_INT_TESTTRIG_ENABLE ? "ENABLED " : "Disabled");
+
+  printf("0x%05x",
+	 rv.int_testtrig_delay & HD_INT_TESTTRIG_DELAY_MASK);
+
+  printf("\n");
+
+  printf("\n");
+  printf("                         Status\n");
+  printf("                                                               Int Buff\n");
+  printf("  Helicity   ...Block Data..       Event             Latch     ..Empty.  TSETTLE\n");
+  printf("  Sequence   Accepted  Ready      Buffer  BERR  BUSY  BUSY      0     1  Filter\n");
+  printf("  ------------------------------------------------------------------------------\n");
+  /*
+   *     "        OK        ---    ---       Empty    lo    lo    lo    YES    YES   128"
+   */
+
+  printf("     %s        ",
+	 rv.csr & HD_CSR_HELICITY_SEQ_ERROR ? "ERROR" : "   OK");
+
+  printf("%s    ",
+	 rv.csr & HD_CSR_BLOCK_ACCEPTED ? "YES" : "---");
+
+  printf("%s    ",
+	 rv.csr & HD_CSR_BLOCK_READY ? "YES" : "---");
+
+  printf("%s   ",
+	 rv.csr & HD_CSR_EMPTY ? "   Empty" : "NotEmpty");
+
+  printf("%s   ",
+	 rv.csr & HD_CSR_BERR_ASSERTED ? " HI" : " lo");
+
+  printf("%s   ",
+	 rv.csr & HD_CSR_BUSY ? " HI" : " lo");
+
+  printf("%s    ",
+	 rv.csr & HD_CSR_BUSY_LATCHED ? " HI" : " lo");
+
+  printf("%s    ",
+	 rv.csr & HD_CSR_INTERNAL_BUF0 ? "YES" : "---");
+
+  printf("%s  ",
+	 rv.csr & HD_CSR_INTERNAL_BUF1 ? "YES" : "---");
+  printf("%d",
+	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_DISABLED ? 0 :
+	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_4 ? 4 :
+	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_8 ? 8 :
+	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_16 ? 16 :
+	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_32 ? 32 :
+	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_64 ? 64 :
+	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_128 ? 128 :
+	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_256 ? 256 :
+	 -1);
+  printf("\n");
+  printf("\n");
+
+  scalers[0] = rv.helicity_scaler[0];
+  scalers[1] = rv.helicity_scaler[1];
+  scalers[2] = rv.helicity_scaler[2];
+  scalers[3] = rv.helicity_scaler[3];
+  scalers[4] = rv.trig1_scaler;
+  scalers[5] = rv.trig2_scaler;
+  scalers[6] = rv.sync_scaler;
+  scalers[7] = rv.evt_count;
+  scalers[8] = rv.blk_count;
+  hdFormatScalers(scalers);
+  printf("\n");
+  hdFormatHelicityGeneratorConfig(rv.gen_config1, rv.gen_config2, rv.gen_config3);
+  printf("\n");
+
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n\n");
+
+
+
+  return OK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Decode a register snapshot into the fields shown by hdStatus
+ *
+ * @param snap Snapshot, from hdSnapshot
+ * @param rec Address to store the decoded status
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdStatusDecode(const HD_SNAPSHOT *snap, HD_STATUS_RECORD *rec)
+{
+  const HD *rv;
+  uint32_t signal, code;
+
+  if((snap == NULL) || (rec == NULL))
+    return ERROR;
+
+  rv = &snap->reg;
+  memset(rec, 0, sizeof(HD_STATUS_RECORD));
+
+  rec->magic = HD_STATUS_RECORD_MAGIC;
+  rec->version = HD_STATUS_RECORD_VERSION;
+  rec->timestamp = snap->timestamp;
+
+  rec->slot = (rv->intr & HD_INT_GEO_MASK) >> 16;
+  rec->boardType = (rv->version & HD_VERSION_BOARD_TYPE_MASK) >> 16;
+  rec->boardRev = (rv->version & HD_VERSION_BOARD_REV_MASK) >> 8;
+  rec->firmware = rv->version & HD_VERSION_FIRMWARE_MASK;
+  rec->vmeA24 = snap->vmeA24;
+  if(rv->adr32 & HD_ADR32_ENABLE)
+    rec->a32Base = (rv->adr32 & HD_ADR32_BASE_MASK) << 16;
+
+  signal = rv->ctrl1 & HD_CTRL1_CLK_SRC_MASK;
+  rec->clkSrc =
+    (signal == HD_CTRL1_CLK_SRC_P0) ? HD_INIT_VXS :
+    (signal == HD_CTRL1_CLK_SRC_FP) ? HD_INIT_FP :
+    (signal == HD_CTRL1_CLK_SRC_FP2) ? HD_INIT_FP_ECL : HD_INIT_INTERNAL;
+
+  signal = rv->ctrl1 & HD_CTRL1_TRIG_SRC_MASK;
+  rec->trigSrc =
+    (signal == HD_CTRL1_TRIG_SRC_P0) ? HD_INIT_VXS :
+    (signal == HD_CTRL1_TRIG_SRC_FP) ? HD_INIT_FP :
+    (signal == HD_CTRL1_TRIG_SRC_FP2) ? HD_INIT_FP_ECL : HD_INIT_INTERNAL;
+
+  signal = rv->ctrl1 & HD_CTRL1_SYNC_RESET_SRC_MASK;
+  rec->srSrc =
+    (signal == HD_CTRL1_SYNC_RESET_SRC_P0) ? HD_INIT_VXS :
+    (signal == HD_CTRL1_SYNC_RESET_SRC_FP) ? HD_INIT_FP :
+    (signal == HD_CTRL1_SYNC_RESET_SRC_FP2) ? HD_INIT_FP_ECL : HD_INIT_INTERNAL;
+
+  rec->helSrc = (rv->ctrl1 & HD_CTRL1_USE_INT_HELICITY) ? 1 : 0;
+  rec->helInput = (rv->ctrl1 & HD_CTRL1_USE_EXT_CU_IN) ? 1 : 0;
+  rec->helOutput = (rv->ctrl1 & HD_CTRL1_INT_HELICITY_TO_FP) ? 1 : 0;
+
+  rec->invertFiberInput = (rv->ctrl1 & HD_CTRL1_INVERT_FIBER_INPUT) ? 1 : 0;
+  rec->invertCuInput = (rv->ctrl1 & HD_CTRL1_INVERT_CU_INPUT) ? 1 : 0;
+  rec->invertCuOutput = (rv->ctrl1 & HD_CTRL1_INVERT_CU_OUTPUT) ? 1 : 0;
+  code = (rv->ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) >> 13;
+  rec->tsettleFilter = (code == 0) ? 0 : (2 << code);
+
+  rec->blocklevel = rv->blk_size & HD_BLOCKLEVEL_MASK;
+  rec->triggerDelay = rv->delay & HD_DELAY_TRIGGER_MASK;
+  rec->dataDelay = (rv->delay & HD_DELAY_DATA_MASK) >> 16;
+
+  rec->decoder = (rv->ctrl2 & HD_CTRL2_DECODER_ENABLE) ? 1 : 0;
+  rec->triggers = (rv->ctrl2 & HD_CTRL2_GO) ? 1 : 0;
+  rec->eventBuild = (rv->ctrl2 & HD_CTRL2_EVENT_BUILD_ENABLE) ? 1 : 0;
+  rec->helicityGenerator = (rv->ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE) ? 1 : 0;
+  rec->forceBusy = (rv->ctrl2 & HD_CTRL2_FORCE_BUSY) ? 1 : 0;
+  rec->testTrigger = (rv->ctrl1 & HD_CTRL1_INT_TESTTRIG_ENABLE) ? 1 : 0;
+  rec->systemPLL = (rv->csr & HD_CSR_SYSTEM_CLK_PLL_LOCKED) ? 1 : 0;
+  rec->localPLL = (rv->csr & HD_CSR_LOCAL_CLK_PLL_LOCKED) ? 1 : 0;
+  rec->testTriggerDelay = rv->int_testtrig_delay & HD_INT_TESTTRIG_DELAY_MASK;
+
+  rec->csr = rv->csr;
+
+  rec->scalers[0] = rv->helicity_scaler[0];
+  rec->scalers[1] = rv->helicity_scaler[1];
+  rec->scalers[2] = rv->helicity_scaler[2];
+  rec->scalers[3] = rv->helicity_scaler[3];
+  rec->scalers[4] = rv->trig1_scaler;
+  rec->scalers[5] = rv->trig2_scaler;
+  rec->scalers[6] = rv->sync_scaler;
+  rec->scalers[7] = rv->evt_count;
+  rec->scalers[8] = rv->blk_count;
+
+  rec->genPattern = rv->gen_config1 & HD_HELICITY_CONFIG1_PATTERN_MASK;
+  rec->genWindowDelay = (rv->gen_config1 & HD_HELICITY_CONFIG1_HELICITY_DELAY_MASK) >> 8;
+  rec->genSettleTime = (rv->gen_config1 & HD_HELICITY_CONFIG1_HELICITY_SETTLE_MASK) >> 16;
+  rec->genStableTime = rv->gen_config2 & HD_HELICITY_CONFIG2_STABLE_TIME_MASK;
+  rec->genSeed = rv->gen_config3 & HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK;
+
+  return OK;
+}
+
+static const char *
+hdSourceName(uint8_t src)
+{
+  return
+    (src == HD_INIT_VXS) ? "VXS" :
+    (src == HD_INIT_FP) ? "FP" :
+    (src == HD_INIT_FP_ECL) ? "FP2" : "INT";
+}
+
+/**
+ * @ingroup Status
+ * @brief Render the content of hdStatus into a buffer, as JSON or as a
+ *        binary HD_STATUS_RECORD.
+ *
+ *   Built from a single register snapshot.  hdMutex is only held while the
+ *   snapshot is taken, not while formatting.
+ *
+ * @param buf Address to store the output
+ * @param size Size of buf, in bytes
+ * @param format
+ *      0 (HD_STATUS_EXPORT_JSON)   JSON, null terminated
+ *      1 (HD_STATUS_EXPORT_BINARY) HD_STATUS_RECORD
+ *
+ * @return Number of bytes stored (not including the null), otherwise ERROR
+ */
+int32_t
+hdStatusExport(char *buf, uint32_t size, int32_t format)
+{
+  HD_SNAPSHOT snap;
+  HD_STATUS_RECORD rec;
+  int32_t n = 0, iscal;
+  CHECKINIT;
+
+  if(buf == NULL)
+    {
+      printf("%s: ERROR: Invalid buffer\n", __func__);
+      return ERROR;
+    }
+
+  if((format != HD_STATUS_EXPORT_JSON) && (format != HD_STATUS_EXPORT_BINARY))
+    {
+      printf("%s: ERROR: Invalid format (%d)\n", __func__, format);
+      return ERROR;
+    }
+
+  if(hdSnapshot(&snap) != OK)
+    return ERROR;
+
+  hdStatusDecode(&snap, &rec);
+
+  if(format == HD_STATUS_EXPORT_BINARY)
+    {
+      if(size < sizeof(HD_STATUS_RECORD))
+	{
+	  printf("%s: ERROR: Buffer too small (%d < %d)\n",
+		 __func__, size, (int32_t)sizeof(HD_STATUS_RECORD));
+	  return ERROR;
+	}
+      memcpy(buf, &rec, sizeof(HD_STATUS_RECORD));
+      return sizeof(HD_STATUS_RECORD);
+    }
+
+#define HDEXPORT(...)							\
+  do {									\
+    if(n >= 0)								\
+      {									\
+	int32_t _m = snprintf(buf + n, (n < (int32_t)size) ? size - n : 0, \
+			      __VA_ARGS__);				\
+	n = ((_m < 0) || (n + _m >= (int32_t)size)) ? -1 : n + _m;	\
+      }									\
+  } while(0)
+
+  HDEXPORT("{\"timestamp\":%llu,", (unsigned long long)rec.timestamp);
+  HDEXPORT("\"slot\":%d,\"boardType\":\"0x%04x\",\"boardRev\":%d,\"firmware\":%d,",
+	   rec.slot, rec.boardType, rec.boardRev, rec.firmware);
+  HDEXPORT("\"a24\":\"0x%06x\",\"a32\":\"0x%08x\",\"a32Enabled\":%s,",
+	   rec.vmeA24, rec.a32Base, rec.a32Base ? "true" : "false");
+
+  HDEXPORT("\"sources\":{\"clock\":\"%s\",\"trigger\":\"%s\",\"syncReset\":\"%s\"},",
+	   hdSourceName(rec.clkSrc), hdSourceName(rec.trigSrc),
+	   hdSourceName(rec.srSrc));
+
+  HDEXPORT("\"helicity\":{\"input\":\"%s\",\"output\":\"%s\","
+	   "\"invertFiberInput\":%s,\"invertCuInput\":%s,\"invertCuOutput\":%s},",
+	   rec.helSrc ? "INT" : rec.helInput ? "COPPER" : "FIBER",
+	   rec.helOutput ? "INT" : "EXT",
+	   rec.invertFiberInput ? "true" : "false",
+	   rec.invertCuInput ? "true" : "false",
+	   rec.invertCuOutput ? "true" : "false");
+
+  HDEXPORT("\"blocklevel\":%d,\"procDelay\":{\"trigger\":%d,\"data\":%d},",
+	   rec.blocklevel, rec.triggerDelay, rec.dataDelay);
+
+  HDEXPORT("\"enables\":{\"decoder\":%s,\"triggers\":%s,\"eventBuild\":%s,"
+	   "\"helicityGenerator\":%s,\"forceBusy\":%s,\"testTrigger\":%s},",
+	   rec.decoder ? "true" : "false",
+	   rec.triggers ? "true" : "false",
+	   rec.eventBuild ? "true" : "false",
+	   rec.helicityGenerator ? "true" : "false",
+	   rec.forceBusy ? "true" : "false",
+	   rec.testTrigger ? "true" : "false");
+  HDEXPORT("\"testTriggerDelay\":%d,\"tsettleFilter\":%d,",
+	   rec.testTriggerDelay, rec.tsettleFilter);
+
+  HDEXPORT("\"csr\":{\"value\":\"0x%08x\",\"systemPLL\":%s,\"localPLL\":%s,"
+	   "\"helicitySeqError\":%s,\"blockAccepted\":%s,\"blockReady\":%s,"
+	   "\"empty\":%s,\"berr\":%s,\"busy\":%s,\"busyLatched\":%s,"
+	   "\"intBuf0Empty\":%s,\"intBuf1Empty\":%s},",
+	   rec.csr,
+	   rec.systemPLL ? "true" : "false",
+	   rec.localPLL ? "true" : "false",
+	   (rec.csr & HD_CSR_HELICITY_SEQ_ERROR) ? "true" : "false",
+	   (rec.csr & HD_CSR_BLOCK_ACCEPTED) ? "true" : "false",
+	   (rec.csr & HD_CSR_BLOCK_READY) ? "true" : "false",
+	   (rec.csr & HD_CSR_EMPTY) ? "true" : "false",
+	   (rec.csr & HD_CSR_BERR_ASSERTED) ? "true" : "false",
+	   (rec.csr & HD_CSR_BUSY) ? "true" : "false",
+	   (rec.csr & HD_CSR_BUSY_LATCHED) ? "true" : "false",
+	   (rec.csr & HD_CSR_INTERNAL_BUF0) ? "true" : "false",
+	   (rec.csr & HD_CSR_INTERNAL_BUF1) ? "true" : "false");
+
+  HDEXPORT("\"scalers\":[");
+  for(iscal = 0; iscal < 9; iscal++)
+    HDEXPORT("%u%s", rec.scalers[iscal], (iscal < 8) ? "," : "],");
+
+  HDEXPORT("\"generator\":{\"pattern\":\"%s\",\"windowDelay\":%d,"
+	   "\"settleTime\":%d,\"stableTime\":%d,\"seed\":\"0x%08x\"}}",
+	   (rec.genPattern == 0) ? "PAIR" :
+	   (rec.genPattern == 1) ? "QUARTET" :
+	   (rec.genPattern == 2) ? "OCTET" : "TOGGLE",
+	   rec.genWindowDelay, rec.genSettleTime, rec.genStableTime,
+	   rec.genSeed);
+#undef HDEXPORT
+
+  if(n < 0)
+    {
+      printf("%s: ERROR: Buffer too small (%d bytes)\n", __func__, size);
+      return ERROR;
+    }
+
+  return n;
+}
+
+/**
+ * @ingroup Status
+ * @brief Return the firmware version of the module
+ *
+ * @return Firmware version if successful, otherwise ERROR
+ */
+int32_t
+hdGetFirmwareVersion()
+{
+  int32_t rval;
+  CHECKINIT;
+
+  rval = HREAD(version) & HD_VERSION_FIRMWARE_MASK;
+
+  return rval;
+}
+
+
+/**
+ * @ingroup Config
+ * @brief Reset the module
+ *
+ * @param type Reset Type
+ *           0 Soft
+ *           1 Hard
+ *           2 Both
+ * @param clearA32 Flag to clear A32 settings
+ *           0 Restore A32 settings after reset
+ *           1 Wipe them out.  All of them.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+
+int32_t
+hdReset(uint8_t type, uint8_t clearA32)
+{
+  int32_t rval = OK;
+  uint32_t wreg = 0;
+  uint32_t adr32 = 0;
+  CHECKINIT;
+
+  switch(type)
+    {
+    case 0:
+      wreg = HD_CSR_SOFT_RESET;
+      break;
+    case 1:
+      wreg = HD_CSR_HARD_RESET;
+      break;
+    case 2:
+    default:
+      wreg = HD_CSR_SOFT_RESET | HD_CSR_HARD_RESET;
+    }
+
+  clearA32 = clearA32 ? 1 : 0;
+
+  if(!clearA32)
+    adr32 = hdGetA32();
+
+  HLOCK;
+  hdWrite32(&hdp->csr, HD_CSR_HARD_RESET);
+  HUNLOCK;
+
+  if(!clearA32)
+    hdSetA32(adr32);
+
+  return rval;
+}
+
+/**
+ * @ingroup Config
+ * @brief Set the A32 Base
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+
+int32_t
+hdSetA32(uint32_t a32base)
+{
+  int32_t rval = OK;
+  uint32_t wreg = 0;
+  HDBOARD;
+
+  if(((a32base >> 16) & HD_ADR32_BASE_MASK) == 0)
+    {
+      printf("%s: ERROR: Invalid a32base (0x%08x)\n",
+	     __func__, a32base);
+      return ERROR;
+    }
+
+  if(hdp != NULL)
+    {
+      /* If the library has been initialized, configure pointer and register */
+      devaddr_t laddr = 0;
+      int32_t res = hdAccessBusToLocalAdrs(0x09,
+				      (char *)(devaddr_t)a32base,
+				      (char **)&laddr);
+      if (res != 0)
+	{
+	  printf("%s: ERROR in vmeBusToLocalAdrs(0x09,0x%x,&laddr) \n",
+		 __func__, a32base);
+	  return ERROR;
+	}
+
+      HLOCK;
+      hdA32Base = a32base;
+      hdA32Offset = laddr - hdA32Base;
+      hdDatap = (uint32_t *)(laddr);  /* Set a pointer to the FIFO */
+
+      wreg = ((a32base >> 16) & HD_ADR32_BASE_MASK) | HD_ADR32_ENABLE;
+
+      hdWrite32(&hdp->adr32, 0);
+      hdWrite32(&hdp->adr32, wreg);
+
+      HUNLOCK;
+    }
+  else
+    {
+      HLOCK;
+      hdA32Base = a32base;
+      HUNLOCK;
+    }
+
+  return rval;
+}
+
+/**
+ * @ingroup Status
+ * @brief Get the A32 Base
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+
+uint32_t
+hdGetA32()
+{
+  uint32_t rval;
+  HDBOARD;
+
+  HLOCK;
+  rval = hdA32Base;
+  HUNLOCK;
+
+  return rval;
+}
+
+/* Poll a register, without hdMutex, until (value & mask) == expected has
+   held for stableUs.  Return the time it took to get there in us, or ERROR
+   after timeoutUs. */
+static int32_t
+hdPollRegister(volatile uint32_t *reg, uint32_t mask, uint32_t expected,
+	       uint32_t stableUs, uint32_t timeoutUs)
+{
+  uint64_t start, now, since = 0;
+
+  start = hdTimestamp();
+  while(1)
+    {
+      now = hdTimestamp();
+      if((hdRead32(reg) & mask) == expected)
+	{
+	  if(since == 0)
+	    since = now;
+	  if(now - since >= (uint64_t)stableUs * 1000ULL)
+	    return (int32_t)((since - start) / 1000);
+	}
+      else
+	since = 0;
+
+      if(now - start >= (uint64_t)timeoutUs * 1000ULL)
+	return ERROR;
+
+      usleep(HD_POLL_INTERVAL_US);
+    }
+}
+
+/* Wait, without hdMutex, for the clock PLLs to lock after the clock source
+   was written.  If it changed, the lock bits of the old source may still
+   read set, so first wait for them to drop.  A switch that never drops
+   them costs HD_PLL_UNLOCK_TIMEOUT_US.  Return the time to lock in us, or
+   ERROR after HD_PLL_LOCK_TIMEOUT_US. */
+static int32_t
+hdWaitClockPLL(HD_BOARD *hdb, int32_t changed)
+{
+  uint32_t locked = HD_CSR_SYSTEM_CLK_PLL_LOCKED | HD_CSR_LOCAL_CLK_PLL_LOCKED;
+  uint64_t start = hdTimestamp();
+  int32_t unlockUs = 0, lockUs;
+
+  if(changed)
+    {
+      while(((hdRead32(&hdp->csr) & locked) == locked) &&
+	    (hdTimestamp() - start < HD_PLL_UNLOCK_TIMEOUT_US * 1000ULL))
+	usleep(HD_POLL_INTERVAL_US);
+      unlockUs = (hdTimestamp() - start) / 1000;
+    }
+
+  lockUs = hdPollRegister(&hdp->csr, locked, locked,
+			  HD_PLL_LOCK_STABLE_US, HD_PLL_LOCK_TIMEOUT_US);
+  if(lockUs == ERROR)
+    return ERROR;
+
+  return unlockUs + lockUs;
+}
+
+/* Wait for the helicity generator to finish the window in progress after
+   it is disabled: one window (settle + stable) of its
+   configuration.  The generator has no state bit to poll, so this is the
+   shortest safe dwell.  At least HD_GENERATOR_MIN_DWELL_US. */
+static void
+hdGeneratorDwell(uint32_t config1, uint32_t config2)
+{
+  uint64_t windowNs;
+
+  windowNs = (uint64_t)HD_GENERATOR_TICK_NS *
+    (((config1 & HD_HELICITY_CONFIG1_HELICITY_SETTLE_MASK) >> 16) +
+     (config2 & HD_HELICITY_CONFIG2_STABLE_TIME_MASK));
+
+  if(windowNs < HD_GENERATOR_MIN_DWELL_US * 1000ULL)
+    windowNs = HD_GENERATOR_MIN_DWELL_US * 1000ULL;
+
+  usleep((windowNs + 999) / 1000);
+}
+
+/**
+ * @ingroup Status
+ * @brief Return how long the last configuration waits took
+ *
+ * @param signalSourcesUs Address to store the time for the clock PLLs to
+ *                        lock in hdSetSignalSources, us (ERROR = timeout)
+ * @param generatorUs Address to store the time of hdHelicityGeneratorConfig, us
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdGetSettleTime(int32_t *signalSourcesUs, int32_t *generatorUs)
+{
+  HDBOARD;
+
+  if(signalSourcesUs != NULL)
+    *signalSourcesUs = hdSettleSignalSourcesUs;
+  if(generatorUs != NULL)
+    *generatorUs = hdSettleGeneratorUs;
+
+  return OK;
+}
+
+/* 1 if the calling thread is staging configuration for the board */
+static int32_t
+hdConfigStaged(HD_BOARD *hdb)
+{
+  return hdStaging && pthread_equal(hdStageOwner, pthread_self());
+}
+
+static void
+hdConfigStage(HD_BOARD *hdb, uint32_t offset, uint32_t clear, uint32_t set)
+{
+  uint32_t ireg = offset >> 2;
+
+  hdStageClear[ireg] |= clear;
+  hdStageSet[ireg] = (hdStageSet[ireg] & ~clear) | set;
+}
+
+/**
+ * @ingroup Config
+ * @brief Start staging configuration.
+ *
+ *   Until hdConfigCommit (or hdConfigAbort), the configuration routines
+ *   called from this thread (hdSetSignalSources, hdSetHelicitySource,
+ *   hdSetProcDelay, hdHelicityGeneratorConfig, hdEnableDecoder, ...) only
+ *   record their fields.  Other threads are not affected.  Each board
+ *   has its own staging; commit with the same board selected.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdConfigBegin()
+{
+  CHECKINIT;
+
+  pthread_mutex_lock(&hdStageMutex);
+  if(hdStaging)
+    {
+      pthread_mutex_unlock(&hdStageMutex);
+      printf("%s: ERROR: Configuration already being staged\n", __func__);
+      return ERROR;
+    }
+
+  memset(hdStageClear, 0, sizeof(hdStageClear));
+  memset(hdStageSet, 0, sizeof(hdStageSet));
+  hdStageOwner = pthread_self();
+  hdStaging = 1;
+  pthread_mutex_unlock(&hdStageMutex);
+
+  return OK;
+}
+
+/**
+ * @ingroup Config
+ * @brief Discard the staged configuration
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdConfigAbort()
+{
+  HDBOARD;
+
+  pthread_mutex_lock(&hdStageMutex);
+  if(!hdConfigStaged(hdb))
+    {
+      pthread_mutex_unlock(&hdStageMutex);
+      printf("%s: ERROR: No configuration staged by this thread\n", __func__);
+      return ERROR;
+    }
+  hdStaging = 0;
+  pthread_mutex_unlock(&hdStageMutex);
+
+  return OK;
+}
+
+/* Order the staged registers are written in */
+static const uint32_t hdConfigOrder[] =
+  {
+    offsetof(HD, ctrl1),
+    offsetof(HD, blk_size),
+    offsetof(HD, delay),
+    offsetof(HD, int_testtrig_delay),
+    offsetof(HD, delay_setup),
+    offsetof(HD, gen_config1),
+    offsetof(HD, gen_config2),
+    offsetof(HD, gen_config3),
+    offsetof(HD, ctrl2)
+  };
+#define HD_CONFIG_NORDER (sizeof(hdConfigOrder) / sizeof(hdConfigOrder[0]))
+
+/* Current (rreg) and new (wreg) values of the staged registers, read with
+   hdMutex held.  Both are 0 for the registers not staged. */
+static void
+hdConfigRead(HD_BOARD *hdb, const uint32_t *clear, const uint32_t *set,
+	     uint32_t *rreg, uint32_t *wreg)
+{
+  volatile uint32_t *regs = (volatile uint32_t *)hdp;
+  uint32_t iorder, ireg;
+
+  memset(rreg, 0, HD_NREGS * sizeof(uint32_t));
+  memset(wreg, 0, HD_NREGS * sizeof(uint32_t));
+
+  for(iorder = 0; iorder < HD_CONFIG_NORDER; iorder++)
+    {
+      ireg = hdConfigOrder[iorder] >> 2;
+      if((clear[ireg] | set[ireg]) == 0)
+	continue;
 
-  printf("%s    ",
-	 rv.ctrl2 & HD_CTRL2_FORCE_BUSY ? "ENABLED " : "Disabled");
+      rreg[ireg] = hdRead32(&regs[ireg]);
+      wreg[ireg] = (rreg[ireg] & ~clear[ireg]) | set[ireg];
+    }
+}
 
-  printf("%s   ",
-	 rv.ctrl1 & HD_CTRL1_INT_TESTTRIG_ENABLE ? "ENABLED " : "Disabled");
+/**
+ * @ingroup Config
+ * @brief Apply the staged configuration
+ *
+ *   Each staged register is read, and written only if it changes, in the
+ *   order: ctrl1 (sources, helicity source, inversion), block level,
+ *   delays, test trigger, delay test, generator, and ctrl2 (enables) last.
+ *   The writes are made under one lock, so readout and the other routines
+ *   see either the old or the new configuration.
+ *
+ *   Two changes need a wait first, made before the writes and without the
+ *   lock, as in hdSetSignalSources and hdHelicityGeneratorConfig:
+ *   - a new clock source is written on its own, and the PLLs lock;
+ *   - a running generator that is reconfigured is disabled, and finishes
+ *     the window in progress.
+ *   The registers are then read again under the lock for the writes.  A
+ *   disabled generator is reenabled once its new configuration settled,
+ *   after the others are written.
+ *
+ *   Only the staged registers are read, under the same lock as the
+ *   writes, so an unchanged configuration costs one read per staged
+ *   register and no writes.
+ *
+ * @return Number of register writes if successful, otherwise ERROR
+ */
+int32_t
+hdConfigCommit()
+{
+  const uint32_t iCtrl1 = offsetof(HD, ctrl1) >> 2, iCtrl2 = offsetof(HD, ctrl2) >> 2,
+    iGen1 = offsetof(HD, gen_config1) >> 2, iGen2 = offsetof(HD, gen_config2) >> 2,
+    iGen3 = offsetof(HD, gen_config3) >> 2;
+  uint32_t clear[HD_NREGS], set[HD_NREGS], rreg[HD_NREGS], wreg[HD_NREGS];
+  uint32_t iorder, ireg, ctrl2, old1, old2, clockChanged, genDisabled = 0,
+    genReenable = 0;
+  int32_t nwrites = 0, rval = OK;
+  volatile uint32_t *regs;
+  CHECKINIT;
 
-  printf("0x%05x",
-	 rv.int_testtrig_delay & HD_INT_TESTTRIG_DELAY_MASK);
+  pthread_mutex_lock(&hdStageMutex);
+  if(!hdConfigStaged(hdb))
+    {
+      pthread_mutex_unlock(&hdStageMutex);
+      printf("%s: ERROR: No configuration staged by this thread\n", __func__);
+      return ERROR;
+    }
+  memcpy(clear, hdStageClear, sizeof(clear));
+  memcpy(set, hdStageSet, sizeof(set));
+  hdStaging = 0;
+  pthread_mutex_unlock(&hdStageMutex);
 
-  printf("\n");
+  regs = (volatile uint32_t *)hdp;
 
-  printf("\n");
-  printf("                         Status\n");
-  printf("                                                               Int Buff\n");
-  printf("  Helicity   ...Block Data..       Event             Latch     ..Empty.  TSETTLE\n");
-  printf("  Sequence   Accepted  Ready      Buffer  BERR  BUSY  BUSY      0     1  Filter\n");
-  printf("  ------------------------------------------------------------------------------\n");
-  /*
-   *     "        OK        ---    ---       Empty    lo    lo    lo    YES    YES   128"
-   */
+  HLOCK;
+  hdConfigRead(hdb, clear, set, rreg, wreg);
 
-  printf("     %s        ",
-	 rv.csr & HD_CSR_HELICITY_SEQ_ERROR ? "ERROR" : "   OK");
+  /* Clock source switch, on its own */
+  clockChanged = (rreg[iCtrl1] ^ wreg[iCtrl1]) & HD_CTRL1_CLK_SRC_MASK;
+  if(clockChanged)
+    {
+      hdWrite32(&regs[iCtrl1], wreg[iCtrl1]);
+      nwrites++;
+    }
 
-  printf("%s    ",
-	 rv.csr & HD_CSR_BLOCK_ACCEPTED ? "YES" : "---");
+  /* Generator must be disabled while it is configured */
+  if((rreg[iGen1] != wreg[iGen1]) || (rreg[iGen2] != wreg[iGen2]) ||
+     (rreg[iGen3] != wreg[iGen3]))
+    {
+      ctrl2 = (clear[iCtrl2] | set[iCtrl2]) ? rreg[iCtrl2] : hdRead32(&hdp->ctrl2);
+      if(ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE)
+	{
+	  old1 = (clear[iGen1] | set[iGen1]) ? rreg[iGen1] : hdRead32(&hdp->gen_config1);
+	  old2 = (clear[iGen2] | set[iGen2]) ? rreg[iGen2] : hdRead32(&hdp->gen_config2);
+	  hdWrite32(&hdp->ctrl2, ctrl2 & ~HD_CTRL2_INT_HELICITY_ENABLE);
+	  nwrites++;
+	  genDisabled = 1;
+	  /* Reenabled after the writes, unless staged to be disabled */
+	  genReenable = (clear[iCtrl2] & HD_CTRL2_INT_HELICITY_ENABLE) == 0;
+	}
+    }
 
-  printf("%s    ",
-	 rv.csr & HD_CSR_BLOCK_READY ? "YES" : "---");
+  if(clockChanged || genDisabled)
+    {
+      HUNLOCK;
 
-  printf("%s   ",
-	 rv.csr & HD_CSR_EMPTY ? "   Empty" : "NotEmpty");
+      if(genDisabled)
+	hdGeneratorDwell(old1, old2);
 
-  printf("%s   ",
-	 rv.csr & HD_CSR_BERR_ASSERTED ? " HI" : " lo");
+      if(clockChanged)
+	{
+	  hdSettleSignalSourcesUs = hdWaitClockPLL(hdb, 1);
+	  if(hdSettleSignalSourcesUs == ERROR)
+	    {
+	      printf("%s: ERROR: Clock PLL not locked after %d ms (csr = 0x%08x)\n",
+		     __func__, HD_PLL_LOCK_TIMEOUT_US / 1000, HREAD(csr));
+	      rval = ERROR;
+	    }
+	}
 
-  printf("%s   ",
-	 rv.csr & HD_CSR_BUSY ? " HI" : " lo");
+      /* Other threads may have written the registers meanwhile */
+      HLOCK;
+      hdConfigRead(hdb, clear, set, rreg, wreg);
+      if(genDisabled)
+	wreg[iCtrl2] &= ~HD_CTRL2_INT_HELICITY_ENABLE;
+    }
 
-  printf("%s    ",
-	 rv.csr & HD_CSR_BUSY_LATCHED ? " HI" : " lo");
+  /* The writes, in one critical section */
+  for(iorder = 0; iorder < HD_CONFIG_NORDER; iorder++)
+    {
+      ireg = hdConfigOrder[iorder] >> 2;
+      if(wreg[ireg] != rreg[ireg])
+	{
+	  hdWrite32(&regs[ireg], wreg[ireg]);
+	  nwrites++;
+	}
+    }
+  HUNLOCK;
 
-  printf("%s    ",
-	 rv.csr & HD_CSR_INTERNAL_BUF0 ? "YES" : "---");
+  /* Settle the new generator configuration before it is reenabled */
+  if(genReenable)
+    {
+      usleep(HD_GENERATOR_MIN_DWELL_US);
 
-  printf("%s  ",
-	 rv.csr & HD_CSR_INTERNAL_BUF1 ? "YES" : "---");
-  printf("%d",
-	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_DISABLED ? 0 :
-	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_4 ? 4 :
-	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_8 ? 8 :
-	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_16 ? 16 :
-	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_32 ? 32 :
-	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_64 ? 64 :
-	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_128 ? 128 :
-	 (rv.ctrl1 & HD_CTRL1_TSETTLE_FILTER_MASK) == HD_CTRL1_TSETTLE_FILTER_256 ? 256 :
-	 -1);
-  printf("\n");
-  printf("\n");
+      HLOCK;
+      hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) | HD_CTRL2_INT_HELICITY_ENABLE);
+      nwrites++;
+      HUNLOCK;
 
-  hdPrintScalers();
-  printf("\n");
-  hdPrintHelicityGeneratorConfig();
-  printf("\n");
+      usleep(HD_GENERATOR_MIN_DWELL_US);
+    }
 
-  printf("--------------------------------------------------------------------------------\n");
-  printf("\n\n");
+  return (rval == OK) ? nwrites : ERROR;
+}
 
+/* Registers in a configuration checkpoint, and their configuration bits */
+static const struct
+{
+  uint32_t offset;
+  uint32_t mask;
+} hdCheckpointRegs[HD_CHECKPOINT_NREGS] =
+  {
+    {offsetof(HD, ctrl1),              HD_CTRL1_CONFIG_MASK},
+    {offsetof(HD, ctrl2),              HD_CTRL2_CONFIG_MASK},
+    {offsetof(HD, adr32),              HD_ADR32_BASE_MASK | HD_ADR32_ENABLE},
+    {offsetof(HD, blk_size),           HD_BLOCKLEVEL_MASK},
+    {offsetof(HD, delay),              HD_DELAY_TRIGGER_MASK | HD_DELAY_DATA_MASK},
+    {offsetof(HD, gen_config1),        (HD_HELICITY_CONFIG1_PATTERN_MASK |
+					HD_HELICITY_CONFIG1_HELICITY_DELAY_MASK |
+					HD_HELICITY_CONFIG1_HELICITY_SETTLE_MASK)},
+    {offsetof(HD, gen_config2),        HD_HELICITY_CONFIG2_STABLE_TIME_MASK},
+    {offsetof(HD, gen_config3),        HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK},
+    {offsetof(HD, int_testtrig_delay), HD_INT_TESTTRIG_DELAY_MASK},
+    {offsetof(HD, delay_setup),        (HD_DELAY_SETUP_SELECTION_MASK |
+					HD_DELAY_SETUP_ENABLE)},
+  };
+
+static const char *hdCheckpointNames[HD_CHECKPOINT_NREGS] =
+  {
+    "ctrl1", "ctrl2", "adr32", "blk_size", "delay",
+    "gen_config1", "gen_config2", "gen_config3",
+    "int_testtrig_delay", "delay_setup"
+  };
+
+static uint32_t
+hdCheckpointChecksum(const HD_CHECKPOINT *cp)
+{
+  const uint32_t *word = (const uint32_t *)cp;
+  uint32_t iword, sum = 0;
 
+  for(iword = 0; iword < offsetof(HD_CHECKPOINT, checksum) >> 2; iword++)
+    sum = (sum << 1 | sum >> 31) ^ word[iword];
 
-  return OK;
+  return sum;
 }
 
 /**
- * @ingroup Status
- * @brief Return the firmware version of the module
+ * @ingroup Config
+ * @brief Read the configuration of the module into a checkpoint
  *
- * @return Firmware version if successful, otherwise ERROR
+ * @param cp Where to put the checkpoint
+ *
+ * @return OK if successful, otherwise ERROR
  */
 int32_t
-hdGetFirmwareVersion()
+hdCheckpointGet(HD_CHECKPOINT *cp)
 {
-  int32_t rval;
+  volatile uint32_t *regs;
+  int32_t ireg;
   CHECKINIT;
 
+  if(cp == NULL)
+    {
+      printf("%s: ERROR: Invalid checkpoint pointer\n", __func__);
+      return ERROR;
+    }
+  regs = (volatile uint32_t *)hdp;
+
+  memset(cp, 0, sizeof(HD_CHECKPOINT));
+  cp->magic = HD_CHECKPOINT_MAGIC;
+  cp->version = HD_CHECKPOINT_VERSION;
+  cp->size = sizeof(HD_CHECKPOINT);
+  cp->saved = (uint64_t)time(NULL);
+
   HLOCK;
-  rval = vmeRead32(&hdp->version) & HD_VERSION_FIRMWARE_MASK;
+  cp->vmeA24 = (uint32_t)((devaddr_t)hdp - hdA24Offset);
+  cp->a32Base = hdA32Base;
+  cp->firmware = hdRead32(&hdp->version);
+  for(ireg = 0; ireg < HD_CHECKPOINT_NREGS; ireg++)
+    cp->reg[ireg] = hdRead32(&regs[hdCheckpointRegs[ireg].offset >> 2])
+      & hdCheckpointRegs[ireg].mask;
   HUNLOCK;
 
-  return rval;
-}
+  cp->checksum = hdCheckpointChecksum(cp);
 
+  return OK;
+}
 
 /**
  * @ingroup Config
- * @brief Reset the module
+ * @brief Save the configuration of the module to a checkpoint file
  *
- * @param type Reset Type
- *           0 Soft
- *           1 Hard
- *           2 Both
- * @param clearA32 Flag to clear A32 settings
- *           0 Restore A32 settings after reset
- *           1 Wipe them out.  All of them.
+ *   The file is written next to the old one and renamed over it, so a
+ *   crash while saving leaves the previous checkpoint intact.
+ *
+ * @param filename Checkpoint file
  *
  * @return OK if successful, otherwise ERROR
  */
-
 int32_t
-hdReset(uint8_t type, uint8_t clearA32)
+hdCheckpointSave(const char *filename)
 {
-  int32_t rval = OK;
-  uint32_t wreg = 0;
-  uint32_t adr32 = 0;
-  CHECKINIT;
+  HD_CHECKPOINT cp;
+  char tmpname[256];
+  FILE *f;
+  int32_t nwritten;
 
-  switch(type)
+  if(hdCheckpointGet(&cp) != OK)
+    return ERROR;
+
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+  f = fopen(tmpname, "wb");
+  if(f == NULL)
     {
-    case 0:
-      wreg = HD_CSR_SOFT_RESET;
-      break;
-    case 1:
-      wreg = HD_CSR_HARD_RESET;
-      break;
-    case 2:
-    default:
-      wreg = HD_CSR_SOFT_RESET | HD_CSR_HARD_RESET;
+      printf("%s: ERROR: Unable to open %s\n", __func__, tmpname);
+      return ERROR;
     }
 
-  clearA32 = clearA32 ? 1 : 0;
+  nwritten = fwrite(&cp, sizeof(cp), 1, f);
+  if((fclose(f) != 0) || (nwritten != 1) || (rename(tmpname, filename) != 0))
+    {
+      printf("%s: ERROR: Unable to write %s\n", __func__, filename);
+      remove(tmpname);
+      return ERROR;
+    }
 
-  if(!clearA32)
-    adr32 = hdGetA32();
+  return OK;
+}
 
-  HLOCK;
-  vmeWrite32(&hdp->csr, HD_CSR_HARD_RESET);
-  HUNLOCK;
+/**
+ * @ingroup Config
+ * @brief Load a checkpoint file
+ *
+ * @param filename Checkpoint file, from hdCheckpointSave
+ * @param cp Where to put the checkpoint
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdCheckpointLoad(const char *filename, HD_CHECKPOINT *cp)
+{
+  FILE *f;
+  int32_t nread;
 
-  if(!clearA32)
-    hdSetA32(adr32);
+  if(cp == NULL)
+    {
+      printf("%s: ERROR: Invalid checkpoint pointer\n", __func__);
+      return ERROR;
+    }
 
-  return rval;
+  f = fopen(filename, "rb");
+  if(f == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      return ERROR;
+    }
+  nread = fread(cp, sizeof(HD_CHECKPOINT), 1, f);
+  fclose(f);
+
+  if((nread != 1) || (cp->magic != HD_CHECKPOINT_MAGIC) ||
+     (cp->version != HD_CHECKPOINT_VERSION) ||
+     (cp->size != sizeof(HD_CHECKPOINT)) ||
+     (cp->checksum != hdCheckpointChecksum(cp)))
+    {
+      printf("%s: ERROR: %s is not a valid checkpoint\n", __func__, filename);
+      return ERROR;
+    }
+
+  return OK;
 }
 
 /**
  * @ingroup Config
- * @brief Set the A32 Base
+ * @brief Compare the module configuration against a checkpoint
  *
- * @return OK if successful, otherwise ERROR
+ * @param cp Checkpoint, from hdCheckpointLoad or hdCheckpointGet
+ * @param pflag Print the registers that differ, if 1
+ *
+ * @return Number of registers that differ, or ERROR
  */
-
 int32_t
-hdSetA32(uint32_t a32base)
+hdCheckpointVerify(const HD_CHECKPOINT *cp, int32_t pflag)
 {
-  int32_t rval = OK;
-  uint32_t wreg = 0;
+  HD_CHECKPOINT now;
+  int32_t ireg, ndiff = 0;
 
-  if(((a32base >> 16) & HD_ADR32_BASE_MASK) == 0)
+  if(cp == NULL)
     {
-      printf("%s: ERROR: Invalid a32base (0x%08x)\n",
-	     __func__, a32base);
+      printf("%s: ERROR: Invalid checkpoint pointer\n", __func__);
       return ERROR;
     }
 
-  if(hdp != NULL)
+  if(hdCheckpointGet(&now) != OK)
+    return ERROR;
+
+  if((now.vmeA24 != cp->vmeA24) || (now.firmware != cp->firmware))
     {
-      /* If the library has been initialized, configure pointer and register */
-      devaddr_t laddr = 0;
-      int32_t res = vmeBusToLocalAdrs(0x09,
-				      (char *)(devaddr_t)a32base,
-				      (char **)&laddr);
-      if (res != 0)
+      if(pflag)
+	printf("%s: Module 0x%06x (version 0x%08x) is not the checkpointed module 0x%06x (version 0x%08x)\n",
+	       __func__, now.vmeA24, now.firmware, cp->vmeA24, cp->firmware);
+      return HD_CHECKPOINT_NREGS;
+    }
+
+  /* Checkpoints saved with a wider mask still compare on the
+     configuration bits only */
+  for(ireg = 0; ireg < HD_CHECKPOINT_NREGS; ireg++)
+    {
+      if(now.reg[ireg] != (cp->reg[ireg] & hdCheckpointRegs[ireg].mask))
 	{
-	  printf("%s: ERROR in vmeBusToLocalAdrs(0x09,0x%x,&laddr) \n",
-		 __func__, a32base);
-	  return ERROR;
+	  if(pflag)
+	    printf("%s: %-20s module 0x%08x  checkpoint 0x%08x\n",
+		   __func__, hdCheckpointNames[ireg], now.reg[ireg],
+		   cp->reg[ireg]);
+	  ndiff++;
 	}
+    }
 
-      HLOCK;
-      hdA32Base = a32base;
-      hdA32Offset = laddr - hdA32Base;
-      hdDatap = (uint32_t *)(laddr);  /* Set a pointer to the FIFO */
+  return ndiff;
+}
 
-      wreg = ((a32base >> 16) & HD_ADR32_BASE_MASK) | HD_ADR32_ENABLE;
+/**
+ * @ingroup Config
+ * @brief Restore the module configuration from a checkpoint
+ *
+ *   The A32 base is set with hdSetA32 if it differs, and the other
+ *   registers are committed as a staged configuration, so only the
+ *   registers that differ are written.  The run state (ctrl2 GO,
+ *   EVENT_BUILD_ENABLE, FORCE_BUSY) is not part of a checkpoint, and is
+ *   left as it is.
+ *
+ * @param cp Checkpoint, from hdCheckpointLoad
+ *
+ * @return Number of register writes if successful, otherwise ERROR
+ */
+int32_t
+hdCheckpointRestore(const HD_CHECKPOINT *cp)
+{
+  int32_t ireg, nwrites = 0, rval;
+  uint32_t adr32;
+  CHECKINIT;
 
-      vmeWrite32(&hdp->adr32, 0);
-      vmeWrite32(&hdp->adr32, wreg);
+  if(cp == NULL)
+    {
+      printf("%s: ERROR: Invalid checkpoint pointer\n", __func__);
+      return ERROR;
+    }
 
-      HUNLOCK;
+  adr32 = hdRead32(&hdp->adr32) & (HD_ADR32_BASE_MASK | HD_ADR32_ENABLE);
+  if((adr32 != cp->reg[2]) || (hdA32Base != cp->a32Base))
+    {
+      if(hdSetA32(cp->a32Base) != OK)
+	return ERROR;
+      nwrites += 2;
     }
-  else
+
+  if(hdConfigBegin() != OK)
+    return ERROR;
+
+  for(ireg = 0; ireg < HD_CHECKPOINT_NREGS; ireg++)
     {
-      HLOCK;
-      hdA32Base = a32base;
-      HUNLOCK;
+      if(hdCheckpointRegs[ireg].offset == offsetof(HD, adr32))
+	continue;
+      hdConfigStage(hdb, hdCheckpointRegs[ireg].offset, hdCheckpointRegs[ireg].mask,
+		    cp->reg[ireg] & hdCheckpointRegs[ireg].mask);
     }
 
-  return rval;
+  rval = hdConfigCommit();
+  if(rval == ERROR)
+    return ERROR;
+
+  return nwrites + rval;
 }
 
 /**
- * @ingroup Status
- * @brief Get the A32 Base
+ * @ingroup Config
+ * @brief Set the checkpoint file used by hdInit with HD_INIT_WARM, for the
+ *        selected board
  *
- * @return OK if successful, otherwise ERROR
+ * @param filename Checkpoint file.  NULL to attach without checking.
+ *
+ * @return OK
  */
-
-uint32_t
-hdGetA32()
+int32_t
+hdSetCheckpointFile(const char *filename)
 {
-  uint32_t rval;
+  HDBOARD;
+
   HLOCK;
-  rval = hdA32Base;
+  if(filename == NULL)
+    hdCheckpointFile[0] = '\0';
+  else
+    strncpy(hdCheckpointFile, filename, sizeof(hdCheckpointFile) - 1);
   HUNLOCK;
 
-  return rval;
+  return OK;
 }
 
 /**
  * @ingroup Config
  * @brief Set the signal sources for the module
  *
+ *   Returns when the clock PLLs are locked on the new source (see
+ *   hdGetSettleTime), without holding hdMutex while waiting.
+ *
  * @param clkSrc Clock Source
  *      0 Internal
  *      1 Front Panel - LVDS
@@ -732,14 +2668,14 @@ hdGetA32()
  *      2 VXS
  *      3 Front Panel - ECL
  *
- * @return OK if successful, otherwise ERROR
+ * @return OK if successful, ERROR if the PLLs did not lock
  */
 
 int32_t
 hdSetSignalSources(uint8_t clkSrc, uint8_t trigSrc, uint8_t srSrc)
 {
   int32_t rval = OK;
-  uint32_t wreg = 0;
+  uint32_t wreg = 0, rreg, clockChanged;
   CHECKINIT;
 
 
@@ -818,14 +2754,28 @@ hdSetSignalSources(uint8_t clkSrc, uint8_t trigSrc, uint8_t srSrc)
 	     __func__, srSrc);
     }
 
+  HSTAGE(ctrl1, HD_CTRL1_CLK_SRC_MASK | HD_CTRL1_INT_CLK_ENABLE |
+	 HD_CTRL1_TRIG_SRC_MASK | HD_CTRL1_SYNC_RESET_SRC_MASK, wreg);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl1,
-	     (vmeRead32(&hdp->ctrl1) &
+  rreg = hdRead32(&hdp->ctrl1);
+  clockChanged = (rreg ^ wreg) & (HD_CTRL1_CLK_SRC_MASK | HD_CTRL1_INT_CLK_ENABLE);
+  hdWrite32(&hdp->ctrl1,
+	     (rreg &
 	      ~(HD_CTRL1_CLK_SRC_MASK | HD_CTRL1_INT_CLK_ENABLE |
 		HD_CTRL1_TRIG_SRC_MASK | HD_CTRL1_SYNC_RESET_SRC_MASK)) | wreg);
-  taskDelay(40);
   HUNLOCK;
 
+  /* Wait for the clock PLLs to lock on the new source */
+  hdSettleSignalSourcesUs = hdWaitClockPLL(hdb, clockChanged ? 1 : 0);
+
+  if(hdSettleSignalSourcesUs == ERROR)
+    {
+      printf("%s: ERROR: Clock PLL not locked after %d ms (csr = 0x%08x)\n",
+	     __func__, HD_PLL_LOCK_TIMEOUT_US / 1000, HREAD(csr));
+      rval = ERROR;
+    }
+
   return rval;
 }
 
@@ -856,9 +2806,7 @@ hdGetSignalSources(uint8_t *clkSrc, uint8_t *trigSrc, uint8_t *srSrc)
   uint32_t rreg = 0, signal = 0;
   CHECKINIT;
 
-  HLOCK;
-  rreg = vmeRead32(&hdp->ctrl1);
-  HUNLOCK;
+  rreg = HREAD(ctrl1);
 
   /* Clock Source */
   signal = rreg & HD_CTRL1_CLK_SRC_MASK;
@@ -954,9 +2902,11 @@ hdSetHelicitySource(uint8_t helSrc, uint8_t input, uint8_t output)
   wreg |= input ? HD_CTRL1_USE_EXT_CU_IN : 0;
   wreg |= output ? HD_CTRL1_INT_HELICITY_TO_FP : 0;
 
+  HSTAGE(ctrl1, HD_CTRL1_HEL_SRC_MASK, wreg);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl1,
-	     (vmeRead32(&hdp->ctrl1) & ~HD_CTRL1_HEL_SRC_MASK) | wreg);
+  hdWrite32(&hdp->ctrl1,
+	     (hdRead32(&hdp->ctrl1) & ~HD_CTRL1_HEL_SRC_MASK) | wreg);
   HUNLOCK;
 
   return rval;
@@ -986,9 +2936,7 @@ hdGetHelicitySource(uint8_t *helSrc, uint8_t *input, uint8_t *output)
   uint32_t rreg = 0;
   CHECKINIT;
 
-  HLOCK;
-  rreg = vmeRead32(&hdp->ctrl1) & HD_CTRL1_HEL_SRC_MASK;
-  HUNLOCK;
+  rreg = HREAD(ctrl1) & HD_CTRL1_HEL_SRC_MASK;
 
   *helSrc = (rreg & HD_CTRL1_USE_INT_HELICITY) ? 1 : 0;
   *input = (rreg & HD_CTRL1_USE_EXT_CU_IN) ? 1 : 0;
@@ -1011,8 +2959,10 @@ hdSetBlocklevel(uint8_t blklevel)
   int32_t rval = OK;
   CHECKINIT;
 
+  HSTAGE(blk_size, 0xFFFFFFFF, blklevel);
+
   HLOCK;
-  vmeWrite32(&hdp->blk_size, blklevel);
+  hdWrite32(&hdp->blk_size, blklevel);
   HUNLOCK;
 
   return rval;
@@ -1030,9 +2980,7 @@ hdGetBlocklevel()
   int32_t rval = OK;
   CHECKINIT;
 
-  HLOCK;
-  rval = vmeRead32(&hdp->blk_size) & 0xFF;
-  HUNLOCK;
+  rval = HREAD(blk_size) & 0xFF;
 
   return rval;
 }
@@ -1069,8 +3017,10 @@ hdSetProcDelay(uint16_t dataInputDelay, uint16_t triggerLatencyDelay)
     }
 
   wreg = triggerLatencyDelay | (dataInputDelay << 16);
+  HSTAGE(delay, 0xFFFFFFFF, wreg);
+
   HLOCK;
-  vmeWrite32(&hdp->delay, wreg);
+  hdWrite32(&hdp->delay, wreg);
   HUNLOCK;
 
   return rval;
@@ -1094,12 +3044,10 @@ hdGetProcDelay(uint16_t *dataInputDelay, uint16_t *triggerLatencyDelay)
   uint32_t rreg = 0;
   CHECKINIT;
 
-  HLOCK;
-  rreg = vmeRead32(&hdp->delay);
+  rreg = HREAD(delay);
 
   *dataInputDelay = (rreg & HD_DELAY_DATA_MASK) >> 16;
   *triggerLatencyDelay = rreg & HD_DELAY_TRIGGER_MASK;
-  HUNLOCK;
 
   return rval;
 }
@@ -1125,56 +3073,56 @@ hdConfirmProcDelay(uint8_t pflag)
   CHECKINIT;
 
   HLOCK;
-  rreg_programmed = vmeRead32(&hdp->delay);
-  rreg_trigger = vmeRead32(&hdp->latency_confirm);
-  rreg_data = vmeRead32(&hdp->delay_confirm);
+  rreg_programmed = hdRead32(&hdp->delay);
+  rreg_trigger = hdRead32(&hdp->latency_confirm);
+  rreg_data = hdRead32(&hdp->delay_confirm);
   HUNLOCK;
 
   /* Check trigger */
-  dataInputDelay = (rreg_programmed & HD_DELAY_DATA_MASK) >> 16;
+  triggerLatencyDelay = rreg_programmed & HD_DELAY_TRIGGER_MASK;
   rdaddr = rreg_trigger & HD_CONFIRM_READ_ADDR_MASK;
-  wraddr = rreg_trigger & HD_CONFIRM_WRITE_ADDR_MASK;
+  wraddr = (rreg_trigger & HD_CONFIRM_WRITE_ADDR_MASK) >> 16;
 
-  if (wraddr > rdaddr) delay = wraddr - rdaddr;
-  else                 delay = 4096 + wraddr - rdaddr;
+  if (wraddr >= rdaddr) delay = wraddr - rdaddr;
+  else                  delay = 4096 + wraddr - rdaddr;
 
-  if(dataInputDelay != delay)
+  if(triggerLatencyDelay != delay)
     {
-      printf("%s: ERROR: Programmed dataInputDelay != wraddr-rdaddr  (0x%04x != 0x%04x)\n",
+      printf("%s: ERROR: Programmed triggerLatencydelay != wraddr-rdaddr  (0x%04x != 0x%04x)\n",
 	     __func__,
-	     dataInputDelay, delay);
+	     triggerLatencyDelay, delay);
       rval = ERROR;
     }
   else if(pflag)
     {
-      printf("%s: dataInputDelay Confirmed 0x%04x = %s0x%04x - 0x%04x\n",
+      printf("%s: triggerLatencydelay Confirmed 0x%04x = %s0x%04x - 0x%04x\n",
 	     __func__,
-	     dataInputDelay,
-	     (wraddr > rdaddr) ? "" : "4096 + ",
+	     triggerLatencyDelay,
+	     (wraddr >= rdaddr) ? "" : "4096 + ",
 	     wraddr, rdaddr);
     }
 
   /* Check data */
-  triggerLatencyDelay = rreg_programmed & HD_DELAY_TRIGGER_MASK;
+  dataInputDelay = (rreg_programmed & HD_DELAY_DATA_MASK) >> 16;
   rdaddr = rreg_data & HD_CONFIRM_READ_ADDR_MASK;
-  wraddr = rreg_data & HD_CONFIRM_WRITE_ADDR_MASK;
+  wraddr = (rreg_data & HD_CONFIRM_WRITE_ADDR_MASK) >> 16;
 
-  if (wraddr > rdaddr) delay = wraddr - rdaddr;
-  else                 delay = 4096 + wraddr - rdaddr;
+  if (wraddr >= rdaddr) delay = wraddr - rdaddr;
+  else                  delay = 4096 + wraddr - rdaddr;
 
-  if(triggerLatencyDelay != delay)
+  if(dataInputDelay != delay)
     {
-      printf("%s: ERROR: Programmed triggerLatencydelay != wraddr-rdaddr  (0x%04x != 0x%04x)\n",
+      printf("%s: ERROR: Programmed dataInputDelay != wraddr-rdaddr  (0x%04x != 0x%04x)\n",
 	     __func__,
-	     triggerLatencyDelay, delay);
+	     dataInputDelay, delay);
       rval = ERROR;
     }
   else if(pflag)
     {
-      printf("%s: triggerLatencydelay Confirmed 0x%04x = %s0x%04x - 0x%04x\n",
+      printf("%s: dataInputDelay Confirmed 0x%04x = %s0x%04x - 0x%04x\n",
 	     __func__,
-	     triggerLatencyDelay,
-	     (wraddr > rdaddr) ? "" : "4096 + ",
+	     dataInputDelay,
+	     (wraddr >= rdaddr) ? "" : "4096 + ",
 	     wraddr, rdaddr);
     }
 
@@ -1197,11 +3145,13 @@ hdSetBERR(uint8_t enable)
   int32_t rval = OK;
   CHECKINIT;
 
+  HSTAGE(ctrl1, HD_CTRL1_BERR_ENABLE, enable ? HD_CTRL1_BERR_ENABLE : 0);
+
   HLOCK;
   if(enable)
-    vmeWrite32(&hdp->ctrl1, vmeRead32(&hdp->ctrl1) | HD_CTRL1_BERR_ENABLE);
+    hdWrite32(&hdp->ctrl1, hdRead32(&hdp->ctrl1) | HD_CTRL1_BERR_ENABLE);
   else
-    vmeWrite32(&hdp->ctrl1, vmeRead32(&hdp->ctrl1) & ~HD_CTRL1_BERR_ENABLE);
+    hdWrite32(&hdp->ctrl1, hdRead32(&hdp->ctrl1) & ~HD_CTRL1_BERR_ENABLE);
   HUNLOCK;
 
   return rval;
@@ -1211,6 +3161,9 @@ hdSetBERR(uint8_t enable)
  * @ingroup Status
  * @brief Get the configuration for BERR Response from the module
  *
+ *   Under hdMutex: the programmed I/O readout clears the BERR enable
+ *   while it reads, and restores it after.
+ *
  * @return 1 if enabled, 0 if disabled, otherwise ERROR
  */
 int32_t
@@ -1220,7 +3173,7 @@ hdGetBERR()
   CHECKINIT;
 
   HLOCK;
-  rval = (vmeRead32(&hdp->ctrl1) & HD_CTRL1_BERR_ENABLE) ? 1 : 0;
+  rval = (HREAD(ctrl1) & HD_CTRL1_BERR_ENABLE) ? 1 : 0;
   HUNLOCK;
 
   return rval;
@@ -1241,8 +3194,10 @@ hdEnableDecoder()
   uint32_t wreg = HD_CTRL2_DECODER_ENABLE;
   CHECKINIT;
 
+  HSTAGE(ctrl2, 0, wreg);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl2, vmeRead32(&hdp->ctrl2) | wreg);
+  hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) | wreg);
   HUNLOCK;
 
   return rval;
@@ -1261,8 +3216,10 @@ hdEnable()
   uint32_t wreg = HD_CTRL2_DECODER_ENABLE | HD_CTRL2_GO | HD_CTRL2_EVENT_BUILD_ENABLE;
   CHECKINIT;
 
+  HSTAGE(ctrl2, 0, wreg);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl2, vmeRead32(&hdp->ctrl2) | wreg);
+  hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) | wreg);
   HUNLOCK;
 
   return rval;
@@ -1281,8 +3238,10 @@ hdDisable()
   uint32_t wreg = HD_CTRL2_DECODER_ENABLE | HD_CTRL2_GO | HD_CTRL2_EVENT_BUILD_ENABLE;
   CHECKINIT;
 
+  HSTAGE(ctrl2, wreg, 0);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl2, vmeRead32(&hdp->ctrl2) & ~wreg);
+  hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) & ~wreg);
   HUNLOCK;
 
   return rval;
@@ -1307,7 +3266,7 @@ hdTrig(int pflag)
     printf("%s: Software Trigger\n", __func__);
 
   HLOCK;
-  vmeWrite32(&hdp->csr, HD_CSR_TRIGGER_PULSE);
+  hdWrite32(&hdp->csr, HD_CSR_TRIGGER_PULSE);
   HUNLOCK;
 
   return rval;
@@ -1332,7 +3291,7 @@ hdSync(int pflag)
     printf("%s: Software SyncReset\n", __func__);
 
   HLOCK;
-  vmeWrite32(&hdp->csr, HD_CSR_SYNC_RESET_PULSE);
+  hdWrite32(&hdp->csr, HD_CSR_SYNC_RESET_PULSE);
   HUNLOCK;
 
   return rval;
@@ -1354,11 +3313,13 @@ hdBusy(int enable)
   int32_t rval = OK;
   CHECKINIT;
 
+  HSTAGE(ctrl2, HD_CTRL2_FORCE_BUSY, enable ? HD_CTRL2_FORCE_BUSY : 0);
+
   HLOCK;
   if(enable)
-    vmeWrite32(&hdp->ctrl2, vmeRead32(&hdp->ctrl2) | HD_CTRL2_FORCE_BUSY);
+    hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) | HD_CTRL2_FORCE_BUSY);
   else
-    vmeWrite32(&hdp->ctrl2, vmeRead32(&hdp->ctrl2) & ~HD_CTRL2_FORCE_BUSY);
+    hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) & ~HD_CTRL2_FORCE_BUSY);
   HUNLOCK;
 
   return rval;
@@ -1376,9 +3337,7 @@ hdBReady()
   int32_t rval = 0;
   CHECKINIT;
 
-  HLOCK;
-  rval = (vmeRead32(&hdp->csr) & HD_CSR_BLOCK_READY) ? 1 : 0;
-  HUNLOCK;
+  rval = (HREAD(csr) & HD_CSR_BLOCK_READY) ? 1 : 0;
 
   return rval;
 }
@@ -1395,9 +3354,7 @@ hdBERRStatus()
   int32_t rval = 0;
   CHECKINIT;
 
-  HLOCK;
-  rval = (vmeRead32(&hdp->csr) & HD_CSR_BERR_ASSERTED) ? 1 : 0;
-  HUNLOCK;
+  rval = (HREAD(csr) & HD_CSR_BERR_ASSERTED) ? 1 : 0;
 
   return rval;
 }
@@ -1416,7 +3373,7 @@ hdBusyStatus(uint8_t *latched)
   CHECKINIT;
 
   HLOCK;
-  rreg = vmeRead32(&hdp->csr);
+  rreg = hdRead32(&hdp->csr);
 
   rval = (rreg & HD_CSR_BUSY) ? 1 : 0;
 
@@ -1425,36 +3382,23 @@ hdBusyStatus(uint8_t *latched)
       *latched = (rreg & HD_CSR_BUSY_LATCHED) ? 1 : 0;
 
       if(*latched) /* Clear if it's latched */
-	vmeWrite32(&hdp->csr, HD_CSR_BUSY_LATCHED);
+	hdWrite32(&hdp->csr, HD_CSR_BUSY_LATCHED);
     }
   HUNLOCK;
 
   return rval;
 }
 
-/**
- * @ingroup Readout
- * @brief Read a block of events from the module
- *
- * @param   data  - local memory address to place data
- * @param   nwrds - Max number of words to transfer
- * @param   rflag - Readout Flag
- *       -       0 - programmed I/O
- *       -       1 - DMA transfer using Universe/Tempe DMA Engine
- *                    (DMA VME transfer Mode must be setup prior)
- *
- * @return Number of words transferred to data if successful, ERROR otherwise
- *
- */
-int32_t
-hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
+/* Block transfer for hdReadBlock, without the statistics */
+static int32_t
+hdReadBlockTransfer(volatile unsigned int *data, int nwrds, int rflag)
 {
   int32_t rval = OK;
-  int32_t ii, dummy=0, iword = 0;
+  int32_t ii, dummy=0;
   int32_t dCnt, retVal, xferCount;
   volatile uint32_t *laddr;
   uint32_t vmeAdr, val;
-  int32_t ntrig=0, itrig = 0, trigwords = 0;
+  int32_t ndecoder = 0, trailer = 0;
 
   CHECKINIT;
 
@@ -1481,7 +3425,7 @@ hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 
       vmeAdr = (devaddr_t)hdDatap - hdA32Offset;
 
-      retVal = vmeDmaSend((devaddr_t)laddr, vmeAdr, (nwrds<<2));
+      retVal = hdDmaSend((devaddr_t)laddr, vmeAdr, (nwrds<<2));
       if(retVal != 0)
 	{
 	  printf("\n%s: ERROR in DMA transfer Initialization 0x%x\n",
@@ -1491,7 +3435,7 @@ hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 	}
 
       /* Wait until Done or Error */
-      retVal = vmeDmaDone();
+      retVal = hdAccessDmaDone();
 
       if(retVal > 0)
 	{
@@ -1522,13 +3466,20 @@ hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
       dCnt = 0;
       ii=0;
 
+      if(nwrds <= 0)
+	{
+	  printf("%s: ERROR: Invalid nwrds (%d)\n", __func__, nwrds);
+	  HUNLOCK;
+	  return(ERROR);
+	}
+
       /* Check if Bus Errors are enabled. If so then disable for Prog I/O reading */
-      uint8_t berr = (vmeRead32(&hdp->ctrl1) & HD_CTRL1_BERR_ENABLE) ? 1 : 0;
+      uint8_t berr = (hdRead32(&hdp->ctrl1) & HD_CTRL1_BERR_ENABLE) ? 1 : 0;
       if(berr)
-	vmeWrite32(&hdp->ctrl1, vmeRead32(&hdp->ctrl1) & ~HD_CTRL1_BERR_ENABLE);
+	hdWrite32(&hdp->ctrl1, hdRead32(&hdp->ctrl1) & ~HD_CTRL1_BERR_ENABLE);
 
       /* Read Block Header - should be first word */
-      uint32_t bhead = vmeRead32(hdDatap);
+      uint32_t bhead = hdRead32(hdDatap);
 
       if((bhead&HD_DATA_TYPE_DEFINE)&&((bhead&HD_DATA_TYPE_MASK) == HD_DATA_BLOCK_HEADER))
 	{
@@ -1540,7 +3491,7 @@ hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
       else
 	{
 	  /* We got bad data - Check if there is any data at all */
-	  if( (vmeRead32(&hdp->evt_count) & HD_EVENTS_ON_BOARD_MASK) == 0)
+	  if( (hdRead32(&hdp->evt_count) & HD_EVENTS_ON_BOARD_MASK) == 0)
 	    {
 	      printf("%s: FIFO Empty (0x%08x)\n",
 		     __func__, bhead);
@@ -1556,24 +3507,36 @@ hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
 	    }
 	}
 
+      /* Stop at the block trailer, or when data is full */
       ii=0;
-      while(ii<nwrds)
+      while((dCnt + ii) < nwrds)
 	{
-	  val = vmeRead32(hdDatap);
-	  data[ii+2] = LSWAP(val);
-
-	  if( (val&HD_DATA_TYPE_DEFINE)
-	      && ((val&HD_DATA_TYPE_MASK) == HD_DATA_BLOCK_TRAILER) )
-	    break;
+	  val = hdRead32(hdDatap);
+	  data[dCnt + ii] = LSWAP(val);
 	  ii++;
 
+	  /* Decoder data words can look like any data type */
+	  if(ndecoder > 0)
+	    ndecoder--;
+	  else if( (val&HD_DATA_TYPE_DEFINE)
+		   && ((val&HD_DATA_TYPE_MASK) == HD_DATA_DECODER_HEADER) )
+	    ndecoder = val & HD_DATA_DECODER_NWORDS_MASK;
+	  else if( (val&HD_DATA_TYPE_DEFINE)
+		   && ((val&HD_DATA_TYPE_MASK) == HD_DATA_BLOCK_TRAILER) )
+	    {
+	      trailer = 1;
+	      break;
+	    }
 	}
-      ii++;
       dCnt += ii;
 
+      if(!trailer)
+	printf("%s: WARNING: Block trailer not found in %d words\n",
+	       __func__, nwrds);
+
       /* Re-enabled Bus errors */
       if(berr)
-	vmeWrite32(&hdp->ctrl1, vmeRead32(&hdp->ctrl1) | HD_CTRL1_BERR_ENABLE);
+	hdWrite32(&hdp->ctrl1, hdRead32(&hdp->ctrl1) | HD_CTRL1_BERR_ENABLE);
 
       HUNLOCK;
       return dCnt;
@@ -1584,6 +3547,128 @@ hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
   return rval;
 }
 
+/**
+ * @ingroup Readout
+ * @brief Read a block of events from the module
+ *
+ * @param   data  - local memory address to place data
+ * @param   nwrds - Max number of words to transfer
+ * @param   rflag - Readout Flag
+ *       -       0 - programmed I/O
+ *       -       1 - DMA transfer using Universe/Tempe DMA Engine
+ *                    (DMA VME transfer Mode must be setup prior)
+ *
+ * With programmed I/O the block is stored contiguously from data[0]
+ * (the block header) through the block trailer, as with a block transfer.
+ * Earlier versions stored the words after the header from data[2],
+ * leaving data[1] unset and the trailer past the returned count.  The
+ * words that follow a decoder data header are skipped when looking for
+ * the trailer, since they can look like any data type.  No more than
+ * nwrds words are stored.
+ *
+ * @return Number of words transferred to data if successful, ERROR otherwise
+ *
+ */
+int32_t
+hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
+{
+  int32_t rval, timing = hdReadoutTiming;
+  uint64_t start = 0, elapsed, max;
+  HDBOARD;
+
+  if(timing)
+    start = hdTimestamp();
+
+  rval = hdReadBlockTransfer(data, nwrds, rflag);
+
+  if(timing)
+    {
+      elapsed = hdTimestamp() - start;
+      __sync_fetch_and_add(&hdReadoutStats.busyNs, elapsed);
+      max = hdReadoutStats.maxNs;
+      while((elapsed > max) &&
+	    !__sync_bool_compare_and_swap(&hdReadoutStats.maxNs, max, elapsed))
+	max = hdReadoutStats.maxNs;
+      hdReadoutStats.lastNs = elapsed;
+    }
+
+  __sync_fetch_and_add(&hdReadoutStats.nreads, 1);
+  if(rval > 0)
+    __sync_fetch_and_add(&hdReadoutStats.nwords, rval);
+  else if(rval == 0)
+    __sync_fetch_and_add(&hdReadoutStats.nempty, 1);
+  else
+    __sync_fetch_and_add(&hdReadoutStats.nerrors, 1);
+
+  return rval;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Get the readout statistics accumulated by hdReadBlock
+ *
+ *   The fields are copied one at a time without a lock, so a copy taken
+ *   during a readout may be one call out between fields.
+ *
+ * @param stats Address to store the statistics
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdGetReadoutStats(HD_READOUT_STATS *stats)
+{
+  HDBOARD;
+
+  if(stats == NULL)
+    return ERROR;
+
+  *stats = hdReadoutStats;
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Reset the readout statistics accumulated by hdReadBlock
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdResetReadoutStats()
+{
+  HDBOARD;
+
+  __sync_fetch_and_and(&hdReadoutStats.nreads, 0);
+  __sync_fetch_and_and(&hdReadoutStats.nwords, 0);
+  __sync_fetch_and_and(&hdReadoutStats.nempty, 0);
+  __sync_fetch_and_and(&hdReadoutStats.nerrors, 0);
+  __sync_fetch_and_and(&hdReadoutStats.busyNs, 0);
+  __sync_fetch_and_and(&hdReadoutStats.maxNs, 0);
+  hdReadoutStats.lastNs = 0;
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Enable or disable the timing of hdReadBlock
+ *
+ *   The counters are always kept.  The time in hdReadBlock (busyNs, maxNs,
+ *   lastNs) costs two clock reads per call, and is only accumulated while
+ *   enabled.  hdDeadtimeStart enables it.
+ *
+ * @param enable 1 to enable, 0 to disable
+ *
+ * @return OK
+ */
+int32_t
+hdSetReadoutTiming(int32_t enable)
+{
+  hdReadoutTiming = enable ? 1 : 0;
+
+  return OK;
+}
+
 /**
  *  @ingroup Readout
  *  @brief Scaler Data readout routine
@@ -1594,30 +3679,48 @@ hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
  *            1 - helicity scalers, trig1, trig2, syncreset, evt_count, blk_count
  *            2 - trig1, trig2, syncreset, evt_count, blk_count
  *
+ *  With a buffer from hdSetSnapshotDMA (for this thread), the scalers
+ *  are read with one A24 block transfer.
  *
  *  @return Number of uint32 added to data if successful, otherwise ERROR.
  */
 int32_t
 hdReadScalers(volatile uint32_t *data, int rflag)
 {
-  int32_t dCnt = 0;
+  int32_t dCnt = 0, iword;
+  uint32_t scalers[9];
   CHECKINIT;
 
   HLOCK;
+  /* trig1_scaler (0x30) through helicity_scaler[3] (0x50) in one block
+     transfer */
+  if(hdRegisterBlockRead(hdb, __func__, offsetof(HD, trig1_scaler), scalers, 9) == OK)
+    {
+      if(rflag != 2)
+	for(iword = 5; iword < 9; iword++)
+	  data[dCnt++] = scalers[iword];
+      if(rflag != 0)
+	for(iword = 0; iword < 5; iword++)
+	  data[dCnt++] = scalers[iword];
+
+      HUNLOCK;
+      return dCnt;
+    }
+
   if(rflag != 2)
     {
-      data[dCnt++] = vmeRead32(&hdp->helicity_scaler[0]);
-      data[dCnt++] = vmeRead32(&hdp->helicity_scaler[1]);
-      data[dCnt++] = vmeRead32(&hdp->helicity_scaler[2]);
-      data[dCnt++] = vmeRead32(&hdp->helicity_scaler[3]);
+      data[dCnt++] = hdRead32(&hdp->helicity_scaler[0]);
+      data[dCnt++] = hdRead32(&hdp->helicity_scaler[1]);
+      data[dCnt++] = hdRead32(&hdp->helicity_scaler[2]);
+      data[dCnt++] = hdRead32(&hdp->helicity_scaler[3]);
     }
   if(rflag != 0)
     {
-      data[dCnt++] = vmeRead32(&hdp->trig1_scaler);
-      data[dCnt++] = vmeRead32(&hdp->trig2_scaler);
-      data[dCnt++] = vmeRead32(&hdp->sync_scaler);
-      data[dCnt++] = vmeRead32(&hdp->evt_count);
-      data[dCnt++] = vmeRead32(&hdp->blk_count);
+      data[dCnt++] = hdRead32(&hdp->trig1_scaler);
+      data[dCnt++] = hdRead32(&hdp->trig2_scaler);
+      data[dCnt++] = hdRead32(&hdp->sync_scaler);
+      data[dCnt++] = hdRead32(&hdp->evt_count);
+      data[dCnt++] = hdRead32(&hdp->blk_count);
     }
   HUNLOCK;
 
@@ -1635,23 +3738,8 @@ hdPrintScalers()
 {
   volatile uint32_t scalers[9];
 
-  if(hdReadScalers(scalers, 1))
-    {
-      printf("  Helicity Scalers:\n");
-      printf("    T_SETTLE falling = 0x%08x (%d)\n", scalers[0], scalers[0]);
-      printf("    T_SETTLE rising  = 0x%08x (%d)\n", scalers[1], scalers[1]);
-      printf("    PATTERN_SYNC     = 0x%08x (%d)\n", scalers[2], scalers[2]);
-      printf("    PAIR_SYNC        = 0x%08x (%d)\n", scalers[3], scalers[3]);
-      printf("\n");
-      printf("  Signal scalers:\n");
-      printf("    Trig1            = 0x%08x (%d)\n", scalers[4], scalers[4]);
-      printf("    Trig2            = 0x%08x (%d)\n", scalers[5], scalers[5]);
-      printf("    SyncReset        = 0x%08x (%d)\n", scalers[6], scalers[6]);
-      printf("\n");
-      printf("  Run Scalers:\n");
-      printf("    Events           = 0x%08x (%d)\n", scalers[7], scalers[7]);
-      printf("    Blocks           = 0x%08x (%d)\n", scalers[8], scalers[8]);
-    }
+  if(hdReadScalers(scalers, 1) == 9)
+    hdFormatScalers((uint32_t *)scalers);
 
   return OK;
 }
@@ -1676,15 +3764,79 @@ hdReadHelicityHistory(volatile unsigned int *data)
   CHECKINIT;
 
   HLOCK;
-  data[dCnt++] = vmeRead32(&hdp->helicity_history1);
-  data[dCnt++] = vmeRead32(&hdp->helicity_history2);
-  data[dCnt++] = vmeRead32(&hdp->helicity_history3);
-  data[dCnt++] = vmeRead32(&hdp->helicity_history4);
+  data[dCnt++] = hdRead32(&hdp->helicity_history1);
+  data[dCnt++] = hdRead32(&hdp->helicity_history2);
+  data[dCnt++] = hdRead32(&hdp->helicity_history3);
+  data[dCnt++] = hdRead32(&hdp->helicity_history4);
   HUNLOCK;
 
   return dCnt;
 }
 
+/**
+ *  @ingroup Readout
+ *  @brief Helicity History register readout, with the number of helicity
+ *         windows at the time of the read.
+ *
+ *    The four history registers and the T_STABLE rising edge scaler are
+ *    read under a single lock.  The scaler is read before and after the
+ *    history registers, and the read is repeated if a new window arrived
+ *    in between, so the histories are consistent with each other and with
+ *    the returned window count.  With a buffer from hdSetSnapshotDMA (for
+ *    this thread), the four history registers are one A24 block transfer.
+ *
+ *  @param data   - local memory address to place data
+ *                  Bit 0 is the most recent value
+ *                  element 0 : PATTERN_SYNC
+ *                  element 1 : PAIR_SYNC
+ *                  element 2 : reported HELICITY
+ *                  element 3 : reported HELICITY at PATTERN_SYNC
+ *  @param windowCount - address to place the T_STABLE rising edge count
+ *
+ *  @return Number (4) of uint32 added to data if successful, otherwise ERROR.
+ */
+int32_t
+hdReadHelicityHistoryCount(volatile unsigned int *data, uint32_t *windowCount)
+{
+  int32_t itry = 0, ntries = 4;
+  uint32_t before = 0, after = 0, history[4];
+  CHECKINIT;
+
+  HLOCK;
+  for(itry = 0; itry < ntries; itry++)
+    {
+      before = hdRead32(&hdp->helicity_scaler[HD_HELICITY_SCALER_TSTABLE_RISING]);
+      if(hdRegisterBlockRead(hdb, __func__, offsetof(HD, helicity_history1),
+			     history, 4) != OK)
+	{
+	  history[0] = hdRead32(&hdp->helicity_history1);
+	  history[1] = hdRead32(&hdp->helicity_history2);
+	  history[2] = hdRead32(&hdp->helicity_history3);
+	  history[3] = hdRead32(&hdp->helicity_history4);
+	}
+      after = hdRead32(&hdp->helicity_scaler[HD_HELICITY_SCALER_TSTABLE_RISING]);
+
+      if(before == after)
+	break;
+    }
+  HUNLOCK;
+
+  if(before != after)
+    {
+      printf("%s: ERROR: Helicity window changed during %d reads\n",
+	     __func__, ntries);
+      return ERROR;
+    }
+
+  data[0] = history[0];
+  data[1] = history[1];
+  data[2] = history[2];
+  data[3] = history[3];
+  *windowCount = after;
+
+  return 4;
+}
+
 /**
  * @ingroup Status
  * @brief Get the recovered shift register value(s)
@@ -1702,10 +3854,10 @@ hdGetRecoveredShiftRegisterValue(uint32_t *recovered, uint32_t *internalGenerato
   CHECKINIT;
 
   HLOCK;
-  rreg1 = vmeRead32(&hdp->recovered_shift_reg);
+  rreg1 = hdRead32(&hdp->recovered_shift_reg);
 
   if(internalGenerator != NULL)
-    rreg2 = vmeRead32(&hdp->generator_shift_reg);
+    rreg2 = hdRead32(&hdp->generator_shift_reg);
 
   HUNLOCK;
 
@@ -1730,8 +3882,10 @@ hdEnableHelicityGenerator()
   uint32_t wreg = HD_CTRL2_INT_HELICITY_ENABLE;
   CHECKINIT;
 
+  HSTAGE(ctrl2, 0, wreg);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl2, vmeRead32(&hdp->ctrl2) | wreg);
+  hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) | wreg);
   HUNLOCK;
 
   return rval;
@@ -1750,8 +3904,10 @@ hdDisableHelicityGenerator()
   uint32_t wreg = HD_CTRL2_INT_HELICITY_ENABLE;
   CHECKINIT;
 
+  HSTAGE(ctrl2, wreg, 0);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl2, vmeRead32(&hdp->ctrl2) & ~wreg);
+  hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) & ~wreg);
   HUNLOCK;
 
   return rval;
@@ -1761,6 +3917,12 @@ hdDisableHelicityGenerator()
  * @ingroup Config
  * @brief Configure the internal helicity generator
  *
+ *   Each step waits for the register to read back as written, without
+ *   holding hdMutex.  The register readback does not show the generator
+ *   state, so after disabling it waits one helicity window of the old
+ *   configuration, and at least HD_GENERATOR_MIN_DWELL_US after the other
+ *   steps.
+ *
  * @param pattern Helicity Pattern [0,3]
  *              0 Pair
  *              1 Quartet
@@ -1779,8 +3941,9 @@ hdHelicityGeneratorConfig(uint8_t pattern, uint8_t windowDelay,
 			  uint32_t seed)
 {
   int32_t rval = OK;
-  uint32_t rreg = 0, wreg1, wreg2, wreg3;
+  uint32_t rreg = 0, wreg1, wreg2, wreg3, old1 = 0, old2 = 0;
   uint8_t reenable=0;
+  uint64_t start;
   CHECKINIT;
 
   if(pattern > 3)
@@ -1794,31 +3957,80 @@ hdHelicityGeneratorConfig(uint8_t pattern, uint8_t windowDelay,
   wreg2 = stableTime & HD_HELICITY_CONFIG2_STABLE_TIME_MASK;
   wreg3 = seed & HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK;
 
+  if(hdConfigStaged(hdb))
+    {
+      hdConfigStage(hdb, offsetof(HD, gen_config1), 0xFFFFFFFF, wreg1);
+      hdConfigStage(hdb, offsetof(HD, gen_config2), 0xFFFFFFFF, wreg2);
+      hdConfigStage(hdb, offsetof(HD, gen_config3), 0xFFFFFFFF, wreg3);
+      return rval;
+    }
+
+  start = hdTimestamp();
+
   HLOCK;
   /* Check if the generator is already enabled */
-  rreg = vmeRead32(&hdp->ctrl2);
+  rreg = hdRead32(&hdp->ctrl2);
   reenable = (rreg & HD_CTRL2_INT_HELICITY_ENABLE) ? 1 : 0;
 
   if(reenable)
     {
       /* Disable generator */
-      vmeWrite32(&hdp->ctrl2, rreg & ~HD_CTRL2_INT_HELICITY_ENABLE);
-      taskDelay(10);
+      old1 = hdRead32(&hdp->gen_config1);
+      old2 = hdRead32(&hdp->gen_config2);
+      hdWrite32(&hdp->ctrl2, rreg & ~HD_CTRL2_INT_HELICITY_ENABLE);
+    }
+  HUNLOCK;
+
+  if(reenable)
+    {
+      if(hdPollRegister(&hdp->ctrl2, HD_CTRL2_INT_HELICITY_ENABLE, 0,
+			0, HD_REGISTER_TIMEOUT_US) == ERROR)
+	{
+	  printf("%s: ERROR: Generator not disabled (ctrl2 = 0x%08x)\n",
+		 __func__, HREAD(ctrl2));
+	  return ERROR;
+	}
+
+      /* Let it finish the window in progress */
+      hdGeneratorDwell(old1, old2);
     }
 
-  vmeWrite32(&hdp->gen_config1, wreg1);
-  vmeWrite32(&hdp->gen_config2, wreg2);
-  vmeWrite32(&hdp->gen_config3, wreg3);
+  HLOCK;
+  hdWrite32(&hdp->gen_config1, wreg1);
+  hdWrite32(&hdp->gen_config2, wreg2);
+  hdWrite32(&hdp->gen_config3, wreg3);
+  HUNLOCK;
 
-  taskDelay(10);
+  if((hdPollRegister(&hdp->gen_config1, 0xFFFFFFFF, wreg1, 0, HD_REGISTER_TIMEOUT_US) == ERROR) ||
+     (hdPollRegister(&hdp->gen_config2, HD_HELICITY_CONFIG2_STABLE_TIME_MASK, wreg2,
+		     0, HD_REGISTER_TIMEOUT_US) == ERROR) ||
+     (hdPollRegister(&hdp->gen_config3, HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK, wreg3,
+		     0, HD_REGISTER_TIMEOUT_US) == ERROR))
+    {
+      printf("%s: ERROR: Configuration not accepted (0x%08x 0x%08x 0x%08x)\n",
+	     __func__, HREAD(gen_config1), HREAD(gen_config2), HREAD(gen_config3));
+      rval = ERROR;
+    }
+  usleep(HD_GENERATOR_MIN_DWELL_US);
 
   if(reenable)
     {
       /* Reenable generator */
-      vmeWrite32(&hdp->ctrl2, rreg | HD_CTRL2_INT_HELICITY_ENABLE);
-      taskDelay(10);
+      HLOCK;
+      hdWrite32(&hdp->ctrl2, hdRead32(&hdp->ctrl2) | HD_CTRL2_INT_HELICITY_ENABLE);
+      HUNLOCK;
+
+      if(hdPollRegister(&hdp->ctrl2, HD_CTRL2_INT_HELICITY_ENABLE,
+			HD_CTRL2_INT_HELICITY_ENABLE, 0, HD_REGISTER_TIMEOUT_US) == ERROR)
+	{
+	  printf("%s: ERROR: Generator not reenabled (ctrl2 = 0x%08x)\n",
+		 __func__, HREAD(ctrl2));
+	  rval = ERROR;
+	}
+      usleep(HD_GENERATOR_MIN_DWELL_US);
     }
-  HUNLOCK;
+
+  hdSettleGeneratorUs = (hdTimestamp() - start) / 1000;
 
   return rval;
 }
@@ -1849,9 +4061,9 @@ hdGetHelicityGeneratorConfig(uint8_t *pattern, uint8_t *windowDelay,
   CHECKINIT;
 
   HLOCK;
-  rreg1 = vmeRead32(&hdp->gen_config1);
-  rreg2 = vmeRead32(&hdp->gen_config2);
-  rreg3 = vmeRead32(&hdp->gen_config3);
+  rreg1 = hdRead32(&hdp->gen_config1);
+  rreg2 = hdRead32(&hdp->gen_config2);
+  rreg3 = hdRead32(&hdp->gen_config3);
   HUNLOCK;
 
   *pattern = rreg1 & HD_HELICITY_CONFIG1_PATTERN_MASK;
@@ -1873,38 +4085,16 @@ hdGetHelicityGeneratorConfig(uint8_t *pattern, uint8_t *windowDelay,
 int32_t
 hdPrintHelicityGeneratorConfig()
 {
-  uint8_t pattern, windowDelay;
-  uint16_t settleTime;
-  uint32_t stableTime, seed;
-
-  if(hdGetHelicityGeneratorConfig(&pattern, &windowDelay,
-				  &settleTime, &stableTime,
-				  &seed) == OK)
-    {
-      printf("\n");
-      printf("  Helicity Generator Configuration\n");
-      printf("\n");
-      printf("               Window Settle                Stable\n");
-      printf("    Pattern    Delay  Time                  Time                     Seed\n");
-      printf("  ------------------------------------------------------------------------------\n");
-      /*
-       *     "    PAIR       0      0x0000 (    0 ns)     0x0000000 (        0 ns) 0x00000000"
-       */
-
-      printf("    %s  ",
-	     (pattern == 0) ? "PAIR   " :
-	     (pattern == 1) ? "QUARTET" :
-	     (pattern == 2) ? "OCTET  " :
-	     (pattern == 3) ? "TOGGLE " : "???????" );
-
-      printf("%3d      ", windowDelay);
+  uint32_t rreg1, rreg2, rreg3;
+  CHECKINIT;
 
-      printf("0x%04x (%5d ns)     ", settleTime, settleTime * 8);
-      printf("0x%07x (%9d ns) ", stableTime, stableTime * 8);
+  HLOCK;
+  rreg1 = hdRead32(&hdp->gen_config1);
+  rreg2 = hdRead32(&hdp->gen_config2);
+  rreg3 = hdRead32(&hdp->gen_config3);
+  HUNLOCK;
 
-      printf("0x%08x", seed);
-      printf("\n");
-    }
+  hdFormatHelicityGeneratorConfig(rreg1, rreg2, rreg3);
 
   return OK;
 }
@@ -2140,8 +4330,10 @@ hdSetInternalTestTriggerDelay(uint32_t delay)
       return ERROR;
     }
 
+  HSTAGE(int_testtrig_delay, 0xFFFFFFFF, delay);
+
   HLOCK;
-  vmeWrite32(&hdp->int_testtrig_delay, delay);
+  hdWrite32(&hdp->int_testtrig_delay, delay);
   HUNLOCK;
 
   return rval;
@@ -2163,9 +4355,7 @@ hdGetInternalTestTriggerDelay(uint32_t *delay)
   int32_t rval = OK;
   CHECKINIT;
 
-  HLOCK;
-  *delay = vmeRead32(&hdp->int_testtrig_delay) & HD_INT_TESTTRIG_DELAY_MASK;
-  HUNLOCK;
+  *delay = HREAD(int_testtrig_delay) & HD_INT_TESTTRIG_DELAY_MASK;
 
   return rval;
 }
@@ -2188,8 +4378,10 @@ hdEnableInternalTestTrigger(int32_t pflag)
   if(pflag)
     printf("%s: ENABLE\n", __func__);
 
+  HSTAGE(ctrl1, 0, HD_CTRL1_INT_TESTTRIG_ENABLE);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl1, vmeRead32(&hdp->ctrl1) | HD_CTRL1_INT_TESTTRIG_ENABLE);
+  hdWrite32(&hdp->ctrl1, hdRead32(&hdp->ctrl1) | HD_CTRL1_INT_TESTTRIG_ENABLE);
   HUNLOCK;
 
   return rval;
@@ -2213,13 +4405,37 @@ hdDisableInternalTestTrigger(int32_t pflag)
   if(pflag)
     printf("%s: DISABLE\n", __func__);
 
+  HSTAGE(ctrl1, HD_CTRL1_INT_TESTTRIG_ENABLE, 0);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl1, vmeRead32(&hdp->ctrl1) & ~HD_CTRL1_INT_TESTTRIG_ENABLE);
+  hdWrite32(&hdp->ctrl1, hdRead32(&hdp->ctrl1) & ~HD_CTRL1_INT_TESTTRIG_ENABLE);
   HUNLOCK;
 
   return rval;
 }
 
+/**
+ * @ingroup Status
+ * @brief Return the value of the CSR register.  Does not clear any
+ *        latched bits.
+ *
+ * @param csr Address to store the CSR value
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdGetCSR(uint32_t *csr)
+{
+  CHECKINIT;
+
+  if(csr == NULL)
+    return ERROR;
+
+  *csr = HREAD(csr);
+
+  return OK;
+}
+
 /**
  * @ingroup Status
  * @brief Return the status of PLL Lock for System and Local clock
@@ -2238,12 +4454,10 @@ hdGetClockPLLStatus(int32_t *system, int32_t *local)
   uint32_t rreg = 0;
   CHECKINIT;
 
-  HLOCK;
-  rreg = vmeRead32(&hdp->csr);
+  rreg = HREAD(csr);
 
   *system = (rreg & HD_CSR_SYSTEM_CLK_PLL_LOCKED) ? 1 : 0;
   *local = (rreg & HD_CSR_LOCAL_CLK_PLL_LOCKED) ? 1 : 0;
-  HUNLOCK;
 
   return rval;
 }
@@ -2263,10 +4477,8 @@ hdGetSlotNumber(uint32_t *slotnumber)
   uint32_t rreg = 0;
   CHECKINIT;
 
-  HLOCK;
-  rreg = vmeRead32(&hdp->intr);
+  rreg = HREAD(intr);
   *slotnumber = (rreg & HD_INT_GEO_MASK) >> 16;
-  HUNLOCK;
 
   return rval;
 }
@@ -2290,9 +4502,11 @@ hdSetHelicityInversion(uint8_t fiber_input, uint8_t cu_input, uint8_t cu_output)
   rset |= cu_input ? HD_CTRL1_INVERT_CU_INPUT : 0;
   rset |= cu_output ? HD_CTRL1_INVERT_CU_OUTPUT : 0;
 
+  HSTAGE(ctrl1, HD_CTRL1_INVERT_MASK, rset);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl1,
-	     ((vmeRead32(&hdp->ctrl1) &~ HD_CTRL1_INVERT_MASK) | rset));
+  hdWrite32(&hdp->ctrl1,
+	     ((hdRead32(&hdp->ctrl1) &~ HD_CTRL1_INVERT_MASK) | rset));
 
   HUNLOCK;
 
@@ -2314,9 +4528,7 @@ hdGetHelicityInversion(uint8_t *fiber_input, uint8_t *cu_input, uint8_t *cu_outp
   uint32_t rreg = 0;
   CHECKINIT;
 
-  HLOCK;
-  rreg = vmeRead32(&hdp->ctrl1) & HD_CTRL1_INVERT_MASK;
-  HUNLOCK;
+  rreg = HREAD(ctrl1) & HD_CTRL1_INVERT_MASK;
 
   *fiber_input = (rreg & HD_CTRL1_INVERT_FIBER_INPUT) ? 1 : 0;
   *cu_input = (rreg & HD_CTRL1_INVERT_CU_INPUT) ? 1 : 0;
@@ -2328,6 +4540,9 @@ hdGetHelicityInversion(uint8_t *fiber_input, uint8_t *cu_input, uint8_t *cu_outp
 /**
  * @ingroup Config
  * @brief Set the clock period for TSettle Filtering
+ *
+ *   The code goes in ctrl1 bits 15-13 (HD_CTRL1_TSETTLE_FILTER_MASK).
+ *
  * @param[in] clock  clock period
  *     0   Disabled
  *     1   4 clock cycles
@@ -2349,13 +4564,15 @@ hdSetTSettleFilter(uint8_t clock)
     {
       printf("%s: ERROR: Invalid clock %d (0x%x).  MAX = %d (0x%x)\n",
 	     __func__, clock, clock,
-	     HD_CTRL1_TSETTLE_FILTER_256, HD_CTRL1_TSETTLE_FILTER_256);
+	     HD_CTRL1_TSETTLE_FILTER_256 >> 13, HD_CTRL1_TSETTLE_FILTER_256 >> 13);
       return ERROR;
     }
 
+  HSTAGE(ctrl1, HD_CTRL1_TSETTLE_FILTER_MASK, clock << 13);
+
   HLOCK;
-  vmeWrite32(&hdp->ctrl1,
-	     ((vmeRead32(&hdp->ctrl1) &~ HD_CTRL1_TSETTLE_FILTER_MASK) | clock));
+  hdWrite32(&hdp->ctrl1,
+	     ((hdRead32(&hdp->ctrl1) &~ HD_CTRL1_TSETTLE_FILTER_MASK) | (clock << 13)));
 
   HUNLOCK;
 
@@ -2383,9 +4600,7 @@ hdGetTSettleFilter(uint8_t *clock)
   int32_t rval = 0;
   CHECKINIT;
 
-  HLOCK;
-  *clock = (vmeRead32(&hdp->ctrl1) & HD_CTRL1_TSETTLE_FILTER_MASK) >> 13;
-  HUNLOCK;
+  *clock = (HREAD(ctrl1) & HD_CTRL1_TSETTLE_FILTER_MASK) >> 13;
 
   return rval;
 
@@ -2405,13 +4620,15 @@ hdSetProcessedOutput(int8_t enable)
   int32_t rval = 0;
   CHECKINIT;
 
+  HSTAGE(ctrl1, HD_CTRL1_PROCESSED_TO_FP, enable ? HD_CTRL1_PROCESSED_TO_FP : 0);
+
   HLOCK;
   if(enable)
-    vmeWrite32(&hdp->ctrl1,
-	       vmeRead32(&hdp->ctrl1) | HD_CTRL1_PROCESSED_TO_FP);
+    hdWrite32(&hdp->ctrl1,
+	       hdRead32(&hdp->ctrl1) | HD_CTRL1_PROCESSED_TO_FP);
   else
-    vmeWrite32(&hdp->ctrl1,
-	       vmeRead32(&hdp->ctrl1) & ~HD_CTRL1_PROCESSED_TO_FP);
+    hdWrite32(&hdp->ctrl1,
+	       hdRead32(&hdp->ctrl1) & ~HD_CTRL1_PROCESSED_TO_FP);
   HUNLOCK;
 
   return rval;
@@ -2428,9 +4645,7 @@ hdGetProcessedOutput()
   int32_t rval = 0;
   CHECKINIT;
 
-  HLOCK;
-  rval = (vmeRead32(&hdp->ctrl1) & HD_CTRL1_PROCESSED_TO_FP) ? 1 : 0;
-  HUNLOCK;
+  rval = (HREAD(ctrl1) & HD_CTRL1_PROCESSED_TO_FP) ? 1 : 0;
 
   return rval;
 }
@@ -2476,8 +4691,10 @@ hdDelayTestSetup(uint8_t pair_delay_selection, int8_t enable)
 
   delay_enable = enable ? HD_DELAY_SETUP_ENABLE : 0;
 
+  HSTAGE(delay_setup, 0xFFFFFFFF, pair_delay_selection | delay_enable);
+
   HLOCK;
-  vmeWrite32(&hdp->delay_setup, pair_delay_selection | delay_enable);
+  hdWrite32(&hdp->delay_setup, pair_delay_selection | delay_enable);
   HUNLOCK;
 
   return rval;
@@ -2515,11 +4732,9 @@ hdGetDelayTestSetup(uint8_t *pair_delay_selection, int8_t *enable)
   uint32_t delay_setup = 0;
   CHECKINIT;
 
-  HLOCK;
-  delay_setup = vmeRead32(&hdp->delay_setup);
+  delay_setup = HREAD(delay_setup);
   *pair_delay_selection = delay_setup & HD_DELAY_SETUP_SELECTION_MASK;
   *enable = (delay_setup & HD_DELAY_SETUP_ENABLE) ? 1 : 0;
-  HUNLOCK;
 
   return rval;
 }
@@ -2535,9 +4750,7 @@ hdGetDelayTestErrorCount()
   uint32_t rval = 0;
   CHECKINIT;
 
-  HLOCK;
-  rval = vmeRead32(&hdp->delay_error_count);
-  HUNLOCK;
+  rval = HREAD(delay_error_count);
 
   return rval;
 }
@@ -2554,7 +4767,7 @@ hdDelayTestErrorCountReset()
   CHECKINIT;
 
   HLOCK;
-  vmeWrite32(&hdp->delay_error_count, HD_DELAY_ERROR_RESET);
+  hdWrite32(&hdp->delay_error_count, HD_DELAY_ERROR_RESET);
   HUNLOCK;
 
   return rval;
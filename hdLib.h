@@ -6,6 +6,15 @@
  */
 
 #include <stdint.h>
+#include <pthread.h>
+
+/* Loops written to vectorize.  At -O2, gcc doesn't vectorize (before 12)
+   or only with the very cheap cost model, which rejects them */
+#if defined(__GNUC__) && !defined(__clang__)
+#define HD_VECTORIZE __attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))
+#else
+#define HD_VECTORIZE
+#endif
 
 typedef struct hd_struct
 {
@@ -50,6 +59,108 @@ typedef struct hd_struct
 
 } HD;
 
+/* Register map snapshot, from hdSnapshot */
+typedef struct hd_snapshot_struct
+{
+  HD       reg;
+  uint64_t timestamp;   /* Monotonic clock, ns */
+  uint32_t vmeA24;
+  uint32_t a32Base;
+  int32_t  dma;         /* 1 if read with a block transfer */
+} HD_SNAPSHOT;
+
+/* Readout statistics, from hdGetReadoutStats */
+typedef struct hd_readout_stats_struct
+{
+  uint64_t nreads;      /* Calls to hdReadBlock */
+  uint64_t nwords;      /* Words transferred */
+  uint64_t nempty;      /* Calls with no data */
+  uint64_t nerrors;     /* Calls that returned an error */
+  uint64_t busyNs;      /* Total time in hdReadBlock (hdSetReadoutTiming) */
+  uint64_t maxNs;       /* Longest hdReadBlock (hdSetReadoutTiming) */
+  uint64_t lastNs;      /* Last hdReadBlock (hdSetReadoutTiming) */
+} HD_READOUT_STATS;
+
+/* hdMutex profiling, per HLOCK call site (build with -DHD_LOCK_PROFILE)
+   Histogram bin i counts times in [2^i, 2^(i+1)) ns */
+#define HD_LOCK_PROFILE_NBINS     32
+#define HD_LOCK_PROFILE_MAX_SITES 256
+
+typedef struct hd_lock_stats_struct
+{
+  const char *func;
+  int32_t  line;
+  int32_t  registered;
+  uint64_t nlocks;
+  uint64_t waitNs;      /* Total time waiting for hdMutex */
+  uint64_t waitMaxNs;
+  uint64_t holdNs;      /* Total time holding hdMutex */
+  uint64_t holdMaxNs;
+  uint32_t waitHist[HD_LOCK_PROFILE_NBINS];
+  uint32_t holdHist[HD_LOCK_PROFILE_NBINS];
+} HD_LOCK_STATS;
+
+/* Decoded status, from hdStatusExport(.., HD_STATUS_EXPORT_BINARY) */
+#define HD_STATUS_RECORD_MAGIC   0x48445354  /* "HDST" */
+#define HD_STATUS_RECORD_VERSION 2
+
+typedef struct hd_status_record_struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t timestamp;           /* Monotonic clock of the snapshot, ns */
+
+  uint32_t slot;
+  uint32_t boardType;
+  uint32_t boardRev;
+  uint32_t firmware;
+  uint32_t vmeA24;
+  uint32_t a32Base;             /* 0 = disabled */
+
+  /* Signal sources, as hdGetSignalSources */
+  uint8_t  clkSrc;
+  uint8_t  trigSrc;
+  uint8_t  srSrc;
+  /* Helicity source, as hdGetHelicitySource */
+  uint8_t  helSrc;
+  uint8_t  helInput;
+  uint8_t  helOutput;
+  /* Inversion, as hdGetHelicityInversion */
+  uint8_t  invertFiberInput;
+  uint8_t  invertCuInput;
+  uint8_t  invertCuOutput;
+  uint16_t tsettleFilter;       /* Clocks, 0 if disabled, as hdStatus */
+  uint16_t blocklevel;
+
+  uint16_t triggerDelay;
+  uint16_t dataDelay;
+
+  /* Enables */
+  uint8_t  decoder;
+  uint8_t  triggers;
+  uint8_t  eventBuild;
+  uint8_t  helicityGenerator;
+  uint8_t  forceBusy;
+  uint8_t  testTrigger;
+  uint8_t  systemPLL;
+  uint8_t  localPLL;
+  uint32_t testTriggerDelay;
+
+  uint32_t csr;
+
+  uint32_t scalers[9];          /* As hdReadScalers(data, 1) */
+
+  /* Helicity generator, as hdGetHelicityGeneratorConfig */
+  uint8_t  genPattern;
+  uint8_t  genWindowDelay;
+  uint16_t genSettleTime;
+  uint32_t genStableTime;
+  uint32_t genSeed;
+} HD_STATUS_RECORD;
+
+#define HD_STATUS_EXPORT_JSON   0
+#define HD_STATUS_EXPORT_BINARY 1
+
 /* 0x0 version bits and masks */
 #define HD_VERSION_FIRMWARE_MASK    0x000000FF
 #define HD_VERSION_BOARD_REV_MASK   0x0000FF00
@@ -117,6 +228,8 @@ typedef struct hd_struct
 #define HD_CTRL1_INVERT_CU_OUTPUT        (1 << 23)
 #define HD_CTRL1_PROCESSED_TO_FP         (1 << 24)
 #define HD_CTRL1_INVERT_MASK             0x00e00000
+/* Configuration bits: all of the above */
+#define HD_CTRL1_CONFIG_MASK             0x01FFF1FF
 
 /* 0xC ctrl2 bits and masks */
 #define HD_CTRL2_DECODER_ENABLE      (1 << 0)
@@ -124,6 +237,9 @@ typedef struct hd_struct
 #define HD_CTRL2_EVENT_BUILD_ENABLE  (1 << 2)
 #define HD_CTRL2_INT_HELICITY_ENABLE (1 << 8)
 #define HD_CTRL2_FORCE_BUSY          (1 << 9)
+/* Configuration bits.  GO, EVENT_BUILD_ENABLE and FORCE_BUSY are run
+   state, set by hdEnable/hdDisable and hdBusy */
+#define HD_CTRL2_CONFIG_MASK         (HD_CTRL2_DECODER_ENABLE | HD_CTRL2_INT_HELICITY_ENABLE)
 
 /* 0x10 adr32 bits and masks */
 #define HD_ADR32_ENABLE    (1 << 0)
@@ -157,6 +273,12 @@ typedef struct hd_struct
 /* 0x24 helicity_config2 */
 #define HD_HELICITY_CONFIG2_STABLE_TIME_MASK 0x00FFFFFF
 
+/* Generator settle and stable times count in these, the trigger time and
+   processing delays in clock ticks */
+#define HD_GENERATOR_TICK_NS 40
+#define HD_CLOCK_NS          8
+#define HD_GENERATOR_TICKS   (HD_GENERATOR_TICK_NS / HD_CLOCK_NS)
+
 /* 0x28 helicity_config3 */
 #define HD_HELICITY_CONFIG3_PSEUDO_SEED_MASK 0x3FFFFFFF
 
@@ -217,6 +339,25 @@ typedef struct hd_struct
 #define HD_DATA_TYPE_MASK         0x78000000
 #define HD_DATA_BLOCK_HEADER      0x00000000
 #define HD_DATA_BLOCK_TRAILER     0x08000000
+#define HD_DATA_EVENT_HEADER      0x10000000
+#define HD_DATA_TRIGGER_TIME      0x18000000
+#define HD_DATA_DECODER_HEADER    0x40000000
+#define HD_DATA_FILLER            0x78000000
+
+#define HD_DATA_EVENT_NUMBER_MASK    0x00000FFF
+#define HD_DATA_TRIGGER_TIME_MASK    0x00FFFFFF
+#define HD_DATA_DECODER_NWORDS_MASK  0x0000003F
+
+/* Decoder data word index (words following the DECODER HEADER) */
+#define HD_DECODER_WORD_SHIFT_REG                 0
+#define HD_DECODER_WORD_WINDOW_COUNT              1
+#define HD_DECODER_WORD_PATTERN_COUNT             2
+#define HD_DECODER_WORD_PAIR_COUNT                3
+#define HD_DECODER_WORD_PATTERN_SYNC_HISTORY      4
+#define HD_DECODER_WORD_PAIR_SYNC_HISTORY         5
+#define HD_DECODER_WORD_HELICITY_HISTORY          6
+#define HD_DECODER_WORD_PATTERN_HELICITY_HISTORY  7
+#define HD_DECODER_NWORDS                         8
 
 /* Supported Firmware Version */
 #define HD_SUPPORTED_FIRMWARE  0x11
@@ -224,6 +365,7 @@ typedef struct hd_struct
 /* hdInit initialization flags */
 #define HD_INIT_IGNORE_FIRMWARE (1 << 0)
 #define HD_INIT_NO_INIT         (1 << 1)
+#define HD_INIT_WARM            (1 << 2)
 #define HD_INIT_INTERNAL        0
 #define HD_INIT_FP              1
 #define HD_INIT_VXS             2
@@ -233,18 +375,93 @@ typedef struct hd_struct
 #define HD_INIT_EXTERNAL_FIBER     1
 #define HD_INIT_EXTERNAL_COPPER    2
 
+/* Configuration checkpoint, from hdCheckpointSave */
+#define HD_CHECKPOINT_MAGIC   0x48444350  /* "HDCP" */
+#define HD_CHECKPOINT_VERSION 1
+#define HD_CHECKPOINT_NREGS   10
+
+typedef struct hd_checkpoint_struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;                      /* sizeof(HD_CHECKPOINT) */
+  uint32_t vmeA24;
+  uint32_t a32Base;
+  uint32_t firmware;                  /* version register */
+  uint64_t saved;                     /* Wall clock, s */
+  /* ctrl1, ctrl2, adr32, blk_size, delay, gen_config1-3,
+     int_testtrig_delay, delay_setup.  Configuration bits only */
+  uint32_t reg[HD_CHECKPOINT_NREGS];
+  uint32_t checksum;
+} HD_CHECKPOINT;
+
+/* Board found by hdFindAll */
+typedef struct hd_found_struct
+{
+  uint32_t vmeA24;
+  uint32_t slot;
+  uint32_t version;   /* version register */
+  uint32_t boardRev;
+  uint32_t firmware;
+} HD_FOUND;
+
+/* Boards handled by the library (hdInitAll), and init threads */
+#define HD_MAX_BOARDS    18
+#define HD_INIT_NTHREADS 4
+
+/* hdFindAll flags */
+#define HD_FIND_NO_CACHE (1 << 0)
+/* hdFindAll rescans the crate, for boards in empty slots, when the cache
+   is older than this */
+#define HD_FIND_RESCAN_SEC 600
+
+/* Interval between the polls of a register, in us */
+#define HD_POLL_INTERVAL_US 10
+
 /* function prototypes */
 
 int32_t hdCheckAddresses();
 int32_t hdInit(uint32_t vAddr, uint8_t source, uint8_t helSignalSrc, uint32_t iFlag);
+int32_t hdInitAll(const uint32_t *vAddr, int32_t nboards, uint8_t source,
+		  uint8_t helSignalSrc, uint32_t iFlag, int32_t *status);
+int32_t hdSelect(int32_t id);
+int32_t hdGetSelected();
+int32_t hdGetNboards();
+volatile HD *hdGetRegs();
+pthread_mutex_t *hdGetMutex();
 uint32_t hdFind();
+int32_t hdFindAll(HD_FOUND *found, int32_t max, uint32_t fflag);
+int32_t hdSetDiscoveryCache(const char *filename);
+int32_t hdDiscoveryCacheClear();
 int32_t hdStatus(int pflag);
+int32_t hdStatusDecode(const HD_SNAPSHOT *snap, HD_STATUS_RECORD *rec);
+int32_t hdStatusExport(char *buf, uint32_t size, int32_t format);
+int32_t hdSetSnapshotDMA(volatile uint32_t *buffer);
+int32_t hdSnapshot(HD_SNAPSHOT *out);
+uint64_t hdTimestamp();
 int32_t hdGetFirmwareVersion();
+
+void    hdLockProfileLock(HD_LOCK_STATS *site);
+void    hdLockProfileUnlock();
+int32_t hdLockProfileGet(HD_LOCK_STATS *stats, int32_t max);
+int32_t hdLockProfileReset();
+int32_t hdLockProfilePrint(int32_t pflag);
+int32_t hdLockProfileDump(const char *filename);
 int32_t hdReset(uint8_t type, uint8_t clearA32);
 int32_t hdSetA32(uint32_t a32base);
 uint32_t hdGetA32();
+int32_t hdConfigBegin();
+int32_t hdConfigAbort();
+int32_t hdConfigCommit();
+int32_t hdCheckpointGet(HD_CHECKPOINT *cp);
+int32_t hdCheckpointSave(const char *filename);
+int32_t hdCheckpointLoad(const char *filename, HD_CHECKPOINT *cp);
+int32_t hdCheckpointVerify(const HD_CHECKPOINT *cp, int32_t pflag);
+int32_t hdCheckpointRestore(const HD_CHECKPOINT *cp);
+int32_t hdSetCheckpointFile(const char *filename);
 int32_t hdSetSignalSources(uint8_t clkSrc, uint8_t trigSrc, uint8_t srSrc);
 int32_t hdGetSignalSources(uint8_t *clkSrc, uint8_t *trigSrc, uint8_t *srSrc);
+int32_t hdGetSettleTime(int32_t *signalSourcesUs, int32_t *generatorUs);
 int32_t hdSetHelicitySource(uint8_t helSrc, uint8_t input, uint8_t output);
 int32_t hdGetHelicitySource(uint8_t *helSrc, uint8_t *input, uint8_t *output);
 
@@ -270,10 +487,14 @@ int32_t hdBERRStatus();
 int32_t hdBusyStatus(uint8_t *latched);
 
 int32_t hdReadBlock(volatile unsigned int *data, int nwrds, int rflag);
+int32_t hdGetReadoutStats(HD_READOUT_STATS *stats);
+int32_t hdResetReadoutStats();
+int32_t hdSetReadoutTiming(int32_t enable);
 int32_t hdReadScalers(volatile unsigned int *data, int rflag);
 int32_t hdPrintScalers();
 
 int32_t hdReadHelicityHistory(volatile unsigned int *data);
+int32_t hdReadHelicityHistoryCount(volatile unsigned int *data, uint32_t *windowCount);
 
 int32_t hdGetRecoveredShiftRegisterValue(uint32_t *recovered, uint32_t *internalGenerator);
 
@@ -293,6 +514,7 @@ int32_t hdSetInternalTestTriggerDelay(uint32_t delay);
 int32_t hdGetInternalTestTriggerDelay(uint32_t *delay);
 int32_t hdEnableInternalTestTrigger(int32_t pflag);
 int32_t hdDisableInternalTestTrigger(int32_t pflag);
+int32_t hdGetCSR(uint32_t *csr);
 int32_t hdGetClockPLLStatus(int32_t *system, int32_t *local);
 int32_t hdGetSlotNumber(uint32_t *slotnumber);
 
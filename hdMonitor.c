@@ -0,0 +1,1390 @@
+/* Module: hdMonitor.c
+ *
+ * Description: Helicity Decoder Monitoring Library
+ *              Background sampling of the module, published for other
+ *              threads without touching the VME bus.
+ *
+ * Author:
+ *        Bryan Moffit
+ *        JLab Data Acquisition Group
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jvme.h"
+#include "hdMonitor.h"
+#include "hdTelemetry.h"
+
+/**
+ * @defgroup Monitor Monitoring
+ */
+
+/* Scaler sampler.
+   Single writer at a time (hdScalerWriteMutex), lock-free readers (seqlock). */
+static pthread_mutex_t hdScalerWriteMutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile uint32_t hdScalerSeq = 0;
+static HD_SCALER_SAMPLE hdScalerLatest;  /* Published sample */
+static HD_SCALER_SAMPLE hdScalerWork;    /* Writer's working copy */
+static uint64_t hdScalerAverageNs = 1000000000ULL;
+
+static pthread_t hdScalerThread;
+static volatile int32_t hdScalerRun = 0;
+static uint32_t hdScalerPeriodMs = 1000;
+/* Board selected when the thread was started */
+static int32_t hdScalerBoard = 0;
+
+/**
+ * @ingroup Monitor
+ * @brief Read the scalers from the module, extend the counters to 64 bits,
+ *        update the rates, and publish the result.
+ *
+ *   Called periodically by the sampler thread, or directly (e.g. once per
+ *   readout cycle) when the thread is not used.  Counters must be sampled
+ *   at least once per 32 bit wrap.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdScalerSamplerUpdate()
+{
+  uint32_t raw[HD_SCALER_NCOUNTERS], delta;
+  uint64_t now;
+  double dt = 0, alpha = 1;
+  int32_t ichan;
+  HD_SCALER_SAMPLE *w = &hdScalerWork;
+
+  /* Read and timestamp under the write lock, so that samples from the
+     sampler thread and direct calls are applied in the order taken */
+  pthread_mutex_lock(&hdScalerWriteMutex);
+
+  if(hdReadScalers(raw, 1) != HD_SCALER_NCOUNTERS)
+    {
+      pthread_mutex_unlock(&hdScalerWriteMutex);
+      return ERROR;
+    }
+
+  now = hdTimestamp();
+
+  if(w->nsamples == 0)
+    {
+      for(ichan = 0; ichan < HD_SCALER_NEXTENDED; ichan++)
+	{
+	  w->count[ichan] = raw[ichan];
+	  w->rate[ichan] = 0;
+	  w->avgRate[ichan] = 0;
+	}
+    }
+  else
+    {
+      dt = (now - w->timestamp) * 1e-9;
+      if(hdScalerAverageNs > 0)
+	alpha = 1 - exp(-(double)(now - w->timestamp) / hdScalerAverageNs);
+
+      for(ichan = 0; ichan < HD_SCALER_NEXTENDED; ichan++)
+	{
+	  delta = raw[ichan] - w->raw[ichan];
+	  w->count[ichan] += delta;
+	  w->rate[ichan] = (dt > 0) ? delta / dt : 0;
+
+	  if(w->nsamples == 1)
+	    w->avgRate[ichan] = w->rate[ichan];
+	  else
+	    w->avgRate[ichan] += alpha * (w->rate[ichan] - w->avgRate[ichan]);
+	}
+    }
+
+  memcpy(w->raw, raw, sizeof(raw));
+  w->timestamp = now;
+  w->nsamples++;
+
+  /* Publish */
+  hdScalerSeq++;
+  __sync_synchronize();
+  hdScalerLatest = *w;
+  __sync_synchronize();
+  hdScalerSeq++;
+
+  pthread_mutex_unlock(&hdScalerWriteMutex);
+
+  return OK;
+}
+
+static void *
+hdScalerSamplerThread(void *arg)
+{
+  hdSelect(hdScalerBoard);
+
+  while(hdScalerRun)
+    {
+      hdScalerSamplerUpdate();
+      usleep(hdScalerPeriodMs * 1000);
+    }
+
+  return NULL;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Start the background scaler sampler thread
+ *        The thread samples the board selected (hdSelect) when it
+ *        is started.
+ *
+ * @param periodMs Sampling period in ms
+ * @param averageMs Time constant of the averaged rates in ms
+ *                  0 = no averaging
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdScalerSamplerStart(uint32_t periodMs, uint32_t averageMs)
+{
+  if(periodMs == 0)
+    {
+      printf("%s: ERROR: Invalid periodMs (%d)\n",
+	     __func__, periodMs);
+      return ERROR;
+    }
+
+  if(hdScalerRun)
+    {
+      printf("%s: ERROR: Sampler already running\n", __func__);
+      return ERROR;
+    }
+
+  pthread_mutex_lock(&hdScalerWriteMutex);
+  hdScalerPeriodMs = periodMs;
+  hdScalerAverageNs = (uint64_t)averageMs * 1000000ULL;
+  memset(&hdScalerWork, 0, sizeof(hdScalerWork));
+  pthread_mutex_unlock(&hdScalerWriteMutex);
+
+  hdScalerBoard = hdGetSelected();
+  hdScalerRun = 1;
+  if(pthread_create(&hdScalerThread, NULL, hdScalerSamplerThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      hdScalerRun = 0;
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Stop the background scaler sampler thread
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdScalerSamplerStop()
+{
+  if(!hdScalerRun)
+    return ERROR;
+
+  hdScalerRun = 0;
+  pthread_join(hdScalerThread, NULL);
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Get the latest scaler sample.  Does not touch the VME bus,
+ *        and does not take any lock.
+ *
+ * @param out Address to store the sample
+ *
+ * @return OK if successful, ERROR if there is no sample yet
+ */
+int32_t
+hdScalerSamplerGet(HD_SCALER_SAMPLE *out)
+{
+  uint32_t seq0, seq1;
+
+  if(out == NULL)
+    return ERROR;
+
+  do
+    {
+      seq0 = hdScalerSeq;
+      __sync_synchronize();
+      *out = hdScalerLatest;
+      __sync_synchronize();
+      seq1 = hdScalerSeq;
+    }
+  while((seq0 != seq1) || (seq0 & 1));
+
+  return (out->nsamples > 0) ? OK : ERROR;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Allocate a scaler aggregation over several boards
+ *
+ * @param agg Aggregation
+ * @param nboards Number of boards
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdScalerAggInit(HD_SCALER_AGG *agg, uint32_t nboards)
+{
+  uint32_t n = nboards * HD_SCALER_NCOUNTERS;
+
+  if((agg == NULL) || (nboards == 0))
+    {
+      printf("%s: ERROR: Invalid arguments\n", __func__);
+      return ERROR;
+    }
+
+  memset(agg, 0, sizeof(HD_SCALER_AGG));
+  agg->nboards = nboards;
+
+  agg->raw   = calloc(n, sizeof(uint32_t));
+  agg->delta = calloc(n, sizeof(uint32_t));
+  agg->count = calloc(n, sizeof(uint64_t));
+  agg->rate  = calloc(n, sizeof(double));
+  agg->cur   = calloc(n, sizeof(uint32_t));
+
+  if(!agg->raw || !agg->delta || !agg->count || !agg->rate || !agg->cur)
+    {
+      printf("%s: ERROR: Unable to allocate for %d boards\n",
+	     __func__, nboards);
+      hdScalerAggFree(agg);
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Free a scaler aggregation
+ *
+ * @param agg Aggregation
+ */
+void
+hdScalerAggFree(HD_SCALER_AGG *agg)
+{
+  if(agg == NULL)
+    return;
+
+  free(agg->raw);
+  free(agg->delta);
+  free(agg->count);
+  free(agg->rate);
+  free(agg->cur);
+
+  memset(agg, 0, sizeof(HD_SCALER_AGG));
+}
+
+/* Update one counter for all boards.  No branches, so with HD_VECTORIZE
+   it is vectorized at -O2 as well */
+static void HD_VECTORIZE
+hdScalerAggCounter(uint32_t nboards, const uint32_t * restrict cur,
+		   uint32_t * restrict raw, uint32_t * restrict delta,
+		   uint64_t * restrict count, double * restrict rate,
+		   double invdt, uint64_t *sum, uint32_t *min, uint32_t *max)
+{
+  uint32_t iboard, d, dmin = 0xFFFFFFFF, dmax = 0;
+  uint64_t dsum = 0;
+
+  for(iboard = 0; iboard < nboards; iboard++)
+    {
+      d = cur[iboard] - raw[iboard];  /* Modulo 2^32: wrap corrected */
+      delta[iboard] = d;
+      count[iboard] += d;
+      rate[iboard] = d * invdt;
+      raw[iboard] = cur[iboard];
+
+      dsum += d;
+      dmin = (d < dmin) ? d : dmin;
+      dmax = (d > dmax) ? d : dmax;
+    }
+
+  *sum = dsum;
+  *min = dmin;
+  *max = dmax;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Update the aggregation with a new scaler sample of every board
+ *
+ *   Must be called at least once per 32 bit wrap of the fastest counter.
+ *   The first update only sets the reference.
+ *
+ * @param agg Aggregation
+ * @param scalers Board major: nboards blocks of HD_SCALER_NCOUNTERS words,
+ *                each in the order of hdReadScalers(data, 1)
+ * @param timestamp Time of the sample, ns (e.g. hdTimestamp)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdScalerAggUpdate(HD_SCALER_AGG *agg, const uint32_t *scalers, uint64_t timestamp)
+{
+  uint32_t nboards, iboard, ichan, min, max, *pcur;
+  uint64_t sum;
+  double invdt;
+
+  if((agg == NULL) || (agg->raw == NULL) || (scalers == NULL))
+    return ERROR;
+
+  nboards = agg->nboards;
+
+  /* Transpose to counter major */
+  for(iboard = 0; iboard < nboards; iboard++)
+    for(ichan = 0; ichan < HD_SCALER_NCOUNTERS; ichan++)
+      agg->cur[ichan * nboards + iboard] =
+	scalers[iboard * HD_SCALER_NCOUNTERS + ichan];
+
+  if(agg->nsamples == 0)
+    {
+      for(ichan = 0; ichan < HD_SCALER_NCOUNTERS; ichan++)
+	{
+	  pcur = &agg->cur[ichan * nboards];
+	  memcpy(&agg->raw[ichan * nboards], pcur, nboards * sizeof(uint32_t));
+	  agg->total[ichan] = 0;
+	  for(iboard = 0; iboard < nboards; iboard++)
+	    {
+	      agg->count[ichan * nboards + iboard] = pcur[iboard];
+	      agg->total[ichan] += pcur[iboard];
+	    }
+	}
+      agg->timestamp = timestamp;
+      agg->nsamples++;
+      return OK;
+    }
+
+  agg->dt = (timestamp - agg->timestamp) * 1e-9;
+  invdt = (agg->dt > 0) ? 1.0 / agg->dt : 0;
+
+  for(ichan = 0; ichan < HD_SCALER_NEXTENDED; ichan++)
+    {
+      hdScalerAggCounter(nboards, &agg->cur[ichan * nboards],
+			 &agg->raw[ichan * nboards], &agg->delta[ichan * nboards],
+			 &agg->count[ichan * nboards], &agg->rate[ichan * nboards],
+			 invdt, &sum, &min, &max);
+
+      agg->total[ichan] += sum;
+      agg->totalDelta[ichan] = sum;
+      agg->totalRate[ichan] = sum * invdt;
+
+      if(ichan < 4)
+	{
+	  agg->helicityMeanDelta[ichan] = (double)sum / nboards;
+	  agg->helicityMinDelta[ichan] = min;
+	  agg->helicityMaxDelta[ichan] = max;
+	}
+    }
+
+  sum = agg->totalDelta[HD_HELICITY_SCALER_PATTERN_SYNC];
+  agg->windowsPerPattern = (sum > 0) ?
+    (double)agg->totalDelta[HD_HELICITY_SCALER_TSTABLE_RISING] / sum : 0;
+  agg->pairsPerPattern = (sum > 0) ?
+    (double)agg->totalDelta[HD_HELICITY_SCALER_PAIR_SYNC] / sum : 0;
+
+  /* Occupancy, not counters */
+  for(ichan = HD_SCALER_NEXTENDED; ichan < HD_SCALER_NCOUNTERS; ichan++)
+    {
+      pcur = &agg->cur[ichan * nboards];
+      sum = 0;
+      for(iboard = 0; iboard < nboards; iboard++)
+	sum += pcur[iboard];
+      memcpy(&agg->raw[ichan * nboards], pcur, nboards * sizeof(uint32_t));
+      agg->total[ichan] = sum;
+      agg->totalDelta[ichan] = 0;
+      agg->totalRate[ichan] = 0;
+    }
+
+  agg->timestamp = timestamp;
+  agg->nsamples++;
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Print the crate totals of a scaler aggregation to standard out
+ *
+ * @param agg Aggregation
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdScalerAggPrint(HD_SCALER_AGG *agg)
+{
+  const char *names[HD_SCALER_NCOUNTERS] =
+    {
+      "T_SETTLE falling", "T_SETTLE rising ", "PATTERN_SYNC    ",
+      "PAIR_SYNC       ", "Trig1           ", "Trig2           ",
+      "SyncReset       ", "Events          ", "Blocks          "
+    };
+  int32_t ichan;
+
+  if(agg == NULL)
+    return ERROR;
+
+  printf("\n");
+  printf("  Crate Scalers (%d boards, %.3f s interval)\n",
+	 agg->nboards, agg->dt);
+  printf("\n");
+  printf("                       Total              Rate (Hz)\n");
+  printf("  ------------------------------------------------------------------------------\n");
+  for(ichan = 0; ichan < HD_SCALER_NCOUNTERS; ichan++)
+    {
+      printf("    %s  %18llu", names[ichan],
+	     (unsigned long long)agg->total[ichan]);
+      if(ichan < HD_SCALER_NEXTENDED)
+	printf("  %14.1f", agg->totalRate[ichan]);
+      printf("\n");
+    }
+  printf("\n");
+
+  printf("  Helicity States, per board over the interval\n");
+  printf("\n");
+  printf("                            Mean         Min         Max\n");
+  printf("  ------------------------------------------------------------------------------\n");
+  for(ichan = 0; ichan < 4; ichan++)
+    printf("    %s  %10.1f  %10u  %10u\n", names[ichan],
+	   agg->helicityMeanDelta[ichan],
+	   agg->helicityMinDelta[ichan], agg->helicityMaxDelta[ichan]);
+  printf("\n");
+  printf("    Windows per pattern  %.3f\n", agg->windowsPerPattern);
+  printf("    Pairs per pattern    %.3f\n", agg->pairsPerPattern);
+  printf("\n");
+
+  return OK;
+}
+
+/* Scaler bank.  Used from the readout thread. */
+static uint32_t hdScalerBankEveryN = 0;
+static uint64_t hdScalerBankEveryNs = 0;
+static uint32_t hdScalerBankNevents = 0;
+static uint64_t hdScalerBankLast = 0;
+static uint64_t hdScalerBankPrevTime = 0;
+static uint32_t hdScalerBankPrevRaw[HD_SCALER_NCOUNTERS];
+
+/**
+ * @ingroup Monitor
+ * @brief Configure how often a scaler bank is inserted in the data stream
+ *
+ * @param everyNEvents Insert every N events.  0 = not by events
+ * @param everyMs Insert every T ms.  0 = not by time
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdScalerBankConfig(uint32_t everyNEvents, uint32_t everyMs)
+{
+  hdScalerBankEveryN = everyNEvents;
+  hdScalerBankEveryNs = (uint64_t)everyMs * 1000000ULL;
+  hdScalerBankNevents = 0;
+  hdScalerBankLast = hdTimestamp();
+  hdScalerBankPrevTime = 0;
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Count events, and check if a scaler bank is due
+ *
+ * @param nevents Events in this readout (e.g. the block level)
+ *
+ * @return 1 if a scaler bank is due, otherwise 0
+ */
+int32_t
+hdScalerBankDue(uint32_t nevents)
+{
+  hdScalerBankNevents += nevents;
+
+  if(hdScalerBankEveryN && (hdScalerBankNevents >= hdScalerBankEveryN))
+    return 1;
+
+  if(hdScalerBankEveryNs && (hdTimestamp() - hdScalerBankLast >= hdScalerBankEveryNs))
+    return 1;
+
+  return 0;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Fill a scaler bank (see HD_SCALER_BANK_NWORDS in hdMonitor.h)
+ *
+ *   Uses the latest sample from the scaler sampler, if it is running.
+ *   Otherwise the scalers are read here, and the rates are since the
+ *   previous bank.  That is one block transfer if the calling thread set
+ *   a buffer with hdSetSnapshotDMA and configured the DMA engine for A24
+ *   BLT32, otherwise 9 programmed I/O reads.
+ *
+ *   The words are big-endian, the same byte order as the module's data
+ *   in the readout bank, so the event builder swaps both banks alike.
+ *
+ * @param data Local memory address to place the bank
+ * @param nwrds Maximum number of words
+ *
+ * @return Number of words added to data, otherwise ERROR
+ */
+int32_t
+hdScalerBankFill(volatile uint32_t *data, int32_t nwrds)
+{
+  HD_SCALER_SAMPLE sample;
+  uint32_t raw[HD_SCALER_NCOUNTERS], rate[HD_SCALER_NEXTENDED], flags = 0;
+  uint64_t now;
+  double dt;
+  int32_t ichan, dCnt = 0;
+
+  if((data == NULL) || (nwrds < HD_SCALER_BANK_NWORDS))
+    {
+      printf("%s: ERROR: Invalid data or nwrds (%d < %d)\n",
+	     __func__, nwrds, HD_SCALER_BANK_NWORDS);
+      return ERROR;
+    }
+
+  if(hdScalerRun && (hdScalerSamplerGet(&sample) == OK))
+    {
+      now = sample.timestamp;
+      memcpy(raw, sample.raw, sizeof(raw));
+      for(ichan = 0; ichan < HD_SCALER_NEXTENDED; ichan++)
+	rate[ichan] = (uint32_t)(sample.rate[ichan] + 0.5);
+      flags |= HD_SCALER_BANK_FLAG_SAMPLER;
+    }
+  else
+    {
+      if(hdReadScalers(raw, 1) != HD_SCALER_NCOUNTERS)
+	return ERROR;
+      now = hdTimestamp();
+
+      dt = (hdScalerBankPrevTime != 0) ? (now - hdScalerBankPrevTime) * 1e-9 : 0;
+      for(ichan = 0; ichan < HD_SCALER_NEXTENDED; ichan++)
+	rate[ichan] = (dt > 0) ?
+	  (uint32_t)((raw[ichan] - hdScalerBankPrevRaw[ichan]) / dt + 0.5) : 0;
+
+      memcpy(hdScalerBankPrevRaw, raw, sizeof(raw));
+      hdScalerBankPrevTime = now;
+    }
+
+  /* Swap to the module's (big-endian) byte order, like the readout bank */
+  data[dCnt++] = LSWAP((HD_SCALER_BANK_VERSION << 24) | (flags << 16) |
+		       HD_SCALER_BANK_NWORDS);
+  data[dCnt++] = LSWAP((uint32_t)(now & 0xFFFFFFFF));
+  data[dCnt++] = LSWAP((uint32_t)(now >> 32));
+  for(ichan = 0; ichan < HD_SCALER_NCOUNTERS; ichan++)
+    data[dCnt++] = LSWAP(raw[ichan]);
+  for(ichan = 0; ichan < HD_SCALER_NEXTENDED; ichan++)
+    data[dCnt++] = LSWAP(rate[ichan]);
+
+  hdScalerBankNevents = 0;
+  hdScalerBankLast = hdTimestamp();
+
+  return dCnt;
+}
+
+/* Deadtime accounting */
+static pthread_mutex_t hdDeadtimeMutex = PTHREAD_MUTEX_INITIALIZER;
+static HD_DEADTIME_STATS hdDeadtime;
+static uint64_t hdDeadtimePrevTime = 0;
+static HD_READOUT_STATS hdDeadtimePrevReadout;
+static int32_t hdDeadtimeInEpisode = 0;
+static uint32_t hdDeadtimePrevCsr = 0;
+
+static pthread_t hdDeadtimeThread;
+static volatile int32_t hdDeadtimeRun = 0;
+static uint32_t hdDeadtimePeriodUs = 100;
+/* Board selected when the thread was started */
+static int32_t hdDeadtimeBoard = 0;
+
+/**
+ * @ingroup Monitor
+ * @brief Sample BUSY and BUSY_LATCHED, and update the deadtime accounting.
+ *
+ *   BUSY gives the busy fraction by sampling.  An interval between samples
+ *   counts as busy at any time if BUSY is set at either end, or
+ *   BUSY_LATCHED rose during it.  The CSR is read without hdMutex, and
+ *   BUSY_LATCHED is never cleared here: it belongs to hdBusyStatus callers.
+ *   While nothing clears it, short episodes between samples are missed.  The hdReadBlock calls since the last sample are
+ *   assigned to the busy or the idle intervals, to compare the readout
+ *   latency in each.
+ *
+ *   Called periodically by the deadtime thread, or directly once per
+ *   readout cycle.
+ *
+ * @return 1 if busy, 0 if not, otherwise ERROR
+ */
+int32_t
+hdDeadtimeSample()
+{
+  HD_READOUT_STATS readout;
+  uint32_t csr, latched;
+  int32_t busy;
+  uint64_t now, dt, nreads, readNs;
+  HD_DEADTIME_STATS *d = &hdDeadtime;
+
+  pthread_mutex_lock(&hdDeadtimeMutex);
+
+  if(hdGetCSR(&csr) != OK)
+    {
+      pthread_mutex_unlock(&hdDeadtimeMutex);
+      return ERROR;
+    }
+
+  now = hdTimestamp();
+  hdGetReadoutStats(&readout);
+
+  busy = (csr & HD_CSR_BUSY) ? 1 : 0;
+  latched = (hdDeadtimePrevTime != 0)
+    && (csr & ~hdDeadtimePrevCsr & HD_CSR_BUSY_LATCHED);
+  latched |= hdDeadtimeInEpisode;
+
+  d->nsamples++;
+  if(busy)
+    d->nbusy++;
+
+  if(hdDeadtimePrevTime != 0)
+    {
+      dt = now - hdDeadtimePrevTime;
+      nreads = readout.nreads - hdDeadtimePrevReadout.nreads;
+      readNs = readout.busyNs - hdDeadtimePrevReadout.busyNs;
+
+      d->elapsedNs += dt;
+      if(latched || busy)
+	{
+	  d->nlatched++;
+	  d->latchedNs += dt;
+	  d->busyReads += nreads;
+	  d->busyReadNs += readNs;
+	}
+      else
+	{
+	  d->idleReads += nreads;
+	  d->idleReadNs += readNs;
+	}
+
+      if(!hdDeadtimeInEpisode && (latched || busy))
+	d->episodes++;
+    }
+
+  hdDeadtimeInEpisode = busy;
+  hdDeadtimePrevCsr = csr;
+  hdDeadtimePrevTime = now;
+  hdDeadtimePrevReadout = readout;
+
+  d->busyFraction = (double)d->nbusy / d->nsamples;
+  d->latchedFraction = (d->elapsedNs > 0) ?
+    (double)d->latchedNs / d->elapsedNs : 0;
+
+  pthread_mutex_unlock(&hdDeadtimeMutex);
+
+  return busy;
+}
+
+static void *
+hdDeadtimeSampleThread(void *arg)
+{
+  hdSelect(hdDeadtimeBoard);
+
+  while(hdDeadtimeRun)
+    {
+      hdDeadtimeSample();
+      usleep(hdDeadtimePeriodUs);
+    }
+
+  return NULL;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Start the deadtime sampler thread, and enable the hdReadBlock
+ *        timing (hdSetReadoutTiming)
+ *        The thread samples the board selected (hdSelect) when it
+ *        is started.
+ *
+ * @param periodUs Sampling period in us
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdDeadtimeStart(uint32_t periodUs)
+{
+  if(periodUs == 0)
+    {
+      printf("%s: ERROR: Invalid periodUs (%d)\n",
+	     __func__, periodUs);
+      return ERROR;
+    }
+
+  if(hdDeadtimeRun)
+    {
+      printf("%s: ERROR: Deadtime sampler already running\n", __func__);
+      return ERROR;
+    }
+
+  hdDeadtimePeriodUs = periodUs;
+
+  /* The busy and idle readout latencies need the hdReadBlock timing */
+  hdSetReadoutTiming(1);
+
+  hdDeadtimeBoard = hdGetSelected();
+  hdDeadtimeRun = 1;
+  if(pthread_create(&hdDeadtimeThread, NULL, hdDeadtimeSampleThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      hdDeadtimeRun = 0;
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Stop the deadtime sampler thread
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdDeadtimeStop()
+{
+  if(!hdDeadtimeRun)
+    return ERROR;
+
+  hdDeadtimeRun = 0;
+  pthread_join(hdDeadtimeThread, NULL);
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Get the deadtime accounting
+ *
+ * @param stats Address to store the accounting
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdDeadtimeGet(HD_DEADTIME_STATS *stats)
+{
+  if(stats == NULL)
+    return ERROR;
+
+  pthread_mutex_lock(&hdDeadtimeMutex);
+  *stats = hdDeadtime;
+  pthread_mutex_unlock(&hdDeadtimeMutex);
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Reset the deadtime accounting
+ *
+ * @return OK
+ */
+int32_t
+hdDeadtimeReset()
+{
+  pthread_mutex_lock(&hdDeadtimeMutex);
+  memset(&hdDeadtime, 0, sizeof(hdDeadtime));
+  hdDeadtimePrevTime = 0;
+  hdDeadtimePrevCsr = 0;
+  hdDeadtimeInEpisode = 0;
+  pthread_mutex_unlock(&hdDeadtimeMutex);
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Print the deadtime accounting to standard out
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdDeadtimePrint()
+{
+  HD_DEADTIME_STATS d;
+
+  hdDeadtimeGet(&d);
+
+  printf("\n");
+  printf("  Deadtime\n");
+  printf("    Samples          = %llu over %.3f s\n",
+	 (unsigned long long)d.nsamples, d.elapsedNs * 1e-9);
+  printf("    Busy fraction    = %.4f (sampled)  %.4f (latched, upper bound)\n",
+	 d.busyFraction, d.latchedFraction);
+  printf("    Busy episodes    = %llu\n", (unsigned long long)d.episodes);
+  printf("    Readout latency  = %.1f us busy (%llu reads)  %.1f us idle (%llu reads)\n",
+	 d.busyReads ? d.busyReadNs * 1e-3 / d.busyReads : 0.,
+	 (unsigned long long)d.busyReads,
+	 d.idleReads ? d.idleReadNs * 1e-3 / d.idleReads : 0.,
+	 (unsigned long long)d.idleReads);
+  printf("\n");
+
+  return OK;
+}
+
+/* Telemetry publisher */
+static pthread_mutex_t hdTelemetryMutex = PTHREAD_MUTEX_INITIALIZER;
+static HD_TELEMETRY *hdTelemetrySeg = NULL;
+static char hdTelemetryName[256];
+static pthread_t hdTelemetryThread;
+static volatile int32_t hdTelemetryRun = 0;
+static uint32_t hdTelemetryPeriodMs = 1000;
+/* Board selected when the thread was started */
+static int32_t hdTelemetryBoard = 0;
+
+/**
+ * @ingroup Monitor
+ * @brief Update the telemetry segment with a register snapshot, the latest
+ *        scaler sample, the readout statistics, and the deadtime.
+ *
+ *   If the scaler sampler thread is not running, the scalers are sampled
+ *   here.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdTelemetryPublish()
+{
+  HD_SNAPSHOT snap;
+  HD_SCALER_SAMPLE scalers;
+  HD_READOUT_STATS readout;
+  HD_DEADTIME_STATS deadtime;
+  HD_TELEMETRY *t;
+  int32_t haveScalers;
+
+  if(hdSnapshot(&snap) != OK)
+    return ERROR;
+
+  if(!hdScalerRun)
+    hdScalerSamplerUpdate();
+  haveScalers = (hdScalerSamplerGet(&scalers) == OK);
+
+  hdGetReadoutStats(&readout);
+  hdDeadtimeGet(&deadtime);
+
+  pthread_mutex_lock(&hdTelemetryMutex);
+  t = hdTelemetrySeg;
+  if(t == NULL)
+    {
+      pthread_mutex_unlock(&hdTelemetryMutex);
+      return ERROR;
+    }
+
+  t->seq++;
+  __sync_synchronize();
+
+  t->reg = snap.reg;
+  t->snapshotTime = snap.timestamp;
+  t->vmeA24 = snap.vmeA24;
+  t->a32Base = snap.a32Base;
+  t->systemPLL = (snap.reg.csr & HD_CSR_SYSTEM_CLK_PLL_LOCKED) ? 1 : 0;
+  t->localPLL = (snap.reg.csr & HD_CSR_LOCAL_CLK_PLL_LOCKED) ? 1 : 0;
+
+  if(haveScalers)
+    {
+      t->scalerTime = scalers.timestamp;
+      memcpy(t->scalerRaw, scalers.raw, sizeof(t->scalerRaw));
+      memcpy(t->scalerCount, scalers.count, sizeof(t->scalerCount));
+      memcpy(t->scalerRate, scalers.rate, sizeof(t->scalerRate));
+      memcpy(t->scalerAvgRate, scalers.avgRate, sizeof(t->scalerAvgRate));
+    }
+
+  t->readout = readout;
+  t->deadtime = deadtime;
+  t->updated = hdTimestamp();
+  t->nupdates++;
+
+  __sync_synchronize();
+  t->seq++;
+  pthread_mutex_unlock(&hdTelemetryMutex);
+
+  return OK;
+}
+
+static void *
+hdTelemetryPublishThread(void *arg)
+{
+  hdSelect(hdTelemetryBoard);
+
+  while(hdTelemetryRun)
+    {
+      hdTelemetryPublish();
+      usleep(hdTelemetryPeriodMs * 1000);
+    }
+
+  return NULL;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Create the telemetry shared memory segment and start a thread
+ *        that updates it.  Read it from other processes with hdTelemetryOpen.
+ *        The thread samples the board selected (hdSelect) when it
+ *        is started.
+ *
+ * @param name Segment name, or NULL for HD_TELEMETRY_DEFAULT_NAME
+ * @param periodMs Update period in ms.  0 = no thread, the caller updates
+ *                 with hdTelemetryPublish.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdTelemetryPublishStart(const char *name, uint32_t periodMs)
+{
+  int32_t fd;
+  void *addr;
+
+  if(name == NULL)
+    name = HD_TELEMETRY_DEFAULT_NAME;
+
+  pthread_mutex_lock(&hdTelemetryMutex);
+  if(hdTelemetrySeg != NULL)
+    {
+      pthread_mutex_unlock(&hdTelemetryMutex);
+      printf("%s: ERROR: Telemetry already published as %s\n",
+	     __func__, hdTelemetryName);
+      return ERROR;
+    }
+
+  fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if(fd < 0)
+    {
+      pthread_mutex_unlock(&hdTelemetryMutex);
+      perror("shm_open");
+      return ERROR;
+    }
+
+  if(ftruncate(fd, sizeof(HD_TELEMETRY)) < 0)
+    {
+      pthread_mutex_unlock(&hdTelemetryMutex);
+      perror("ftruncate");
+      close(fd);
+      return ERROR;
+    }
+
+  addr = mmap(NULL, sizeof(HD_TELEMETRY), PROT_READ | PROT_WRITE,
+	      MAP_SHARED, fd, 0);
+  close(fd);
+  if(addr == MAP_FAILED)
+    {
+      pthread_mutex_unlock(&hdTelemetryMutex);
+      perror("mmap");
+      return ERROR;
+    }
+
+  hdTelemetrySeg = (HD_TELEMETRY *)addr;
+  memset(hdTelemetrySeg, 0, sizeof(HD_TELEMETRY));
+  hdTelemetrySeg->magic = HD_TELEMETRY_MAGIC;
+  hdTelemetrySeg->version = HD_TELEMETRY_VERSION;
+  hdTelemetrySeg->size = sizeof(HD_TELEMETRY);
+  hdTelemetrySeg->pid = getpid();
+  hdTelemetrySeg->running = 1;
+  strncpy(hdTelemetryName, name, sizeof(hdTelemetryName) - 1);
+  pthread_mutex_unlock(&hdTelemetryMutex);
+
+  if(periodMs == 0)
+    return OK;
+
+  hdTelemetryPeriodMs = periodMs;
+  hdTelemetryBoard = hdGetSelected();
+  hdTelemetryRun = 1;
+  if(pthread_create(&hdTelemetryThread, NULL, hdTelemetryPublishThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      hdTelemetryRun = 0;
+      hdTelemetryPublishStop();
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Stop publishing telemetry, and remove the shared memory segment
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdTelemetryPublishStop()
+{
+  if(hdTelemetryRun)
+    {
+      hdTelemetryRun = 0;
+      pthread_join(hdTelemetryThread, NULL);
+    }
+
+  pthread_mutex_lock(&hdTelemetryMutex);
+  if(hdTelemetrySeg == NULL)
+    {
+      pthread_mutex_unlock(&hdTelemetryMutex);
+      return ERROR;
+    }
+
+  hdTelemetrySeg->running = 0;
+  munmap(hdTelemetrySeg, sizeof(HD_TELEMETRY));
+  hdTelemetrySeg = NULL;
+  shm_unlink(hdTelemetryName);
+  pthread_mutex_unlock(&hdTelemetryMutex);
+
+  return OK;
+}
+
+/* CSR watcher.
+   hdCsrWatchMutex protects the callbacks, the previous CSR and the log.
+   Callbacks are called without it held. */
+typedef struct
+{
+  uint32_t mask;
+  uint32_t edges;
+  HD_CSR_CALLBACK callback;
+  void *arg;
+} HD_CSR_WATCH;
+
+static pthread_mutex_t hdCsrWatchMutex = PTHREAD_MUTEX_INITIALIZER;
+static HD_CSR_WATCH hdCsrWatch[HD_CSR_WATCH_MAX_CALLBACKS];
+static uint32_t hdCsrWatchPrev = 0;
+static int32_t hdCsrWatchPrimed = 0;
+static HD_CSR_EVENT hdCsrWatchLog[HD_CSR_WATCH_LOG_SIZE];
+static uint64_t hdCsrWatchNlog = 0;
+
+static pthread_t hdCsrWatchThread;
+static volatile int32_t hdCsrWatchRun = 0;
+static uint32_t hdCsrWatchPeriodUs = 1000;
+/* Board selected when the thread was started */
+static int32_t hdCsrWatchBoard = 0;
+
+/**
+ * @ingroup Monitor
+ * @brief Register a callback for transitions of CSR bits
+ *
+ * @param mask HD_CSR_* bits to watch.  0 = HD_CSR_WATCH_DEFAULT_MASK
+ * @param edges HD_CSR_EDGE_RISING, HD_CSR_EDGE_FALLING, or HD_CSR_EDGE_BOTH
+ * @param callback Called once per transition, from the thread that
+ *                 calls hdCsrWatchSample
+ * @param arg Passed to the callback
+ *
+ * @return Callback id if successful, otherwise ERROR
+ */
+int32_t
+hdCsrWatchAdd(uint32_t mask, uint32_t edges, HD_CSR_CALLBACK callback, void *arg)
+{
+  int32_t id;
+
+  if(callback == NULL)
+    {
+      printf("%s: ERROR: Invalid callback\n", __func__);
+      return ERROR;
+    }
+
+  if(mask == 0)
+    mask = HD_CSR_WATCH_DEFAULT_MASK;
+
+  if(edges == 0)
+    edges = HD_CSR_EDGE_BOTH;
+
+  pthread_mutex_lock(&hdCsrWatchMutex);
+  for(id = 0; id < HD_CSR_WATCH_MAX_CALLBACKS; id++)
+    {
+      if(hdCsrWatch[id].callback == NULL)
+	{
+	  hdCsrWatch[id].mask = mask;
+	  hdCsrWatch[id].edges = edges;
+	  hdCsrWatch[id].callback = callback;
+	  hdCsrWatch[id].arg = arg;
+	  break;
+	}
+    }
+  pthread_mutex_unlock(&hdCsrWatchMutex);
+
+  if(id == HD_CSR_WATCH_MAX_CALLBACKS)
+    {
+      printf("%s: ERROR: No free callbacks (max = %d)\n",
+	     __func__, HD_CSR_WATCH_MAX_CALLBACKS);
+      return ERROR;
+    }
+
+  return id;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Remove a callback registered with hdCsrWatchAdd
+ *
+ * @param id Callback id
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdCsrWatchRemove(int32_t id)
+{
+  if((id < 0) || (id >= HD_CSR_WATCH_MAX_CALLBACKS))
+    {
+      printf("%s: ERROR: Invalid id (%d)\n", __func__, id);
+      return ERROR;
+    }
+
+  pthread_mutex_lock(&hdCsrWatchMutex);
+  memset(&hdCsrWatch[id], 0, sizeof(HD_CSR_WATCH));
+  pthread_mutex_unlock(&hdCsrWatchMutex);
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Read the CSR, log the transitions of the watched bits since the
+ *        last sample, and call the registered callbacks.
+ *
+ *   Called periodically by the watcher thread, or directly (e.g. once per
+ *   readout cycle).  The first sample only sets the reference.
+ *   BUSY_LATCHED is not cleared here.  It falls when cleared by
+ *   hdBusyStatus.
+ *
+ * @return Number of transitions, otherwise ERROR
+ */
+int32_t
+hdCsrWatchSample()
+{
+  HD_CSR_WATCH watch[HD_CSR_WATCH_MAX_CALLBACKS];
+  HD_CSR_EVENT events[32];
+  uint32_t csr, changed, watched = 0;
+  uint64_t now;
+  int32_t ibit, iwatch, nevents = 0, ievent;
+
+  /* Sample under the lock, so that transitions are logged in the order
+     the CSR was read */
+  pthread_mutex_lock(&hdCsrWatchMutex);
+
+  if(hdGetCSR(&csr) != OK)
+    {
+      pthread_mutex_unlock(&hdCsrWatchMutex);
+      return ERROR;
+    }
+
+  now = hdTimestamp();
+
+  for(iwatch = 0; iwatch < HD_CSR_WATCH_MAX_CALLBACKS; iwatch++)
+    if(hdCsrWatch[iwatch].callback != NULL)
+      watched |= hdCsrWatch[iwatch].mask;
+  watched |= HD_CSR_WATCH_DEFAULT_MASK;
+
+  if(!hdCsrWatchPrimed)
+    {
+      hdCsrWatchPrev = csr;
+      hdCsrWatchPrimed = 1;
+      pthread_mutex_unlock(&hdCsrWatchMutex);
+      return 0;
+    }
+
+  changed = (csr ^ hdCsrWatchPrev) & watched;
+  hdCsrWatchPrev = csr;
+
+  for(ibit = 0; changed != 0; ibit++, changed >>= 1)
+    {
+      if((changed & 1) == 0)
+	continue;
+
+      events[nevents].timestamp = now;
+      events[nevents].bit = 1u << ibit;
+      events[nevents].csr = csr;
+      events[nevents].edge = (csr & (1u << ibit)) ?
+	HD_CSR_EDGE_RISING : HD_CSR_EDGE_FALLING;
+
+      hdCsrWatchLog[hdCsrWatchNlog % HD_CSR_WATCH_LOG_SIZE] = events[nevents];
+      hdCsrWatchNlog++;
+      nevents++;
+    }
+
+  memcpy(watch, hdCsrWatch, sizeof(watch));
+  pthread_mutex_unlock(&hdCsrWatchMutex);
+
+  for(ievent = 0; ievent < nevents; ievent++)
+    {
+      for(iwatch = 0; iwatch < HD_CSR_WATCH_MAX_CALLBACKS; iwatch++)
+	{
+	  if((watch[iwatch].callback != NULL) &&
+	     (watch[iwatch].mask & events[ievent].bit) &&
+	     (watch[iwatch].edges & events[ievent].edge))
+	    watch[iwatch].callback(&events[ievent], watch[iwatch].arg);
+	}
+    }
+
+  return nevents;
+}
+
+static void *
+hdCsrWatchSampleThread(void *arg)
+{
+  hdSelect(hdCsrWatchBoard);
+
+  while(hdCsrWatchRun)
+    {
+      hdCsrWatchSample();
+      usleep(hdCsrWatchPeriodUs);
+    }
+
+  return NULL;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Start the CSR watcher thread
+ *        The thread samples the board selected (hdSelect) when it
+ *        is started.
+ *
+ * @param periodUs Sampling period in us
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdCsrWatchStart(uint32_t periodUs)
+{
+  if(periodUs == 0)
+    {
+      printf("%s: ERROR: Invalid periodUs (%d)\n",
+	     __func__, periodUs);
+      return ERROR;
+    }
+
+  if(hdCsrWatchRun)
+    {
+      printf("%s: ERROR: Watcher already running\n", __func__);
+      return ERROR;
+    }
+
+  pthread_mutex_lock(&hdCsrWatchMutex);
+  hdCsrWatchPeriodUs = periodUs;
+  hdCsrWatchPrimed = 0;
+  pthread_mutex_unlock(&hdCsrWatchMutex);
+
+  hdCsrWatchBoard = hdGetSelected();
+  hdCsrWatchRun = 1;
+  if(pthread_create(&hdCsrWatchThread, NULL, hdCsrWatchSampleThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      hdCsrWatchRun = 0;
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Stop the CSR watcher thread
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdCsrWatchStop()
+{
+  if(!hdCsrWatchRun)
+    return ERROR;
+
+  hdCsrWatchRun = 0;
+  pthread_join(hdCsrWatchThread, NULL);
+
+  return OK;
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Copy the most recent CSR transitions, oldest first
+ *
+ * @param events Address to store the transitions
+ * @param max Maximum number to store
+ *
+ * @return Number of transitions stored, otherwise ERROR
+ */
+int32_t
+hdCsrWatchGetLog(HD_CSR_EVENT *events, int32_t max)
+{
+  uint64_t first, ilog;
+  int32_t n = 0;
+
+  if((events == NULL) || (max < 0))
+    return ERROR;
+
+  if(max > HD_CSR_WATCH_LOG_SIZE)
+    max = HD_CSR_WATCH_LOG_SIZE;
+
+  pthread_mutex_lock(&hdCsrWatchMutex);
+  first = (hdCsrWatchNlog > (uint64_t)max) ? hdCsrWatchNlog - max : 0;
+  for(ilog = first; ilog < hdCsrWatchNlog; ilog++)
+    events[n++] = hdCsrWatchLog[ilog % HD_CSR_WATCH_LOG_SIZE];
+  pthread_mutex_unlock(&hdCsrWatchMutex);
+
+  return n;
+}
+
+static const char *
+hdCsrBitName(uint32_t bit)
+{
+  switch(bit)
+    {
+    case HD_CSR_SYSTEM_CLK_PLL_LOCKED: return "SYSTEM_CLK_PLL_LOCKED";
+    case HD_CSR_LOCAL_CLK_PLL_LOCKED:  return "LOCAL_CLK_PLL_LOCKED";
+    case HD_CSR_BLOCK_ACCEPTED:        return "BLOCK_ACCEPTED";
+    case HD_CSR_BLOCK_READY:           return "BLOCK_READY";
+    case HD_CSR_EMPTY:                 return "EMPTY";
+    case HD_CSR_BERR_ASSERTED:         return "BERR_ASSERTED";
+    case HD_CSR_BUSY:                  return "BUSY";
+    case HD_CSR_BUSY_LATCHED:          return "BUSY_LATCHED";
+    case HD_CSR_INTERNAL_BUF0:         return "INTERNAL_BUF0";
+    case HD_CSR_INTERNAL_BUF1:         return "INTERNAL_BUF1";
+    case HD_CSR_HELICITY_SEQ_ERROR:    return "HELICITY_SEQ_ERROR";
+    case HD_CSR_TRIGTIME_WORD_ERROR:   return "TRIGTIME_WORD_ERROR";
+    default:                           return "???";
+    }
+}
+
+/**
+ * @ingroup Monitor
+ * @brief Print the CSR transition log to standard out
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdCsrWatchPrintLog()
+{
+  HD_CSR_EVENT events[HD_CSR_WATCH_LOG_SIZE];
+  int32_t n, ievent;
+
+  n = hdCsrWatchGetLog(events, HD_CSR_WATCH_LOG_SIZE);
+  if(n < 0)
+    return ERROR;
+
+  printf("\n");
+  printf("  CSR Transitions (%d)\n", n);
+  printf("\n");
+  printf("           Time (s)    Bit                       Edge     CSR\n");
+  printf("  ------------------------------------------------------------------------------\n");
+  /*
+   *     "   123456.123456789    SYSTEM_CLK_PLL_LOCKED     FALLING  0x00000002"
+   */
+  for(ievent = 0; ievent < n; ievent++)
+    {
+      printf("  %9llu.%09llu    %-24s  %s  0x%08x\n",
+	     (unsigned long long)(events[ievent].timestamp / 1000000000ULL),
+	     (unsigned long long)(events[ievent].timestamp % 1000000000ULL),
+	     hdCsrBitName(events[ievent].bit),
+	     (events[ievent].edge == HD_CSR_EDGE_RISING) ? "RISING " : "FALLING",
+	     events[ievent].csr);
+    }
+  printf("\n");
+
+  return OK;
+}
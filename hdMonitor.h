@@ -0,0 +1,151 @@
+#pragma once
+/******************************************************************************
+ *
+ *  hdMonitor.h -  Header for monitoring tools for the JLab helicity decoder
+ *
+ */
+
+#include <stdint.h>
+#include "hdLib.h"
+
+/* Scaler index, in the order of hdReadScalers(data, 1) */
+#define HD_SCALER_TSETTLE_FALLING  0
+#define HD_SCALER_TSETTLE_RISING   1
+#define HD_SCALER_PATTERN_SYNC     2
+#define HD_SCALER_PAIR_SYNC        3
+#define HD_SCALER_TRIG1            4
+#define HD_SCALER_TRIG2            5
+#define HD_SCALER_SYNCRESET        6
+#define HD_SCALER_EVENTS_ON_BOARD  7
+#define HD_SCALER_BLOCKS_ON_BOARD  8
+#define HD_SCALER_NCOUNTERS        9
+#define HD_SCALER_NEXTENDED        7  /* Counters extended to 64 bits */
+
+/* Latest scaler sample, from the scaler sampler */
+typedef struct hd_scaler_sample_struct
+{
+  uint64_t timestamp;                     /* Monotonic clock, ns */
+  uint64_t nsamples;
+  uint32_t raw[HD_SCALER_NCOUNTERS];      /* As read from the module */
+  uint64_t count[HD_SCALER_NEXTENDED];    /* Extended across 32 bit wraps */
+  double   rate[HD_SCALER_NEXTENDED];     /* Over the last interval, Hz */
+  double   avgRate[HD_SCALER_NEXTENDED];  /* Exponential average, Hz */
+} HD_SCALER_SAMPLE;
+
+int32_t hdScalerSamplerUpdate();
+int32_t hdScalerSamplerStart(uint32_t periodMs, uint32_t averageMs);
+int32_t hdScalerSamplerStop();
+int32_t hdScalerSamplerGet(HD_SCALER_SAMPLE *out);
+
+/* Deadtime accounting, from the BUSY and BUSY_LATCHED CSR bits */
+typedef struct hd_deadtime_stats_struct
+{
+  uint64_t nsamples;
+  uint64_t nbusy;            /* Samples with BUSY asserted */
+  uint64_t nlatched;         /* Intervals busy at any time (BUSY or a new BUSY_LATCHED) */
+  uint64_t episodes;         /* Transitions from not busy to busy */
+  uint64_t elapsedNs;        /* Time covered by the samples */
+  uint64_t latchedNs;        /* Time of those intervals */
+  double   busyFraction;     /* nbusy / nsamples */
+  double   latchedFraction;  /* latchedNs / elapsedNs, upper bound */
+
+  /* hdReadBlock calls, split by the busy state of their interval */
+  uint64_t busyReads;
+  uint64_t busyReadNs;
+  uint64_t idleReads;
+  uint64_t idleReadNs;
+} HD_DEADTIME_STATS;
+
+int32_t hdDeadtimeSample();
+int32_t hdDeadtimeStart(uint32_t periodUs);
+int32_t hdDeadtimeStop();
+int32_t hdDeadtimeGet(HD_DEADTIME_STATS *stats);
+int32_t hdDeadtimeReset();
+int32_t hdDeadtimePrint();
+
+/* Scaler aggregation over several boards.
+   Per-board arrays are counter major: [ichan * nboards + iboard] */
+typedef struct hd_scaler_agg_struct
+{
+  uint32_t nboards;
+  uint64_t nsamples;
+  uint64_t timestamp;   /* Of the last update, ns */
+  double   dt;          /* Interval of the last update, s */
+
+  uint32_t *raw;        /* Last raw values */
+  uint32_t *delta;      /* Wrap corrected deltas over the last interval */
+  uint64_t *count;      /* Extended counters */
+  double   *rate;       /* Hz */
+  uint32_t *cur;        /* Sample being processed, counter major */
+
+  /* Crate totals.  For EVENTS/BLOCKS_ON_BOARD, the current sum */
+  uint64_t total[HD_SCALER_NCOUNTERS];
+  uint64_t totalDelta[HD_SCALER_NCOUNTERS];
+  double   totalRate[HD_SCALER_NCOUNTERS];
+
+  /* Helicity state breakdown, from helicity_scaler[] (T_STABLE falling,
+     T_STABLE rising, PATTERN_SYNC, PAIR_SYNC).  The module has no per
+     helicity (+/-) counters, so the breakdown is by these states.  The
+     per board deltas and rates are in delta[] and rate[]; here the mean
+     and spread between boards, which should agree for boards on the same
+     helicity signals */
+  double   helicityMeanDelta[4];
+  uint32_t helicityMinDelta[4];
+  uint32_t helicityMaxDelta[4];
+  double   windowsPerPattern;   /* T_STABLE rising / PATTERN_SYNC */
+  double   pairsPerPattern;     /* PAIR_SYNC / PATTERN_SYNC */
+} HD_SCALER_AGG;
+
+int32_t hdScalerAggInit(HD_SCALER_AGG *agg, uint32_t nboards);
+void    hdScalerAggFree(HD_SCALER_AGG *agg);
+int32_t hdScalerAggUpdate(HD_SCALER_AGG *agg, const uint32_t *scalers, uint64_t timestamp);
+int32_t hdScalerAggPrint(HD_SCALER_AGG *agg);
+
+/* Scaler bank, from hdScalerBankFill.  Big-endian, like the readout bank
+     word 0     : HD_SCALER_BANK_VERSION << 24 | flags << 16 | number of words
+     word 1-2   : timestamp, ns (low, high)
+     word 3-11  : scalers, in the order of hdReadScalers(data, 1)
+     word 12-18 : rates of the first 7 scalers, Hz */
+#define HD_SCALER_BANK_VERSION        1
+#define HD_SCALER_BANK_NWORDS         19
+#define HD_SCALER_BANK_FLAG_SAMPLER   (1 << 0)  /* From the scaler sampler */
+
+int32_t hdScalerBankConfig(uint32_t everyNEvents, uint32_t everyMs);
+int32_t hdScalerBankDue(uint32_t nevents);
+int32_t hdScalerBankFill(volatile uint32_t *data, int32_t nwrds);
+
+int32_t hdTelemetryPublish();
+int32_t hdTelemetryPublishStart(const char *name, uint32_t periodMs);
+int32_t hdTelemetryPublishStop();
+
+/* CSR watcher */
+#define HD_CSR_WATCH_DEFAULT_MASK					\
+  (HD_CSR_SYSTEM_CLK_PLL_LOCKED | HD_CSR_LOCAL_CLK_PLL_LOCKED |		\
+   HD_CSR_HELICITY_SEQ_ERROR | HD_CSR_TRIGTIME_WORD_ERROR |		\
+   HD_CSR_BUSY_LATCHED | HD_CSR_BERR_ASSERTED)
+
+#define HD_CSR_EDGE_RISING   (1 << 0)
+#define HD_CSR_EDGE_FALLING  (1 << 1)
+#define HD_CSR_EDGE_BOTH     (HD_CSR_EDGE_RISING | HD_CSR_EDGE_FALLING)
+
+#define HD_CSR_WATCH_MAX_CALLBACKS 16
+#define HD_CSR_WATCH_LOG_SIZE      256
+
+/* One transition of one CSR bit */
+typedef struct hd_csr_event_struct
+{
+  uint64_t timestamp;  /* Monotonic clock, ns */
+  uint32_t bit;        /* HD_CSR_* bit that changed */
+  uint32_t csr;        /* CSR after the transition */
+  uint32_t edge;       /* HD_CSR_EDGE_RISING or HD_CSR_EDGE_FALLING */
+} HD_CSR_EVENT;
+
+typedef void (*HD_CSR_CALLBACK)(const HD_CSR_EVENT *event, void *arg);
+
+int32_t hdCsrWatchAdd(uint32_t mask, uint32_t edges, HD_CSR_CALLBACK callback, void *arg);
+int32_t hdCsrWatchRemove(int32_t id);
+int32_t hdCsrWatchSample();
+int32_t hdCsrWatchStart(uint32_t periodUs);
+int32_t hdCsrWatchStop();
+int32_t hdCsrWatchGetLog(HD_CSR_EVENT *events, int32_t max);
+int32_t hdCsrWatchPrintLog();
@@ -0,0 +1,159 @@
+/* Module: hdTelemetry.c
+ *
+ * Description: Helicity Decoder Telemetry Reader Library
+ *              Read the shared memory segment published by the process
+ *              that owns the module.  Does not use jvme, so external
+ *              monitors can link this alone (libhdtelemetry).
+ *
+ * Author:
+ *        Bryan Moffit
+ *        JLab Data Acquisition Group
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hdTelemetry.h"
+
+#ifndef OK
+#define OK 0
+#endif
+#ifndef ERROR
+#define ERROR -1
+#endif
+
+/**
+ * @defgroup Telemetry Telemetry
+ */
+
+/**
+ * @ingroup Telemetry
+ * @brief Open the telemetry segment for reading
+ *
+ * @param r Reader
+ * @param name Segment name, or NULL for HD_TELEMETRY_DEFAULT_NAME
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdTelemetryOpen(HD_TELEMETRY_READER *r, const char *name)
+{
+  struct stat st;
+  void *addr;
+
+  if(r == NULL)
+    return ERROR;
+
+  memset(r, 0, sizeof(HD_TELEMETRY_READER));
+  r->fd = -1;
+
+  if(name == NULL)
+    name = HD_TELEMETRY_DEFAULT_NAME;
+
+  r->fd = shm_open(name, O_RDONLY, 0);
+  if(r->fd < 0)
+    {
+      perror("shm_open");
+      printf("%s: ERROR: Unable to open telemetry segment %s\n",
+	     __func__, name);
+      return ERROR;
+    }
+
+  if((fstat(r->fd, &st) < 0) || (st.st_size < (off_t)sizeof(HD_TELEMETRY)))
+    {
+      printf("%s: ERROR: Telemetry segment %s too small\n",
+	     __func__, name);
+      close(r->fd);
+      r->fd = -1;
+      return ERROR;
+    }
+
+  addr = mmap(NULL, sizeof(HD_TELEMETRY), PROT_READ, MAP_SHARED, r->fd, 0);
+  if(addr == MAP_FAILED)
+    {
+      perror("mmap");
+      close(r->fd);
+      r->fd = -1;
+      return ERROR;
+    }
+  r->seg = (const volatile HD_TELEMETRY *)addr;
+
+  if((r->seg->magic != HD_TELEMETRY_MAGIC) ||
+     (r->seg->version != HD_TELEMETRY_VERSION))
+    {
+      printf("%s: ERROR: Telemetry segment %s version 0x%08x/%d.  Expected 0x%08x/%d\n",
+	     __func__, name, r->seg->magic, r->seg->version,
+	     HD_TELEMETRY_MAGIC, HD_TELEMETRY_VERSION);
+      hdTelemetryClose(r);
+      return ERROR;
+    }
+
+  return OK;
+}
+
+/**
+ * @ingroup Telemetry
+ * @brief Copy a consistent image of the telemetry segment
+ *
+ * @param r Reader
+ * @param out Address to store the copy
+ *
+ * @return OK if successful, ERROR if nothing has been published or no
+ *         consistent copy was made in HD_TELEMETRY_READ_TRIES tries
+ */
+int32_t
+hdTelemetryRead(HD_TELEMETRY_READER *r, HD_TELEMETRY *out)
+{
+  uint32_t seq0, seq1;
+  int32_t itry;
+
+  if((r == NULL) || (r->seg == NULL) || (out == NULL))
+    return ERROR;
+
+  for(itry = 0; itry < HD_TELEMETRY_READ_TRIES; itry++)
+    {
+      seq0 = r->seg->seq;
+      __sync_synchronize();
+      memcpy(out, (const void *)r->seg, sizeof(HD_TELEMETRY));
+      __sync_synchronize();
+      seq1 = r->seg->seq;
+
+      if((seq0 == seq1) && !(seq0 & 1))
+	return (out->nupdates > 0) ? OK : ERROR;
+
+      sched_yield();
+    }
+
+  /* Publisher died mid-update, or is updating faster than we can copy */
+  return ERROR;
+}
+
+/**
+ * @ingroup Telemetry
+ * @brief Close the telemetry segment
+ *
+ * @param r Reader
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int32_t
+hdTelemetryClose(HD_TELEMETRY_READER *r)
+{
+  if(r == NULL)
+    return ERROR;
+
+  if(r->seg != NULL)
+    munmap((void *)r->seg, sizeof(HD_TELEMETRY));
+  if(r->fd >= 0)
+    close(r->fd);
+
+  r->seg = NULL;
+  r->fd = -1;
+
+  return OK;
+}
@@ -0,0 +1,65 @@
+#pragma once
+/******************************************************************************
+ *
+ *  hdTelemetry.h -  Shared memory telemetry segment for the JLab helicity
+ *                   decoder.  Published by the process that owns the module
+ *                   (hdTelemetryPublishStart in hdMonitor.h), read by any
+ *                   other process with no VME access and no locking.
+ *
+ */
+
+#include <stdint.h>
+#include "hdLib.h"
+#include "hdMonitor.h"
+
+#define HD_TELEMETRY_DEFAULT_NAME "/hdTelemetry"
+#define HD_TELEMETRY_MAGIC        0x48445445  /* "HDTE" */
+#define HD_TELEMETRY_VERSION      2
+#define HD_TELEMETRY_READ_TRIES   100  /* hdTelemetryRead copies before giving up */
+
+typedef struct hd_telemetry_struct
+{
+  /* Header, written once when the segment is created */
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;                /* sizeof(HD_TELEMETRY) of the publisher */
+  uint32_t pid;                 /* Publishing process */
+
+  volatile uint32_t seq;        /* Odd while an update is in progress */
+  uint32_t running;             /* 0 after the publisher stops */
+  uint64_t nupdates;
+  uint64_t updated;             /* Monotonic clock of the publisher, ns */
+
+  /* Register snapshot */
+  HD       reg;
+  uint64_t snapshotTime;
+  uint32_t vmeA24;
+  uint32_t a32Base;
+
+  /* PLL lock state, from csr */
+  int32_t  systemPLL;
+  int32_t  localPLL;
+
+  /* Scalers, extended to 64 bits, and rates (Hz), from the scaler sampler */
+  uint64_t scalerTime;
+  uint32_t scalerRaw[HD_SCALER_NCOUNTERS];
+  uint64_t scalerCount[HD_SCALER_NEXTENDED];
+  double   scalerRate[HD_SCALER_NEXTENDED];
+  double   scalerAvgRate[HD_SCALER_NEXTENDED];
+
+  /* Readout statistics */
+  HD_READOUT_STATS readout;
+
+  /* Deadtime accounting */
+  HD_DEADTIME_STATS deadtime;
+} HD_TELEMETRY;
+
+typedef struct hd_telemetry_reader_struct
+{
+  int32_t fd;
+  const volatile HD_TELEMETRY *seg;
+} HD_TELEMETRY_READER;
+
+int32_t hdTelemetryOpen(HD_TELEMETRY_READER *r, const char *name);
+int32_t hdTelemetryRead(HD_TELEMETRY_READER *r, HD_TELEMETRY *out);
+int32_t hdTelemetryClose(HD_TELEMETRY_READER *r);
@@ -26,16 +26,58 @@
 #include "dmaBankTools.h"
 #include "tiprimary_list.c" /* Source required for CODA readout lists using the TI */
 #include "hdLib.h"
+#include "hdMonitor.h"
 
 #define HELICITY_DECODER_ADDR 0xed0000
 #define HELICITY_DECODER_BANK 0xDEC
 
+/* Scaler bank, inserted every N events and/or every T ms (0 = not used).
+   Big-endian, like the module's data in HELICITY_DECODER_BANK */
+#define HELICITY_SCALER_BANK       0xDEC5
+#define SCALER_BANK_EVERY_NEVENTS  0
+#define SCALER_BANK_EVERY_MS       1000
+/* Background scaler sampler period, used for the scaler bank (0 = not used,
+   the scalers are then read in rocTrigger, with programmed I/O) */
+#define SCALER_SAMPLER_PERIOD_MS   1000
+
 /* Define initial blocklevel and buffering level */
 #define BLOCKLEVEL 1
 #define BUFFERLEVEL 1
 
 #define INTRANDOMPULSER
 
+/* Buffer for the register block transfers of hdStatus */
+DMA_MEM_ID hdStatusPool = NULL;
+
+/* Helicity decoder status, with its registers read in one A24 block
+   transfer (hdSetSnapshotDMA).  The readout's DMA configuration is put
+   back after.  Programmed I/O if there is no buffer. */
+static void
+hdStatusDMA(int pflag)
+{
+  DMANODE *node = NULL;
+
+  vmeBusLock();
+  if(hdStatusPool != NULL)
+    node = dmaPGetItem(hdStatusPool);
+
+  if(node != NULL)
+    {
+      vmeDmaConfig(1,2,0);
+      hdSetSnapshotDMA((volatile uint32_t *)node->data);
+    }
+
+  hdStatus(pflag);
+
+  if(node != NULL)
+    {
+      hdSetSnapshotDMA(NULL);
+      vmeDmaConfig(2,5,1);
+      dmaPFreeItem(node);
+    }
+  vmeBusUnlock();
+}
+
 /****************************************
  *  DOWNLOAD
  ****************************************/
@@ -54,6 +96,9 @@ rocDownload()
    */
   vmeDmaConfig(2,5,1);
 
+  /* One buffer, for the helicity decoder register block transfers */
+  hdStatusPool = dmaPCreate("hdStatus", sizeof(HD), 1, 0);
+
   /* Define BLock Level */
   blockLevel = BLOCKLEVEL;
 
@@ -105,7 +150,7 @@ rocDownload()
 
   /* Initialize the library and module with its internal clock*/
   hdInit(HELICITY_DECODER_ADDR, HD_INIT_INTERNAL, 0, 0);
-  hdStatus(1);
+  hdStatusDMA(1);
 
   printf("rocDownload: User Download Executed\n");
 
@@ -127,6 +172,9 @@ rocPrestart()
 
   tiStatus(0);
 
+  /* Stage the configuration, and apply it at once with hdConfigCommit */
+  hdConfigBegin();
+
   /* Switch helicity decoder to VXS master clock, trigger, syncreset */
   hdSetSignalSources(HD_INIT_VXS, HD_INIT_VXS, HD_INIT_VXS);
 
@@ -141,12 +189,21 @@ rocPrestart()
   hdSetHelicitySource(1, 0, 1);
   hdHelicityGeneratorConfig(2,     /* Pattern = 2 (OCTET) */
 			    0,     /* Window Delay = 0 (0 windows) */
-			    0x40,  /* SettleTime = 0x40 (512 ns) */
-			    0x80,  /* StableTime = 0x80 (1024 ns) */
+			    0x40,  /* SettleTime = 0x40 (2560 ns) */
+			    0x80,  /* StableTime = 0x80 (5120 ns) */
 			    0xABCDEF01); /* Seed */
   hdEnableHelicityGenerator();
 
-  hdStatus(0);
+  stat = hdConfigCommit();
+  if(stat < 0)
+    printf("rocPrestart: ERROR configuring the helicity decoder\n");
+  else
+    printf("rocPrestart: Helicity decoder configured with %d register writes\n", stat);
+
+  /* Periodic scaler bank */
+  hdScalerBankConfig(SCALER_BANK_EVERY_NEVENTS, SCALER_BANK_EVERY_MS);
+
+  hdStatusDMA(0);
 
   printf("rocPrestart: User Prestart Executed\n");
 
@@ -168,7 +225,10 @@ rocGo()
   hdSetBlocklevel(blockLevel);
 
   hdEnable();
-  hdStatus(0);
+  hdStatusDMA(0);
+
+  if(SCALER_SAMPLER_PERIOD_MS)
+    hdScalerSamplerStart(SCALER_SAMPLER_PERIOD_MS, 10 * SCALER_SAMPLER_PERIOD_MS);
 
   /* Example: How to start internal pulser trigger */
 #ifdef INTRANDOMPULSER
@@ -200,7 +260,10 @@ rocEnd()
 
   hdDisable();
 
-  hdStatus(0);
+  if(SCALER_SAMPLER_PERIOD_MS)
+    hdScalerSamplerStop();
+
+  hdStatusDMA(0);
 
   tiStatus(0);
 
@@ -260,6 +323,16 @@ rocTrigger(int arg)
 
   BANKCLOSE;
 
+  /* Scaler bank, when due */
+  if(hdScalerBankDue(blockLevel))
+    {
+      BANKOPEN(HELICITY_SCALER_BANK, BT_UI4, 0);
+      dCnt = hdScalerBankFill(dma_dabufp, HD_SCALER_BANK_NWORDS);
+      if(dCnt > 0)
+	dma_dabufp += dCnt;
+      BANKCLOSE;
+    }
+
   /* Set TI output 0 low */
   tiSetOutputPort(0,0,0,0);
 
@@ -0,0 +1,398 @@
+/*
+ * File:
+ *    hdAccessTest
+ *
+ * Description:
+ *    Check the bus transactions of the library against budgets, on an
+ *    in-memory board (no crate needed).  The calls are recorded, then
+ *    replayed, and the replay must make the same transactions.
+ *
+ *
+ */
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <getopt.h>
+#include "jvme.h"
+#include "hdLib.h"
+#include "hdConfig.h"
+#include "hdAccess.h"
+#include "hdMonitor.h"
+
+#define BOARD_A24  0xed0000
+#define LOG_SIZE   16384
+
+char *progName;
+
+/* Most transactions each routine may make directly, for one call */
+typedef struct
+{
+  const char *func;
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t dmas;
+} BUDGET;
+
+BUDGET budgets[] =
+  {
+    {"hdGetFirmwareVersion",  1, 0, 0},
+    {"hdGetBlocklevel",       1, 0, 0},
+    {"hdBReady",              1, 0, 0},
+    {"hdGetSignalSources",    1, 0, 0},
+    {"hdGetProcDelay",        1, 0, 0},
+    {"hdSetBlocklevel",       0, 1, 0},
+    {"hdSetProcDelay",        0, 1, 0},
+    {"hdReadScalers",         9, 0, 0},
+    {"hdSnapshot",           22, 0, 0},
+    {"hdReadBlockTransfer",   8, 2, 0},
+  };
+#define NBUDGETS (sizeof(budgets) / sizeof(budgets[0]))
+
+/* Block of one event: block header, event header, trigger time, trailer */
+uint32_t block[] =
+  {
+    0x80000001, 0x90000001, 0x98000123, 0x00000456, 0x88000005
+  };
+
+void
+usage()
+{
+  printf("\n");
+  printf("%s [options]\n", progName);
+  printf("\n");
+  printf(" options:\n");
+  printf("     -v                     Print the transactions of each routine\n");
+  printf("\n");
+
+}
+
+/* One pass of the calls.  Values read go in out[] */
+int32_t
+exercise(uint32_t *out)
+{
+  volatile uint32_t scalers[9], data[32];
+  uint8_t clk, trig, sr;
+  uint16_t dataDelay, trigDelay;
+  HD_SNAPSHOT snap;
+  int32_t n = 0, iword;
+
+  out[n++] = hdGetFirmwareVersion();
+  out[n++] = hdGetBlocklevel();
+  out[n++] = hdBReady();
+  hdGetSignalSources(&clk, &trig, &sr);
+  out[n++] = (clk << 16) | (trig << 8) | sr;
+  hdSetBlocklevel(2);
+  hdSetProcDelay(0x80, 0x20);
+  hdGetProcDelay(&dataDelay, &trigDelay);
+  out[n++] = (dataDelay << 16) | trigDelay;
+
+  hdReadScalers(scalers, 1);
+  for(iword = 0; iword < 9; iword++)
+    out[n++] = scalers[iword];
+
+  hdSnapshot(&snap);
+  out[n++] = snap.reg.ctrl1;
+  out[n++] = snap.reg.delay;
+
+  out[n++] = hdReadBlock(data, 32, 0);
+  out[n++] = data[0];
+
+  return n;
+}
+
+/* Writes and reads made since the last hdAccessCountReset */
+void
+countTotal(uint64_t *reads, uint64_t *writes)
+{
+  HD_ACCESS_COUNT total;
+
+  hdAccessCountTotal(&total);
+  *reads = total.reads;
+  *writes = total.writes;
+}
+
+/* Configuration apply, commit and restore.  Returns the number of failed
+   checks */
+int32_t
+checkConfig(HD_ACCESS_MEMORY *mem)
+{
+  HD_CONFIG config;
+  HD_CHECKPOINT cp;
+  uint64_t reads, writes;
+  int32_t nfail = 0, nwrites;
+
+  printf("\n  Configuration\n");
+  printf("  ---------------------------------------------------------------\n");
+
+  /* Re-applying an unchanged configuration: one read of each staged
+     register (ctrl1, blk_size, delay, gen_config1-3), no writes */
+  memset(&config, 0, sizeof(config));
+  config.present = HD_CONFIG_BLOCKLEVEL | HD_CONFIG_PROC_DELAY |
+    HD_CONFIG_TSETTLE_FILTER | HD_CONFIG_GENERATOR;
+  config.blocklevel = 4;
+  config.dataInputDelay = 0x40;
+  config.triggerLatencyDelay = 0x10;
+  config.tsettleFilter = 3;
+  config.genPattern = 1;
+  config.genWindowDelay = 2;
+  config.genSettleTime = 25;
+  config.genStableTime = 100;
+  config.genSeed = 0x1234;
+  hdConfigApply(&config);
+
+  hdAccessCountReset();
+  nwrites = hdConfigApply(&config);
+  countTotal(&reads, &writes);
+  printf("  %-40s %6llu %7llu    6/0 %s\n", "Unchanged hdConfigApply",
+	 (unsigned long long)reads, (unsigned long long)writes,
+	 ((nwrites != 0) || (reads != 6) || (writes != 0)) ? "FAIL" : "");
+  nfail += (nwrites != 0) || (reads != 6) || (writes != 0);
+
+  /* Restoring an unchanged checkpoint: no writes */
+  hdCheckpointGet(&cp);
+  hdAccessCountReset();
+  nwrites = hdCheckpointRestore(&cp);
+  countTotal(&reads, &writes);
+  printf("  %-40s %6llu %7llu   -/0 %s\n", "Unchanged hdCheckpointRestore",
+	 (unsigned long long)reads, (unsigned long long)writes,
+	 ((nwrites != 0) || (writes != 0)) ? "FAIL" : "");
+  nfail += (nwrites != 0) || (writes != 0);
+
+  /* The run state is not restored, nor changed, by a checkpoint */
+  mem->reg.ctrl2 |= HD_CTRL2_GO | HD_CTRL2_EVENT_BUILD_ENABLE | HD_CTRL2_FORCE_BUSY;
+  hdAccessCountReset();
+  nwrites = hdCheckpointRestore(&cp);
+  countTotal(&reads, &writes);
+  printf("  %-40s %6llu %7llu   -/0 %s\n", "hdCheckpointRestore while running",
+	 (unsigned long long)reads, (unsigned long long)writes,
+	 ((nwrites != 0) || (writes != 0)) ? "FAIL" : "");
+  nfail += (nwrites != 0) || (writes != 0);
+  mem->reg.ctrl2 &= ~(HD_CTRL2_GO | HD_CTRL2_EVENT_BUILD_ENABLE | HD_CTRL2_FORCE_BUSY);
+
+  /* Generator reconfigured while running: disabled, configured, and
+     reenabled (hdConfigCommit) */
+  mem->reg.ctrl2 |= HD_CTRL2_INT_HELICITY_ENABLE;
+  config.genSeed = 0x4321;
+  hdAccessCountReset();
+  nwrites = hdConfigApply(&config);
+  countTotal(&reads, &writes);
+  printf("  %-40s %6llu %7llu   -/3 %s\n", "Running generator reconfigured",
+	 (unsigned long long)reads, (unsigned long long)writes,
+	 ((nwrites != 3) || (writes != 3) || (mem->reg.gen_config3 != 0x4321) ||
+	  !(mem->reg.ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE)) ? "FAIL" : "");
+  nfail += (nwrites != 3) || (writes != 3) || (mem->reg.gen_config3 != 0x4321) ||
+    !(mem->reg.ctrl2 & HD_CTRL2_INT_HELICITY_ENABLE);
+
+  return nfail;
+}
+
+/* Programmed IO readout stops at the block trailer, and never stores past
+   nwrds.  Returns the number of failed checks */
+int32_t
+checkReadBlock(HD_ACCESS_MEMORY *mem)
+{
+  volatile uint32_t data[8];
+  int32_t nfail = 0, nread, iword, over;
+  const int32_t nblock = sizeof(block) / sizeof(block[0]);
+
+  printf("\n  Readout                                   Words  Expected\n");
+  printf("  ---------------------------------------------------------------\n");
+
+  /* Whole block */
+  memset((void *)data, 0xff, sizeof(data));
+  hdAccessMemoryPush(mem, block, nblock);
+  nread = hdReadBlock(data, 8, 0);
+  printf("  %-40s %6d  %d %s\n", "hdReadBlock, block fits", nread, nblock,
+	 ((nread != nblock) || (data[nblock] != 0xffffffff)) ? "FAIL" : "");
+  nfail += (nread != nblock) || (data[nblock] != 0xffffffff);
+
+  /* Block longer than the buffer */
+  memset((void *)data, 0xff, sizeof(data));
+  hdAccessMemoryPush(mem, block, nblock);
+  nread = hdReadBlock(data, 3, 0);
+  for(iword = 3, over = 0; iword < 8; iword++)
+    over += (data[iword] != 0xffffffff);
+  printf("  %-40s %6d  %d %s\n", "hdReadBlock, block too long", nread, 3,
+	 ((nread != 3) || over) ? "FAIL" : "");
+  nfail += (nread != 3) || over;
+
+  return nfail;
+}
+
+/* hdSnapshot with a block transfer buffer (hdSetSnapshotDMA): one block
+   transfer, no single reads, and the same registers.  Returns the number
+   of failed checks */
+int32_t
+checkSnapshotDMA()
+{
+  static volatile uint32_t buffer[sizeof(HD) >> 2] __attribute__((aligned(8)));
+  HD_SNAPSHOT pio, dma;
+  HD_ACCESS_COUNT total;
+  int32_t nfail = 0, same;
+
+  printf("\n  Snapshot                           Reads  Block transfers\n");
+  printf("  ---------------------------------------------------------------\n");
+
+  hdSnapshot(&pio);
+
+  hdSetSnapshotDMA(buffer);
+  hdAccessCountReset();
+  hdSnapshot(&dma);
+  hdAccessCountTotal(&total);
+  hdSetSnapshotDMA(NULL);
+
+  same = dma.dma && (dma.reg.ctrl1 == pio.reg.ctrl1) &&
+    (dma.reg.ctrl2 == pio.reg.ctrl2) && (dma.reg.delay == pio.reg.delay) &&
+    (dma.reg.gen_config1 == pio.reg.gen_config1) &&
+    (dma.reg.trig1_scaler == pio.reg.trig1_scaler);
+  printf("  %-32s %6llu  %6llu   0/1 %s\n", "hdSnapshot, block transfer",
+	 (unsigned long long)total.reads, (unsigned long long)total.dmas,
+	 ((total.reads != 0) || (total.dmas != 1) || !same) ? "FAIL" : "");
+  nfail += (total.reads != 0) || (total.dmas != 1) || !same;
+
+  return nfail;
+}
+
+/* The scaler bank must be big-endian, like the module's readout data */
+int32_t
+checkScalerBank(HD_ACCESS_MEMORY *mem)
+{
+  volatile uint32_t data[HD_SCALER_BANK_NWORDS];
+  uint32_t head;
+  int32_t nfail = 0, dCnt;
+
+  printf("\n  Scaler bank                        Words  Byte order\n");
+  printf("  ---------------------------------------------------------------\n");
+
+  hdScalerBankConfig(0, 0);
+  dCnt = hdScalerBankFill(data, HD_SCALER_BANK_NWORDS);
+  head = LSWAP(data[0]);
+
+  nfail = (dCnt != HD_SCALER_BANK_NWORDS) ||
+    ((head >> 24) != HD_SCALER_BANK_VERSION) ||
+    ((head & 0xFFFF) != HD_SCALER_BANK_NWORDS) ||
+    (LSWAP(data[3 + 4]) != mem->reg.trig1_scaler); /* after 4 helicity scalers */
+  printf("  %-32s %6d  %s %s\n", "hdScalerBankFill", dCnt,
+	 ((head & 0xFFFF) == HD_SCALER_BANK_NWORDS) ? "big-endian" : "host",
+	 nfail ? "FAIL" : "");
+
+  return nfail;
+}
+
+int
+main(int argc, char *argv[])
+{
+  progName = argv[0];
+  int32_t verbose = 0, opt = -1, nfail = 0, ibudget, nout, nreplay, iout;
+  static HD_ACCESS_MEMORY mem;
+  static HD_ACCESS_RECORDER rec;
+  static HD_ACCESS_RECORD log[LOG_SIZE];
+  HD_ACCESS_OPS memOps, recOps;
+  HD_ACCESS_COUNT count;
+  uint32_t out[64], replayOut[64];
+
+  while ((opt = getopt(argc, argv, "v")) != -1) {
+    switch (opt) {
+    case 'v':
+      verbose = 1;
+      break;
+    default: /* '?' */
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Record an init and one pass, on the in-memory board */
+  hdAccessMemoryInit(&mem, BOARD_A24, &memOps);
+  mem.reg.blk_size = 1;
+  mem.reg.evt_count = 1;
+  mem.reg.trig1_scaler = 1234;
+  hdAccessMemoryPush(&mem, block, sizeof(block) / sizeof(block[0]));
+
+  hdAccessRecordInit(&rec, &memOps, log, LOG_SIZE, &recOps);
+  hdSetAccess(&recOps);
+
+  if(hdInit(BOARD_A24, HD_INIT_VXS, HD_INIT_INTERNAL_HELICITY, 0) != OK)
+    {
+      printf("%s: ERROR: hdInit failed\n", progName);
+      exit(1);
+    }
+
+  hdAccessCountReset();
+  nout = exercise(out);
+
+  if(verbose)
+    hdAccessCountPrint();
+
+  printf("\n  Routine                    Reads  Writes  DMAs   Budget\n");
+  printf("  ---------------------------------------------------------------\n");
+  for(ibudget = 0; ibudget < NBUDGETS; ibudget++)
+    {
+      BUDGET *b = &budgets[ibudget];
+      int32_t over;
+
+      hdAccessCountFunc(b->func, &count);
+      over = (count.reads > b->reads) || (count.writes > b->writes) ||
+	(count.dmas > b->dmas);
+      printf("  %-24s %6llu %7llu %5llu   %llu/%llu/%llu %s\n", b->func,
+	     (unsigned long long)count.reads, (unsigned long long)count.writes,
+	     (unsigned long long)count.dmas, (unsigned long long)b->reads,
+	     (unsigned long long)b->writes, (unsigned long long)b->dmas,
+	     over ? "OVER" : "");
+      nfail += over;
+    }
+
+  printf("\n  Recorded %d calls (%d dropped)\n", rec.n, rec.ndropped);
+  if(rec.ndropped)
+    nfail++;
+
+  /* Replay.  The same calls must give the same transactions and values */
+  {
+    static HD_ACCESS_RECORDER replay;
+    HD_ACCESS_OPS replayOps;
+
+    hdAccessReplayInit(&replay, log, rec.n, &replayOps);
+    hdSetAccess(&replayOps);
+
+    if(hdInit(BOARD_A24, HD_INIT_VXS, HD_INIT_INTERNAL_HELICITY, 0) != OK)
+      replay.nmismatch++;
+    nreplay = exercise(replayOut);
+
+    for(iout = 0; iout < nout; iout++)
+      if((nreplay != nout) || (replayOut[iout] != out[iout]))
+	replay.nmismatch++;
+
+    printf("  Replayed %d of %d calls, %d mismatches\n", replay.pos, replay.n,
+	   replay.nmismatch);
+    if(replay.nmismatch || (replay.pos != replay.n))
+      nfail++;
+  }
+
+  /* Configuration, on the in-memory board */
+  hdSetAccess(&memOps);
+  if(hdInit(BOARD_A24, HD_INIT_VXS, HD_INIT_INTERNAL_HELICITY, 0) != OK)
+    nfail++;
+  else
+    {
+      nfail += checkConfig(&mem);
+      nfail += checkReadBlock(&mem);
+      nfail += checkSnapshotDMA();
+      nfail += checkScalerBank(&mem);
+    }
+
+  hdSetAccess(NULL);
+
+  printf("\n  %s\n\n", nfail ? "FAILED" : "PASSED");
+
+  exit(nfail ? 1 : 0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k hdAccessTest"
+  End:
+ */
@@ -0,0 +1,157 @@
+/*
+ * File:
+ *    hdCalibrateDelay
+ *
+ * Description:
+ *    Calibrate the data input delay with the internal test trigger
+ *    (hdCalibrateProcDelay).  On the emulated helicity decoder by default,
+ *    where the band is known; with -a, on the module at that A24 address,
+ *    which must be running the helicity signal, with no other triggers.
+ *
+ *
+ */
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <getopt.h>
+#include "jvme.h"
+#include "hdLib.h"
+#include "hdEmu.h"
+#include "hdHelicityTools.h"
+
+#define BOARD_A24  0xed0000
+
+char *progName;
+
+void
+usage()
+{
+  printf("\n");
+  printf("%s [options]\n", progName);
+  printf("\n");
+  printf(" options:\n");
+  printf("     -a [A24]               Module at A24 (DEFAULT emulated)\n");
+  printf("     -l [DELAY]             Trigger latency delay, 8 ns (DEFAULT 0x40)\n");
+  printf("     -t [DELAY]             Test trigger delay, 8 ns (DEFAULT middle of window)\n");
+  printf("     -n [NEVENTS]           Events per step (DEFAULT 8)\n");
+  printf("\n");
+
+}
+
+int
+main(int argc, char *argv[])
+{
+  progName = argv[0];
+  int32_t opt = -1, nfail = 0, emulated = 1, stat;
+  uint32_t a24 = BOARD_A24;
+  static HD_EMU emu;
+  HD_ACCESS_OPS emuOps;
+  HD_DELAY_CALIBRATION cal;
+
+  memset(&cal, 0, sizeof(cal));
+  cal.triggerLatencyDelay = 0x40;
+
+  while ((opt = getopt(argc, argv, "a:l:t:n:")) != -1) {
+    switch (opt) {
+    case 'a':
+      a24 = strtoul(optarg, NULL, 16);
+      emulated = 0;
+      break;
+    case 'l':
+      cal.triggerLatencyDelay = strtoul(optarg, NULL, 0);
+      break;
+    case 't':
+      cal.testTriggerDelay = strtoul(optarg, NULL, 0);
+      break;
+    case 'n':
+      cal.neventsPerStep = atoi(optarg);
+      break;
+    default: /* '?' */
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(emulated)
+    {
+      hdEmuInit(&emu, a24, &emuOps);
+      hdSetAccess(&emuOps);
+
+      if(hdInit(a24, HD_INIT_INTERNAL, HD_INIT_INTERNAL_HELICITY, 0) != OK)
+	{
+	  printf("%s: ERROR: hdInit failed\n", progName);
+	  nfail++;
+	  goto CLOSE;
+	}
+
+      hdSetProcDelay(0x100, cal.triggerLatencyDelay);
+      hdHelicityGeneratorConfig(2, 0,
+				0x40, 0x80,
+				0xABCDEF01);
+      hdEnableHelicityGenerator();
+
+      hdEnable();
+      hdSync(0);
+    }
+  else
+    {
+      stat = vmeOpenDefaultWindows();
+      if(stat != OK)
+	goto CLOSE;
+
+      vmeCheckMutexHealth(1);
+      vmeBusLock();
+
+      if(hdInit(a24, 0, 0, HD_INIT_WARM) != OK)
+	{
+	  printf("%s: ERROR: hdInit failed\n", progName);
+	  nfail++;
+	  goto UNLOCK;
+	}
+    }
+
+  if(hdCalibrateProcDelay(&cal, 1) != OK)
+    nfail++;
+
+  /* Emulated: aligned while the sample (trigger + latency - data delay) is
+     in the trigger's window, 0 to 960 ticks after its start */
+  if(emulated && (nfail == 0))
+    {
+      uint32_t top = cal.testTriggerDelay + cal.triggerLatencyDelay;
+      uint32_t bottom = (top > 959) ? top - 959 : 1;
+
+      if(top > 0xFFF)
+	top = 0xFFF;
+      printf("\n  Expected 0x%03x - 0x%03x\n", bottom, top);
+      if((cal.lo != bottom) || (cal.hi != top))
+	nfail++;
+    }
+
+  if(emulated)
+    hdDisable();
+
+ UNLOCK:
+  if(!emulated)
+    vmeBusUnlock();
+
+ CLOSE:
+
+  if(emulated)
+    hdSetAccess(NULL);
+  else
+    vmeCloseDefaultWindows();
+
+  printf("\n  %s\n\n", nfail ? "FAILED" : "PASSED");
+
+  exit(nfail ? 1 : 0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k hdCalibrateDelay"
+  End:
+ */
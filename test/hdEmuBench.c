@@ -0,0 +1,254 @@
+/*
+ * File:
+ *    hdEmuBench
+ *
+ * Description:
+ *    Readout benchmark on the emulated helicity decoder (no crate needed).
+ *    Configures the module as hdReadoutTest does, then triggers and reads
+ *    out blocks, checking the block structure, and reports the readout
+ *    time and the bus transactions per readout.  With -t, the bus
+ *    transactions are also written to a trace file, with a mark at each
+ *    trigger, for hdTraceReplay.
+ *
+ *
+ */
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include "jvme.h"
+#include "hdLib.h"
+#include "hdEmu.h"
+
+#define BOARD_A24  0xed0000
+#define LOG_SIZE   65536
+
+char *progName;
+
+void
+usage()
+{
+  printf("\n");
+  printf("%s [options]\n", progName);
+  printf("\n");
+  printf(" options:\n");
+  printf("     -n [NREADS]            Number of readouts (DEFAULT 100000)\n");
+  printf("     -b [BLOCKLEVEL]        Events per block (DEFAULT 1)\n");
+  printf("     -p                     Programmed I/O readout (DEFAULT DMA)\n");
+  printf("     -t [FILE]              Write a trace of the readout to FILE\n");
+  printf("     -v                     Decode the first block\n");
+  printf("\n");
+
+}
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Block header, event headers, and trailer word count.  Returns the number
+   of events, or -1 */
+int32_t
+checkBlock(volatile unsigned int *data, int32_t nwords, int32_t blocklevel)
+{
+  int32_t iword, nevents = 0, trailer = -1;
+  uint32_t word;
+
+  word = LSWAP(data[0]);
+  if((word & (HD_DATA_TYPE_DEFINE | HD_DATA_TYPE_MASK)) !=
+     (HD_DATA_TYPE_DEFINE | HD_DATA_BLOCK_HEADER))
+    return -1;
+
+  for(iword = 1; iword < nwords; iword++)
+    {
+      word = LSWAP(data[iword]);
+      if(!(word & HD_DATA_TYPE_DEFINE))
+	continue;
+      if((word & HD_DATA_TYPE_MASK) == HD_DATA_DECODER_HEADER)
+	iword += word & HD_DATA_DECODER_NWORDS_MASK;  /* Data can look like any type */
+      if((word & HD_DATA_TYPE_MASK) == HD_DATA_EVENT_HEADER)
+	nevents++;
+      if((word & HD_DATA_TYPE_MASK) == HD_DATA_BLOCK_TRAILER)
+	{
+	  trailer = iword;
+	  break;
+	}
+    }
+
+  if((trailer < 0) || ((word & 0x3FFFFF) != (uint32_t)(trailer + 1)) ||
+     (nevents != blocklevel))
+    return -1;
+
+  return nevents;
+}
+
+int
+main(int argc, char *argv[])
+{
+  progName = argv[0];
+  int32_t nreads = 100000, blocklevel = 1, rflag = 1, verbose = 0,
+    opt = -1, ireadout = 0, iword, dCnt, nbad = 0, nevents = 0, maxwords;
+  static HD_EMU emu;
+  static HD_ACCESS_RECORDER rec;
+  static HD_ACCESS_RECORD log[LOG_SIZE];
+  HD_ACCESS_OPS emuOps, recOps;
+  char *traceFile = NULL;
+  HD_ACCESS_COUNT total;
+  volatile unsigned int *data;
+  uint64_t nwords = 0, start, elapsed;
+
+  while ((opt = getopt(argc, argv, "n:b:pt:v")) != -1) {
+    switch (opt) {
+    case 'n':
+      nreads = atoi(optarg);
+      break;
+    case 'b':
+      blocklevel = atoi(optarg);
+      break;
+    case 'p':
+      rflag = 0;
+      break;
+    case 't':
+      traceFile = optarg;
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default: /* '?' */
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if((nreads <= 0) || (blocklevel <= 0) || (blocklevel > 255))
+    {
+      usage();
+      exit(EXIT_FAILURE);
+    }
+
+  maxwords = blocklevel * (4 + HD_DECODER_NWORDS) + 4;
+  data = (volatile unsigned int *)malloc(maxwords * sizeof(uint32_t));
+  if(data == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate %d words\n", progName, maxwords);
+      exit(1);
+    }
+
+  hdEmuInit(&emu, BOARD_A24, &emuOps);
+  if(traceFile)
+    {
+      hdAccessRecordInit(&rec, &emuOps, log, LOG_SIZE, &recOps);
+      if(hdAccessTraceOpen(&rec, traceFile) != OK)
+	exit(1);
+      hdSetAccess(&recOps);
+    }
+  else
+    hdSetAccess(&emuOps);
+
+  if(hdInit(BOARD_A24, HD_INIT_INTERNAL, HD_INIT_INTERNAL_HELICITY, 0) != OK)
+    {
+      printf("%s: ERROR: hdInit failed\n", progName);
+      goto CLOSE;
+    }
+
+  hdSetBlocklevel(blocklevel);
+  hdSetProcDelay(0x100, 0x40);
+  hdHelicityGeneratorConfig(2, 0,
+			    0x40, 0x80,
+			    0xABCDEF01);
+  hdEnableHelicityGenerator();
+
+  hdEnable();
+  hdSync(0);
+
+  hdAccessCountReset();
+  start = now_ns();
+
+  for(ireadout = 0; ireadout < nreads; ireadout++)
+    {
+      hdAccessMark(ireadout);
+      hdEmuTrigger(&emu, blocklevel);
+
+      int timeout=0;
+      while((hdBReady() != 1) && (timeout < 100))
+	{
+	  timeout++;
+	}
+
+      if(timeout >= 100)
+	{
+	  printf("%s: ERROR: TIMEOUT at readout %d\n", progName, ireadout);
+	  break;
+	}
+
+      dCnt = hdReadBlock(data, maxwords, rflag);
+      if(dCnt <= 0)
+	{
+	  printf("%s: ERROR: No data or error at readout %d.  dCnt = %d\n",
+		 progName, ireadout, dCnt);
+	  nbad++;
+	  continue;
+	}
+      nwords += dCnt;
+
+      if(verbose && (ireadout == 0))
+	{
+	  printf("  dCnt = %d\n", dCnt);
+	  for(iword = 0; iword < dCnt; iword++)
+	    hdDecodeData(LSWAP(data[iword]));
+	  printf("\n\n");
+	}
+
+      if(checkBlock(data, dCnt, blocklevel) < 0)
+	nbad++;
+      else
+	nevents += blocklevel;
+    }
+
+  hdAccessMark(ireadout);  /* End of the last readout */
+  elapsed = now_ns() - start;
+  hdAccessCountTotal(&total);
+
+  hdDisable();
+
+  if(ireadout)
+    {
+      printf("\n  %s readout, block level %d\n", rflag ? "DMA" : "PIO", blocklevel);
+      printf("  ---------------------------------------------------------------\n");
+      printf("  Readouts                %10d  (%d bad)\n", ireadout, nbad);
+      printf("  Events                  %10d\n", nevents);
+      printf("  Words                   %10llu\n", (unsigned long long)nwords);
+      printf("  Time per readout        %10.1f ns\n", (double)elapsed / ireadout);
+      printf("  Words per second        %10.3e\n",
+	     elapsed ? (double)nwords * 1e9 / elapsed : 0.);
+      printf("  Per readout:  reads %.2f  writes %.2f  block transfers %.2f\n",
+	     (double)total.reads / ireadout, (double)total.writes / ireadout,
+	     (double)total.dmas / ireadout);
+      printf("\n");
+    }
+
+ CLOSE:
+
+  if(traceFile)
+    printf("  Trace %s: %d records\n\n", traceFile, hdAccessTraceClose(&rec));
+
+  hdSetAccess(NULL);
+  free((void *)data);
+
+  exit(((ireadout == nreads) && (nbad == 0)) ? 0 : 1);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k hdEmuBench"
+  End:
+ */
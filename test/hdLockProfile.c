@@ -0,0 +1,159 @@
+/*
+ * File:
+ *    hdLockProfile
+ *
+ * Description:
+ *    Profile hdMutex for the helicity decoder at the specified address.
+ *    A "monitoring" thread polls status, scalers, and configuration while
+ *    the main thread runs the given number of iterations of the same calls.
+ *    The wait and hold times of each call site are printed, and optionally
+ *    written to a CSV file.
+ *
+ *    Requires the library to be built with LOCKPROFILE=1.
+ *
+ *
+ */
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <getopt.h>
+#include "jvme.h"
+#include "hdLib.h"
+
+char *progName;
+volatile int32_t monitorRun = 1;
+
+void
+usage()
+{
+  printf("\n");
+  printf("%s [options] <A24 address> \n", progName);
+  printf("\n");
+  printf(" options:\n");
+  printf("     -n [NITER]             Number of iterations (DEFAULT 1000)\n");
+  printf("     -o [FILE]              Write the profile to a CSV file\n");
+  printf("     -v                     Print the wait and hold histograms\n");
+  printf("\n");
+
+}
+
+void
+exercise()
+{
+  volatile uint32_t scalers[9], history[4];
+  uint8_t pattern, windowDelay;
+  uint16_t settleTime;
+  uint32_t stableTime, seed, recovered, generator;
+  HD_SNAPSHOT snap;
+
+  hdReadScalers(scalers, 1);
+  hdReadHelicityHistory(history);
+  hdGetRecoveredShiftRegisterValue(&recovered, &generator);
+  hdGetHelicityGeneratorConfig(&pattern, &windowDelay, &settleTime,
+			       &stableTime, &seed);
+  hdSnapshot(&snap);
+}
+
+void *
+monitorThread(void *arg)
+{
+  while(monitorRun)
+    {
+      exercise();
+      usleep(100);
+    }
+
+  return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+  progName = argv[0];
+  int32_t niter = 1000, verbose = 0, iiter, opt = -1;
+  char *filename = NULL;
+  pthread_t monitor;
+
+  while ((opt = getopt(argc, argv, "n:o:v")) != -1) {
+    switch (opt) {
+    case 'n':
+      niter = atoi(optarg);
+      break;
+    case 'o':
+      filename = optarg;
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default: /* '?' */
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if ((optind + 1) != argc) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t a24_address = (uint32_t) strtoll(argv[optind++], NULL, 16) & 0xffffffff;
+
+  printf("\n %s: a24 address = 0x%08x\n", argv[0], a24_address);
+  printf("----------------------------\n");
+
+  int stat = vmeOpenDefaultWindows();
+  if(stat != OK)
+    goto CLOSE;
+
+  vmeCheckMutexHealth(1);
+  vmeBusLock();
+
+  if(hdInit(a24_address, 0, 0, HD_INIT_NO_INIT) != OK)
+    goto CLOSE;
+
+  hdLockProfileReset();
+
+  if(pthread_create(&monitor, NULL, monitorThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      goto CLOSE;
+    }
+
+  for(iiter = 0; iiter < niter; iiter++)
+    exercise();
+
+  monitorRun = 0;
+  pthread_join(monitor, NULL);
+
+  hdLockProfilePrint(verbose);
+
+  if(filename != NULL)
+    {
+      if(hdLockProfileDump(filename) >= 0)
+	printf("%s: Profile written to %s\n", progName, filename);
+    }
+
+ CLOSE:
+
+  vmeBusUnlock();
+
+  stat = vmeCloseDefaultWindows();
+  if (stat != OK)
+    {
+      printf("vmeCloseDefaultWindows failed: code 0x%08x\n",stat);
+      return -1;
+    }
+
+  exit(0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k hdLockProfile"
+  End:
+ */
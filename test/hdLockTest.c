@@ -0,0 +1,167 @@
+/*
+ * File:
+ *    hdLockTest
+ *
+ * Description:
+ *    Check that the single register status getters do not wait for
+ *    hdMutex.  A "readout" thread holds hdMutex for a given time, over and
+ *    over (as a long hdReadBlock would), while the main thread times the
+ *    getters.
+ *
+ *
+ */
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <getopt.h>
+#include "jvme.h"
+#include "hdLib.h"
+
+
+char *progName;
+volatile int32_t holdRun = 1;
+uint32_t holdUs = 10000;
+
+void
+usage()
+{
+  printf("\n");
+  printf("%s [options] <A24 address> \n", progName);
+  printf("\n");
+  printf(" options:\n");
+  printf("     -t [HOLD TIME]         Time hdMutex is held each time, in us (DEFAULT 10000)\n");
+  printf("     -n [NCALLS]            Number of calls of each getter (DEFAULT 1000)\n");
+  printf("\n");
+
+}
+
+void *
+holdThread(void *arg)
+{
+  while(holdRun)
+    {
+      pthread_mutex_lock(hdGetMutex());
+      usleep(holdUs);
+      pthread_mutex_unlock(hdGetMutex());
+      usleep(10);
+    }
+
+  return NULL;
+}
+
+/* Time ncalls calls of a getter.  Print the mean and longest, in us, and
+   count the calls that waited for the holder */
+#define TIMEGETTER(_call)						\
+  {									\
+    uint64_t start, dt, sum = 0, max = 0;				\
+    int32_t icall, nslow = 0;						\
+    for(icall = 0; icall < ncalls; icall++)				\
+      {									\
+	start = hdTimestamp();						\
+	_call;								\
+	dt = hdTimestamp() - start;					\
+	sum += dt;							\
+	if(dt > max) max = dt;						\
+	if(dt > holdUs * 500ULL) nslow++;				\
+      }									\
+    printf("  %-40s  %10.2f  %10.2f  %6d\n", #_call,			\
+	   sum * 1e-3 / ncalls, max * 1e-3, nslow);			\
+    nfail += nslow;							\
+  }
+
+int
+main(int argc, char *argv[])
+{
+  progName = argv[0];
+  int32_t ncalls = 1000, nfail = 0, opt = -1;
+  pthread_t holder;
+  uint8_t clk, trig, sr;
+  uint16_t dataDelay, trigDelay;
+  int32_t system, local;
+  uint32_t csr, slot;
+
+  while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+    switch (opt) {
+    case 't':
+      holdUs = atoi(optarg);
+      break;
+    case 'n':
+      ncalls = atoi(optarg);
+      break;
+    default: /* '?' */
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if ((optind + 1) != argc) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t a24_address = (uint32_t) strtoll(argv[optind++], NULL, 16) & 0xffffffff;
+
+  printf("\n %s: a24 address = 0x%08x\n", argv[0], a24_address);
+  printf("----------------------------\n");
+
+  int stat = vmeOpenDefaultWindows();
+  if(stat != OK)
+    goto CLOSE;
+
+  vmeCheckMutexHealth(1);
+  vmeBusLock();
+
+  if(hdInit(a24_address, 0, 0, HD_INIT_NO_INIT) != OK)
+    goto CLOSE;
+
+  if(pthread_create(&holder, NULL, holdThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      goto CLOSE;
+    }
+  usleep(1000);
+
+  printf("\n  hdMutex held for %d us at a time\n\n", holdUs);
+  printf("  Getter                                      Mean (us)    Max (us)  > hold/2\n");
+  printf("  ------------------------------------------------------------------------------\n");
+
+  TIMEGETTER(hdGetFirmwareVersion());
+  TIMEGETTER(hdBReady());
+  TIMEGETTER(hdBERRStatus());
+  TIMEGETTER(hdGetBlocklevel());
+  TIMEGETTER(hdGetSignalSources(&clk, &trig, &sr));
+  TIMEGETTER(hdGetProcDelay(&dataDelay, &trigDelay));
+  TIMEGETTER(hdGetClockPLLStatus(&system, &local));
+  TIMEGETTER(hdGetCSR(&csr));
+  TIMEGETTER(hdGetSlotNumber(&slot));
+
+  holdRun = 0;
+  pthread_join(holder, NULL);
+
+  printf("\n  %s: %d calls waited for hdMutex\n\n",
+	 nfail ? "FAILED" : "PASSED", nfail);
+
+ CLOSE:
+
+  vmeBusUnlock();
+
+  stat = vmeCloseDefaultWindows();
+  if (stat != OK)
+    {
+      printf("vmeCloseDefaultWindows failed: code 0x%08x\n",stat);
+      return -1;
+    }
+
+  exit(nfail ? 1 : 0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k hdLockTest"
+  End:
+ */
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include "jvme.h"
+#include "dmaPList.h"
 #include "hdLib.h"
 
 int
@@ -23,6 +24,8 @@ main(int argc, char *argv[])
 
   int stat;
   uint32_t address=0;
+  DMA_MEM_ID vmeIN;
+  DMANODE *node = NULL;
 
   if (argc > 1)
     {
@@ -43,9 +46,30 @@ main(int argc, char *argv[])
   vmeCheckMutexHealth(1);
   vmeBusLock();
 
+  /* Registers in one A24 block transfer, if DMA memory is available */
+  dmaPFreeAll();
+  vmeIN = dmaPCreate("vmeIN", sizeof(HD), 1, 0);
+  if(vmeIN != NULL)
+    {
+      dmaPReInitAll();
+      node = dmaPGetItem(vmeIN);
+    }
+  if(node != NULL)
+    {
+      vmeDmaConfig(1,2,0);
+      hdSetSnapshotDMA((volatile uint32_t *)node->data);
+    }
+
   hdInit(address, 0, 0, HD_INIT_NO_INIT);
   hdStatus(1);
 
+  if(node != NULL)
+    {
+      hdSetSnapshotDMA(NULL);
+      dmaPFreeItem(node);
+    }
+  dmaPFreeAll();
+
  CLOSE:
 
   vmeBusUnlock();
@@ -0,0 +1,267 @@
+/*
+ * File:
+ *    hdTraceReplay
+ *
+ * Description:
+ *    Replay a readout trace (hdAccessTraceOpen), offline, to measure the
+ *    CPU time of the library per trigger and check its bus transactions
+ *    against the recorded ones.
+ *
+ *    The trace must have a mark (hdAccessMark) at each trigger.  The replay
+ *    attaches (hdInit with HD_INIT_WARM) at the first mark, then, for each
+ *    trigger, polls hdBReady and reads blocks with hdReadBlock, as the
+ *    readout lists do, until the next mark.  The transactions after the
+ *    last mark are not replayed.
+ *
+ *
+ */
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include "jvme.h"
+#include "hdLib.h"
+#include "hdAccess.h"
+
+#define MAX_WORDS   65536
+#define MAX_POLLS   1000
+
+char *progName;
+
+void
+usage()
+{
+  printf("\n");
+  printf("%s [options] <trace file>\n", progName);
+  printf("\n");
+  printf(" options:\n");
+  printf("     -r [NREPEAT]           Replay the trace NREPEAT times (DEFAULT 1)\n");
+  printf("     -m [NS]                Fail if the CPU time per trigger is over NS\n");
+  printf("     -v                     Print the transactions of each routine\n");
+  printf("\n");
+
+}
+
+static uint64_t
+cpu_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Replay the triggers between marks[0] and marks[nmarks - 1].  Returns the
+   number of triggers replayed */
+int32_t
+replay(HD_ACCESS_RECORDER *rep, const uint32_t *marks, int32_t nmarks,
+       volatile unsigned int *data)
+{
+  HD_ACCESS_RECORD *log = rep->log;
+  uint32_t irec, pos;
+  int32_t imark, rflag, nwords, npolls;
+
+  for(imark = 0; imark < nmarks - 1; imark++)
+    {
+      if(hdAccessMark(log[marks[imark]].addr) != OK)
+	return imark;
+
+      /* Read out as the recorded trigger did: block transfers of the
+	 recorded size, or programmed I/O */
+      rflag = 0;
+      nwords = MAX_WORDS;
+      for(irec = marks[imark]; irec < marks[imark + 1];
+	  irec += hdAccessRecordSpan(&log[irec]))
+	if(log[irec].type == HD_ACCESS_RECORD_DMA_SEND)
+	  {
+	    rflag = 1;
+	    nwords = log[irec].value >> 2;
+	    break;
+	  }
+
+      npolls = 0;
+      while((rep->pos < marks[imark + 1]) && (rep->nmismatch == 0) &&
+	    (npolls < MAX_POLLS))
+	{
+	  pos = rep->pos;
+	  if(hdBReady() > 0)
+	    hdReadBlock(data, nwords, rflag);
+	  npolls = (rep->pos == pos) ? npolls + 1 : 0;
+	}
+
+      if(rep->nmismatch || (rep->pos != marks[imark + 1]))
+	return imark;
+    }
+
+  if(hdAccessMark(log[marks[nmarks - 1]].addr) != OK)
+    return nmarks - 2;
+
+  return nmarks - 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  progName = argv[0];
+  int32_t nrepeat = 1, verbose = 0, opt = -1, n, nmarks = 0, ntrig,
+    nreplayed, irepeat, nfail = 0;
+  uint32_t irec, a24 = 0, *marks;
+  uint64_t maxNs = 0, recordedNs = 0, cpu = 0, start;
+  uint64_t reads = 0, writes = 0, dmas = 0;
+  double perTrigNs;
+  HD_ACCESS_TRACE_HEADER header;
+  HD_ACCESS_RECORD *log;
+  static HD_ACCESS_RECORDER rep;
+  HD_ACCESS_OPS repOps;
+  HD_ACCESS_COUNT total;
+  volatile unsigned int *data;
+  time_t started;
+
+  while ((opt = getopt(argc, argv, "r:m:v")) != -1) {
+    switch (opt) {
+    case 'r':
+      nrepeat = atoi(optarg);
+      break;
+    case 'm':
+      maxNs = strtoull(optarg, NULL, 10);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default: /* '?' */
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if((optind != argc - 1) || (nrepeat <= 0))
+    {
+      usage();
+      exit(EXIT_FAILURE);
+    }
+
+  n = hdAccessTraceLoad(argv[optind], &header, &log);
+  if(n == ERROR)
+    exit(1);
+
+  started = (time_t)header.started;
+  printf("\n  Trace %s\n", argv[optind]);
+  printf("    Recorded on %s, %s", header.host, ctime(&started));
+  printf("    %d records (%d dropped)\n", n, header.ndropped);
+
+  /* Module, and the marks */
+  marks = (uint32_t *)malloc((n + 1) * sizeof(uint32_t));
+  data = (volatile unsigned int *)malloc(MAX_WORDS * sizeof(uint32_t));
+  if((marks == NULL) || (data == NULL))
+    {
+      printf("%s: ERROR: Unable to allocate buffers\n", progName);
+      exit(1);
+    }
+
+  for(irec = 0; irec < n; irec += hdAccessRecordSpan(&log[irec]))
+    {
+      if((a24 == 0) && (log[irec].type == HD_ACCESS_RECORD_MAP) &&
+	 (log[irec].value == 0x39))
+	a24 = log[irec].addr;
+      if(log[irec].type == HD_ACCESS_RECORD_MARK)
+	marks[nmarks++] = irec;
+    }
+
+  if((nmarks < 2) || (a24 == 0))
+    {
+      printf("%s: ERROR: Trace needs a module and at least 2 marks (%d)\n",
+	     progName, nmarks);
+      exit(1);
+    }
+  ntrig = nmarks - 1;
+
+  /* Recorded transactions and time, from the first mark to the last */
+  for(irec = marks[0] + 1; irec <= marks[nmarks - 1];
+      irec += hdAccessRecordSpan(&log[irec]))
+    {
+      HD_ACCESS_RECORD *r = &log[irec];
+
+      recordedNs += r->dt;
+      if((r->type == HD_ACCESS_RECORD_READ) || (r->type == HD_ACCESS_RECORD_PROBE))
+	reads++;
+      else if(r->type == HD_ACCESS_RECORD_WRITE)
+	writes++;
+      else if(r->type == HD_ACCESS_RECORD_DMA_SEND)
+	dmas++;
+    }
+
+  printf("    Module at 0x%06x, %d triggers\n", a24, ntrig);
+
+  for(irepeat = 0; irepeat < nrepeat; irepeat++)
+    {
+      if(hdAccessReplayAttachInit(&rep, log, n, &repOps) != OK)
+	exit(1);
+      hdSetAccess(&repOps);
+
+      if(hdInit(a24, 0, 0, HD_INIT_WARM | HD_INIT_IGNORE_FIRMWARE) != OK)
+	{
+	  printf("%s: ERROR: Unable to attach to the trace\n", progName);
+	  exit(1);
+	}
+
+      hdAccessCountReset();
+      start = cpu_ns();
+      nreplayed = replay(&rep, marks, nmarks, data);
+      cpu += cpu_ns() - start;
+
+      if(rep.nmismatch || (nreplayed != ntrig))
+	{
+	  printf("%s: ERROR: Replay differs from the trace at trigger %d (record %d)\n",
+		 progName, nreplayed, rep.pos);
+	  nfail++;
+	  goto CLOSE;
+	}
+    }
+
+  /* Counts are from the last replay */
+  hdAccessCountTotal(&total);
+  if(verbose)
+    hdAccessCountPrint();
+
+  perTrigNs = (double)cpu / ((double)nrepeat * ntrig);
+
+  printf("\n                               Recorded      Replayed\n");
+  printf("  ---------------------------------------------------------------\n");
+  printf("  Reads per trigger        %12.2f  %12.2f\n",
+	 (double)reads / ntrig, (double)total.reads / ntrig);
+  printf("  Writes per trigger       %12.2f  %12.2f\n",
+	 (double)writes / ntrig, (double)total.writes / ntrig);
+  printf("  Block transfers per trig %12.2f  %12.2f\n",
+	 (double)dmas / ntrig, (double)total.dmas / ntrig);
+  printf("  Time per trigger (ns)    %12.1f  %12.1f (CPU)\n",
+	 (double)recordedNs / ntrig, perTrigNs);
+
+  if(maxNs && (perTrigNs > maxNs))
+    {
+      printf("\n  CPU time per trigger over %llu ns\n", (unsigned long long)maxNs);
+      nfail++;
+    }
+
+ CLOSE:
+
+  hdSetAccess(NULL);
+
+  printf("\n  %s\n\n", nfail ? "FAILED" : "PASSED");
+
+  free(log);
+  free(marks);
+  free((void *)data);
+
+  exit(nfail ? 1 : 0);
+}
+
+/*
+  Local Variables:
+  compile-command: "make -k hdTraceReplay"
+  End:
+ */